@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "batch_sched.h"
+
+int64_t batch_sched_now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void wait_until(batch_sched_t *sched, int64_t deadline_us)
+{
+    struct timespec ts;
+    ts.tv_sec = deadline_us / 1000000;
+    ts.tv_nsec = (deadline_us % 1000000) * 1000;
+    pthread_cond_timedwait(&sched->work_cond, &sched->lock, &ts);
+}
+
+static void *sched_thread(void *arg)
+{
+    batch_sched_t *sched = (batch_sched_t *)arg;
+    batch_item_t *items[BATCH_SCHED_MAX];
+
+    pthread_mutex_lock(&sched->lock);
+    for (;;) {
+        while (!sched->quit && sched->queued == 0) {
+            pthread_cond_wait(&sched->work_cond, &sched->lock);
+        }
+        if (sched->queued == 0) {
+            break;
+        }
+
+        // the oldest frame decides how long the batch may keep filling
+        int timeout = 0;
+        if (sched->queued < sched->batch_size && sched->max_wait_us > 0) {
+            int64_t deadline = sched->head->enqueue_us + sched->max_wait_us;
+            while (!sched->quit && sched->queued < sched->batch_size && batch_sched_now_us() < deadline) {
+                wait_until(sched, deadline);
+            }
+            timeout = sched->queued < sched->batch_size;
+        }
+
+        int n = 0;
+        while (n < sched->batch_size && sched->head != NULL) {
+            items[n++] = sched->head;
+            sched->head = sched->head->next;
+        }
+        if (sched->head == NULL) {
+            sched->tail = NULL;
+        }
+        sched->queued -= n;
+        pthread_mutex_unlock(&sched->lock);
+
+        int64_t start = batch_sched_now_us();
+        int ret = sched->run(sched->arg, items, n);
+        int64_t end = batch_sched_now_us();
+
+        pthread_mutex_lock(&sched->lock);
+        for (int i = 0; i < n; i++) {
+            if (ret < 0) {
+                items[i]->ret = ret;
+            }
+            items[i]->done_us = end;
+            items[i]->done = 1;
+            int64_t latency = end - items[i]->enqueue_us;
+            sched->latency_sum_us += latency;
+            if (latency > sched->latency_max_us) {
+                sched->latency_max_us = latency;
+            }
+        }
+        sched->batches++;
+        sched->frames += n;
+        sched->timeouts += timeout;
+        sched->fill_hist[n]++;
+        sched->run_sum_us += end - start;
+        pthread_cond_broadcast(&sched->done_cond);
+    }
+    pthread_mutex_unlock(&sched->lock);
+    return NULL;
+}
+
+int batch_sched_init(batch_sched_t *sched, int batch_size, int64_t max_wait_us, batch_run_fn run, void *arg)
+{
+    memset(sched, 0, sizeof(batch_sched_t));
+    if (batch_size < 1 || batch_size > BATCH_SCHED_MAX || run == NULL) {
+        printf("batch sched: invalid batch size %d\n", batch_size);
+        return -1;
+    }
+    sched->batch_size = batch_size;
+    sched->max_wait_us = max_wait_us > 0 ? max_wait_us : 0;
+    sched->run = run;
+    sched->arg = arg;
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&sched->lock, NULL);
+    pthread_cond_init(&sched->work_cond, &attr);
+    pthread_cond_init(&sched->done_cond, NULL);
+    pthread_condattr_destroy(&attr);
+
+    if (pthread_create(&sched->thread, NULL, sched_thread, sched) != 0) {
+        printf("batch sched: create thread fail\n");
+        pthread_cond_destroy(&sched->work_cond);
+        pthread_cond_destroy(&sched->done_cond);
+        pthread_mutex_destroy(&sched->lock);
+        return -1;
+    }
+    sched->running = 1;
+    return 0;
+}
+
+void batch_sched_deinit(batch_sched_t *sched)
+{
+    if (!sched->running) {
+        return;
+    }
+    pthread_mutex_lock(&sched->lock);
+    sched->quit = 1;
+    pthread_cond_broadcast(&sched->work_cond);
+    pthread_mutex_unlock(&sched->lock);
+    pthread_join(sched->thread, NULL);
+    sched->running = 0;
+
+    pthread_cond_destroy(&sched->work_cond);
+    pthread_cond_destroy(&sched->done_cond);
+    pthread_mutex_destroy(&sched->lock);
+}
+
+int batch_sched_post(batch_sched_t *sched, batch_item_t *item)
+{
+    item->ret = 0;
+    item->done = 0;
+    item->done_us = 0;
+    item->next = NULL;
+
+    pthread_mutex_lock(&sched->lock);
+    if (!sched->running || sched->quit) {
+        pthread_mutex_unlock(&sched->lock);
+        item->ret = -1;
+        return -1;
+    }
+    item->enqueue_us = batch_sched_now_us();
+    if (sched->tail != NULL) {
+        sched->tail->next = item;
+    } else {
+        sched->head = item;
+    }
+    sched->tail = item;
+    sched->queued++;
+    pthread_cond_signal(&sched->work_cond);
+    pthread_mutex_unlock(&sched->lock);
+    return 0;
+}
+
+int batch_sched_wait(batch_sched_t *sched, batch_item_t *item)
+{
+    pthread_mutex_lock(&sched->lock);
+    while (!item->done) {
+        pthread_cond_wait(&sched->done_cond, &sched->lock);
+    }
+    pthread_mutex_unlock(&sched->lock);
+    return item->ret;
+}
+
+int batch_sched_submit(batch_sched_t *sched, batch_item_t *item)
+{
+    if (batch_sched_post(sched, item) != 0) {
+        return -1;
+    }
+    return batch_sched_wait(sched, item);
+}
+
+void batch_sched_reset_stats(batch_sched_t *sched)
+{
+    pthread_mutex_lock(&sched->lock);
+    sched->batches = 0;
+    sched->frames = 0;
+    sched->timeouts = 0;
+    memset(sched->fill_hist, 0, sizeof(sched->fill_hist));
+    sched->latency_sum_us = 0;
+    sched->latency_max_us = 0;
+    sched->run_sum_us = 0;
+    pthread_mutex_unlock(&sched->lock);
+}
+
+void batch_sched_print_stats(batch_sched_t *sched)
+{
+    pthread_mutex_lock(&sched->lock);
+    if (sched->batches == 0) {
+        pthread_mutex_unlock(&sched->lock);
+        printf("batch sched: no batches\n");
+        return;
+    }
+    printf("batch sched: batch %d wait %lld us: %llu frames in %llu batches (avg fill %.2f, %llu by timeout), "
+           "latency avg %.1f max %.1f ms, run avg %.1f ms\n",
+           sched->batch_size, (long long)sched->max_wait_us, (unsigned long long)sched->frames,
+           (unsigned long long)sched->batches, (double)sched->frames / sched->batches,
+           (unsigned long long)sched->timeouts, sched->latency_sum_us / 1000.0 / sched->frames,
+           sched->latency_max_us / 1000.0, sched->run_sum_us / 1000.0 / sched->batches);
+    printf("  fill:");
+    for (int i = 1; i <= sched->batch_size; i++) {
+        printf(" %d=%llu", i, (unsigned long long)sched->fill_hist[i]);
+    }
+    printf("\n");
+    pthread_mutex_unlock(&sched->lock);
+}
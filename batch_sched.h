@@ -0,0 +1,111 @@
+#ifndef _RKNN_YOLOV5_DEMO_BATCH_SCHED_H_
+#define _RKNN_YOLOV5_DEMO_BATCH_SCHED_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+#define BATCH_SCHED_MAX 16
+
+/**
+ * @brief One frame waiting for a batch slot, owned by the submitting thread
+ */
+typedef struct batch_item_s {
+    void *data;                 // backend payload
+    int ret;                    // backend result for this frame
+    int64_t enqueue_us;         // set by batch_sched_submit()
+    int64_t done_us;
+    int done;
+    struct batch_item_s *next;
+} batch_item_t;
+
+/**
+ * @brief Run one batch of 1..batch_size frames, set items[i]->ret for each
+ *
+ * Called from the scheduler thread only, so the backend does not need to be reentrant.
+ *
+ * @return int 0: success; <0: the whole batch failed, copied into every item->ret
+ */
+typedef int (*batch_run_fn)(void *arg, batch_item_t **items, int n);
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t work_cond;   // queue grew or quit
+    pthread_cond_t done_cond;   // a batch finished
+    pthread_t thread;
+    int running;
+    int quit;
+
+    int batch_size;
+    int64_t max_wait_us;        // oldest frame waits at most this long for the batch to fill
+    batch_run_fn run;
+    void *arg;
+
+    batch_item_t *head;
+    batch_item_t *tail;
+    int queued;
+
+    // stats
+    uint64_t batches;
+    uint64_t frames;
+    uint64_t timeouts;          // batches started by max_wait_us before they were full
+    uint64_t fill_hist[BATCH_SCHED_MAX + 1];
+    int64_t latency_sum_us;     // submit to done, per frame
+    int64_t latency_max_us;
+    int64_t run_sum_us;         // backend time, per batch
+} batch_sched_t;
+
+/**
+ * @brief Start the scheduler thread
+ *
+ * @param sched [out] Scheduler
+ * @param batch_size [in] Frames per batch, 1..BATCH_SCHED_MAX, at most the model batch
+ * @param max_wait_us [in] Longest time the oldest frame waits for more frames, 0: run whatever is queued
+ * @param run [in] Backend
+ * @param arg [in] Passed to run
+ * @return int 0: success; -1: error
+ */
+int batch_sched_init(batch_sched_t *sched, int batch_size, int64_t max_wait_us, batch_run_fn run, void *arg);
+
+/**
+ * @brief Stop the scheduler thread, queued frames are still run
+ */
+void batch_sched_deinit(batch_sched_t *sched);
+
+/**
+ * @brief Queue a frame and wait until its batch has run
+ *
+ * Safe to call from several threads, one per stream (or tile). The item must stay
+ * valid until the call returns.
+ *
+ * @param item [in] Frame, data set by the caller
+ * @return int item->ret
+ */
+int batch_sched_submit(batch_sched_t *sched, batch_item_t *item);
+
+/**
+ * @brief Queue a frame without waiting, for a thread that feeds several frames (tiles of one image)
+ *
+ * The item must stay valid until batch_sched_wait() returns for it.
+ *
+ * @param item [in] Frame, data set by the caller
+ * @return int 0: queued; -1: scheduler stopped, item->ret is -1, do not wait for it
+ */
+int batch_sched_post(batch_sched_t *sched, batch_item_t *item);
+
+/**
+ * @brief Wait until a frame posted with batch_sched_post() (returned 0) has run
+ *
+ * @return int item->ret
+ */
+int batch_sched_wait(batch_sched_t *sched, batch_item_t *item);
+
+/**
+ * @brief Monotonic clock in microseconds, the time base of the enqueue / done stamps
+ */
+int64_t batch_sched_now_us();
+
+void batch_sched_reset_stats(batch_sched_t *sched);
+
+void batch_sched_print_stats(batch_sched_t *sched);
+
+#endif // _RKNN_YOLOV5_DEMO_BATCH_SCHED_H_
@@ -0,0 +1,865 @@
+/*
+ * Offline micro benchmarks, no camera / NPU needed.
+ *
+ * Usage: yolo5_benchmark <mode> [args]
+ *   nms [iterations]    cost of each NMS method vs candidate count
+ *   scale [iterations]  CPU float scaler (previous fallback) vs fixed-point scaler vs RGA
+ *   rga [frames]        RGA core routing on the stub backend (modelled per-core latency)
+ *   dispatch [iterations] [profile]  RGA vs CPU cost per format pair and size class
+ *   threads [iterations]  CPU conversion with 1..8 threads, checks the output is identical
+ *   batch [frames] [streams] [fps]  batch scheduler throughput / latency vs batch size and max wait
+ *                                   on a modelled NPU backend
+ *   decode [iterations]  FP16 model outputs: runtime FP32 conversion + float decoder vs the FP16 decoder
+ *   sched [seconds] [streams] [background]  FIFO vs earliest deadline first with a high priority detector
+ *                                           and a low priority background model on modelled NPU cores
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "nms.h"
+#include "image_scale.h"
+#include "image_utils.h"
+#include "rga_sched.h"
+#include "image_dispatch.h"
+#include "image_pool.h"
+#include "image_threads.h"
+#include "batch_sched.h"
+#include "npu_sched.h"
+#include "yolov5_decoder.h"
+#include "im2d.h"
+
+static int64_t get_time_us()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/*
+ * Crowded scene: candidates are jittered copies of a few ground truth boxes on a 640x640 input,
+ * like the raw decoder output of a dense crowd. Sorted by score as post_process does.
+ */
+static void make_candidates(nms_boxes_t *boxes, int count, int num_class, unsigned int seed)
+{
+    srand(seed);
+    const int per_object = 8;
+    int objects = (count + per_object - 1) / per_object;
+    std::vector<float> gt(objects * 5);
+    for (int o = 0; o < objects; o++) {
+        gt[o * 5 + 0] = rand() % 600;
+        gt[o * 5 + 1] = rand() % 600;
+        gt[o * 5 + 2] = 16 + rand() % 120;
+        gt[o * 5 + 3] = 32 + rand() % 200;
+        gt[o * 5 + 4] = rand() % num_class;
+    }
+
+    std::vector<float> score(count);
+    for (int i = 0; i < count; i++) {
+        score[i] = 0.25f + (rand() % 7500) / 10000.0f;
+    }
+    std::sort(score.begin(), score.end(), [](float a, float b) { return a > b; });
+
+    nms_boxes_resize(boxes, count);
+    for (int i = 0; i < count; i++) {
+        const float *g = &gt[(rand() % objects) * 5];
+        float jx = (rand() % 21 - 10) * g[2] / 100.0f;
+        float jy = (rand() % 21 - 10) * g[3] / 100.0f;
+        nms_boxes_set(boxes, i, g[0] + jx, g[1] + jy, g[2], g[3], score[i], (int)g[4]);
+    }
+}
+
+static int bench_nms(int argc, char **argv)
+{
+    int iterations = argc > 0 ? atoi(argv[0]) : 20;
+    if (iterations <= 0) {
+        iterations = 20;
+    }
+    const int counts[] = {64, 128, 256, 512, 1024, 2048, 4096};
+    const int n_count = sizeof(counts) / sizeof(counts[0]);
+
+    printf("nms benchmark, %d iterations, time per call in us (kept boxes)\n", iterations);
+    printf("%8s", "count");
+    for (int m = 0; m < NMS_METHOD_NUM; m++) {
+        printf(" %16s", nms_method_name((nms_method_t)m));
+    }
+    printf("\n");
+
+    nms_boxes_t src, work;
+    std::vector<int> keep;
+    for (int c = 0; c < n_count; c++) {
+        make_candidates(&src, counts[c], 3, 1234 + c);
+        printf("%8d", counts[c]);
+        for (int m = 0; m < NMS_METHOD_NUM; m++) {
+            nms_config_t cfg;
+            cfg.method = (nms_method_t)m;
+            cfg.iou_threshold = 0.45f;
+            cfg.score_threshold = 0.25f;
+            cfg.sigma = 0.5f;
+            // no cap, measure the full cost of each method
+            cfg.max_det = counts[c];
+
+            int64_t total = 0;
+            int kept = 0;
+            for (int it = 0; it < iterations; it++) {
+                // Soft / Matrix decay scores in place
+                work = src;
+                int64_t start = get_time_us();
+                kept = run_nms(&work, &cfg, keep, NULL);
+                total += get_time_us() - start;
+            }
+            char cell[32];
+            snprintf(cell, sizeof(cell), "%.1f (%d)", (double)total / iterations, kept);
+            printf(" %16s", cell);
+        }
+        printf("\n");
+    }
+    return 0;
+}
+
+/*
+ * The CPU fallback scaler used before image_scale.c, kept here as the baseline.
+ */
+static int reference_scale_c(int channel, unsigned char *src, int src_width, int src_height, int crop_x, int crop_y,
+                             int crop_width, int crop_height, unsigned char *dst, int dst_width, int dst_height,
+                             int dst_box_x, int dst_box_y, int dst_box_width, int dst_box_height)
+{
+    (void)dst_height;
+    float x_ratio = (float)crop_width / (float)dst_box_width;
+    float y_ratio = (float)crop_height / (float)dst_box_height;
+
+    for (int dst_y = dst_box_y; dst_y < dst_box_y + dst_box_height; dst_y++) {
+        for (int dst_x = dst_box_x; dst_x < dst_box_x + dst_box_width; dst_x++) {
+            int dst_x_offset = dst_x - dst_box_x;
+            int dst_y_offset = dst_y - dst_box_y;
+
+            int src_x = (int)(dst_x_offset * x_ratio) + crop_x;
+            int src_y = (int)(dst_y_offset * y_ratio) + crop_y;
+
+            float x_diff = (dst_x_offset * x_ratio) - (src_x - crop_x);
+            float y_diff = (dst_y_offset * y_ratio) - (src_y - crop_y);
+
+            int index1 = src_y * src_width * channel + src_x * channel;
+            int index2 = index1 + src_width * channel;
+            if (src_y == src_height - 1) {
+                index2 = index1 - src_width * channel;
+            }
+            int index3 = index1 + 1 * channel;
+            int index4 = index2 + 1 * channel;
+            if (src_x == src_width - 1) {
+                index3 = index1 - 1 * channel;
+                index4 = index2 - 1 * channel;
+            }
+
+            for (int c = 0; c < channel; c++) {
+                unsigned char A = src[index1 + c];
+                unsigned char B = src[index3 + c];
+                unsigned char C = src[index2 + c];
+                unsigned char D = src[index4 + c];
+
+                unsigned char pixel = (unsigned char)(A * (1 - x_diff) * (1 - y_diff) + B * x_diff * (1 - y_diff) +
+                                                      C * y_diff * (1 - x_diff) + D * x_diff * y_diff);
+
+                dst[(dst_y * dst_width + dst_x) * channel + c] = pixel;
+            }
+        }
+    }
+    return 0;
+}
+
+static int bench_scale(int argc, char **argv)
+{
+    int iterations = argc > 0 ? atoi(argv[0]) : 20;
+    if (iterations <= 0) {
+        iterations = 20;
+    }
+    const int cases[][4] = {{640, 480, 640, 640}, {3840, 2160, 640, 360}};
+    const int n_case = sizeof(cases) / sizeof(cases[0]);
+    const int channel = 3;
+
+    printf("scale benchmark, RGB888, %d iterations, time per frame in us\n", iterations);
+    printf("%20s %12s %12s %12s\n", "size", "cpu_float", "cpu_fixed", "rga");
+    for (int c = 0; c < n_case; c++) {
+        int src_w = cases[c][0], src_h = cases[c][1], dst_w = cases[c][2], dst_h = cases[c][3];
+        std::vector<unsigned char> src(src_w * src_h * channel);
+        std::vector<unsigned char> dst(dst_w * dst_h * channel);
+        srand(42);
+        for (size_t i = 0; i < src.size(); i++) {
+            src[i] = rand() & 0xff;
+        }
+
+        int64_t start = get_time_us();
+        for (int it = 0; it < iterations; it++) {
+            reference_scale_c(channel, src.data(), src_w, src_h, 0, 0, src_w, src_h, dst.data(), dst_w, dst_h, 0, 0,
+                              dst_w, dst_h);
+        }
+        double t_float = (double)(get_time_us() - start) / iterations;
+
+        image_scale_plan_t plan;
+        if (image_scale_plan_init(&plan, channel, src_w, src_h, dst_w, dst_h) != 0) {
+            return -1;
+        }
+        start = get_time_us();
+        for (int it = 0; it < iterations; it++) {
+            image_scale_rows(&plan, src.data(), src_w * channel, dst.data(), dst_w * channel, 0, dst_h);
+        }
+        double t_fixed = (double)(get_time_us() - start) / iterations;
+        image_scale_plan_release(&plan);
+
+        double t_rga = -1;
+        rga_buffer_t rga_src = wrapbuffer_virtualaddr(src.data(), src_w, src_h, RK_FORMAT_RGB_888);
+        rga_buffer_t rga_dst = wrapbuffer_virtualaddr(dst.data(), dst_w, dst_h, RK_FORMAT_RGB_888);
+        if (imcheck(rga_src, rga_dst, {}, {}) == IM_STATUS_NOERROR) {
+            start = get_time_us();
+            for (int it = 0; it < iterations; it++) {
+                imresize(rga_src, rga_dst);
+            }
+            t_rga = (double)(get_time_us() - start) / iterations;
+        }
+
+        char size[32];
+        snprintf(size, sizeof(size), "%dx%d->%dx%d", src_w, src_h, dst_w, dst_h);
+        printf("%20s %12.1f %12.1f", size, t_float, t_fixed);
+        if (t_rga >= 0) {
+            printf(" %12.1f\n", t_rga);
+        } else {
+            printf(" %12s\n", "n/a");
+        }
+    }
+    return 0;
+}
+
+static rga_work_t make_work(int op, int src_w, int src_h, image_format_t src_fmt, int dst_w, int dst_h,
+                            image_format_t dst_fmt)
+{
+    rga_work_t w;
+    w.op = op;
+    w.src_w = src_w;
+    w.src_h = src_h;
+    w.src_fmt = src_fmt;
+    w.dst_w = dst_w;
+    w.dst_h = dst_h;
+    w.dst_fmt = dst_fmt;
+    return w;
+}
+
+/*
+ * Run the per-frame RGA work of the camera pipeline on the stub backend, frames back to back.
+ * split = 0: everything in one job on the first capable core (what the driver does with one job)
+ * split = 1: preprocess and display as two jobs routed by rga_sched_submit()
+ */
+static void simulate_rga(const char *name, const rga_work_t *pre, int n_pre, const rga_work_t *disp, int n_disp,
+                         int split, int frames)
+{
+    rga_scheduler_t sched;
+    rga_sched_init(&sched, 1);
+
+    rga_work_t all[16];
+    int n_all = 0;
+    for (int i = 0; i < n_disp; i++) {
+        all[n_all++] = disp[i];
+    }
+    for (int i = 0; i < n_pre; i++) {
+        all[n_all++] = pre[i];
+    }
+
+    for (int f = 0; f < frames; f++) {
+        int64_t end = sched.stub_now_us;
+        if (!split) {
+            int core = -1;
+            for (int c = 0; c < RGA_CORE_NUM; c++) {
+                if (rga_sched_core_supports((rga_core_t)c, all, n_all)) {
+                    core = c;
+                    break;
+                }
+            }
+            if (core < 0) {
+                printf("%s: no core supports the job\n", name);
+                return;
+            }
+            int64_t est = rga_sched_estimate_us(&sched, (rga_core_t)core, all, n_all);
+            sched.jobs[core]++;
+            end = rga_sched_stub_run(&sched, core, est);
+            rga_sched_job_done(&sched, core, 0, est);
+        } else {
+            int64_t pre_est = 0, disp_est = 0;
+            int pre_core = rga_sched_submit(&sched, pre, n_pre, &pre_est);
+            int disp_core = rga_sched_submit(&sched, disp, n_disp, &disp_est);
+            if (pre_core < 0 || disp_core < 0) {
+                printf("%s: no core supports the job\n", name);
+                return;
+            }
+            int64_t pre_end = rga_sched_stub_run(&sched, pre_core, pre_est);
+            int64_t disp_end = rga_sched_stub_run(&sched, disp_core, disp_est);
+            end = std::max(pre_end, disp_end);
+            rga_sched_job_done(&sched, pre_core, pre_est, 0);
+            rga_sched_job_done(&sched, disp_core, disp_est, 0);
+        }
+        // next frame starts once all RGA work of this one is done
+        sched.stub_now_us = end;
+    }
+    printf("%s: %.1f us per frame\n", name, (double)sched.stub_now_us / frames);
+    rga_sched_print_stats(&sched, 0);
+}
+
+static int bench_rga(int argc, char **argv)
+{
+    int frames = argc > 0 ? atoi(argv[0]) : 300;
+    if (frames <= 0) {
+        frames = 300;
+    }
+
+    // camera pipeline: 640x480 NV12 -> RGB -> rotate -> letterbox 640x640, display 480x640 -> 1080x1920 RGBA
+    rga_work_t pre[4];
+    int n_pre = 0;
+    pre[n_pre++] = make_work(RGA_OP_CVTCOLOR, 640, 480, IMAGE_FORMAT_YUV420SP_NV12, 640, 480, IMAGE_FORMAT_RGB888);
+    pre[n_pre++] = make_work(RGA_OP_ROTATE, 640, 480, IMAGE_FORMAT_RGB888, 480, 640, IMAGE_FORMAT_RGB888);
+    pre[n_pre++] = make_work(RGA_OP_RESIZE, 480, 640, IMAGE_FORMAT_RGB888, 640, 640, IMAGE_FORMAT_RGB888);
+    rga_work_t disp[1];
+    disp[0] = make_work(RGA_OP_RESIZE | RGA_OP_CVTCOLOR, 480, 640, IMAGE_FORMAT_RGB888, 1080, 1920,
+                        IMAGE_FORMAT_RGBA8888);
+
+    printf("rga routing on the stub backend, %d frames\n", frames);
+    simulate_rga("one job", pre, n_pre, disp, 1, 0, frames);
+    simulate_rga("scheduled", pre, n_pre, disp, 1, 1, frames);
+
+    // same with the padding filled every frame, fill is RGA2 only
+    pre[n_pre++] = make_work(RGA_OP_FILL, 0, 0, IMAGE_FORMAT_RGB888, 640, 640, IMAGE_FORMAT_RGB888);
+    simulate_rga("one job + fill", pre, n_pre, disp, 1, 0, frames);
+    simulate_rga("scheduled + fill", pre, n_pre, disp, 1, 1, frames);
+    return 0;
+}
+
+static int bench_dispatch(int argc, char **argv)
+{
+    int iterations = argc > 0 ? atoi(argv[0]) : 10;
+    const char *profile = argc > 1 ? argv[1] : NULL;
+
+    // fresh measurement on pool buffers like the app's, the profile is only written
+    image_pool_t pool;
+    image_pool_init(&pool);
+    image_dispatch_allocator_t allocator;
+    image_pool_dispatch_allocator(&pool, &allocator);
+    image_dispatch_init(NULL, &allocator);
+    image_dispatch_calibrate(iterations, &allocator);
+    if (profile != NULL && image_dispatch_save(profile) == 0) {
+        printf("profile saved to %s\n", profile);
+    }
+
+    // route a letterbox-sized conversion through the dispatcher
+    image_buffer_t src, dst;
+    memset(&src, 0, sizeof(src));
+    memset(&dst, 0, sizeof(dst));
+    src.width = 640;
+    src.height = 480;
+    src.format = IMAGE_FORMAT_RGB888;
+    src.size = get_image_size(&src);
+    dst.width = 640;
+    dst.height = 640;
+    dst.format = IMAGE_FORMAT_RGB888;
+    dst.size = get_image_size(&dst);
+    std::vector<unsigned char> src_data(src.size, 0x80), dst_data(dst.size);
+    src.virt_addr = src_data.data();
+    dst.virt_addr = dst_data.data();
+    letterbox_t letterbox;
+    int64_t start = get_time_us();
+    for (int i = 0; i < iterations; i++) {
+        convert_image_with_letterbox(&src, &dst, &letterbox, 114);
+    }
+    printf("letterbox 640x480 -> 640x640 via dispatcher: %.1f us\n", (double)(get_time_us() - start) / iterations);
+    image_dispatch_print_stats();
+    image_dispatch_deinit();
+    image_pool_deinit(&pool);
+    return 0;
+}
+
+static int bench_threads(int argc, char **argv)
+{
+    int iterations = argc > 0 ? atoi(argv[0]) : 20;
+    if (iterations <= 0) {
+        iterations = 20;
+    }
+    // camera frame to model input, with and without colour conversion
+    const struct {
+        const char *name;
+        image_format_t src_fmt;
+        int src_w, src_h;
+        image_format_t dst_fmt;
+        int dst_w, dst_h;
+    } cases[] = {
+        {"rgb letterbox", IMAGE_FORMAT_RGB888, 1920, 1080, IMAGE_FORMAT_RGB888, 640, 640},
+        {"nv12 letterbox", IMAGE_FORMAT_YUV420SP_NV12, 1920, 1080, IMAGE_FORMAT_RGB888, 640, 640},
+        {"nv12 cvtcolor", IMAGE_FORMAT_YUV420SP_NV12, 1920, 1080, IMAGE_FORMAT_RGB888, 1920, 1080},
+        {"13mp letterbox", IMAGE_FORMAT_YUV420SP_NV12, 4208, 3120, IMAGE_FORMAT_RGB888, 640, 640},
+    };
+    const int n_case = sizeof(cases) / sizeof(cases[0]);
+    const int max_threads = 8;
+
+    printf("CPU conversion benchmark, %d iterations, time per frame in us\n", iterations);
+    printf("%16s", "case");
+    for (int t = 1; t <= max_threads; t++) {
+        printf(" %7d", t);
+    }
+    printf("\n");
+
+    for (int c = 0; c < n_case; c++) {
+        image_buffer_t src, dst;
+        memset(&src, 0, sizeof(src));
+        memset(&dst, 0, sizeof(dst));
+        src.width = cases[c].src_w;
+        src.height = cases[c].src_h;
+        src.format = cases[c].src_fmt;
+        src.size = get_image_size(&src);
+        dst.width = cases[c].dst_w;
+        dst.height = cases[c].dst_h;
+        dst.format = cases[c].dst_fmt;
+        dst.size = get_image_size(&dst);
+        std::vector<unsigned char> src_data(src.size), dst_data(dst.size), ref(dst.size);
+        srand(42);
+        for (size_t i = 0; i < src_data.size(); i++) {
+            src_data[i] = rand() & 0xff;
+        }
+        src.virt_addr = src_data.data();
+        dst.virt_addr = dst_data.data();
+
+        // letterbox geometry as convert_image_with_letterbox computes it
+        image_rect_t src_box = {0, 0, src.width - 1, src.height - 1};
+        image_rect_t dst_box = {0, 0, dst.width - 1, dst.height - 1};
+        if (dst.width * src.height != src.width * dst.height) {
+            int h = src.height * dst.width / src.width / 2 * 2;
+            dst_box.top = (dst.height - h) / 2;
+            dst_box.bottom = dst_box.top + h - 1;
+        }
+
+        printf("%16s", cases[c].name);
+        int identical = 1;
+        for (int t = 1; t <= max_threads; t++) {
+            image_threads_init(t);
+            memset(dst.virt_addr, 0, dst.size);
+            int64_t start = get_time_us();
+            for (int it = 0; it < iterations; it++) {
+                convert_image_cpu(&src, &dst, &src_box, &dst_box, 114, 1);
+            }
+            printf(" %7.0f", (double)(get_time_us() - start) / iterations);
+            fflush(stdout);
+            if (t == 1) {
+                memcpy(ref.data(), dst.virt_addr, dst.size);
+            } else if (memcmp(ref.data(), dst.virt_addr, dst.size) != 0) {
+                identical = 0;
+            }
+        }
+        printf("  %s\n", identical ? "identical" : "MISMATCH");
+    }
+    image_threads_deinit();
+    return 0;
+}
+
+/*
+ * Modelled batch NPU: a fixed cost per rknn_run (input / output copies, job setup) plus the
+ * per image compute, split over the cores given to rknn_set_batch_core_num.
+ */
+typedef struct {
+    int64_t run_overhead_us;
+    int64_t image_us;
+    int cores;
+} npu_model_t;
+
+static int run_modelled_npu(void *arg, batch_item_t **items, int n)
+{
+    const npu_model_t *npu = (const npu_model_t *)arg;
+    int rounds = (n + npu->cores - 1) / npu->cores;
+    usleep(npu->run_overhead_us + npu->image_us * rounds);
+    for (int i = 0; i < n; i++) {
+        items[i]->ret = 0;
+    }
+    return 0;
+}
+
+typedef struct {
+    batch_sched_t *sched;
+    int frames;
+    int64_t period_us;
+    int64_t start_us;
+    std::vector<int64_t> latency_us;
+} stream_t;
+
+static void *stream_thread(void *arg)
+{
+    stream_t *st = (stream_t *)arg;
+    for (int f = 0; f < st->frames; f++) {
+        // frames arrive at the camera rate, a late stream submits right away
+        int64_t due = st->start_us + f * st->period_us;
+        int64_t now = batch_sched_now_us();
+        if (due > now) {
+            usleep(due - now);
+        }
+        batch_item_t item;
+        memset(&item, 0, sizeof(item));
+        batch_sched_submit(st->sched, &item);
+        st->latency_us.push_back(item.done_us - item.enqueue_us);
+    }
+    return NULL;
+}
+
+static void simulate_batch(const npu_model_t *npu, int batch_size, int64_t max_wait_us, int streams, int fps,
+                           int frames)
+{
+    batch_sched_t sched;
+    if (batch_sched_init(&sched, batch_size, max_wait_us, run_modelled_npu, (void *)npu) != 0) {
+        return;
+    }
+
+    std::vector<stream_t> st(streams);
+    std::vector<pthread_t> threads(streams);
+    int64_t start = batch_sched_now_us();
+    for (int i = 0; i < streams; i++) {
+        st[i].sched = &sched;
+        st[i].frames = frames;
+        st[i].period_us = 1000000 / fps;
+        // streams are not in phase
+        st[i].start_us = start + st[i].period_us * i / streams;
+        pthread_create(&threads[i], NULL, stream_thread, &st[i]);
+    }
+    std::vector<int64_t> all;
+    for (int i = 0; i < streams; i++) {
+        pthread_join(threads[i], NULL);
+        all.insert(all.end(), st[i].latency_us.begin(), st[i].latency_us.end());
+    }
+    int64_t elapsed = batch_sched_now_us() - start;
+    std::sort(all.begin(), all.end());
+
+    double avg = 0;
+    for (size_t i = 0; i < all.size(); i++) {
+        avg += all[i];
+    }
+    avg /= all.size();
+    printf("%5d %8.1f %8.1f %8.1f %8.1f %8.1f %8.2f\n", batch_size, max_wait_us / 1000.0,
+           all.size() * 1000000.0 / elapsed, avg / 1000.0, all[all.size() / 2] / 1000.0,
+           all[all.size() * 99 / 100] / 1000.0, (double)sched.frames / sched.batches);
+    batch_sched_deinit(&sched);
+}
+
+static int bench_batch(int argc, char **argv)
+{
+    int frames = argc > 0 ? atoi(argv[0]) : 30;
+    int streams = argc > 1 ? atoi(argv[1]) : 4;
+    int fps = argc > 2 ? atoi(argv[2]) : 30;
+    if (frames <= 0) {
+        frames = 30;
+    }
+    if (streams <= 0) {
+        streams = 4;
+    }
+    if (fps <= 0) {
+        fps = 30;
+    }
+
+    // yolov5s 640x640 on one RK3588 NPU core, 3 cores for batches
+    npu_model_t npu;
+    npu.run_overhead_us = 2000;
+    npu.image_us = 12000;
+    npu.cores = 3;
+
+    static const int batch_sizes[] = {1, 2, 3, 4};
+    static const int waits_ms[] = {0, 5, 10, 20};
+    printf("batch scheduler on the modelled NPU (run %.1f ms + %.1f ms per image, %d cores), "
+           "%d streams at %d fps, %d frames each\n",
+           npu.run_overhead_us / 1000.0, npu.image_us / 1000.0, npu.cores, streams, fps, frames);
+    printf("batch wait(ms)      fps  avg(ms)  p50(ms)  p99(ms)     fill\n");
+    for (size_t b = 0; b < sizeof(batch_sizes) / sizeof(batch_sizes[0]); b++) {
+        for (size_t w = 0; w < sizeof(waits_ms) / sizeof(waits_ms[0]); w++) {
+            simulate_batch(&npu, batch_sizes[b], waits_ms[w] * 1000, streams, fps, frames);
+            if (batch_sizes[b] == 1) {
+                // nothing to wait for
+                break;
+            }
+        }
+    }
+    return 0;
+}
+
+/*
+ * Modelled NPU cores shared by two models: every core has a context of each, one job runs at a time.
+ */
+#define SCHED_MODEL_DETECTOR 0
+#define SCHED_MODEL_BACKGROUND 1
+
+static int run_modelled_job(void *arg, npu_job_t *job)
+{
+    const int64_t *cost_us = (const int64_t *)arg;
+    usleep(cost_us[job->model]);
+    job->ret = 0;
+    return 0;
+}
+
+typedef struct {
+    npu_sched_t *sched;
+    int model;
+    int priority;
+    int64_t period_us;          // 0: submit back to back
+    int64_t deadline_us;        // relative to the frame arrival
+    int64_t start_us;
+    int64_t end_us;
+} sched_stream_t;
+
+static void *sched_stream_thread(void *arg)
+{
+    sched_stream_t *st = (sched_stream_t *)arg;
+    for (int f = 0;; f++) {
+        int64_t now = npu_sched_now_us();
+        int64_t due = st->period_us > 0 ? st->start_us + f * st->period_us : now;
+        if (due >= st->end_us) {
+            break;
+        }
+        if (due > now) {
+            usleep(due - now);
+        }
+        // the deadline counts from the frame arrival, a stream that fell behind submits it already late
+        npu_job_t job;
+        memset(&job, 0, sizeof(job));
+        job.model = st->model;
+        job.priority = st->priority;
+        job.deadline_us = due + st->deadline_us;
+        npu_sched_submit(st->sched, &job);
+    }
+    return NULL;
+}
+
+static void simulate_sched(int policy, const int64_t *cost_us, int cores, int streams, int fps, int background,
+                           int seconds)
+{
+    npu_sched_t sched;
+    if (npu_sched_init(&sched, policy, run_modelled_job) != 0) {
+        return;
+    }
+    for (int i = 0; i < cores; i++) {
+        npu_sched_add_context(&sched, (1 << SCHED_MODEL_DETECTOR) | (1 << SCHED_MODEL_BACKGROUND), (void *)cost_us);
+    }
+    if (npu_sched_start(&sched) != 0) {
+        npu_sched_deinit(&sched);
+        return;
+    }
+
+    int n = streams + background;
+    std::vector<sched_stream_t> st(n);
+    std::vector<pthread_t> threads(n);
+    int64_t start = npu_sched_now_us();
+    for (int i = 0; i < n; i++) {
+        st[i].sched = &sched;
+        st[i].start_us = start;
+        st[i].end_us = start + (int64_t)seconds * 1000000;
+        if (i < streams) {
+            // camera streams, not in phase, the result is useless after one frame period
+            st[i].model = SCHED_MODEL_DETECTOR;
+            st[i].priority = NPU_PRIO_HIGH;
+            st[i].period_us = 1000000 / fps;
+            st[i].deadline_us = st[i].period_us;
+            st[i].start_us += st[i].period_us * i / streams;
+        } else {
+            // background analytics as fast as the NPU allows, 5 frame periods of slack
+            st[i].model = SCHED_MODEL_BACKGROUND;
+            st[i].priority = NPU_PRIO_LOW;
+            st[i].period_us = 0;
+            st[i].deadline_us = 5 * 1000000 / fps;
+        }
+        pthread_create(&threads[i], NULL, sched_stream_thread, &st[i]);
+    }
+    for (int i = 0; i < n; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    static const int classes[] = {NPU_PRIO_HIGH, NPU_PRIO_LOW};
+    for (size_t c = 0; c < sizeof(classes) / sizeof(classes[0]); c++) {
+        npu_sched_class_stats_t *cs = &sched.stats[classes[c]];
+        printf("%-6s %-6s %6llu %6llu %8llu %6llu %7.1f %8.1f %8.1f\n", policy == NPU_SCHED_EDF ? "edf" : "fifo",
+               npu_sched_priority_name(classes[c]), (unsigned long long)cs->submitted, (unsigned long long)cs->run,
+               (unsigned long long)cs->dropped, (unsigned long long)cs->late,
+               cs->submitted ? (cs->dropped + cs->late) * 100.0 / cs->submitted : 0.0,
+               cs->run ? cs->latency_sum_us / 1000.0 / cs->run : 0.0, cs->latency_max_us / 1000.0);
+    }
+    npu_sched_deinit(&sched);
+}
+
+static int bench_sched(int argc, char **argv)
+{
+    int seconds = argc > 0 ? atoi(argv[0]) : 3;
+    int streams = argc > 1 ? atoi(argv[1]) : 4;
+    int background = argc > 2 ? atoi(argv[2]) : 3;
+    if (seconds <= 0) {
+        seconds = 3;
+    }
+    if (streams <= 0) {
+        streams = 4;
+    }
+    if (background < 0) {
+        background = 3;
+    }
+
+    // yolov5s 640x640 and a larger background model on the 3 RK3588 NPU cores
+    const int fps = 30;
+    const int cores = 3;
+    int64_t cost_us[2];
+    cost_us[SCHED_MODEL_DETECTOR] = 12000;
+    cost_us[SCHED_MODEL_BACKGROUND] = 40000;
+
+    printf("npu scheduler on %d modelled cores: %d detector streams at %d fps (%.1f ms, deadline %.1f ms, high), "
+           "%d background threads (%.1f ms, deadline %.1f ms, low), %d s\n",
+           cores, streams, fps, cost_us[SCHED_MODEL_DETECTOR] / 1000.0, 1000.0 / fps, background,
+           cost_us[SCHED_MODEL_BACKGROUND] / 1000.0, 5000.0 / fps, seconds);
+    printf("policy class    jobs    run  dropped   late  miss(%%)  avg(ms)  max(ms)\n");
+    simulate_sched(NPU_SCHED_FIFO, cost_us, cores, streams, fps, background, seconds);
+    simulate_sched(NPU_SCHED_EDF, cost_us, cores, streams, fps, background, seconds);
+    return 0;
+}
+
+#if defined(YOLOV5_DECODE_FP16)
+/*
+ * yolov5s 640x640 NCHW heads with 80 classes: low objectness except ~1% of the cells,
+ * like a street scene. want_float makes the runtime convert every element to FP32 first.
+ */
+static int bench_decode(int argc, char **argv)
+{
+    int iterations = argc > 0 ? atoi(argv[0]) : 50;
+    if (iterations <= 0) {
+        iterations = 50;
+    }
+    const int num_class = 80;
+    const int grids[YOLOV5_HEAD_NUM] = {80, 40, 20};
+    const float anchors[YOLOV5_HEAD_NUM][6] = {{10, 13, 16, 30, 33, 23},
+                                               {30, 61, 62, 45, 59, 119},
+                                               {116, 90, 156, 198, 373, 326}};
+    const float threshold = 0.25f;
+
+    srand(1);
+    std::vector<yolov5_half_t> half[YOLOV5_HEAD_NUM];
+    std::vector<float> f32[YOLOV5_HEAD_NUM];
+    for (int h = 0; h < YOLOV5_HEAD_NUM; h++) {
+        int grid_len = grids[h] * grids[h];
+        int size = 3 * (5 + num_class) * grid_len;
+        half[h].resize(size);
+        f32[h].resize(size);
+        for (int i = 0; i < size; i++) {
+            int prop = (i / grid_len) % (5 + num_class);
+            float v = (rand() % 1000) / 1000.0f;
+            if (prop == 4) {
+                v = rand() % 100 == 0 ? 0.5f + v / 2 : v / 20;
+            }
+            half[h][i] = yolov5_half_t(v);
+        }
+    }
+
+    const char *name = NULL;
+    yolov5_decode_fn decode_f32 = find_yolov5_decoder(RKNN_TENSOR_FLOAT32, YOLOV5_LAYOUT_NCHW, num_class, 3, NULL);
+    yolov5_decode_fn decode_f16 = find_yolov5_decoder(RKNN_TENSOR_FLOAT16, YOLOV5_LAYOUT_NCHW, num_class, 3, &name);
+    if (decode_f32 == NULL || decode_f16 == NULL) {
+        printf("no decoder\n");
+        return -1;
+    }
+
+    std::vector<float> boxes, probs;
+    std::vector<int> cls;
+    int count[2] = {0, 0};
+    int64_t convert_us = 0, decode_us[2] = {0, 0};
+    for (int it = 0; it < iterations; it++) {
+        boxes.clear();
+        probs.clear();
+        cls.clear();
+        int64_t t0 = get_time_us();
+        for (int h = 0; h < YOLOV5_HEAD_NUM; h++) {
+            for (size_t i = 0; i < half[h].size(); i++) {
+                f32[h][i] = (float)half[h][i];
+            }
+        }
+        int64_t t1 = get_time_us();
+        int n = 0;
+        for (int h = 0; h < YOLOV5_HEAD_NUM; h++) {
+            n += decode_f32(f32[h].data(), anchors[h], grids[h], grids[h], 640 / grids[h], num_class, 3, boxes,
+                            probs, cls, threshold, 0, 1.0f);
+        }
+        int64_t t2 = get_time_us();
+        convert_us += t1 - t0;
+        decode_us[0] += t2 - t1;
+        count[0] = n;
+
+        boxes.clear();
+        probs.clear();
+        cls.clear();
+        t0 = get_time_us();
+        n = 0;
+        for (int h = 0; h < YOLOV5_HEAD_NUM; h++) {
+            n += decode_f16(half[h].data(), anchors[h], grids[h], grids[h], 640 / grids[h], num_class, 3, boxes,
+                            probs, cls, threshold, 0, 1.0f);
+        }
+        decode_us[1] += get_time_us() - t0;
+        count[1] = n;
+    }
+
+    printf("yolov5 decode of FP16 outputs, 3 heads 80 classes, %d iterations\n", iterations);
+    printf("path                         convert(ms)  decode(ms)  total(ms)  boxes\n");
+    printf("want_float + float decoder   %11.3f  %10.3f  %9.3f  %5d\n", convert_us / 1000.0 / iterations,
+           decode_us[0] / 1000.0 / iterations, (convert_us + decode_us[0]) / 1000.0 / iterations, count[0]);
+    printf("%-28s %11.3f  %10.3f  %9.3f  %5d\n", name, 0.0, decode_us[1] / 1000.0 / iterations,
+           decode_us[1] / 1000.0 / iterations, count[1]);
+    if (count[0] != count[1]) {
+        printf("box count differs\n");
+        return -1;
+    }
+    return 0;
+}
+#endif
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s <mode> [args]\n", prog);
+    fprintf(stderr, "  nms [iterations]\n");
+    fprintf(stderr, "  scale [iterations]\n");
+    fprintf(stderr, "  rga [frames]\n");
+    fprintf(stderr, "  dispatch [iterations] [profile]\n");
+    fprintf(stderr, "  threads [iterations]\n");
+    fprintf(stderr, "  batch [frames] [streams] [fps]\n");
+    fprintf(stderr, "  decode [iterations]\n");
+    fprintf(stderr, "  sched [seconds] [streams] [background]\n");
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        usage(argv[0]);
+        return -1;
+    }
+    if (strcmp(argv[1], "nms") == 0) {
+        return bench_nms(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "scale") == 0) {
+        return bench_scale(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "rga") == 0) {
+        return bench_rga(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "dispatch") == 0) {
+        return bench_dispatch(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "threads") == 0) {
+        return bench_threads(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "batch") == 0) {
+        return bench_batch(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "sched") == 0) {
+        return bench_sched(argc - 2, argv + 2);
+    }
+#if defined(YOLOV5_DECODE_FP16)
+    if (strcmp(argv[1], "decode") == 0) {
+        return bench_decode(argc - 2, argv + 2);
+    }
+#endif
+    usage(argv[0]);
+    return -1;
+}
@@ -0,0 +1,96 @@
+#ifndef _RKNN_YOLOV5_DEMO_CASCADE_H_
+#define _RKNN_YOLOV5_DEMO_CASCADE_H_
+
+#include <stdint.h>
+
+#include "rknn_api.h"
+#include "common.h"
+#include "yolov5.h"
+
+#define CASCADE_MAX_CLASSES 16      // detector classes routed to the classifier
+#define CASCADE_MAX_LABELS 1000
+#define CASCADE_MAX_CROPS 64
+
+typedef struct {
+    int classes[CASCADE_MAX_CLASSES];   // detector classes to classify
+    int class_num;                      // 0: every class
+    int min_size;                       // shorter box side in source pixels, smaller boxes are skipped
+    int max_crops;                      // crops per frame, highest detector scores first; bounds the latency
+    float expand;                       // box grown by this fraction of its size on each side for context
+    int core_mask;                      // rknn_core_mask of the classifier, keep it off the detector's cores
+    int priority;                       // NPU_PRIO_* of the classifier context, below the detector
+} cascade_config_t;
+
+/**
+ * @brief Second stage classifier over detection boxes
+ *
+ * The input tensor is one DMA buffer of batch images stacked vertically, RGA scales each
+ * crop straight into its slot and the NPU reads it without a copy (rknn_set_io_mem).
+ */
+typedef struct {
+    cascade_config_t config;
+    rknn_context rknn_ctx;
+    rknn_input_output_num io_num;
+    rknn_tensor_attr input_attr;
+    rknn_tensor_attr output_attr;
+    int width;
+    int height;
+    int batch;                          // crops per rknn_run, dims[0] of the input
+    int class_num;                      // classifier outputs per crop
+    rknn_tensor_mem *input_mem;
+    image_buffer_t input;               // width x (height * batch) RGB888 view of input_mem
+    char **labels;                      // NULL: class ids are printed
+    int label_num;
+    npu_sched_t *sched;                 // runs the classifier with deadlines, NULL: rknn_run on the calling thread
+    int sched_model;                    // npu_job_t.model of the classifier in sched
+
+    uint64_t frames;
+    uint64_t crops;
+    uint64_t skipped;                   // filtered out by class or size
+    uint64_t over_budget;               // dropped by max_crops
+    uint64_t runs;
+    uint64_t dropped;                   // crops not classified, the frame deadline passed first
+    int64_t crop_us;
+    int64_t npu_us;
+} cascade_t;
+
+/**
+ * @brief Defaults: every class, min_size 16, max_crops 8, expand 0.1, NPU core 2, low priority
+ */
+void cascade_default_config(cascade_config_t *config);
+
+/**
+ * @brief Parse "cls[+cls...]" detector class ids into config->classes
+ *
+ * @return int 0: success; -1: invalid list
+ */
+int cascade_parse_classes(cascade_config_t *config, const char *str);
+
+/**
+ * @brief Load the classifier and bind its input tensor
+ *
+ * @param labels_path [in] One class name per line, NULL: none
+ * @return int 0: success; -1: error
+ */
+int cascade_init(cascade_t *cascade, const char *model_path, const char *labels_path, const cascade_config_t *config);
+
+void cascade_release(cascade_t *cascade);
+
+/**
+ * @brief Classify the selected boxes of one frame
+ *
+ * Sets sub_cls_id / sub_prop of the classified results, the others keep -1.
+ *
+ * @param src [in] Image the boxes are on, RGB888 with a DMA fd or virtual address
+ * @param od_results [in,out] Detections
+ * @param deadline_us [in] Frame deadline on the npu_sched_now_us() clock, batches that cannot start
+ *                         before it are dropped; 0: none. Only used with cascade->sched
+ * @return int crops classified; -1: error
+ */
+int cascade_run(cascade_t *cascade, image_buffer_t *src, object_detect_result_list *od_results, int64_t deadline_us);
+
+const char *cascade_cls_to_name(cascade_t *cascade, int cls_id);
+
+void cascade_print_stats(cascade_t *cascade);
+
+#endif // _RKNN_YOLOV5_DEMO_CASCADE_H_
@@ -11,10 +11,21 @@
 #include <linux/videodev2.h>
 #include <linux/fb.h>
 #include <stdint.h>
+#include <signal.h>
+#include <sys/time.h>
 #include "yolov5.h"
+#include "model_registry.h"
+#include "npu_profile.h"
+#include "cascade.h"
+#include "npu_tune.h"
+#include "npu_sched.h"
 #include "image_utils.h"
 #include "file_utils.h"
 #include "image_drawing.h"
+#include "rga_job.h"
+#include "image_pool.h"
+#include "image_dispatch.h"
+#include "image_threads.h"
 #include <opencv2/opencv.hpp>
 #include "RockchipRga.h"
 #include "im2d.hpp"
@@ -44,6 +55,45 @@ static int v4l2_fd = -1;                //摄像头设备文件描述符
 static cam_buf_info buf_infos[FRAMEBUFFER_COUNT];
 static cam_fmt cam_fmts[10];
 static int frm_width, frm_height;   //视频帧宽度和高度
+static int frm_stride;              //视频帧行宽（字节），驱动可能对齐
+static int cap_width = 640, cap_height = 480;  //请求的采集分辨率
+static int stripe_infer = 0;        //1: CPU按行带从NV12直接生成模型输入和预览，不生成全分辨率RGB帧
+static volatile sig_atomic_t snapshot_requested = 0;  //SIGUSR1: 保存一帧全分辨率NV12
+static volatile sig_atomic_t reload_requested = 0;    //SIGHUP: 后台重新加载模型，帧间切换
+static const char *model_path = "../model/yolov5.rknn";
+static model_registry_t model_registry;    //-m 注册的检测模型，按需加载、超出NPU内存预算时按LRU淘汰
+static const char *detector_name = NULL;    //-d 选用的模型，NULL: 第一个注册的
+static npu_mem_t npu_mem;                   //-N 上下文间共享权重/internal内存、启用SRAM
+static int npu_mem_flags = 0;
+static yolov5_reload_t model_reload;
+static npu_profile_t npu_prof;              //-p 每帧各阶段耗时和NPU逐层耗时，默认关闭
+static const char *profile_prefix = NULL;
+static int profile_interval = 0;
+static cascade_t cascade;                   //-C 检测框上的二级分类，rknn_ctx 为0时关闭
+static cascade_config_t cascade_config;
+static const char *cascade_spec = NULL;
+static int npu_tune_mode = 0;               //-A 1: 用保存的调优结果，没有时先调优；-a 2: 强制重新调优
+static int tile_num = 0;                    //-b 推理帧切成的块数，凑成batch跑batch模型，0: 整帧推理
+static int64_t tile_wait_us = 2000;         //-b 凑满一个batch的最长等待
+static npu_sched_t npu_sched;               //检测和级联分类的 rknn_run 都经它按截止时间调度
+static npu_sched_rknn_t npu_slots[2];       //调度槽0: 检测上下文，槽1: 分类器上下文
+static float frame_deadline_ms = 100.f;     //-E 每帧检测+分类的截止时间，从等预处理开始算，0: 不设
+#define NPU_MODEL_DETECTOR 0                //npu_job_t.model
+#define NPU_MODEL_CASCADE 1
+
+/* 动态shape模型的输入尺寸策略 */
+enum {
+    SHAPE_POLICY_NONE = 0,  //固定为模型默认输入
+    SHAPE_POLICY_ASPECT,    //最大尺寸，按帧宽高比选矩形输入
+    SHAPE_POLICY_LOAD,      //按NPU耗时在各尺寸间切换
+    SHAPE_POLICY_OBJECT,    //按目标大小在各尺寸间切换
+};
+static int shape_policy = SHAPE_POLICY_NONE;
+static float npu_budget_ms = 33.f;  //LOAD策略的每帧NPU耗时预算
+static int native_infer = 0;        //1: 在未旋转的原始帧上推理、只旋转检测框和显示
+static int verbose = 0;             //-v 1: 每帧打印所有检测框和分类结果
+static const char *dispatch_profile = NULL;  //RGA/CPU 代价模型文件, NULL: convert_image 先 RGA 后 CPU
+static image_pool_t image_pool;     //图像缓冲池（DMA heap，没有时退回malloc）
 
 void clamp_rgb(int* R, int* G, int* B) {
     *R = (*R < 0) ? 0 : (*R > 255) ? 255 : *R;
@@ -245,8 +295,8 @@ static int v4l2_set_format(void)
 
     /* 设置帧格式 */
     fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;//type类型
-    fmt.fmt.pix.width = 640;  //视频帧宽度
-    fmt.fmt.pix.height = 480;//视频帧高度
+    fmt.fmt.pix.width = cap_width;  //视频帧宽度
+    fmt.fmt.pix.height = cap_height;//视频帧高度
     fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_NV12;  //像素格式
     if (0 > ioctl(v4l2_fd, VIDIOC_S_FMT, &fmt)) {
         fprintf(stderr, "ioctl error: VIDIOC_S_FMT: %s\n", strerror(errno));
@@ -274,7 +324,10 @@ static int v4l2_set_format(void)
     
     frm_width = fmt.fmt.pix.width;  //获取实际的帧宽度
     frm_height = fmt.fmt.pix.height;//获取实际的帧高度
-    printf("视频帧大小<%d * %d>\n", frm_width, frm_height);
+    frm_stride = fmt.fmt.pix_mp.plane_fmt[0].bytesperline;
+    if (frm_stride < frm_width)
+        frm_stride = frm_width;
+    printf("视频帧大小<%d * %d> 行宽 %d\n", frm_width, frm_height, frm_stride);
 
     /* 获取streamparm */
     streamparm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
@@ -361,7 +414,8 @@ static int v4l2_stream_on(void)
 }
 
 
-int rga_cvcolor(char *src_buf, char*dst_buf, int src_width, int src_height, int dst_width, int dst_height, int src_format,  int dst_format)
+int rga_cvcolor(char *src_buf, char*dst_buf, int src_width, int src_height, int dst_width, int dst_height, int src_format,  int dst_format,
+    int *release_fence)
 {
     int ret = 0;
     int src_buf_size, dst_buf_size;
@@ -372,6 +426,19 @@ int rga_cvcolor(char *src_buf, char*dst_buf, int src_width, int src_height, int
     memset(&src_img, 0, sizeof(src_img));
     memset(&dst_img, 0, sizeof(dst_img));
 
+    /* 异步模式：直接用虚拟地址提交，立即返回，调用者在使用dst_buf前 imsync(*release_fence) */
+    if (release_fence != NULL) {
+        src_img = wrapbuffer_virtualaddr(src_buf, src_width, src_height, src_format);
+        dst_img = wrapbuffer_virtualaddr(dst_buf, dst_width, dst_height, dst_format);
+        ret = imcvtcolor(src_img, dst_img, src_format, dst_format, IM_COLOR_SPACE_DEFAULT, 0, release_fence);
+        if (ret != IM_STATUS_SUCCESS) {
+            printf("running failed, %s\n", imStrError((IM_STATUS)ret));
+            *release_fence = -1;
+            return -1;
+        }
+        return 0;
+    }
+
     src_buf_size = src_width * src_height * get_bpp_from_format(src_format);
     dst_buf_size = dst_width * dst_height * get_bpp_from_format(dst_format);
 
@@ -409,7 +476,8 @@ release_buffer:
     return ret;
 }
 
-int rga_resize(char *src_buf, char*dst_buf, int src_width, int src_height, int dst_width, int dst_height, int src_format,  int dst_format)
+int rga_resize(char *src_buf, char*dst_buf, int src_width, int src_height, int dst_width, int dst_height, int src_format,  int dst_format,
+    int *release_fence)
 {
     int ret = 0;
     int src_buf_size, dst_buf_size;
@@ -420,6 +488,19 @@ int rga_resize(char *src_buf, char*dst_buf, int src_width, int src_height, int d
     memset(&src_img, 0, sizeof(src_img));
     memset(&dst_img, 0, sizeof(dst_img));
 
+    /* 异步模式：直接用虚拟地址提交，立即返回，调用者在使用dst_buf前 imsync(*release_fence) */
+    if (release_fence != NULL) {
+        src_img = wrapbuffer_virtualaddr(src_buf, src_width, src_height, src_format);
+        dst_img = wrapbuffer_virtualaddr(dst_buf, dst_width, dst_height, dst_format);
+        ret = imresize(src_img, dst_img, 0, 0, INTER_LINEAR, 0, release_fence);
+        if (ret != IM_STATUS_SUCCESS) {
+            printf("running failed, %s\n", imStrError((IM_STATUS)ret));
+            *release_fence = -1;
+            return -1;
+        }
+        return 0;
+    }
+
     src_buf_size = src_width * src_height * get_bpp_from_format(src_format);
     dst_buf_size = dst_width * dst_height * get_bpp_from_format(dst_format);
 
@@ -471,183 +552,1102 @@ release_buffer:
     return ret;
 }
 
-static int v4l2_read_data(void)
+/* 画框，-v 时打印检测结果，scale_x/scale_y 把检测坐标映射到 image 上 */
+static void draw_results(rknn_app_context_t *app_ctx, image_buffer_t *image, object_detect_result_list *od_results,
+                         float scale_x, float scale_y)
 {
-    struct v4l2_buffer buf = {0};
-    struct v4l2_plane planes[FMT_NUM_PLANES];
+    char text[256];
+    if (verbose)
+        printf("<<<<<<<<<<<od_results.count :%d<<<<<<<<<<<<<",od_results->count);
+    for (int i = 0; i < od_results->count; i++)
+    {
+        object_detect_result *det_result = &(od_results->results[i]);
+        if (verbose)
+            printf("%s @ (%d %d %d %d) %.3f\n", yolov5_cls_to_name(app_ctx, det_result->cls_id),
+                det_result->box.left, det_result->box.top,
+                det_result->box.right, det_result->box.bottom,
+                det_result->prop);
+        int x1 = det_result->box.left * scale_x;
+        int y1 = det_result->box.top * scale_y;
+        int x2 = det_result->box.right * scale_x;
+        int y2 = det_result->box.bottom * scale_y;
+
+        draw_rectangle(image, x1, y1, x2 - x1, y2 - y1, COLOR_BLUE, 3);
+
+        sprintf(text, "%s %.1f%%", yolov5_cls_to_name(app_ctx, det_result->cls_id), det_result->prop * 100);
+        if (det_result->sub_cls_id >= 0)
+        {
+            /* 二级分类结果接在检测类别后面，没有标签文件时显示类别号 */
+            const char *sub_name = cascade_cls_to_name(&cascade, det_result->sub_cls_id);
+            size_t len = strlen(text);
+            if (sub_name != NULL)
+                snprintf(text + len, sizeof(text) - len, " %s %.0f%%", sub_name, det_result->sub_prop * 100);
+            else
+                snprintf(text + len, sizeof(text) - len, " #%d %.0f%%", det_result->sub_cls_id, det_result->sub_prop * 100);
+            if (verbose)
+                printf("  -> %s\n", text);
+        }
+        draw_text(image, text, x1, y1 - 20, COLOR_GREEN, 10);
+    }
+}
 
-    unsigned char* nv12_data = (unsigned char*)malloc(frm_width * frm_height + (frm_width * frm_height / 2));
-    unsigned char* rgb_data = (unsigned char*)malloc(frm_width * frm_height * 4);
-    char* lcd_data1 = (char*)malloc(640 * 480 * 4);
-    char* lcd_data = (char*)malloc(1080 * 1920 * 4);
-    unsigned char* screen_base_temp_data = (unsigned char*)malloc(width * height * 4);
-    if (!nv12_data || !rgb_data) {
-        perror("Error allocating memory for image buffers");
+/* 出队一帧，拷贝到nv12缓冲后立即入队 */
+static int v4l2_grab_frame(struct v4l2_buffer *buf, image_buffer_t *nv12_image)
+{
+    if (ioctl(v4l2_fd, VIDIOC_DQBUF, buf) < 0) {
+        perror("failed to dequeue\n");
         return -1;
     }
+    unsigned long length = buf_infos[buf->index].length[0];
+    if (length > (unsigned long)nv12_image->size) {
+        length = nv12_image->size;
+    }
+    image_pool_sync(&image_pool, nv12_image, IMAGE_DEVICE_CPU, 1);
+    memcpy(nv12_image->virt_addr, buf_infos[buf->index].start[0], length);
+    ioctl(v4l2_fd, VIDIOC_QBUF, buf);
+    return 0;
+}
+
+/*
+ * 分块推理：推理帧切成网格，每块 letterbox 进自己的模型输入，由 batch 调度器凑成 batch
+ * 跑 batch 模型，每块的输出切片后各自后处理；高分辨率帧上的小目标不再被整帧缩小
+ */
+#define TILE_MAX 8
+#define TILE_BATCH_CORES 3          //rknn_set_batch_core_num，RK3588 三核分一个batch
+
+typedef struct {
+    image_rect_t rect;              //块在推理帧上的位置
+    image_rect_t box;               //letterbox 后在模型输入上的有效区域
+    image_buffer_t input;           //模型输入，填充色只填一次
+    object_detect_result_list results;
+    yolov5_batch_job_t job;
+    batch_item_t item;
+} tile_t;
+
+static tile_t tiles[TILE_MAX];
+static batch_sched_t tile_sched;
+
+static int init_tiles(rknn_app_context_t *app_ctx, int infer_w, int infer_h, int bg_color)
+{
+    /* 行列数之积正好是块数，推理帧长边方向的块多 */
+    int rows = 1;
+    for (int r = 1; r * r <= tile_num; r++) {
+        if (tile_num % r == 0)
+            rows = r;
+    }
+    int cols = tile_num / rows;
+    if (infer_h > infer_w) {
+        int t = rows;
+        rows = cols;
+        cols = t;
+    }
+    for (int i = 0; i < tile_num; i++) {
+        tile_t *tile = &tiles[i];
+        int c = i % cols;
+        int r = i / cols;
+        tile->rect.left = infer_w * c / cols;
+        tile->rect.right = infer_w * (c + 1) / cols - 1;
+        tile->rect.top = infer_h * r / rows;
+        tile->rect.bottom = infer_h * (r + 1) / rows - 1;
+
+        memset(&tile->input, 0, sizeof(image_buffer_t));
+        tile->input.width = app_ctx->model_width;
+        tile->input.height = app_ctx->model_height;
+        tile->input.format = IMAGE_FORMAT_RGB888;
+        if (image_pool_alloc(&image_pool, IMAGE_ROLE_MODEL_INPUT, &tile->input) != 0) {
+            printf("alloc tile input fail!\n");
+            return -1;
+        }
+        image_pool_sync(&image_pool, &tile->input, IMAGE_DEVICE_CPU, 1);
+        fill_image_color(&tile->input, bg_color);
+        get_letterbox(tile->rect.right - tile->rect.left + 1, tile->rect.bottom - tile->rect.top + 1,
+                      app_ctx->model_width, app_ctx->model_height, &tile->job.letter_box, &tile->box);
+        tile->job.img = &tile->input;
+        tile->job.od_results = &tile->results;
+        tile->item.data = &tile->job;
+    }
+    init_yolov5_batch(app_ctx, TILE_BATCH_CORES);
+    /* 块数多于模型batch时分几次跑，最后一个batch不满时等 tile_wait_us 后照跑 */
+    int batch_size = tile_num < app_ctx->batch ? tile_num : app_ctx->batch;
+    if (batch_sched_init(&tile_sched, batch_size, tile_wait_us, run_yolov5_batch, app_ctx) != 0)
+        return -1;
+    printf("tiles: %dx%d on %dx%d, batch %d, wait %lld us\n", cols, rows, infer_w, infer_h, batch_size,
+           (long long)tile_wait_us);
+    return 0;
+}
+
+static void release_tiles(void)
+{
+    batch_sched_deinit(&tile_sched);
+    for (int i = 0; i < tile_num; i++) {
+        if (tiles[i].input.virt_addr != NULL)
+            image_pool_release(&image_pool, &tiles[i].input);
+    }
+}
+
+/* 各块一起交给 batch 调度器，全部跑完才返回，检测框还在各块自己的坐标 */
+static int run_tiles(void)
+{
+    int posted = 0;
+    for (int i = 0; i < tile_num; i++) {
+        /* 打包输入时由CPU读 */
+        image_pool_sync(&image_pool, &tiles[i].input, IMAGE_DEVICE_CPU, 0);
+        if (batch_sched_post(&tile_sched, &tiles[i].item) != 0)
+            break;
+        posted++;
+    }
+    int ret = posted == tile_num ? 0 : -1;
+    for (int i = 0; i < posted; i++) {
+        if (batch_sched_wait(&tile_sched, &tiles[i].item) != 0)
+            ret = -1;
+    }
+    return ret;
+}
+
+/* 各块的检测框平移回推理帧坐标后合并；被块边界切开的目标各块各报一个框 */
+static void merge_tiles(object_detect_result_list *od_results)
+{
+    memset(od_results, 0, sizeof(object_detect_result_list));
+    for (int i = 0; i < tile_num; i++) {
+        tile_t *tile = &tiles[i];
+        od_results->candidates += tile->results.candidates;
+        od_results->clipped |= tile->results.clipped;
+        for (int j = 0; j < tile->results.count; j++) {
+            if (od_results->count == OBJ_NUMB_MAX_SIZE) {
+                od_results->clipped |= POST_PROCESS_CLIP_MAX_DET;
+                break;
+            }
+            object_detect_result *r = &od_results->results[od_results->count++];
+            *r = tile->results.results[j];
+            r->box.left += tile->rect.left;
+            r->box.right += tile->rect.left;
+            r->box.top += tile->rect.top;
+            r->box.bottom += tile->rect.top;
+            if (r->box.right > tile->rect.right)
+                r->box.right = tile->rect.right;
+            if (r->box.bottom > tile->rect.bottom)
+                r->box.bottom = tile->rect.bottom;
+        }
+    }
+}
+
+/*
+ * 本帧的颜色转换、旋转、letterbox（填充色在申请时已填好）合成一个job，异步提交，
+ * 由调度器选择RGA核；分块推理时 letterbox 换成每块一个缩放
+ */
+static int submit_preprocess(rga_scheduler_t *sched, rga_job_t *job, int *core, int64_t *est,
+                             image_buffer_t *nv12_image, image_buffer_t *rgb_image, image_buffer_t *rot_image,
+                             image_buffer_t *dst_img, letterbox_t *letter_box, int bg_color)
+{
+    /* 原始帧模式在原始帧上推理；否则由RGA旋转后再推理 */
+    image_buffer_t *infer_image = native_infer ? rgb_image : rot_image;
+    /* 缓存一致性：CPU写过的nv12先刷到内存，RGA要写的缓冲记下写者 */
+    image_pool_sync(&image_pool, nv12_image, IMAGE_DEVICE_RGA, 0);
+    image_pool_sync(&image_pool, rgb_image, IMAGE_DEVICE_RGA, 1);
+    if (!native_infer) {
+        image_pool_sync(&image_pool, rot_image, IMAGE_DEVICE_RGA, 1);
+    }
+    image_pool_sync(&image_pool, dst_img, IMAGE_DEVICE_RGA, 1);
+    for (int i = 0; i < tile_num; i++) {
+        image_pool_sync(&image_pool, &tiles[i].input, IMAGE_DEVICE_RGA, 1);
+    }
+
+    int ret = rga_job_begin(job);
+    if (ret == 0) {
+        ret = rga_job_add_cvtcolor(job, nv12_image, rgb_image);
+    }
+    if (ret == 0 && !native_infer) {
+        ret = rga_job_add_rotate(job, rgb_image, rot_image, 90);
+    }
+    for (int i = 0; i < tile_num && ret == 0; i++) {
+        ret = rga_job_add_convert(job, infer_image, &tiles[i].input, &tiles[i].rect, &tiles[i].box, 0, bg_color);
+    }
+    if (ret == 0 && tile_num == 0) {
+        ret = rga_job_add_letterbox(job, infer_image, dst_img, letter_box, 0, bg_color);
+    }
+    if (ret == 0) {
+        *core = rga_sched_submit(sched, job->work, job->task_count, est);
+        rga_job_set_core(job, rga_sched_core_id(*core));
+        ret = rga_job_submit(job, 1);
+    }
+    if (ret != 0) {
+        printf("rga preprocess job fail! ret=%d\n", ret);
+        rga_job_cancel(job);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * 行带模式：CPU按L2大小的行带从NV12直接做颜色转换+缩放+letterbox，
+ * 只读到双线性插值用到的源行，13M全分辨率帧也不会生成全尺寸RGB中间帧；
+ * 预览帧按屏幕大小生成，显示时再由RGA旋转
+ */
+static int stripe_preprocess(image_buffer_t *nv12_image, image_buffer_t *preview_image, image_buffer_t *dst_img,
+                             letterbox_t *letter_box)
+{
+    image_rect_t dst_box;
+    get_letterbox(nv12_image->width, nv12_image->height, dst_img->width, dst_img->height, letter_box, &dst_box);
+
+    image_pool_sync(&image_pool, nv12_image, IMAGE_DEVICE_CPU, 0);
+    image_pool_sync(&image_pool, dst_img, IMAGE_DEVICE_CPU, 1);
+    image_pool_sync(&image_pool, preview_image, IMAGE_DEVICE_CPU, 1);
+    /* 填充区在申请时已填好，只写有效区域 */
+    if (convert_image_cpu(nv12_image, dst_img, NULL, &dst_box, 0, 0) != 0 ||
+        convert_image_cpu(nv12_image, preview_image, NULL, NULL, 0, 0) != 0) {
+        printf("stripe preprocess fail!\n");
+        return -1;
+    }
+    return 0;
+}
+
+static int start_preprocess(rga_scheduler_t *sched, rga_job_t *job, int *core, int64_t *est,
+                            image_buffer_t *nv12_image, image_buffer_t *rgb_image, image_buffer_t *rot_image,
+                            image_buffer_t *dst_img, letterbox_t *letter_box, int bg_color)
+{
+    if (stripe_infer)
+        return stripe_preprocess(nv12_image, rgb_image, dst_img, letter_box);
+    return submit_preprocess(sched, job, core, est, nv12_image, rgb_image, rot_image, dst_img, letter_box, bg_color);
+}
+
+static int64_t get_time_us(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/* 记一个阶段的耗时，返回当前时间作为下一阶段的起点；没开 -p 时 npu_profile_stage 直接返回 */
+static int64_t profile_mark(const char *stage, int64_t since)
+{
+    int64_t now = get_time_us();
+    npu_profile_stage(&npu_prof, stage, now - since);
+    return now;
+}
+
+/*
+ * 输入尺寸策略：档位是按长边排序的不同尺寸，切换后至少保持 SHAPE_HOLD_FRAMES 帧，避免来回抖动
+ */
+#define SHAPE_HOLD_FRAMES 30
+
+typedef struct {
+    int level;          //当前档位
+    int levels;         //档位个数
+    int frames;         //距上次切换的帧数
+    float npu_ms;       //rknn_run 耗时的滑动平均
+} shape_state_t;
+
+static int shape_side(rknn_app_context_t *ctx, int shape)
+{
+    return ctx->shape_w[shape] > ctx->shape_h[shape] ? ctx->shape_w[shape] : ctx->shape_h[shape];
+}
+
+/* 根据本帧的NPU耗时和检测结果更新档位，返回新的shape */
+static int update_input_shape(shape_state_t *st, rknn_app_context_t *ctx, int infer_w, int infer_h,
+                              object_detect_result_list *od_results, float scale, float npu_ms)
+{
+    st->npu_ms = st->npu_ms > 0 ? st->npu_ms * 0.9f + npu_ms * 0.1f : npu_ms;
+    st->frames++;
+    int cur = select_yolov5_shape(ctx, infer_w, infer_h, st->level);
+    if (st->frames < SHAPE_HOLD_FRAMES || st->levels <= 1) {
+        return cur;
+    }
+
+    int level = st->level;
+    if (shape_policy == SHAPE_POLICY_LOAD) {
+        /* 耗时大致与输入面积成正比 */
+        if (st->npu_ms > npu_budget_ms && level > 0) {
+            level--;
+        } else if (level + 1 < st->levels) {
+            float ratio = (float)shape_side(ctx, select_yolov5_shape(ctx, infer_w, infer_h, level + 1)) /
+                          shape_side(ctx, cur);
+            if (st->npu_ms * ratio * ratio < npu_budget_ms * 0.8f)
+                level++;
+        }
+    } else if (shape_policy == SHAPE_POLICY_OBJECT) {
+        /* 最小目标在模型输入上的边长：太小升档，降档后仍够大则降档；没有目标时升档找远处的小目标 */
+        float min_side = -1.f;
+        for (int i = 0; i < od_results->count; i++) {
+            image_rect_t *box = &od_results->results[i].box;
+            float side = (box->right - box->left < box->bottom - box->top ? box->right - box->left
+                                                                          : box->bottom - box->top) * scale;
+            if (min_side < 0 || side < min_side)
+                min_side = side;
+        }
+        if ((min_side < 0 || min_side < 32.f) && level + 1 < st->levels) {
+            level++;
+        } else if (min_side >= 0 && level > 0) {
+            float ratio = (float)shape_side(ctx, select_yolov5_shape(ctx, infer_w, infer_h, level - 1)) /
+                          shape_side(ctx, cur);
+            if (min_side * ratio > 64.f)
+                level--;
+        }
+    }
+    if (level != st->level) {
+        st->level = level;
+        st->frames = 0;
+    }
+    return select_yolov5_shape(ctx, infer_w, infer_h, st->level);
+}
+
+/* 模型输入缓冲按最大shape申请，切换时只改宽高并重新填充 */
+static void resize_model_input(image_buffer_t *dst_img, rknn_app_context_t *ctx, int shape, int bg_color)
+{
+    dst_img->width = ctx->shape_w[shape];
+    dst_img->height = ctx->shape_h[shape];
+    image_pool_sync(&image_pool, dst_img, IMAGE_DEVICE_CPU, 1);
+    fill_image_color(dst_img, bg_color);
+    printf("model input -> %dx%d\n", dst_img->width, dst_img->height);
+}
+
+/* 保存全分辨率NV12原始帧，不经过RGB */
+static void save_snapshot(image_buffer_t *nv12_image)
+{
+    static int snapshot_index = 0;
+    char path[64];
+    snprintf(path, sizeof(path), "snapshot_%dx%d_%03d.data", nv12_image->width, nv12_image->height, snapshot_index++);
+    image_pool_sync(&image_pool, nv12_image, IMAGE_DEVICE_CPU, 0);
+    write_image(path, nv12_image);
+}
+
+static void on_snapshot_signal(int sig)
+{
+    (void)sig;
+    snapshot_requested = 1;
+}
+
+static void on_reload_signal(int sig)
+{
+    (void)sig;
+    reload_requested = 1;
+}
+
+/*
+ * NPU核掩码/上下文池自动调优：按模型大小+哈希查 NPU_TUNE_FILE，没有结果（或 -a）时先把所有组合测一遍再保存；
+ * 摄像头只有一路、检测每帧只跑一个上下文，用延迟最优（单上下文）的核掩码；
+ * 吞吐最优的上下文池大小和核掩码只保存，主程序还没有多路输入，用不上上下文池
+ */
+static void apply_npu_tune(const char *path)
+{
+    uint32_t size;
+    uint64_t hash;
+    if (npu_tune_model_key(path, &size, &hash) != 0) {
+        printf("npu tune: read %s fail\n", path);
+        return;
+    }
+    npu_tune_result_t best[2];
+    if (npu_tune_mode == 2 || npu_tune_load(NPU_TUNE_FILE, size, hash, NPU_TUNE_LATENCY, &best[NPU_TUNE_LATENCY]) != 0) {
+        if (npu_tune_run(path, 0, best) <= 0) {
+            return;
+        }
+        npu_tune_save(NPU_TUNE_FILE, size, hash, NPU_TUNE_THROUGHPUT, &best[NPU_TUNE_THROUGHPUT]);
+        npu_tune_save(NPU_TUNE_FILE, size, hash, NPU_TUNE_LATENCY, &best[NPU_TUNE_LATENCY]);
+    }
+    char desc[32];
+    printf("npu tune: cores %s, p50 %.2f ms\n", npu_tune_describe(&best[NPU_TUNE_LATENCY], desc, sizeof(desc)),
+           best[NPU_TUNE_LATENCY].p50_ms);
+    set_yolov5_core_mask(best[NPU_TUNE_LATENCY].core_masks[0]);
+}
+
+static int v4l2_read_data(void)
+{
+    struct v4l2_buffer buf = {0};
+    struct v4l2_plane planes[FMT_NUM_PLANES];
 
     buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
     buf.memory = V4L2_MEMORY_MMAP;
     buf.length = FMT_NUM_PLANES;
     buf.m.planes = planes;
     
-    const char *model_path = "../model/yolov5.rknn";
     int ret;
-    rknn_app_context_t rknn_app_ctx;
-    memset(&rknn_app_ctx, 0, sizeof(rknn_app_context_t));
+    rknn_app_context_t default_ctx;
+    memset(&default_ctx, 0, sizeof(rknn_app_context_t));
+    rknn_app_context_t *app_ctx = &default_ctx;
 
     init_post_process();
 
-    ret = init_yolov5_model(model_path, &rknn_app_ctx);
-    if (ret != 0)
+    /* 逐层耗时要在创建上下文时打开 */
+    if (profile_prefix != NULL)
+    {
+        set_yolov5_profiling(1);
+    }
+
+    /* 调优在创建检测上下文之前做，测量时NPU上没有别的负载 */
+    if (npu_tune_mode != 0)
+    {
+        const char *tune_path = model_path;
+        for (int i = 0; i < model_registry.count; i++)
+        {
+            if (detector_name == NULL || strcmp(model_registry.entries[i].name, detector_name) == 0)
+            {
+                tune_path = model_registry.entries[i].model_path;
+                break;
+            }
+        }
+        apply_npu_tune(tune_path);
+    }
+
+    /* 所有上下文都经内存管理器创建：同一模型共享权重，不同时运行的模型共享internal内存 */
+    if (npu_mem_flags != 0)
     {
-        printf("init_yolov5_model fail! ret=%d model_path=%s\n", ret, model_path);
+        npu_mem_init(&npu_mem, npu_mem_flags);
+        set_yolov5_npu_mem(&npu_mem);
     }
 
-    image_buffer_t src_image;
-    memset(&src_image, 0, sizeof(image_buffer_t));
+    model_entry_t *detector_entry = NULL;
+    if (model_registry.count > 0)
+    {
+        /* 按 -d 选注册表中的检测模型，首次使用时加载，自带 anchors 和标签 */
+        detector_entry = model_registry_acquire(&model_registry,
+                                                detector_name ? detector_name : model_registry.entries[0].name);
+        if (detector_entry == NULL)
+        {
+            return -1;
+        }
+        app_ctx = &detector_entry->ctx;
+        model_path = detector_entry->model_path;
+    }
+    else
+    {
+        ret = init_yolov5_model(model_path, app_ctx);
+        if (ret != 0)
+        {
+            printf("init_yolov5_model fail! ret=%d model_path=%s\n", ret, model_path);
+        }
+    }
+    if (npu_mem_flags != 0)
+    {
+        npu_mem_print_stats(&npu_mem);
+    }
+    if (tile_num > 0 && (stripe_infer || app_ctx->batch <= 1))
+    {
+        /* 行带模式没有全分辨率RGB帧可切块；batch 1 的模型没有可凑的槽 */
+        printf("分块推理需要batch模型且不能用行带模式，已关闭\n");
+        tile_num = 0;
+    }
+    if (app_ctx->batch > 1 && tile_num == 0)
+    {
+        /* 整帧推理只填第0个槽，用 -b 把推理帧切块凑满 batch */
+        printf("batch模型 batch=%d，整帧推理只用第0个槽\n", app_ctx->batch);
+    }
+    if (cascade_spec != NULL)
+    {
+        /* 二级分类器跑在另一个NPU核上；行带模式没有全分辨率RGB帧可裁剪 */
+        char classifier_path[512];
+        snprintf(classifier_path, sizeof(classifier_path), "%s", cascade_spec);
+        char *labels_path = strchr(classifier_path, ',');
+        if (labels_path != NULL)
+        {
+            *labels_path++ = '\0';
+        }
+        if (stripe_infer)
+        {
+            printf("行带模式不支持级联分类，已关闭\n");
+        }
+        else if (cascade_init(&cascade, classifier_path, labels_path, &cascade_config) != 0)
+        {
+            printf("级联分类器加载失败，只做检测\n");
+        }
+    }
+    if (profile_prefix != NULL && npu_profile_open(&npu_prof, profile_prefix, profile_interval) == 0)
+    {
+        printf("npu profile: %s_frames.csv, %s_layers.csv, %s.json\n", profile_prefix, profile_prefix, profile_prefix);
+    }
+
+    /*
+     * 检测和分类器各占一个调度槽（跑在不同NPU核上）：主线程设输入、取输出，worker线程只跑 rknn_run；
+     * 过了本帧截止时间还没轮到的推理直接丢弃，结果已经过期。槽里存的是上下文的地址，换模型后跟着新上下文
+     */
+    if (npu_sched_init(&npu_sched, NPU_SCHED_EDF, npu_sched_run_rknn) != 0)
+        return -1;
+    memset(npu_slots, 0, sizeof(npu_slots));
+    npu_slots[0].ctx[NPU_MODEL_DETECTOR] = &app_ctx->rknn_ctx;
+    npu_sched_add_context(&npu_sched, 1u << NPU_MODEL_DETECTOR, &npu_slots[0]);
+    if (cascade.rknn_ctx != 0)
+    {
+        npu_slots[1].ctx[NPU_MODEL_CASCADE] = &cascade.rknn_ctx;
+        npu_sched_add_context(&npu_sched, 1u << NPU_MODEL_CASCADE, &npu_slots[1]);
+        cascade.sched = &npu_sched;
+        cascade.sched_model = NPU_MODEL_CASCADE;
+    }
+    if (npu_sched_start(&npu_sched) != 0)
+        return -1;
+
     object_detect_result_list od_results;
-    cv::Mat src_frame;
-    for ( ; ; ) {
-        for(buf.index = 0; buf.index < FRAMEBUFFER_COUNT; buf.index++) {
-            // printf("Attempting to dequeue buffer with index: %d\n", buf.index);
-            if (ioctl(v4l2_fd, VIDIOC_DQBUF, &buf) < 0) {
-				perror("failed to dequeue\n");
-				return -1;
-			}
-           
-            memcpy(nv12_data, buf_infos[buf.index].start[0], buf_infos[buf.index].length[0]);
-            
-            rga_cvcolor(nv12_data, rgb_data, frm_width, frm_height, frm_width, frm_height, RK_FORMAT_YCbCr_420_SP, RK_FORMAT_RGB_888);
-            
-            cv::Mat rgb_image(frm_height, frm_width, CV_8UC3, rgb_data);
-            cv::rotate(rgb_image, src_frame, cv::ROTATE_90_COUNTERCLOCKWISE);
-            src_image.height = src_frame.rows;
-            src_image.width = src_frame.cols;
-            src_image.width_stride = src_frame.step[0];
-            src_image.virt_addr = src_frame.data;
-            src_image.format = IMAGE_FORMAT_RGB888;
-            src_image.size = src_frame.total() * src_frame.elemSize();
-
-            image_buffer_t dst_img;
-            letterbox_t letter_box;
-            rknn_input inputs[rknn_app_ctx.io_num.n_input];
-            rknn_output outputs[rknn_app_ctx.io_num.n_output];
-            const float nms_threshold = NMS_THRESH;      // Default NMS threshold
-            const float box_conf_threshold = BOX_THRESH; // Default box threshold
-            int bg_color = 114;
+    int bg_color = 114;
+    const float nms_threshold = NMS_THRESH;      // Default NMS threshold
+    const float box_conf_threshold = BOX_THRESH; // Default box threshold
 
-            memset(&od_results, 0x00, sizeof(od_results));
-            memset(&letter_box, 0, sizeof(letterbox_t));
-            memset(&dst_img, 0, sizeof(image_buffer_t));
-            memset(inputs, 0, sizeof(inputs));
-            memset(outputs, 0, sizeof(outputs));
-
-            // Pre Process
-            dst_img.width = rknn_app_ctx.model_width;
-            dst_img.height = rknn_app_ctx.model_height;
-            dst_img.format = IMAGE_FORMAT_RGB888;
-            dst_img.size = get_image_size(&dst_img);
-            dst_img.virt_addr = (unsigned char *)malloc(dst_img.size);
-            if (dst_img.virt_addr == NULL)
-            {
-                printf("malloc buffer size:%d fail!\n", dst_img.size);
+    /*
+     * 所有图像缓冲都从缓冲池申请（带fd，RGA不用再锁页），按用途选择带不带cache的heap；
+     * 模型输入缓冲只申请一次，填充色也只填一次，每帧只重写有效区域。缓冲池在 main 中初始化
+     */
+    image_buffer_t dst_img;
+    memset(&dst_img, 0, sizeof(image_buffer_t));
+    dst_img.width = app_ctx->max_width;
+    dst_img.height = app_ctx->max_height;
+    dst_img.format = IMAGE_FORMAT_RGB888;
+    if (image_pool_alloc(&image_pool, IMAGE_ROLE_MODEL_INPUT, &dst_img) != 0)
+    {
+        printf("alloc model input fail!\n");
+        return -1;
+    }
+    dst_img.width = app_ctx->model_width;
+    dst_img.height = app_ctx->model_height;
+    /* RGA填不了时退回memset，按CPU写处理，提交预处理前会刷cache */
+    image_pool_sync(&image_pool, &dst_img, IMAGE_DEVICE_CPU, 1);
+    fill_image_color(&dst_img, bg_color);
+
+    /*
+     * 动态shape：推理帧（原始帧模式不旋转）按策略选输入尺寸。frame_shapes 记录每组缓冲
+     * 预处理时用的shape，NPU 推理到该帧时才切换模型shape，post_process 的网格跟着变
+     */
+    int infer_w = native_infer ? frm_width : frm_height;
+    int infer_h = native_infer ? frm_height : frm_width;
+    shape_state_t shape_state;
+    memset(&shape_state, 0, sizeof(shape_state));
+    int frame_shapes[2] = {-1, -1};
+    int dst_shape = -1, pending_shape = -1;
+    if (shape_policy != SHAPE_POLICY_NONE && (app_ctx->shape_num == 0 || tile_num > 0)) {
+        printf("static shape model or tiles, input size policy ignored\n");
+        shape_policy = SHAPE_POLICY_NONE;
+    }
+    if (tile_num > 0 && init_tiles(app_ctx, infer_w, infer_h, bg_color) != 0)
+        return -1;
+    if (shape_policy != SHAPE_POLICY_NONE) {
+        shape_state.levels = get_yolov5_shape_levels(app_ctx);
+        /* 从最大尺寸开始 */
+        shape_state.level = shape_state.levels - 1;
+        dst_shape = pending_shape = select_yolov5_shape(app_ctx, infer_w, infer_h, shape_state.level);
+        resize_model_input(&dst_img, app_ctx, dst_shape, bg_color);
+        frame_shapes[0] = dst_shape;
+    }
+
+    image_buffer_t nv12_image;
+    memset(&nv12_image, 0, sizeof(image_buffer_t));
+    nv12_image.width = frm_width;
+    nv12_image.height = frm_height;
+    nv12_image.width_stride = frm_stride;
+    nv12_image.format = IMAGE_FORMAT_YUV420SP_NV12;
+
+    /*
+     * RGB帧和旋转后的竖屏帧都是双缓冲：第N帧画框、显示时，RGA已经在另一组缓冲上
+     * 准备第N+1帧，画框直接画在旋转帧上，不再拷贝
+     */
+    image_buffer_t rgb_images[2];
+    image_buffer_t rot_images[2];
+    memset(rgb_images, 0, sizeof(rgb_images));
+    memset(rot_images, 0, sizeof(rot_images));
+    for (int i = 0; i < 2; i++) {
+        rgb_images[i].width = frm_width;
+        rgb_images[i].height = frm_height;
+        rgb_images[i].format = IMAGE_FORMAT_RGB888;
+
+        rot_images[i].width = frm_height;
+        rot_images[i].height = frm_width;
+        rot_images[i].format = IMAGE_FORMAT_RGB888;
+        if (stripe_infer) {
+            /* 行带模式的RGB帧只是未旋转的预览，按屏幕大小 */
+            rgb_images[i].width = height;
+            rgb_images[i].height = width;
+        }
+    }
+
+    image_buffer_t lcd_image;
+    memset(&lcd_image, 0, sizeof(image_buffer_t));
+    lcd_image.width = width;
+    lcd_image.height = height;
+    lcd_image.width_stride = line_length;   //和显存行宽一致，上屏时整块拷贝
+    lcd_image.format = IMAGE_FORMAT_RGBA8888;
+
+    /*
+     * RGB帧只给RGA读，放不带cache的heap；旋转帧要画框，放带cache的heap；
+     * 行带模式的预览帧由CPU写，放带cache的heap，且不需要旋转帧
+     */
+    image_role_t rgb_role = stripe_infer ? IMAGE_ROLE_DRAW : IMAGE_ROLE_DEVICE;
+    if (image_pool_alloc(&image_pool, IMAGE_ROLE_CAPTURE, &nv12_image) != 0 ||
+        image_pool_alloc(&image_pool, rgb_role, &rgb_images[0]) != 0 ||
+        image_pool_alloc(&image_pool, rgb_role, &rgb_images[1]) != 0 ||
+        (!stripe_infer && image_pool_alloc(&image_pool, IMAGE_ROLE_DRAW, &rot_images[0]) != 0) ||
+        (!stripe_infer && image_pool_alloc(&image_pool, IMAGE_ROLE_DRAW, &rot_images[1]) != 0) ||
+        image_pool_alloc(&image_pool, IMAGE_ROLE_DISPLAY, &lcd_image) != 0) {
+        perror("Error allocating memory for image buffers");
+        return -1;
+    }
+
+    rga_scheduler_t rga_sched;
+    rga_sched_init(&rga_sched, 0);
+    rga_job_t pre_job, disp_job;
+    int64_t pre_est = 0, disp_est = 0;
+    int pre_core = -1, disp_core = -1;
+    int display_pending = 0;    // 上一帧的显示job已提交、还没上屏
+    int frame_index = 0;
+    letterbox_t letter_boxes[2];
+    memset(letter_boxes, 0, sizeof(letter_boxes));
+    memset(&od_results, 0x00, sizeof(od_results));
+
+    /* 第0帧的预处理先提交，循环里每次都提前提交下一帧 */
+    if (v4l2_grab_frame(&buf, &nv12_image) != 0 ||
+        start_preprocess(&rga_sched, &pre_job, &pre_core, &pre_est, &nv12_image, &rgb_images[0], &rot_images[0],
+                         &dst_img, &letter_boxes[0], bg_color) != 0) {
+        return -1;
+    }
+
+    for ( ; ; ) {
+        int cur = frame_index & 1;
+        int next = cur ^ 1;
+        rknn_output outputs[app_ctx->io_num.n_output];
+        memset(outputs, 0, sizeof(outputs));
+        int64_t stage_start = get_time_us();
+        int64_t frame_deadline = frame_deadline_ms > 0 ? npu_sched_now_us() + (int64_t)(frame_deadline_ms * 1000) : 0;
+        int det_dropped = 0;    // 检测推理没赶上截止时间，本帧没有检测结果
+
+        /* NPU要读输入了，这里才等本帧的预处理完成（行带模式已同步完成） */
+        if (!stripe_infer) {
+            if (rga_job_wait(&pre_job) != 0) {
                 return -1;
             }
-
-            // letterbox
-            ret = convert_image_with_letterbox(&src_image, &dst_img, &letter_box, bg_color);
-            if (ret < 0)
-            {
-                printf("convert_image_with_letterbox fail! ret=%d\n", ret);
+            rga_sched_job_done(&rga_sched, pre_core, pre_est, pre_job.latency_us);
+        }
+        stage_start = profile_mark("pre_wait", stage_start);
+        /* 本帧按新的shape做的预处理，推理前切换模型shape */
+        if (frame_shapes[cur] >= 0 &&
+            set_yolov5_input_shape(app_ctx, app_ctx->shape_w[frame_shapes[cur]],
+                                   app_ctx->shape_h[frame_shapes[cur]]) != 0) {
+            return -1;
+        }
+        int64_t run_start = stage_start;
+        if (tile_num > 0) {
+            /* 分块推理：各块凑成batch，推理和每块的后处理都在 batch 调度器线程里做完 */
+            if (run_tiles() != 0) {
+                printf("tile batch fail!\n");
                 return -1;
             }
-
-            // Set Input Data
-            inputs[0].index = 0;
-            inputs[0].type = RKNN_TENSOR_UINT8;
-            inputs[0].fmt = RKNN_TENSOR_NHWC;
-            inputs[0].size = rknn_app_ctx.model_width * rknn_app_ctx.model_height * rknn_app_ctx.model_channel;
-            inputs[0].buf = dst_img.virt_addr;
-
-            ret = rknn_inputs_set(rknn_app_ctx.rknn_ctx, rknn_app_ctx.io_num.n_input, inputs);
+        } else {
+            /* rknn_inputs_set 由CPU拷贝输入 */
+            image_pool_sync(&image_pool, &dst_img, IMAGE_DEVICE_CPU, 0);
+
+            // Set Input Data：按模型原生布局打包，填充行不变，只打包letterbox有效区域（上下各多一行防取整）
+            int pack_begin = letter_boxes[cur].y_pad - 1;
+            int pack_end = app_ctx->model_height - letter_boxes[cur].y_pad + 1;
+            ret = set_yolov5_input(app_ctx, &dst_img, pack_begin, pack_end);
             if (ret < 0)
             {
-                printf("rknn_input_set fail! ret=%d\n", ret);
                 return -1;
             }
-            free(dst_img.virt_addr);
             // Run
             printf("rknn_run\n");
-            ret = rknn_run(rknn_app_ctx.rknn_ctx, nullptr);
-            if (ret < 0)
+            run_start = profile_mark("set_input", stage_start);
+            npu_job_t det_job;
+            memset(&det_job, 0, sizeof(det_job));
+            det_job.model = NPU_MODEL_DETECTOR;
+            det_job.priority = NPU_PRIO_HIGH;
+            det_job.deadline_us = frame_deadline;
+            ret = npu_sched_submit(&npu_sched, &det_job);
+            det_dropped = det_job.dropped;
+            if (ret < 0 && !det_dropped)
             {
                 printf("rknn_run fail! ret=%d\n", ret);
                 return -1;
             }
+        }
+        stage_start = profile_mark("npu_run", run_start);
+        float npu_ms = (stage_start - run_start) / 1000.f;
+
+        /*
+         * 下一帧要写的缓冲正被上一帧的显示job读，先等它完成并上屏；
+         * 原始帧模式的框画在LCD缓冲上，此时 od_results 还是上一帧的结果
+         */
+        if (display_pending) {
+            rga_job_wait(&disp_job);
+            rga_sched_job_done(&rga_sched, disp_core, disp_est, disp_job.latency_us);
+            if (native_infer) {
+                /* 旋转后帧的宽高为 frm_height x frm_width */
+                image_pool_sync(&image_pool, &lcd_image, IMAGE_DEVICE_CPU, 1);
+                draw_results(app_ctx, &lcd_image, &od_results, (float)width / frm_height, (float)height / frm_width);
+            } else {
+                image_pool_sync(&image_pool, &lcd_image, IMAGE_DEVICE_CPU, 0);
+            }
+            memcpy(screen_base, lcd_image.virt_addr, lcd_image.size);
+            display_pending = 0;
+        }
+        stage_start = profile_mark("display", stage_start);
+
+        /* 输入已经交给NPU，提交下一帧的预处理，和本帧的后处理、画框并行 */
+        if (v4l2_grab_frame(&buf, &nv12_image) != 0) {
+            return -1;
+        }
+        if (snapshot_requested) {
+            snapshot_requested = 0;
+            save_snapshot(&nv12_image);
+        }
+        /* 上一帧定下的新尺寸从下一帧的预处理开始生效 */
+        if (pending_shape != dst_shape) {
+            dst_shape = pending_shape;
+            resize_model_input(&dst_img, app_ctx, dst_shape, bg_color);
+        }
+        frame_shapes[next] = dst_shape;
+        if (start_preprocess(&rga_sched, &pre_job, &pre_core, &pre_est, &nv12_image, &rgb_images[next],
+                             &rot_images[next], &dst_img, &letter_boxes[next], bg_color) != 0) {
+            return -1;
+        }
+        stage_start = profile_mark("capture_pre", stage_start);
 
+        if (tile_num > 0) {
+            merge_tiles(&od_results);
+        } else if (det_dropped) {
+            memset(&od_results, 0x00, sizeof(od_results));
+        } else {
             // Get Output
-            memset(outputs, 0, sizeof(outputs));
-            for (int i = 0; i < rknn_app_ctx.io_num.n_output; i++)
+            for (uint32_t i = 0; i < app_ctx->io_num.n_output; i++)
             {
                 outputs[i].index = i;
-                outputs[i].want_float = (!rknn_app_ctx.is_quant);
+                outputs[i].want_float = (!app_ctx->is_quant && !app_ctx->is_fp16);
             }
-            ret = rknn_outputs_get(rknn_app_ctx.rknn_ctx, rknn_app_ctx.io_num.n_output, outputs, NULL);
+            ret = rknn_outputs_get(app_ctx->rknn_ctx, app_ctx->io_num.n_output, outputs, NULL);
+            stage_start = profile_mark("outputs_get", stage_start);
             // Post Process
-            post_process(&rknn_app_ctx, outputs, &letter_box, box_conf_threshold, nms_threshold, &od_results);
-
-            // Remeber to release rknn output
-            rknn_outputs_release(rknn_app_ctx.rknn_ctx, rknn_app_ctx.io_num.n_output, outputs);
-            // 画框
-            char text[256];
-            printf("<<<<<<<<<<<od_results.count :%d<<<<<<<<<<<<<",od_results.count);
-            for (int i = 0; i < od_results.count; i++)
-            {
-                object_detect_result *det_result = &(od_results.results[i]);
-                printf("%s @ (%d %d %d %d) %.3f\n", coco_cls_to_name(det_result->cls_id),
-                    det_result->box.left, det_result->box.top,
-                    det_result->box.right, det_result->box.bottom,
-                    det_result->prop);
-                int x1 = det_result->box.left;
-                int y1 = det_result->box.top;
-                int x2 = det_result->box.right;
-                int y2 = det_result->box.bottom;
-
-                draw_rectangle(&src_image, x1, y1, x2 - x1, y2 - y1, COLOR_BLUE, 3);
-
-                sprintf(text, "%s %.1f%%", coco_cls_to_name(det_result->cls_id), det_result->prop * 100);
-                draw_text(&src_image, text, x1, y1 - 20, COLOR_GREEN, 10);
-            }
-            std::memcpy(lcd_data1, src_image.virt_addr, src_image.size);
-            rga_resize(lcd_data1, lcd_data, 480, 640, width, height, RK_FORMAT_BGR_888, RK_FORMAT_RGBA_8888);
-            memcpy(screen_base, lcd_data, width*height*4);
+            memset(&od_results, 0x00, sizeof(od_results));
+            post_process(app_ctx, outputs, &letter_boxes[cur], box_conf_threshold, nms_threshold, &od_results);
+        }
+        if (od_results.clipped)
+        {
+            printf("post_process clipped: candidates=%d flags=0x%x\n", od_results.candidates, od_results.clipped);
+        }
+        if (cascade.rknn_ctx != 0) {
+            /* 检测框还在推理帧坐标，RGA从推理帧把选中的框直接缩放进分类器的batch输入 */
+            image_buffer_t *infer_image = native_infer ? &rgb_images[cur] : &rot_images[cur];
+            image_pool_sync(&image_pool, infer_image, IMAGE_DEVICE_RGA, 0);
+            cascade_run(&cascade, infer_image, &od_results, frame_deadline);
+            stage_start = profile_mark("cascade", stage_start);
+        }
+        if (shape_policy != SHAPE_POLICY_NONE) {
+            /* 检测框还在推理帧坐标，乘 letterbox 比例即为模型输入上的大小 */
+            pending_shape = update_input_shape(&shape_state, app_ctx, infer_w, infer_h, &od_results,
+                                               letter_boxes[cur].scale, npu_ms);
+        }
 
-            // 数据处理完之后、再入队、往复
-            ioctl(v4l2_fd, VIDIOC_QBUF, &buf);
+        if (native_infer) {
+            /* 检测框旋转到竖屏坐标，与 cv::ROTATE_90_COUNTERCLOCKWISE 一致 */
+            rotate_detect_results(&od_results, frm_width, frm_height, 90);
+        }
+
+        // Remeber to release rknn output
+        if (tile_num == 0 && !det_dropped)
+            rknn_outputs_release(app_ctx->rknn_ctx, app_ctx->io_num.n_output, outputs);
+        stage_start = profile_mark("post_process", stage_start);
+        /* 换模型前查询，本帧的NPU耗时属于跑它的上下文 */
+        npu_profile_end_frame(&npu_prof, app_ctx->rknn_ctx);
+
+        /* 换模型：新模型在后台加载、预热，本帧输出已释放，旧上下文没有在途推理，在这里切换 */
+        if (reload_requested) {
+            reload_requested = 0;
+            /* 注册表模型按它自己的 anchors 和标签重新加载 */
+            if (detector_entry != NULL)
+                start_yolov5_reload(&model_reload, model_path, detector_entry->anchors_path,
+                                    detector_entry->labels_path, 3);
+            else
+                start_yolov5_reload(&model_reload, model_path, NULL, NULL, 3);
+        }
+        /* 新模型文件的NPU内存可能变了，注册表的预算跟着更新 */
+        if (poll_yolov5_reload(&model_reload, app_ctx) == 1) {
+            if (detector_entry != NULL)
+                model_registry_update_mem(&model_registry, detector_entry);
+            /* batch 分核的设置跟着上下文走 */
+            if (tile_num > 0)
+                init_yolov5_batch(app_ctx, TILE_BATCH_CORES);
         }
+        /* 新上下文要的internal内存更大时只给了它新缓冲，其余上下文在帧间才切过去 */
+        if (npu_mem_flags & NPU_MEM_SHARE_INTERNAL)
+            npu_mem_apply_internal(&npu_mem);
+
+        /* 画框后异步提交显示job；原始帧模式显示时由RGA同时完成旋转和缩放 */
+        image_buffer_t *disp_src = native_infer ? &rgb_images[cur] : &rot_images[cur];
+        if (!native_infer) {
+            image_pool_sync(&image_pool, disp_src, IMAGE_DEVICE_CPU, 1);
+            draw_results(app_ctx, disp_src, &od_results, 1.0f, 1.0f);
+        }
+        image_pool_sync(&image_pool, disp_src, IMAGE_DEVICE_RGA, 0);
+        image_pool_sync(&image_pool, &lcd_image, IMAGE_DEVICE_RGA, 1);
+        ret = rga_job_begin(&disp_job);
+        if (ret == 0) {
+            ret = rga_job_add_resize(&disp_job, disp_src, &lcd_image, native_infer ? 90 : 0, RGA_JOB_SWAP_RB);
+        }
+        if (ret == 0) {
+            disp_core = rga_sched_submit(&rga_sched, disp_job.work, disp_job.task_count, &disp_est);
+            rga_job_set_core(&disp_job, rga_sched_core_id(disp_core));
+            ret = rga_job_submit(&disp_job, 1);
+        }
+        if (ret == 0) {
+            display_pending = 1;
+        } else {
+            printf("rga display job fail! ret=%d\n", ret);
+            rga_job_cancel(&disp_job);
+        }
+        profile_mark("draw_submit", stage_start);
+
+        frame_index++;
+        if (frame_index % 300 == 0) {
+            rga_sched_print_stats(&rga_sched, 0);
+            image_pool_print_stats(&image_pool);
+            if (dispatch_profile != NULL)
+                image_dispatch_print_stats();
+            if (model_registry.count > 0)
+                model_registry_print_stats(&model_registry);
+            if (npu_mem_flags != 0)
+                npu_mem_print_stats(&npu_mem);
+            if (cascade.rknn_ctx != 0)
+                cascade_print_stats(&cascade);
+            if (tile_num > 0)
+                batch_sched_print_stats(&tile_sched);
+            npu_sched_print_stats(&npu_sched);
+        }
+    }
+    npu_profile_close(&npu_prof);
+    npu_sched_deinit(&npu_sched);
+    cascade_release(&cascade);
+    release_tiles();
+    image_pool_release(&image_pool, &dst_img);
+    image_pool_release(&image_pool, &nv12_image);
+    for (int i = 0; i < 2; i++) {
+        image_pool_release(&image_pool, &rgb_images[i]);
+        if (!stripe_infer)
+            image_pool_release(&image_pool, &rot_images[i]);
     }
-    free(nv12_data);
-    free(rgb_data);
-    free(lcd_data);
-    free(lcd_data1);
+    image_pool_release(&image_pool, &lcd_image);
+    image_pool_deinit(&image_pool);
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-n hard|agnostic|soft|matrix|diou] [-K topk] [-X max_det] [-r] [-P profile] [-t threads] [-s WxH] [-S] [-D aspect|load|object] [-B ms]\n"
+                    "          [-m name=model.rknn[,anchors,labels]]... [-d name] [-M MB]\n"
+                    "          [-N weights,internal,sram,share-sram] [-p prefix[,frames]]\n"
+                    "          [-C classifier.rknn[,labels.txt]] [-c cls+cls...] [-k crops] [-A|-a] [-b tiles[,wait_ms]] [-E ms] [-v] <video_dev>\n", prog);
+    fprintf(stderr, "  -K  candidates sorted and fed to NMS per frame, highest scores first, 0: no limit (default %d)\n", PRE_NMS_TOPK);
+    fprintf(stderr, "  -X  detections kept per frame after NMS, at most %d (default %d)\n", OBJ_NUMB_MAX_SIZE, OBJ_NUMB_MAX_SIZE);
+    fprintf(stderr, "  -r  infer on the unrotated camera frame, rotate boxes and display only\n");
+    fprintf(stderr, "  -P  route convert_image between RGA and CPU, costs from (or calibrated into) profile\n");
+    fprintf(stderr, "  -t  threads for CPU image conversion, 0: all cores (default 1, all cores with -S)\n");
+    fprintf(stderr, "  -s  capture size, e.g. 4208x3120 (default 640x480)\n");
+    fprintf(stderr, "  -S  stripe mode: model input and preview straight from NV12 on the CPU, implies -r\n");
+    fprintf(stderr, "  -D  dynamic shape model: aspect: largest size matched to the frame aspect,\n"
+                    "      load: switch sizes to keep NPU time under -B, object: switch sizes by object size\n");
+    fprintf(stderr, "  -B  NPU time budget per frame in ms for -D load (default 33)\n");
+    fprintf(stderr, "  -m  register a detector with its own anchors and labels, loaded on first use\n");
+    fprintf(stderr, "  -d  registered detector to run (default the first -m)\n");
+    fprintf(stderr, "  -M  NPU memory budget of all loaded detectors in MB, least recently used evicted (default no limit)\n");
+    fprintf(stderr, "  -N  NPU memory sharing: weights: same model loaded twice shares weights,\n"
+                    "      internal: one internal buffer for models that never run at the same time,\n"
+                    "      sram / share-sram: let the runtime put internal buffers in SRAM (shared between contexts)\n");
+    fprintf(stderr, "  -p  profile: per frame stage and NPU times to prefix_frames.csv, per layer NPU times\n"
+                    "      every frames frames (default 100) to prefix_layers.csv and prefix.json; slows the NPU down\n");
+    fprintf(stderr, "  -C  classify detection boxes with a second model on NPU core 2 at low NPU priority, crops scaled by RGA into its batch input\n");
+    fprintf(stderr, "  -c  detector class ids sent to the classifier, e.g. 0+2 (default all)\n");
+    fprintf(stderr, "  -k  crops classified per frame, highest scores first (default 8)\n");
+    fprintf(stderr, "  -A  run the detector on its tuned NPU cores from " NPU_TUNE_FILE ", tune the model first if it is not there\n");
+    fprintf(stderr, "  -a  tune again: measure core masks and context pool sizes, save the winners\n");
+    fprintf(stderr, "  -b  batch model: split the inference frame into tiles (up to %d) that fill its batch, one rknn_run per batch;\n"
+                    "      a batch that is not full runs after wait_ms (default 2), best with tiles a multiple of the batch\n", TILE_MAX);
+    fprintf(stderr, "  -E  frame deadline in ms from the start of the frame, detector and classifier runs that cannot\n"
+                    "      start before it are dropped, 0: none (default 100)\n");
+    fprintf(stderr, "  -v  print every detection and its classification each frame\n");
+    fprintf(stderr, "  SIGUSR1 saves the next full resolution NV12 frame as snapshot_WxH_NNN.data\n");
+    fprintf(stderr, "  SIGHUP reloads the running model file in the background and swaps it in between frames\n");
 }
 
 int main(int argc, char **argv)
 {
-    if (2 != argc) {
-        fprintf(stderr, "Usage: %s <video_dev>\n", argv[0]);
+    post_process_config_t pp_config;
+    get_post_process_config(&pp_config);
+
+    int cpu_threads = -1;
+    int opt;
+    model_registry_init(&model_registry, 0);
+    cascade_default_config(&cascade_config);
+    while ((opt = getopt(argc, argv, "n:K:X:rP:t:s:SD:B:m:d:M:N:p:C:c:k:Aab:E:v")) != -1) {
+        switch (opt) {
+        case 'n': {
+            /* NMS 算法 */
+            int method = nms_method_from_name(optarg);
+            if (method < 0) {
+                fprintf(stderr, "unknown nms method %s\n", optarg);
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            pp_config.nms_method = (nms_method_t)method;
+            break;
+        }
+        case 'K':
+            /* NMS 前的候选框上限，限制后处理的最坏耗时 */
+            pp_config.pre_nms_topk = atoi(optarg);
+            break;
+        case 'X':
+            /* NMS 后保留的检测框上限 */
+            pp_config.max_det = atoi(optarg);
+            if (pp_config.max_det <= 0 || pp_config.max_det > OBJ_NUMB_MAX_SIZE) {
+                fprintf(stderr, "max detections must be 1..%d\n", OBJ_NUMB_MAX_SIZE);
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'r':
+            /* 原始帧推理 */
+            native_infer = 1;
+            break;
+        case 'P':
+            /* RGA/CPU 代价模型文件 */
+            dispatch_profile = optarg;
+            break;
+        case 't':
+            /* CPU 图像转换线程数 */
+            cpu_threads = atoi(optarg);
+            break;
+        case 's':
+            /* 采集分辨率 */
+            if (sscanf(optarg, "%dx%d", &cap_width, &cap_height) != 2 || cap_width <= 0 || cap_height <= 0) {
+                fprintf(stderr, "invalid capture size %s\n", optarg);
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'S':
+            /* 行带模式，在原始帧上推理 */
+            stripe_infer = 1;
+            native_infer = 1;
+            break;
+        case 'D':
+            /* 动态shape输入尺寸策略 */
+            if (strcmp(optarg, "aspect") == 0) {
+                shape_policy = SHAPE_POLICY_ASPECT;
+            } else if (strcmp(optarg, "load") == 0) {
+                shape_policy = SHAPE_POLICY_LOAD;
+            } else if (strcmp(optarg, "object") == 0) {
+                shape_policy = SHAPE_POLICY_OBJECT;
+            } else {
+                fprintf(stderr, "unknown input size policy %s\n", optarg);
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'B':
+            npu_budget_ms = atof(optarg);
+            break;
+        case 'm':
+            /* 注册检测模型 name=model.rknn[,anchors.txt[,labels.txt]] */
+            if (model_registry_add_spec(&model_registry, optarg) < 0) {
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'd':
+            detector_name = optarg;
+            break;
+        case 'M':
+            /* 所有已加载模型的NPU内存预算，MB */
+            model_registry.mem_budget = (uint64_t)(atof(optarg) * 1024 * 1024);
+            break;
+        case 'N':
+            /* NPU内存共享选项 */
+            npu_mem_flags = npu_mem_flags_from_string(optarg);
+            if (npu_mem_flags < 0) {
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'p': {
+            /* 性能分析输出前缀[,逐层采样间隔帧数] */
+            char *comma = strchr(optarg, ',');
+            if (comma != NULL) {
+                *comma = '\0';
+                profile_interval = atoi(comma + 1);
+            }
+            profile_prefix = optarg;
+            break;
+        }
+        case 'C':
+            /* 二级分类模型[,标签文件] */
+            cascade_spec = optarg;
+            break;
+        case 'c':
+            if (cascade_parse_classes(&cascade_config, optarg) != 0) {
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'k':
+            /* 每帧分类的框数上限，限制级联的延迟 */
+            cascade_config.max_crops = atoi(optarg);
+            break;
+        case 'A':
+            if (npu_tune_mode == 0)
+                npu_tune_mode = 1;
+            break;
+        case 'a':
+            npu_tune_mode = 2;
+            break;
+        case 'b': {
+            /* 分块数[,凑batch最长等待ms] */
+            char *comma = strchr(optarg, ',');
+            if (comma != NULL)
+                tile_wait_us = (int64_t)(atof(comma + 1) * 1000);
+            tile_num = atoi(optarg);
+            if (tile_num < 1 || tile_num > TILE_MAX) {
+                fprintf(stderr, "tiles must be 1..%d\n", TILE_MAX);
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        }
+        case 'E':
+            /* 每帧截止时间，过期的推理丢弃 */
+            frame_deadline_ms = atof(optarg);
+            break;
+        case 'v':
+            verbose = 1;
+            break;
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (optind + 1 != argc) {
+        usage(argv[0]);
         exit(EXIT_FAILURE);
     }
+    set_post_process_config(&pp_config);
+    printf("nms method: %s, pre-nms top-k %d, max detections %d\n", nms_method_name(pp_config.nms_method),
+           pp_config.pre_nms_topk, pp_config.max_det);
 
     printf("%s\n",querystring(RGA_VERSION));
 
+    signal(SIGUSR1, on_snapshot_signal);
+    signal(SIGHUP, on_reload_signal);
+
+    /* CPU 图像转换按行带分给多个线程，先于代价标定；行带模式默认用满所有核 */
+    if (cpu_threads < 0)
+        cpu_threads = stripe_infer ? 0 : 1;
+    if (cpu_threads != 1 && image_threads_init(cpu_threads) == 0)
+        printf("cpu image threads: %d\n", image_threads_count());
+
+    image_pool_init(&image_pool);
+
+    /* 按代价模型在 RGA 与 CPU 之间分派 convert_image，标定用缓冲池的 DMA 缓冲，与运行时一致 */
+    if (dispatch_profile != NULL)
+    {
+        image_dispatch_allocator_t calib_allocator;
+        image_pool_dispatch_allocator(&image_pool, &calib_allocator);
+        if (image_dispatch_init(dispatch_profile, &calib_allocator) != 0)
+            printf("image dispatch disabled\n");
+    }
+
     /* 初始化LCD */
     if (fb_dev_init())
         exit(EXIT_FAILURE);
 
     /* 初始化摄像头 */
-    if (v4l2_dev_init(argv[1]))
+    if (v4l2_dev_init(argv[optind]))
         exit(EXIT_FAILURE);
 
     /* 枚举所有格式并打印摄像头支持的分辨率及帧率 */
@@ -0,0 +1,246 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "model_registry.h"
+
+void model_registry_init(model_registry_t *reg, uint64_t mem_budget)
+{
+    memset(reg, 0, sizeof(model_registry_t));
+    reg->mem_budget = mem_budget;
+}
+
+static void unload_entry(model_registry_t *reg, model_entry_t *entry)
+{
+    release_yolov5_model(&entry->ctx);
+    memset(&entry->ctx, 0, sizeof(rknn_app_context_t));
+    entry->loaded = 0;
+    reg->mem_used -= entry->mem_size;
+}
+
+void model_registry_deinit(model_registry_t *reg)
+{
+    for (int i = 0; i < reg->count; i++) {
+        if (reg->entries[i].loaded) {
+            unload_entry(reg, &reg->entries[i]);
+        }
+    }
+    reg->count = 0;
+}
+
+static model_entry_t *find_entry(model_registry_t *reg, const char *name)
+{
+    for (int i = 0; i < reg->count; i++) {
+        if (strcmp(reg->entries[i].name, name) == 0) {
+            return &reg->entries[i];
+        }
+    }
+    return NULL;
+}
+
+static int copy_path(char *dst, const char *src)
+{
+    if (strlen(src) >= MODEL_PATH_MAX_SIZE) {
+        printf("model registry: path too long %s\n", src);
+        return -1;
+    }
+    strcpy(dst, src);
+    return 0;
+}
+
+int model_registry_add(model_registry_t *reg, const char *name, const char *model_path, const char *anchors_path,
+                       const char *labels_path)
+{
+    if (reg->count >= MODEL_REGISTRY_MAX || strlen(name) >= MODEL_NAME_MAX_SIZE || find_entry(reg, name) != NULL) {
+        printf("model registry: can not add %s\n", name);
+        return -1;
+    }
+    model_entry_t *entry = &reg->entries[reg->count];
+    memset(entry, 0, sizeof(model_entry_t));
+    strcpy(entry->name, name);
+    if (copy_path(entry->model_path, model_path) != 0 ||
+        copy_path(entry->anchors_path, anchors_path != NULL ? anchors_path : ANCHORS_TXT_PATH) != 0 ||
+        copy_path(entry->labels_path, labels_path != NULL ? labels_path : "") != 0) {
+        return -1;
+    }
+
+    // until the first load, the weights in the file are the best guess of its NPU memory
+    struct stat st;
+    if (stat(model_path, &st) == 0) {
+        entry->mem_size = st.st_size;
+    }
+    return reg->count++;
+}
+
+int model_registry_add_spec(model_registry_t *reg, const char *spec)
+{
+    char buf[MODEL_NAME_MAX_SIZE + 3 * MODEL_PATH_MAX_SIZE];
+    if (strlen(spec) >= sizeof(buf)) {
+        printf("model registry: spec too long %s\n", spec);
+        return -1;
+    }
+    strcpy(buf, spec);
+
+    char *eq = strchr(buf, '=');
+    if (eq == NULL || eq == buf || eq[1] == '\0') {
+        printf("model registry: invalid spec %s, expect name=model.rknn[,anchors.txt[,labels.txt]]\n", spec);
+        return -1;
+    }
+    *eq = '\0';
+    char *paths[3] = {eq + 1, NULL, NULL};
+    for (int i = 1; i < 3; i++) {
+        char *comma = strchr(paths[i - 1], ',');
+        if (comma == NULL) {
+            break;
+        }
+        *comma = '\0';
+        paths[i] = comma + 1;
+    }
+    // empty fields keep the defaults
+    for (int i = 1; i < 3; i++) {
+        if (paths[i] != NULL && paths[i][0] == '\0') {
+            paths[i] = NULL;
+        }
+    }
+    return model_registry_add(reg, buf, paths[0], paths[1], paths[2]);
+}
+
+static uint64_t query_mem_size(rknn_context ctx)
+{
+    rknn_mem_size mem;
+    memset(&mem, 0, sizeof(mem));
+    if (rknn_query(ctx, RKNN_QUERY_MEM_SIZE, &mem, sizeof(mem)) != RKNN_SUCC) {
+        return 0;
+    }
+    // all DMA memory of the context when the runtime reports it, else weights and internal tensors
+    if (mem.total_dma_allocated_size > 0) {
+        return mem.total_dma_allocated_size;
+    }
+    return (uint64_t)mem.total_weight_size + mem.total_internal_size;
+}
+
+/* evict least recently used idle models until need more bytes fit, 0: fits */
+static int make_room(model_registry_t *reg, uint64_t need)
+{
+    if (reg->mem_budget == 0) {
+        return 0;
+    }
+    while (reg->mem_used + need > reg->mem_budget) {
+        model_entry_t *lru = NULL;
+        for (int i = 0; i < reg->count; i++) {
+            model_entry_t *e = &reg->entries[i];
+            if (e->loaded && e->refs == 0 && (lru == NULL || e->last_use < lru->last_use)) {
+                lru = e;
+            }
+        }
+        if (lru == NULL) {
+            return -1;
+        }
+        printf("model registry: evict %s (%.1f MB)\n", lru->name, lru->mem_size / 1048576.0);
+        unload_entry(reg, lru);
+        lru->evictions++;
+        reg->evictions++;
+    }
+    return 0;
+}
+
+static int load_entry(model_registry_t *reg, model_entry_t *entry)
+{
+    make_room(reg, entry->mem_size);
+
+    memset(&entry->ctx, 0, sizeof(rknn_app_context_t));
+    if (init_yolov5_model_with_anchors(entry->model_path, entry->anchors_path, &entry->ctx) != 0 ||
+        (entry->labels_path[0] != '\0' && load_yolov5_labels(&entry->ctx, entry->labels_path) < 0)) {
+        printf("model registry: load %s from %s fail\n", entry->name, entry->model_path);
+        release_yolov5_model(&entry->ctx);
+        memset(&entry->ctx, 0, sizeof(rknn_app_context_t));
+        reg->load_failures++;
+        return -1;
+    }
+
+    uint64_t size = query_mem_size(entry->ctx.rknn_ctx);
+    if (size > 0) {
+        entry->mem_size = size;
+    }
+    entry->loaded = 1;
+    entry->loads++;
+    reg->loads++;
+    reg->mem_used += entry->mem_size;
+
+    // the estimate can be off, evict more now that the real size is known
+    entry->refs++;
+    if (make_room(reg, 0) != 0) {
+        reg->over_budget++;
+        printf("model registry: %.1f MB in use, over the %.1f MB budget\n", reg->mem_used / 1048576.0,
+               reg->mem_budget / 1048576.0);
+    }
+    entry->refs--;
+    printf("model registry: load %s (%.1f MB), %.1f MB in use\n", entry->name, entry->mem_size / 1048576.0,
+           reg->mem_used / 1048576.0);
+    return 0;
+}
+
+model_entry_t *model_registry_acquire(model_registry_t *reg, const char *name)
+{
+    model_entry_t *entry = find_entry(reg, name);
+    if (entry == NULL) {
+        printf("model registry: unknown model %s\n", name);
+        return NULL;
+    }
+    if (entry->loaded) {
+        entry->hits++;
+        reg->hits++;
+    } else if (load_entry(reg, entry) != 0) {
+        return NULL;
+    }
+    entry->refs++;
+    entry->last_use = ++reg->tick;
+    return entry;
+}
+
+void model_registry_release(model_registry_t *reg, model_entry_t *entry)
+{
+    (void)reg;
+    if (entry != NULL && entry->refs > 0) {
+        entry->refs--;
+    }
+}
+
+void model_registry_update_mem(model_registry_t *reg, model_entry_t *entry)
+{
+    if (!entry->loaded) {
+        return;
+    }
+    uint64_t size = query_mem_size(entry->ctx.rknn_ctx);
+    if (size == 0 || size == entry->mem_size) {
+        return;
+    }
+    reg->mem_used = reg->mem_used - entry->mem_size + size;
+    entry->mem_size = size;
+
+    // a grown model may push the others out, the entry itself is in use
+    entry->refs++;
+    if (make_room(reg, 0) != 0) {
+        reg->over_budget++;
+        printf("model registry: %.1f MB in use, over the %.1f MB budget\n", reg->mem_used / 1048576.0,
+               reg->mem_budget / 1048576.0);
+    }
+    entry->refs--;
+    printf("model registry: %s now %.1f MB, %.1f MB in use\n", entry->name, entry->mem_size / 1048576.0,
+           reg->mem_used / 1048576.0);
+}
+
+void model_registry_print_stats(model_registry_t *reg)
+{
+    printf("model registry: %.1f / %.1f MB, loads %llu (failed %llu), evictions %llu, hits %llu, over budget %llu\n",
+           reg->mem_used / 1048576.0, reg->mem_budget / 1048576.0, (unsigned long long)reg->loads,
+           (unsigned long long)reg->load_failures, (unsigned long long)reg->evictions,
+           (unsigned long long)reg->hits, (unsigned long long)reg->over_budget);
+    for (int i = 0; i < reg->count; i++) {
+        model_entry_t *e = &reg->entries[i];
+        printf("  %-12s %s %6.1f MB  loads %llu evictions %llu hits %llu\n", e->name, e->loaded ? "loaded" : "      ",
+               e->mem_size / 1048576.0, (unsigned long long)e->loads, (unsigned long long)e->evictions,
+               (unsigned long long)e->hits);
+    }
+}
@@ -0,0 +1,97 @@
+#ifndef _RKNN_YOLOV5_DEMO_MODEL_REGISTRY_H_
+#define _RKNN_YOLOV5_DEMO_MODEL_REGISTRY_H_
+
+#include <stdint.h>
+
+#include "yolov5.h"
+
+#define MODEL_REGISTRY_MAX 8
+#define MODEL_NAME_MAX_SIZE 32
+#define MODEL_PATH_MAX_SIZE 256
+
+/**
+ * @brief One detector: its paths, and once loaded its context with decoder, anchors and labels
+ */
+typedef struct {
+    char name[MODEL_NAME_MAX_SIZE];
+    char model_path[MODEL_PATH_MAX_SIZE];
+    char anchors_path[MODEL_PATH_MAX_SIZE];
+    char labels_path[MODEL_PATH_MAX_SIZE];  // empty: the global coco labels
+    int loaded;
+    int refs;                   // acquired and not yet released, never evicted while > 0
+    rknn_app_context_t ctx;
+    uint64_t mem_size;          // RKNN_QUERY_MEM_SIZE of the last load, file size before the first
+    uint64_t last_use;          // registry tick of the last acquire
+    uint64_t loads;
+    uint64_t evictions;
+    uint64_t hits;
+} model_entry_t;
+
+/**
+ * @brief Models loaded on first use, least recently used ones evicted to stay within an NPU memory budget
+ *
+ * Not thread safe, use it from the thread running inference.
+ */
+typedef struct {
+    model_entry_t entries[MODEL_REGISTRY_MAX];
+    int count;
+    uint64_t mem_budget;        // bytes, 0: no limit
+    uint64_t mem_used;          // sum of mem_size of the loaded entries
+    uint64_t tick;
+    uint64_t loads;
+    uint64_t load_failures;
+    uint64_t evictions;
+    uint64_t hits;
+    uint64_t over_budget;       // loads that stayed over budget, every other model was in use
+} model_registry_t;
+
+/**
+ * @brief Empty registry
+ *
+ * @param mem_budget [in] NPU memory for all loaded models in bytes, 0: no limit
+ */
+void model_registry_init(model_registry_t *reg, uint64_t mem_budget);
+
+/**
+ * @brief Release all loaded models
+ */
+void model_registry_deinit(model_registry_t *reg);
+
+/**
+ * @brief Register a model, nothing is loaded yet
+ *
+ * @param anchors_path [in] NULL: ANCHORS_TXT_PATH
+ * @param labels_path [in] NULL: the global coco labels
+ * @return int entry index; -1: registry full, name taken or path too long
+ */
+int model_registry_add(model_registry_t *reg, const char *name, const char *model_path, const char *anchors_path,
+                       const char *labels_path);
+
+/**
+ * @brief Parse "name=model.rknn[,anchors.txt[,labels.txt]]" and register it
+ *
+ * @return int entry index; -1: error
+ */
+int model_registry_add_spec(model_registry_t *reg, const char *spec);
+
+/**
+ * @brief Get a loaded model, loading it (and evicting LRU models) if needed
+ *
+ * The entry stays loaded until model_registry_release().
+ *
+ * @return model_entry_t* NULL: unknown name or load failed
+ */
+model_entry_t *model_registry_acquire(model_registry_t *reg, const char *name);
+
+void model_registry_release(model_registry_t *reg, model_entry_t *entry);
+
+/**
+ * @brief Re-query the NPU memory of an entry whose context was replaced, e.g. by poll_yolov5_reload()
+ *
+ * The new model file can be larger or smaller than the one it replaced; mem_used follows.
+ */
+void model_registry_update_mem(model_registry_t *reg, model_entry_t *entry);
+
+void model_registry_print_stats(model_registry_t *reg);
+
+#endif // _RKNN_YOLOV5_DEMO_MODEL_REGISTRY_H_
@@ -0,0 +1,270 @@
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "nms.h"
+
+static const char *method_names[NMS_METHOD_NUM] = {"hard", "agnostic", "soft", "matrix", "diou"};
+
+const char *nms_method_name(nms_method_t method)
+{
+    if (method < 0 || method >= NMS_METHOD_NUM) {
+        return "unknown";
+    }
+    return method_names[method];
+}
+
+int nms_method_from_name(const char *name)
+{
+    for (int i = 0; i < NMS_METHOD_NUM; i++) {
+        if (strcmp(name, method_names[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void nms_boxes_resize(nms_boxes_t *boxes, int count)
+{
+    boxes->count = count;
+    boxes->x1.resize(count);
+    boxes->y1.resize(count);
+    boxes->x2.resize(count);
+    boxes->y2.resize(count);
+    boxes->area.resize(count);
+    boxes->score.resize(count);
+    boxes->cls.resize(count);
+}
+
+/*
+ * IoU of box i against boxes [begin, end), written to out[begin, end).
+ * Boxes of another class get 0 unless agnostic. Branch free so the compiler can vectorize it.
+ */
+static void iou_row(const nms_boxes_t *b, int i, int begin, int end, bool agnostic, float *out)
+{
+    const float *x1 = b->x1.data();
+    const float *y1 = b->y1.data();
+    const float *x2 = b->x2.data();
+    const float *y2 = b->y2.data();
+    const float *area = b->area.data();
+    const int *cls = b->cls.data();
+    const float ix1 = x1[i], iy1 = y1[i], ix2 = x2[i], iy2 = y2[i], iarea = area[i];
+    const int icls = cls[i];
+
+    for (int j = begin; j < end; j++) {
+        float w = std::max(0.f, std::min(ix2, x2[j]) - std::max(ix1, x1[j]) + 1.0f);
+        float h = std::max(0.f, std::min(iy2, y2[j]) - std::max(iy1, y1[j]) + 1.0f);
+        float inter = w * h;
+        float iou = inter / (iarea + area[j] - inter);
+        out[j] = (agnostic || cls[j] == icls) ? iou : 0.f;
+    }
+}
+
+/* IoU of box i against boxes idx[0, m), written to out[0, m), same class only */
+static void iou_list(const nms_boxes_t *b, int i, const int *idx, int m, float *out)
+{
+    const float *x1 = b->x1.data();
+    const float *y1 = b->y1.data();
+    const float *x2 = b->x2.data();
+    const float *y2 = b->y2.data();
+    const float *area = b->area.data();
+    const int *cls = b->cls.data();
+    const float ix1 = x1[i], iy1 = y1[i], ix2 = x2[i], iy2 = y2[i], iarea = area[i];
+    const int icls = cls[i];
+
+    for (int k = 0; k < m; k++) {
+        int j = idx[k];
+        float w = std::max(0.f, std::min(ix2, x2[j]) - std::max(ix1, x1[j]) + 1.0f);
+        float h = std::max(0.f, std::min(iy2, y2[j]) - std::max(iy1, y1[j]) + 1.0f);
+        float inter = w * h;
+        float iou = inter / (iarea + area[j] - inter);
+        out[k] = cls[j] == icls ? iou : 0.f;
+    }
+}
+
+/* DIoU = IoU - center_distance^2 / enclosing_diagonal^2 */
+static void diou_row(const nms_boxes_t *b, int i, int begin, int end, float *out)
+{
+    const float *x1 = b->x1.data();
+    const float *y1 = b->y1.data();
+    const float *x2 = b->x2.data();
+    const float *y2 = b->y2.data();
+    const float *area = b->area.data();
+    const int *cls = b->cls.data();
+    const float ix1 = x1[i], iy1 = y1[i], ix2 = x2[i], iy2 = y2[i], iarea = area[i];
+    const float icx = ix1 + ix2, icy = iy1 + iy2;
+    const int icls = cls[i];
+
+    for (int j = begin; j < end; j++) {
+        float w = std::max(0.f, std::min(ix2, x2[j]) - std::max(ix1, x1[j]) + 1.0f);
+        float h = std::max(0.f, std::min(iy2, y2[j]) - std::max(iy1, y1[j]) + 1.0f);
+        float inter = w * h;
+        float iou = inter / (iarea + area[j] - inter);
+        // centers are kept doubled, so scale the enclosing box the same way
+        float dx = icx - (x1[j] + x2[j]);
+        float dy = icy - (y1[j] + y2[j]);
+        float cw = 2.0f * (std::max(ix2, x2[j]) - std::min(ix1, x1[j]) + 1.0f);
+        float ch = 2.0f * (std::max(iy2, y2[j]) - std::min(iy1, y1[j]) + 1.0f);
+        float diou = iou - (dx * dx + dy * dy) / (cw * cw + ch * ch);
+        out[j] = (cls[j] == icls) ? diou : -1.f;
+    }
+}
+
+static int nms_greedy(nms_boxes_t *b, const nms_config_t *cfg, std::vector<int> &keep, int *clipped)
+{
+    const int n = b->count;
+    const bool agnostic = cfg->method == NMS_CLASS_AGNOSTIC;
+    std::vector<uint8_t> removed(n, 0);
+    std::vector<float> row(n);
+
+    for (int i = 0; i < n; i++) {
+        if (removed[i]) {
+            continue;
+        }
+        if ((int)keep.size() >= cfg->max_det) {
+            *clipped = 1;
+            break;
+        }
+        keep.push_back(i);
+        if (cfg->method == NMS_DIOU) {
+            diou_row(b, i, i + 1, n, row.data());
+        } else {
+            iou_row(b, i, i + 1, n, agnostic, row.data());
+        }
+        for (int j = i + 1; j < n; j++) {
+            removed[j] |= (row[j] > cfg->iou_threshold);
+        }
+    }
+    return keep.size();
+}
+
+static int nms_soft(nms_boxes_t *b, const nms_config_t *cfg, std::vector<int> &keep, int *clipped)
+{
+    const int n = b->count;
+    const float inv_sigma = 1.0f / cfg->sigma;
+    std::vector<int> alive(n);
+    std::vector<float> row(n);
+    for (int i = 0; i < n; i++) {
+        alive[i] = i;
+    }
+
+    while (!alive.empty()) {
+        if ((int)keep.size() >= cfg->max_det) {
+            *clipped = 1;
+            break;
+        }
+        // scores change after every step, pick the current best
+        int best_pos = 0;
+        for (int k = 1; k < (int)alive.size(); k++) {
+            if (b->score[alive[k]] > b->score[alive[best_pos]]) {
+                best_pos = k;
+            }
+        }
+        int best = alive[best_pos];
+        keep.push_back(best);
+        alive.erase(alive.begin() + best_pos);
+
+        // only the boxes still alive, each step costs O(alive) instead of O(n)
+        int m = 0;
+        iou_list(b, best, alive.data(), (int)alive.size(), row.data());
+        for (int k = 0; k < (int)alive.size(); k++) {
+            int j = alive[k];
+            float iou = row[k];
+            b->score[j] *= expf(-iou * iou * inv_sigma);
+            if (b->score[j] >= cfg->score_threshold) {
+                alive[m++] = j;
+            }
+        }
+        alive.resize(m);
+    }
+    return keep.size();
+}
+
+/*
+ * Matrix-NMS (SOLOv2): decay_j = min_i f(iou_ij) / f(max_k iou_ki) over higher scored i.
+ * With the gaussian kernel the min of the ratio is exp(min_i (comp_i^2 - iou_ij^2) / sigma),
+ * a max and a min reduction down the columns. comp_i only depends on the rows above i, so it is
+ * final when row i is reached and both reductions share one sweep: every IoU is computed once
+ * and the matrix is never stored. Boxes of other classes change neither reduction, so each
+ * class is swept on its own.
+ */
+static int nms_matrix(nms_boxes_t *b, const nms_config_t *cfg, std::vector<int> &keep, int *clipped)
+{
+    const int n = b->count;
+    const float inv_sigma = 1.0f / cfg->sigma;
+    std::vector<float> comp(n, 0.f);
+    std::vector<float> min_arg(n, 0.f);
+    std::vector<float> row(n);
+
+    // class buckets, score order kept inside each
+    std::vector<int> idx(n);
+    for (int i = 0; i < n; i++) {
+        idx[i] = i;
+    }
+    std::stable_sort(idx.begin(), idx.end(), [b](int x, int y) { return b->cls[x] < b->cls[y]; });
+
+    float *c = comp.data();
+    float *m = min_arg.data();
+    for (int begin = 0; begin < n;) {
+        int end = begin + 1;
+        while (end < n && b->cls[idx[end]] == b->cls[idx[begin]]) {
+            end++;
+        }
+        for (int a = begin; a < end; a++) {
+            int i = idx[a];
+            const int *js = &idx[a + 1];
+            int count = end - a - 1;
+            iou_list(b, i, js, count, row.data());
+            const float ci2 = c[i] * c[i];
+            for (int k = 0; k < count; k++) {
+                int j = js[k];
+                c[j] = std::max(c[j], row[k]);
+                m[j] = std::min(m[j], ci2 - row[k] * row[k]);
+            }
+        }
+        begin = end;
+    }
+
+    std::vector<int> order;
+    order.reserve(n);
+    for (int j = 0; j < n; j++) {
+        b->score[j] *= expf(min_arg[j] * inv_sigma);
+        if (b->score[j] >= cfg->score_threshold) {
+            order.push_back(j);
+        }
+    }
+    std::stable_sort(order.begin(), order.end(), [b](int x, int y) { return b->score[x] > b->score[y]; });
+    if ((int)order.size() > cfg->max_det) {
+        *clipped = 1;
+        order.resize(cfg->max_det);
+    }
+    keep.insert(keep.end(), order.begin(), order.end());
+    return keep.size();
+}
+
+int run_nms(nms_boxes_t *boxes, const nms_config_t *config, std::vector<int> &keep, int *clipped)
+{
+    int dummy = 0;
+    if (clipped == NULL) {
+        clipped = &dummy;
+    }
+    keep.clear();
+    if (boxes->count <= 0) {
+        return 0;
+    }
+
+    switch (config->method) {
+    case NMS_SOFT:
+        return nms_soft(boxes, config, keep, clipped);
+    case NMS_MATRIX:
+        return nms_matrix(boxes, config, keep, clipped);
+    case NMS_HARD:
+    case NMS_CLASS_AGNOSTIC:
+    case NMS_DIOU:
+    default:
+        return nms_greedy(boxes, config, keep, clipped);
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef _RKNN_YOLOV5_DEMO_NMS_H_
+#define _RKNN_YOLOV5_DEMO_NMS_H_
+
+#include <vector>
+
+/**
+ * @brief NMS variants
+ */
+typedef enum {
+    NMS_HARD = 0,           // per-class hard IoU suppression (default)
+    NMS_CLASS_AGNOSTIC,     // hard IoU suppression across all classes, one pass
+    NMS_SOFT,               // per-class gaussian Soft-NMS
+    NMS_MATRIX,             // per-class gaussian Matrix-NMS, no sequential dependency
+    NMS_DIOU,               // per-class DIoU suppression
+    NMS_METHOD_NUM,
+} nms_method_t;
+
+/**
+ * @brief Candidate boxes in SoA layout, sorted by score (descending) before run_nms()
+ */
+typedef struct {
+    int count;
+    std::vector<float> x1;
+    std::vector<float> y1;
+    std::vector<float> x2;
+    std::vector<float> y2;
+    std::vector<float> area;
+    std::vector<float> score;
+    std::vector<int> cls;
+} nms_boxes_t;
+
+typedef struct {
+    nms_method_t method;
+    float iou_threshold;    // hard / agnostic / DIoU suppression threshold
+    float score_threshold;  // Soft / Matrix: drop boxes whose decayed score falls below
+    float sigma;            // Soft / Matrix gaussian decay
+    int max_det;            // stop after this many kept boxes
+} nms_config_t;
+
+/**
+ * @brief Resize all SoA arrays
+ */
+void nms_boxes_resize(nms_boxes_t *boxes, int count);
+
+/**
+ * @brief Set box i from left/top/width/height, also computes area
+ */
+static inline void nms_boxes_set(nms_boxes_t *boxes, int i, float x, float y, float w, float h, float score, int cls)
+{
+    boxes->x1[i] = x;
+    boxes->y1[i] = y;
+    boxes->x2[i] = x + w;
+    boxes->y2[i] = y + h;
+    boxes->area[i] = (w + 1.0f) * (h + 1.0f);
+    boxes->score[i] = score;
+    boxes->cls[i] = cls;
+}
+
+/**
+ * @brief Run NMS
+ *
+ * @param boxes [in/out] Candidates sorted by score, Soft/Matrix write the decayed scores back
+ * @param config [in] Method and thresholds
+ * @param keep [out] Indices of kept boxes, ordered by final score
+ * @param clipped [out] Set to 1 if max_det stopped NMS with candidates left, may be NULL
+ * @return int kept box count
+ */
+int run_nms(nms_boxes_t *boxes, const nms_config_t *config, std::vector<int> &keep, int *clipped);
+
+const char *nms_method_name(nms_method_t method);
+
+/**
+ * @brief Parse method name (hard/agnostic/soft/matrix/diou), -1 if unknown
+ */
+int nms_method_from_name(const char *name);
+
+#endif //_RKNN_YOLOV5_DEMO_NMS_H_
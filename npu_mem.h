@@ -0,0 +1,116 @@
+#ifndef _RKNN_YOLOV5_DEMO_NPU_MEM_H_
+#define _RKNN_YOLOV5_DEMO_NPU_MEM_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "rknn_api.h"
+
+#define NPU_MEM_MAX_CONTEXTS 16
+#define NPU_MEM_PATH_MAX_SIZE 256
+
+// npu_mem_t.flags
+#define NPU_MEM_SHARE_WEIGHTS   0x1 // same model data loaded twice: RKNN_FLAG_SHARE_WEIGHT_MEM
+#define NPU_MEM_SHARE_INTERNAL  0x2 // one internal buffer for all contexts, RKNN_FLAG_INTERNAL_ALLOC_OUTSIDE
+#define NPU_MEM_SRAM            0x4 // RKNN_FLAG_ENABLE_SRAM, the runtime puts internal buffers in SRAM when they fit
+#define NPU_MEM_SHARE_SRAM      0x8 // RKNN_FLAG_SHARE_SRAM, contexts share the reserved SRAM
+
+typedef struct {
+    rknn_context ctx;
+    char model_path[NPU_MEM_PATH_MAX_SIZE];
+    uint32_t model_size;        // with model_hash identifies the model for weight sharing
+    uint64_t model_hash;
+    rknn_context weight_owner;  // context whose weights are used, ctx itself when not shared
+    rknn_tensor_mem *internal;  // this context's view of the shared internal buffer
+    int internal_fd;            // buffer the view points to, an older one until npu_mem_apply_internal()
+    rknn_mem_size mem;          // RKNN_QUERY_MEM_SIZE right after init
+    int released;               // released by its user, kept until no context borrows its weights
+} npu_mem_ctx_t;
+
+/**
+ * @brief Memory sharing between rknn contexts
+ *
+ * Contexts sharing the internal buffer must never run at the same time.
+ */
+typedef struct {
+    int fd;
+    void *va;
+    uint32_t size;
+} npu_mem_buf_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    int flags;
+    npu_mem_ctx_t ctxs[NPU_MEM_MAX_CONTEXTS];
+    int num;
+    int internal_fd;            // DMA buffer shared as internal memory, -1: none yet
+    void *internal_va;
+    uint32_t internal_size;
+    npu_mem_buf_t retired[NPU_MEM_MAX_CONTEXTS]; // outgrown internal buffers still set on contexts
+    int retired_num;
+} npu_mem_t;
+
+/**
+ * @brief Parse "weights,internal,sram,share-sram" into NPU_MEM_* flags
+ *
+ * @return int flags; -1: unknown name
+ */
+int npu_mem_flags_from_string(const char *str);
+
+/**
+ * @brief FNV-1a over the model data, the same file after an update must not share the old weights
+ */
+uint64_t npu_mem_model_hash(const void *model, uint32_t size);
+
+void npu_mem_init(npu_mem_t *mem, int flags);
+
+/**
+ * @brief Free the shared internal buffer, all contexts must be released first
+ */
+void npu_mem_deinit(npu_mem_t *mem);
+
+/**
+ * @brief rknn_init with the sharing flags and register the context
+ *
+ * @param model_path [in] For the stats; weights are shared between contexts of identical model data
+ * @param model [in] Model data
+ * @param size [in] Model size
+ * @param extra_flags [in] Other RKNN_FLAG_* for rknn_init, e.g. RKNN_FLAG_COLLECT_PERF_MASK
+ * @param ctx [out] Context
+ * @return int 0: success; <0: rknn error
+ */
+int npu_mem_init_context(npu_mem_t *mem, const char *model_path, void *model, uint32_t size, uint32_t extra_flags,
+                         rknn_context *ctx);
+
+/**
+ * @brief Unregister a context before rknn_destroy
+ *
+ * A context whose weights other contexts still use is kept and destroyed here once the
+ * last of them is released.
+ *
+ * @return int 0: the caller destroys ctx (also for contexts not created here); 1: leave it to the manager
+ */
+int npu_mem_release_context(npu_mem_t *mem, rknn_context ctx);
+
+/**
+ * @brief Move every context onto the current shared internal buffer, free the outgrown ones
+ *
+ * A context needing a larger internal buffer than the shared one gets a new buffer at init,
+ * the others keep the old one: init may run on a loader thread while they are in rknn_run.
+ * Call between frames from the thread running inference.
+ *
+ * @return int 0: success; -1: a context could not be moved, it keeps its buffer
+ */
+int npu_mem_apply_internal(npu_mem_t *mem);
+
+/**
+ * @brief 1: contexts share the internal buffer, runs must be serialized
+ */
+int npu_mem_shares_internal(npu_mem_t *mem);
+
+/**
+ * @brief Per context RKNN_QUERY_MEM_SIZE, and the memory of all contexts without sharing vs with it
+ */
+void npu_mem_print_stats(npu_mem_t *mem);
+
+#endif // _RKNN_YOLOV5_DEMO_NPU_MEM_H_
@@ -0,0 +1,85 @@
+#ifndef _RKNN_YOLOV5_DEMO_NPU_PROFILE_H_
+#define _RKNN_YOLOV5_DEMO_NPU_PROFILE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "rknn_api.h"
+
+#define NPU_PROFILE_MAX_STAGES 16
+#define NPU_PROFILE_MAX_LAYERS 1024
+#define NPU_PROFILE_DETAIL_INTERVAL 100
+
+typedef struct {
+    int id;
+    char op_type[32];
+    char target[8];             // NPU / CPU / GPU
+    char name[128];
+    double time_us;             // sum over the detail samples
+    int samples;
+} npu_layer_stat_t;
+
+/**
+ * @brief Per frame host stage and NPU times, per layer NPU times every detail_interval frames
+ *
+ * Files written next to each other:
+ *   <prefix>_frames.csv  one row per frame: host stages in us, then RKNN_QUERY_PERF_RUN
+ *   <prefix>_layers.csv  average per layer time of the RKNN_QUERY_PERF_DETAIL samples
+ *   <prefix>.json        stage averages and the layer table
+ * Contexts must be created with RKNN_FLAG_COLLECT_PERF_MASK, see set_yolov5_profiling().
+ */
+typedef struct {
+    int enabled;
+    char prefix[256];
+    int detail_interval;
+    FILE *frames_csv;
+    uint64_t frames;
+
+    // host stages, columns fixed by the first frame
+    int stage_num;
+    int stages_fixed;
+    char stage_names[NPU_PROFILE_MAX_STAGES][32];
+    int64_t stage_us[NPU_PROFILE_MAX_STAGES];   // current frame
+    double stage_sum_us[NPU_PROFILE_MAX_STAGES];
+    double npu_run_sum_us;
+
+    npu_layer_stat_t *layers;
+    int layer_num;
+    int detail_samples;
+} npu_profile_t;
+
+/**
+ * @brief Start profiling, a closed (zeroed) profile ignores every call
+ *
+ * @param detail_interval [in] Frames between RKNN_QUERY_PERF_DETAIL samples, <= 0: NPU_PROFILE_DETAIL_INTERVAL
+ * @return int 0: success; -1: files could not be created
+ */
+int npu_profile_open(npu_profile_t *prof, const char *prefix, int detail_interval);
+
+/**
+ * @brief Write the final layer tables and close the files
+ */
+void npu_profile_close(npu_profile_t *prof);
+
+/**
+ * @brief Add host time to a stage of the current frame
+ */
+void npu_profile_stage(npu_profile_t *prof, const char *name, int64_t us);
+
+/**
+ * @brief Finish the frame: query the NPU run time, write the row, sample the layers when due
+ *
+ * @param ctx [in] Context that ran the frame
+ */
+void npu_profile_end_frame(npu_profile_t *prof, rknn_context ctx);
+
+/**
+ * @brief Parse the RKNN_QUERY_PERF_DETAIL text into layers, one sample each
+ *
+ * Locates the columns by the header line holding OpType and Time(us).
+ *
+ * @return int layers found
+ */
+int npu_profile_parse_detail(const char *text, npu_layer_stat_t *layers, int max_layers);
+
+#endif // _RKNN_YOLOV5_DEMO_NPU_PROFILE_H_
@@ -0,0 +1,300 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "rknn_api.h"
+#include "npu_sched.h"
+
+int64_t npu_sched_now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+uint32_t npu_sched_init_flag(int priority)
+{
+    switch (priority) {
+    case NPU_PRIO_MEDIUM:
+        return RKNN_FLAG_PRIOR_MEDIUM;
+    case NPU_PRIO_LOW:
+        return RKNN_FLAG_PRIOR_LOW;
+    default:
+        return RKNN_FLAG_PRIOR_HIGH;
+    }
+}
+
+const char *npu_sched_priority_name(int priority)
+{
+    switch (priority) {
+    case NPU_PRIO_HIGH:
+        return "high";
+    case NPU_PRIO_MEDIUM:
+        return "medium";
+    case NPU_PRIO_LOW:
+        return "low";
+    default:
+        return "?";
+    }
+}
+
+static int prio_class(int priority)
+{
+    return priority < 0 ? 0 : (priority >= NPU_PRIO_NUM ? NPU_PRIO_NUM - 1 : priority);
+}
+
+/* EDF order: a job with a deadline before one without, then the earlier deadline, then the higher priority */
+static int runs_before(const npu_job_t *a, const npu_job_t *b)
+{
+    if (a->deadline_us != b->deadline_us) {
+        if (a->deadline_us == 0 || b->deadline_us == 0) {
+            return a->deadline_us != 0;
+        }
+        return a->deadline_us < b->deadline_us;
+    }
+    return prio_class(a->priority) < prio_class(b->priority);
+}
+
+static void unlink_job(npu_sched_t *sched, npu_job_t *prev, npu_job_t *job)
+{
+    if (prev != NULL) {
+        prev->next = job->next;
+    } else {
+        sched->head = job->next;
+    }
+    if (sched->tail == job) {
+        sched->tail = prev;
+    }
+    job->next = NULL;
+    sched->queued--;
+}
+
+/* called with the lock held: drop the expired jobs of the models, take the next one by policy */
+static npu_job_t *take_job(npu_sched_t *sched, uint32_t model_mask)
+{
+    int64_t now = npu_sched_now_us();
+    npu_job_t *best = NULL;
+    npu_job_t *best_prev = NULL;
+    npu_job_t *prev = NULL;
+    npu_job_t *job = sched->head;
+    while (job != NULL) {
+        npu_job_t *next = job->next;
+        if (((model_mask >> job->model) & 1) == 0) {
+            prev = job;
+        } else if (job->deadline_us != 0 && now >= job->deadline_us) {
+            unlink_job(sched, prev, job);
+            job->ret = -1;
+            job->dropped = 1;
+            job->done_us = now;
+            job->done = 1;
+            sched->stats[prio_class(job->priority)].dropped++;
+            pthread_cond_broadcast(&sched->done_cond);
+        } else {
+            // submit order is kept on ties, the list is in submit order
+            if (best == NULL || (sched->policy == NPU_SCHED_EDF && runs_before(job, best))) {
+                best = job;
+                best_prev = prev;
+            }
+            prev = job;
+        }
+        job = next;
+    }
+    if (best != NULL) {
+        unlink_job(sched, best_prev, best);
+    }
+    return best;
+}
+
+static void *worker_thread(void *arg)
+{
+    npu_sched_context_t *ctx = (npu_sched_context_t *)arg;
+    npu_sched_t *sched = ctx->sched;
+
+    pthread_mutex_lock(&sched->lock);
+    for (;;) {
+        npu_job_t *job = take_job(sched, ctx->model_mask);
+        if (job == NULL) {
+            if (sched->quit) {
+                break;
+            }
+            pthread_cond_wait(&sched->work_cond, &sched->lock);
+            continue;
+        }
+        job->context = ctx->index;
+        job->start_us = npu_sched_now_us();
+        pthread_mutex_unlock(&sched->lock);
+
+        int ret = sched->run(ctx->arg, job);
+        int64_t end = npu_sched_now_us();
+
+        pthread_mutex_lock(&sched->lock);
+        job->ret = ret;
+        job->done_us = end;
+        job->done = 1;
+        ctx->jobs++;
+        ctx->busy_us += end - job->start_us;
+
+        npu_sched_class_stats_t *st = &sched->stats[prio_class(job->priority)];
+        int64_t latency = end - job->enqueue_us;
+        st->run++;
+        st->latency_sum_us += latency;
+        if (latency > st->latency_max_us) {
+            st->latency_max_us = latency;
+        }
+        st->wait_sum_us += job->start_us - job->enqueue_us;
+        if (job->deadline_us != 0 && end > job->deadline_us) {
+            st->late++;
+        }
+        pthread_cond_broadcast(&sched->done_cond);
+    }
+    pthread_mutex_unlock(&sched->lock);
+    return NULL;
+}
+
+int npu_sched_init(npu_sched_t *sched, int policy, npu_run_fn run)
+{
+    memset(sched, 0, sizeof(npu_sched_t));
+    if ((policy != NPU_SCHED_EDF && policy != NPU_SCHED_FIFO) || run == NULL) {
+        printf("npu sched: invalid policy %d\n", policy);
+        return -1;
+    }
+    sched->policy = policy;
+    sched->run = run;
+    pthread_mutex_init(&sched->lock, NULL);
+    pthread_cond_init(&sched->work_cond, NULL);
+    pthread_cond_init(&sched->done_cond, NULL);
+    return 0;
+}
+
+int npu_sched_add_context(npu_sched_t *sched, uint32_t model_mask, void *arg)
+{
+    if (sched->running || sched->context_num >= NPU_SCHED_MAX_CONTEXTS || model_mask == 0) {
+        printf("npu sched: cannot add context %d\n", sched->context_num);
+        return -1;
+    }
+    npu_sched_context_t *ctx = &sched->contexts[sched->context_num];
+    memset(ctx, 0, sizeof(npu_sched_context_t));
+    ctx->sched = sched;
+    ctx->index = sched->context_num;
+    ctx->model_mask = model_mask;
+    ctx->arg = arg;
+    return sched->context_num++;
+}
+
+int npu_sched_start(npu_sched_t *sched)
+{
+    if (sched->context_num == 0 || sched->running) {
+        printf("npu sched: no contexts to start\n");
+        return -1;
+    }
+    for (int i = 0; i < sched->context_num; i++) {
+        if (pthread_create(&sched->contexts[i].thread, NULL, worker_thread, &sched->contexts[i]) != 0) {
+            printf("npu sched: create thread %d fail\n", i);
+            pthread_mutex_lock(&sched->lock);
+            sched->quit = 1;
+            pthread_cond_broadcast(&sched->work_cond);
+            pthread_mutex_unlock(&sched->lock);
+            for (int j = 0; j < i; j++) {
+                pthread_join(sched->contexts[j].thread, NULL);
+            }
+            sched->quit = 0;
+            return -1;
+        }
+    }
+    sched->running = 1;
+    return 0;
+}
+
+void npu_sched_deinit(npu_sched_t *sched)
+{
+    if (sched->running) {
+        pthread_mutex_lock(&sched->lock);
+        sched->quit = 1;
+        pthread_cond_broadcast(&sched->work_cond);
+        pthread_mutex_unlock(&sched->lock);
+        for (int i = 0; i < sched->context_num; i++) {
+            pthread_join(sched->contexts[i].thread, NULL);
+        }
+        sched->running = 0;
+    }
+    pthread_cond_destroy(&sched->work_cond);
+    pthread_cond_destroy(&sched->done_cond);
+    pthread_mutex_destroy(&sched->lock);
+}
+
+int npu_sched_submit(npu_sched_t *sched, npu_job_t *job)
+{
+    job->ret = 0;
+    job->dropped = 0;
+    job->context = -1;
+    job->done = 0;
+    job->start_us = 0;
+    job->done_us = 0;
+    job->next = NULL;
+
+    pthread_mutex_lock(&sched->lock);
+    uint32_t served = 0;
+    for (int i = 0; i < sched->context_num; i++) {
+        served |= sched->contexts[i].model_mask;
+    }
+    if (!sched->running || sched->quit || job->model < 0 || job->model >= NPU_SCHED_MAX_MODELS ||
+        ((served >> job->model) & 1) == 0) {
+        pthread_mutex_unlock(&sched->lock);
+        job->ret = -1;
+        return -1;
+    }
+    job->enqueue_us = npu_sched_now_us();
+    if (sched->tail != NULL) {
+        sched->tail->next = job;
+    } else {
+        sched->head = job;
+    }
+    sched->tail = job;
+    sched->queued++;
+    sched->stats[prio_class(job->priority)].submitted++;
+    // the workers of other models ignore it, but they all wait on the same condition
+    pthread_cond_broadcast(&sched->work_cond);
+
+    while (!job->done) {
+        pthread_cond_wait(&sched->done_cond, &sched->lock);
+    }
+    pthread_mutex_unlock(&sched->lock);
+    return job->ret;
+}
+
+void npu_sched_reset_stats(npu_sched_t *sched)
+{
+    pthread_mutex_lock(&sched->lock);
+    memset(sched->stats, 0, sizeof(sched->stats));
+    for (int i = 0; i < sched->context_num; i++) {
+        sched->contexts[i].jobs = 0;
+        sched->contexts[i].busy_us = 0;
+    }
+    pthread_mutex_unlock(&sched->lock);
+}
+
+void npu_sched_print_stats(npu_sched_t *sched)
+{
+    pthread_mutex_lock(&sched->lock);
+    printf("npu sched: %s, %d contexts\n", sched->policy == NPU_SCHED_EDF ? "edf" : "fifo", sched->context_num);
+    for (int p = 0; p < NPU_PRIO_NUM; p++) {
+        npu_sched_class_stats_t *st = &sched->stats[p];
+        if (st->submitted == 0) {
+            continue;
+        }
+        uint64_t missed = st->dropped + st->late;
+        printf("  %-6s %llu jobs: %llu run, %llu dropped, %llu late, miss %.1f%%", npu_sched_priority_name(p),
+               (unsigned long long)st->submitted, (unsigned long long)st->run, (unsigned long long)st->dropped,
+               (unsigned long long)st->late, missed * 100.0 / st->submitted);
+        if (st->run > 0) {
+            printf(", latency avg %.1f max %.1f ms, wait avg %.1f ms", st->latency_sum_us / 1000.0 / st->run,
+                   st->latency_max_us / 1000.0, st->wait_sum_us / 1000.0 / st->run);
+        }
+        printf("\n");
+    }
+    for (int i = 0; i < sched->context_num; i++) {
+        printf("  context %d models 0x%x: %llu jobs, busy %.1f ms\n", i, sched->contexts[i].model_mask,
+               (unsigned long long)sched->contexts[i].jobs, sched->contexts[i].busy_us / 1000.0);
+    }
+    pthread_mutex_unlock(&sched->lock);
+}
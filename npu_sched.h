@@ -0,0 +1,175 @@
+#ifndef _RKNN_YOLOV5_DEMO_NPU_SCHED_H_
+#define _RKNN_YOLOV5_DEMO_NPU_SCHED_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "rknn_api.h"
+
+#define NPU_SCHED_MAX_CONTEXTS 8
+#define NPU_SCHED_MAX_MODELS 32
+
+// npu_job_t.priority, also the rknn_init priority of a context (npu_sched_init_flag)
+#define NPU_PRIO_HIGH   0           // safety critical detections
+#define NPU_PRIO_MEDIUM 1
+#define NPU_PRIO_LOW    2           // background models
+#define NPU_PRIO_NUM    3
+
+// npu_sched_t.policy
+#define NPU_SCHED_EDF  0            // earliest deadline first, priority breaks ties
+#define NPU_SCHED_FIFO 1            // submit order, for comparison
+
+/**
+ * @brief One inference request, owned by the submitting thread
+ */
+typedef struct npu_job_s {
+    void *data;                 // backend payload
+    int model;                  // 0..NPU_SCHED_MAX_MODELS-1, runs on a context that has this model
+    int priority;               // NPU_PRIO_*
+    int64_t deadline_us;        // absolute, npu_sched_now_us() time base; 0: none
+    int ret;                    // backend result, -1 when dropped
+    int dropped;                // deadline passed before a context was free, not run
+    int context;                // index of the context that ran it
+    int64_t enqueue_us;         // set by npu_sched_submit()
+    int64_t start_us;
+    int64_t done_us;
+    int done;
+    struct npu_job_s *next;
+} npu_job_t;
+
+/**
+ * @brief Run one job on a context
+ *
+ * Called from the worker thread of that context only, contexts run in parallel.
+ *
+ * @param arg [in] Context argument given to npu_sched_add_context()
+ * @return int 0: success; <0: failure; copied into job->ret
+ */
+typedef int (*npu_run_fn)(void *arg, npu_job_t *job);
+
+/**
+ * @brief Context argument of npu_sched_run_rknn(): the rknn context of each model on one slot
+ *
+ * Pointers to the owners' contexts, so a context replaced between jobs (model reload) is followed.
+ */
+typedef struct {
+    rknn_context *ctx[NPU_SCHED_MAX_MODELS];    // NULL: the slot does not run the model
+} npu_sched_rknn_t;
+
+/**
+ * @brief rknn backend: rknn_run on the slot's context of job->model
+ *
+ * The submitter sets the inputs before npu_sched_submit() and fetches the outputs after it,
+ * the worker thread only runs the NPU. job->data is the rknn_run_extend, NULL: none.
+ */
+int npu_sched_run_rknn(void *arg, npu_job_t *job);
+
+typedef struct {
+    uint64_t submitted;
+    uint64_t run;
+    uint64_t dropped;           // deadline passed while queued
+    uint64_t late;              // run, but finished after the deadline
+    int64_t latency_sum_us;     // submit to done, run jobs only
+    int64_t latency_max_us;
+    int64_t wait_sum_us;        // submit to start
+} npu_sched_class_stats_t;
+
+/**
+ * @brief One NPU execution slot: an rknn context, or one core with a context per model
+ *
+ * A slot runs one job at a time; the jobs of every model it has compete for it.
+ */
+typedef struct {
+    struct npu_sched_s *sched;
+    int index;
+    uint32_t model_mask;        // bit m: runs jobs of model m
+    void *arg;
+    pthread_t thread;
+    uint64_t jobs;
+    int64_t busy_us;
+} npu_sched_context_t;
+
+typedef struct npu_sched_s {
+    pthread_mutex_t lock;
+    pthread_cond_t work_cond;   // queue grew or quit
+    pthread_cond_t done_cond;   // a job finished or was dropped
+    int running;
+    int quit;
+
+    int policy;
+    npu_run_fn run;
+    npu_sched_context_t contexts[NPU_SCHED_MAX_CONTEXTS];
+    int context_num;
+
+    npu_job_t *head;            // submit order
+    npu_job_t *tail;
+    int queued;
+
+    npu_sched_class_stats_t stats[NPU_PRIO_NUM];
+} npu_sched_t;
+
+/**
+ * @brief Prepare an empty scheduler, add the contexts, then npu_sched_start()
+ *
+ * @param policy [in] NPU_SCHED_EDF or NPU_SCHED_FIFO
+ * @param run [in] Backend
+ * @return int 0: success; -1: error
+ */
+int npu_sched_init(npu_sched_t *sched, int policy, npu_run_fn run);
+
+/**
+ * @brief Register a context (rknn context, NPU core, simulated core, ...)
+ *
+ * Several contexts of the same model (rknn_dup_context, one per core) share its queue. A context
+ * with several models (one rknn context per model on the same core) takes the earliest deadline
+ * of all of them, so a background model cannot hold the core while a detection is due.
+ *
+ * @param model_mask [in] Bit m set: the context runs jobs of model m
+ * @param arg [in] Passed to run, which picks the rknn context of job->model
+ * @return int context index; -1: too many contexts
+ */
+int npu_sched_add_context(npu_sched_t *sched, uint32_t model_mask, void *arg);
+
+/**
+ * @brief Start one worker thread per context
+ *
+ * @return int 0: success; -1: error
+ */
+int npu_sched_start(npu_sched_t *sched);
+
+/**
+ * @brief Stop the workers, queued jobs are still dispatched (and dropped if late)
+ */
+void npu_sched_deinit(npu_sched_t *sched);
+
+/**
+ * @brief Queue a job and wait until it has run or was dropped
+ *
+ * Safe to call from several threads, one per stream and model. A free context of the job's model
+ * takes the queued job with the earliest deadline; jobs whose deadline has passed by then are
+ * dropped instead of run, the result would be stale and the NPU time is better spent on the others.
+ *
+ * @param job [in] data, model, priority and deadline_us set by the caller
+ * @return int job->ret, -1 when dropped or no context runs the model
+ */
+int npu_sched_submit(npu_sched_t *sched, npu_job_t *job);
+
+/**
+ * @brief rknn_init flag of a priority class, RKNN_FLAG_PRIOR_HIGH / MEDIUM / LOW
+ *
+ * The driver favours high priority contexts when their jobs compete for the same core.
+ */
+uint32_t npu_sched_init_flag(int priority);
+
+const char *npu_sched_priority_name(int priority);
+
+/**
+ * @brief Monotonic clock in microseconds, the time base of deadlines and stamps
+ */
+int64_t npu_sched_now_us();
+
+void npu_sched_reset_stats(npu_sched_t *sched);
+
+void npu_sched_print_stats(npu_sched_t *sched);
+
+#endif // _RKNN_YOLOV5_DEMO_NPU_SCHED_H_
@@ -0,0 +1,69 @@
+#ifndef _RKNN_YOLOV5_DEMO_NPU_TUNE_H_
+#define _RKNN_YOLOV5_DEMO_NPU_TUNE_H_
+
+#include <stdint.h>
+
+#include "rknn_api.h"
+
+#define NPU_TUNE_MAX_POOL 3
+#define NPU_TUNE_RUN_MS 1500        // measuring time per candidate
+#define NPU_TUNE_FILE "npu_tune.txt"
+
+// npu_tune_result_t.objective
+#define NPU_TUNE_THROUGHPUT 0       // most runs per second over the whole pool, for several streams
+#define NPU_TUNE_LATENCY    1       // lowest p50 of one run, for a single stream
+
+/**
+ * @brief One pool configuration and its measurement
+ *
+ * pool_size contexts of the model run back to back in their own threads, context i on core_masks[i].
+ */
+typedef struct {
+    int pool_size;
+    int core_masks[NPU_TUNE_MAX_POOL];  // rknn_core_mask
+    float fps;                          // runs per second of all contexts together
+    float p50_ms;                       // rknn_inputs_set + rknn_run + rknn_outputs_get of one context
+    float p99_ms;
+} npu_tune_result_t;
+
+/**
+ * @brief Identify a model file by size and FNV-1a of its data
+ *
+ * @return int 0: success; -1: file not readable
+ */
+int npu_tune_model_key(const char *model_path, uint32_t *size, uint64_t *hash);
+
+/**
+ * @brief Look up the tuned configuration of a model
+ *
+ * @param path [in] Tune file, one line per model and objective
+ * @return int 0: found; -1: not tuned yet
+ */
+int npu_tune_load(const char *path, uint32_t size, uint64_t hash, int objective, npu_tune_result_t *result);
+
+/**
+ * @brief Store a configuration, replacing the previous one of the model and objective
+ *
+ * @return int 0: success; -1: write error
+ */
+int npu_tune_save(const char *path, uint32_t size, uint64_t hash, int objective, const npu_tune_result_t *result);
+
+/**
+ * @brief Measure every candidate core mask / pool size combination with the model
+ *
+ * Candidates the NPU rejects (fewer cores) are skipped. The throughput winner is the fastest
+ * configuration, within 3% of it the one with the lower p99; the latency winner is the single
+ * context candidate with the lowest p50, so its core_masks[0] applies to one context as measured.
+ *
+ * @param run_ms [in] Measuring time per candidate, <= 0: NPU_TUNE_RUN_MS
+ * @param best [out] Winner per objective, indexed by NPU_TUNE_THROUGHPUT / NPU_TUNE_LATENCY
+ * @return int candidates measured; -1: model not loadable
+ */
+int npu_tune_run(const char *model_path, int run_ms, npu_tune_result_t best[2]);
+
+/**
+ * @brief Format the core masks, e.g. "0|1|2" for three single core contexts, "012" for one on all cores
+ */
+const char *npu_tune_describe(const npu_tune_result_t *result, char *buf, int size);
+
+#endif // _RKNN_YOLOV5_DEMO_NPU_TUNE_H_
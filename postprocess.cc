@@ -13,6 +13,7 @@
 // limitations under the License.
 
 #include "yolov5.h"
+#include "nms.h"
 
 #include <math.h>
 #include <stdint.h>
@@ -21,15 +22,16 @@
 #include <string.h>
 #include <sys/time.h>
 
-#include <set>
+#include <algorithm>
 #include <vector>
 #define LABEL_NALE_TXT_PATH "../model/coco_80_labels_list.txt"
 
 static char *labels[OBJ_CLASS_NUM];
 
-const int anchor[3][6] = {{10, 13, 16, 30, 33, 23},
-                          {30, 61, 62, 45, 59, 119},
-                          {116, 90, 156, 198, 373, 326}};
+static post_process_config_t pp_config = {PRE_NMS_TOPK, OBJ_NUMB_MAX_SIZE, NMS_HARD, NMS_SIGMA};
+
+// reused between frames, post_process is called from one thread
+static nms_boxes_t nms_boxes;
 
 inline static int clamp(float val, int min, int max) { return val > min ? (val < max ? val : max) : min; }
 
@@ -93,355 +95,48 @@ static int readLines(const char *fileName, char *lines[], int max_line)
     return i;
 }
 
-static int loadLabelName(const char *locationFilename, char *label[])
+int load_label_names(const char *path, char *labels[], int max_num)
 {
-    printf("load lable %s\n", locationFilename);
-    readLines(locationFilename, label, OBJ_CLASS_NUM);
-    return 0;
-}
-
-static float CalculateOverlap(float xmin0, float ymin0, float xmax0, float ymax0, float xmin1, float ymin1, float xmax1,
-                              float ymax1)
-{
-    float w = fmax(0.f, fmin(xmax0, xmax1) - fmax(xmin0, xmin1) + 1.0);
-    float h = fmax(0.f, fmin(ymax0, ymax1) - fmax(ymin0, ymin1) + 1.0);
-    float i = w * h;
-    float u = (xmax0 - xmin0 + 1.0) * (ymax0 - ymin0 + 1.0) + (xmax1 - xmin1 + 1.0) * (ymax1 - ymin1 + 1.0) - i;
-    return u <= 0.f ? 0.f : (i / u);
-}
-
-static int nms(int validCount, std::vector<float> &outputLocations, std::vector<int> classIds, std::vector<int> &order,
-               int filterId, float threshold)
-{
-    for (int i = 0; i < validCount; ++i)
-    {
-        if (order[i] == -1 || classIds[i] != filterId)
-        {
-            continue;
-        }
-        int n = order[i];
-        for (int j = i + 1; j < validCount; ++j)
-        {
-            int m = order[j];
-            if (m == -1 || classIds[i] != filterId)
-            {
-                continue;
-            }
-            float xmin0 = outputLocations[n * 4 + 0];
-            float ymin0 = outputLocations[n * 4 + 1];
-            float xmax0 = outputLocations[n * 4 + 0] + outputLocations[n * 4 + 2];
-            float ymax0 = outputLocations[n * 4 + 1] + outputLocations[n * 4 + 3];
-
-            float xmin1 = outputLocations[m * 4 + 0];
-            float ymin1 = outputLocations[m * 4 + 1];
-            float xmax1 = outputLocations[m * 4 + 0] + outputLocations[m * 4 + 2];
-            float ymax1 = outputLocations[m * 4 + 1] + outputLocations[m * 4 + 3];
-
-            float iou = CalculateOverlap(xmin0, ymin0, xmax0, ymax0, xmin1, ymin1, xmax1, ymax1);
-
-            if (iou > threshold)
-            {
-                order[j] = -1;
-            }
-        }
-    }
-    return 0;
+    printf("load lable %s\n", path);
+    return readLines(path, labels, max_num);
 }
 
-static int quick_sort_indice_inverse(std::vector<float> &input, int left, int right, std::vector<int> &indices)
+void free_label_names(char *labels[], int num)
 {
-    float key;
-    int key_index;
-    int low = left;
-    int high = right;
-    if (left < right)
+    for (int i = 0; i < num; i++)
     {
-        key_index = indices[left];
-        key = input[left];
-        while (low < high)
+        if (labels[i] != nullptr)
         {
-            while (low < high && input[high] <= key)
-            {
-                high--;
-            }
-            input[low] = input[high];
-            indices[low] = indices[high];
-            while (low < high && input[low] >= key)
-            {
-                low++;
-            }
-            input[high] = input[low];
-            indices[high] = indices[low];
+            free(labels[i]);
+            labels[i] = nullptr;
         }
-        input[low] = key;
-        indices[low] = key_index;
-        quick_sort_indice_inverse(input, left, low - 1, indices);
-        quick_sort_indice_inverse(input, low + 1, right, indices);
     }
-    return low;
-}
-
-static float sigmoid(float x) { return 1.0 / (1.0 + expf(-x)); }
-
-static float unsigmoid(float y) { return -1.0 * logf((1.0 / y) - 1.0); }
-
-inline static int32_t __clip(float val, float min, float max)
-{
-    float f = val <= min ? min : (val >= max ? max : val);
-    return f;
-}
-
-static int8_t qnt_f32_to_affine(float f32, int32_t zp, float scale)
-{
-    float dst_val = (f32 / scale) + zp;
-    int8_t res = (int8_t)__clip(dst_val, -128, 127);
-    return res;
 }
 
-static uint8_t qnt_f32_to_affine_u8(float f32, int32_t zp, float scale)
+/*
+ * Sort candidate indices by score (descending). When there are more than topk candidates only
+ * the best topk are selected (nth_element) and sorted, the rest are dropped.
+ */
+static int select_topk(std::vector<float> &scores, int count, int topk, std::vector<int> &order)
 {
-    float dst_val = (f32 / scale) + zp;
-    uint8_t res = (uint8_t)__clip(dst_val, 0, 255);
-    return res;
-}
-
-static float deqnt_affine_to_f32(int8_t qnt, int32_t zp, float scale) { return ((float)qnt - (float)zp) * scale; }
-static float deqnt_affine_u8_to_f32(uint8_t qnt, int32_t zp, float scale) { return ((float)qnt - (float)zp) * scale; }
-
-static int process_u8(uint8_t *input, int *anchor, int grid_h, int grid_w, int height, int width, int stride,
-                      std::vector<float> &boxes, std::vector<float> &objProbs, std::vector<int> &classId, float threshold,
-                      int32_t zp, float scale)
-{
-    int validCount = 0;
-    int grid_len = grid_h * grid_w;
-    uint8_t thres_u8 = qnt_f32_to_affine_u8(threshold, zp, scale);
-    for (int a = 0; a < 3; a++)
+    order.resize(count);
+    for (int i = 0; i < count; ++i)
     {
-        for (int i = 0; i < grid_h; i++)
-        {
-            for (int j = 0; j < grid_w; j++)
-            {
-                uint8_t box_confidence = input[(PROP_BOX_SIZE * a + 4) * grid_len + i * grid_w + j];
-                if (box_confidence >= thres_u8)
-                {
-                    int offset = (PROP_BOX_SIZE * a) * grid_len + i * grid_w + j;
-                    uint8_t *in_ptr = input + offset;
-                    float box_x = (deqnt_affine_u8_to_f32(*in_ptr, zp, scale)) * 2.0 - 0.5;
-                    float box_y = (deqnt_affine_u8_to_f32(in_ptr[grid_len], zp, scale)) * 2.0 - 0.5;
-                    float box_w = (deqnt_affine_u8_to_f32(in_ptr[2 * grid_len], zp, scale)) * 2.0;
-                    float box_h = (deqnt_affine_u8_to_f32(in_ptr[3 * grid_len], zp, scale)) * 2.0;
-                    box_x = (box_x + j) * (float)stride;
-                    box_y = (box_y + i) * (float)stride;
-                    box_w = box_w * box_w * (float)anchor[a * 2];
-                    box_h = box_h * box_h * (float)anchor[a * 2 + 1];
-                    box_x -= (box_w / 2.0);
-                    box_y -= (box_h / 2.0);
-
-                    uint8_t maxClassProbs = in_ptr[5 * grid_len];
-                    int maxClassId = 0;
-                    for (int k = 1; k < OBJ_CLASS_NUM; ++k)
-                    {
-                        uint8_t prob = in_ptr[(5 + k) * grid_len];
-                        if (prob > maxClassProbs)
-                        {
-                            maxClassId = k;
-                            maxClassProbs = prob;
-                        }
-                    }
-                    if (maxClassProbs > thres_u8)
-                    {
-                        objProbs.push_back((deqnt_affine_u8_to_f32(maxClassProbs, zp, scale)) * (deqnt_affine_u8_to_f32(box_confidence, zp, scale)));
-                        classId.push_back(maxClassId);
-                        validCount++;
-                        boxes.push_back(box_x);
-                        boxes.push_back(box_y);
-                        boxes.push_back(box_w);
-                        boxes.push_back(box_h);
-                    }
-                }
-            }
-        }
+        order[i] = i;
     }
-    return validCount;
-}
-
-static int process_i8(int8_t *input, int *anchor, int grid_h, int grid_w, int height, int width, int stride,
-                      std::vector<float> &boxes, std::vector<float> &objProbs, std::vector<int> &classId, float threshold,
-                      int32_t zp, float scale)
-{
-    int validCount = 0;
-    int grid_len = grid_h * grid_w;
-    int8_t thres_i8 = qnt_f32_to_affine(threshold, zp, scale);
-    for (int a = 0; a < 3; a++)
+    auto by_score = [&scores](int a, int b) { return scores[a] > scores[b]; };
+    if (topk > 0 && count > topk)
     {
-        for (int i = 0; i < grid_h; i++)
-        {
-            for (int j = 0; j < grid_w; j++)
-            {
-                int8_t box_confidence = input[(PROP_BOX_SIZE * a + 4) * grid_len + i * grid_w + j];
-                if (box_confidence >= thres_i8)
-                {
-                    int offset = (PROP_BOX_SIZE * a) * grid_len + i * grid_w + j;
-                    int8_t *in_ptr = input + offset;
-                    float box_x = (deqnt_affine_to_f32(*in_ptr, zp, scale)) * 2.0 - 0.5;
-                    float box_y = (deqnt_affine_to_f32(in_ptr[grid_len], zp, scale)) * 2.0 - 0.5;
-                    float box_w = (deqnt_affine_to_f32(in_ptr[2 * grid_len], zp, scale)) * 2.0;
-                    float box_h = (deqnt_affine_to_f32(in_ptr[3 * grid_len], zp, scale)) * 2.0;
-                    box_x = (box_x + j) * (float)stride;
-                    box_y = (box_y + i) * (float)stride;
-                    box_w = box_w * box_w * (float)anchor[a * 2];
-                    box_h = box_h * box_h * (float)anchor[a * 2 + 1];
-                    box_x -= (box_w / 2.0);
-                    box_y -= (box_h / 2.0);
-
-                    int8_t maxClassProbs = in_ptr[5 * grid_len];
-                    int maxClassId = 0;
-                    for (int k = 1; k < OBJ_CLASS_NUM; ++k)
-                    {
-                        int8_t prob = in_ptr[(5 + k) * grid_len];
-                        if (prob > maxClassProbs)
-                        {
-                            maxClassId = k;
-                            maxClassProbs = prob;
-                        }
-                    }
-                    if (maxClassProbs > thres_i8)
-                    {
-                        objProbs.push_back((deqnt_affine_to_f32(maxClassProbs, zp, scale)) * (deqnt_affine_to_f32(box_confidence, zp, scale)));
-                        classId.push_back(maxClassId);
-                        validCount++;
-                        boxes.push_back(box_x);
-                        boxes.push_back(box_y);
-                        boxes.push_back(box_w);
-                        boxes.push_back(box_h);
-                    }
-                }
-            }
-        }
-    }
-    return validCount;
-}
-
-static int process_i8_rv1106(int8_t *input, int *anchor, int grid_h, int grid_w, int height, int width, int stride,
-                      std::vector<float> &boxes, std::vector<float> &boxScores, std::vector<int> &classId, float threshold,
-                      int32_t zp, float scale) {
-    int validCount = 0;
-    int8_t thres_i8 = qnt_f32_to_affine(threshold, zp, scale);
-
-    int anchor_per_branch = 3;
-    int align_c = PROP_BOX_SIZE * anchor_per_branch;
-
-    for (int h = 0; h < grid_h; h++) {
-        for (int w = 0; w < grid_w; w++) {
-            for (int a = 0; a < anchor_per_branch; a++) {
-                int hw_offset = h * grid_w * align_c + w * align_c + a * PROP_BOX_SIZE;
-                int8_t *hw_ptr = input + hw_offset;
-                int8_t box_confidence = hw_ptr[4];
-
-                if (box_confidence >= thres_i8) {
-                    int8_t maxClassProbs = hw_ptr[5];
-                    int maxClassId = 0;
-                    for (int k = 1; k < OBJ_CLASS_NUM; ++k) {
-                        int8_t prob = hw_ptr[5 + k];
-                        if (prob > maxClassProbs) {
-                            maxClassId = k;
-                            maxClassProbs = prob;
-                        }
-                    }
-
-                    float box_conf_f32 = deqnt_affine_to_f32(box_confidence, zp, scale);
-                    float class_prob_f32 = deqnt_affine_to_f32(maxClassProbs, zp, scale);
-                    float limit_score = box_conf_f32 * class_prob_f32;
-
-                    if (limit_score > threshold) {
-                        float box_x, box_y, box_w, box_h;
-
-                        box_x = deqnt_affine_to_f32(hw_ptr[0], zp, scale) * 2.0 - 0.5;
-                        box_y = deqnt_affine_to_f32(hw_ptr[1], zp, scale) * 2.0 - 0.5;
-                        box_w = deqnt_affine_to_f32(hw_ptr[2], zp, scale) * 2.0;
-                        box_h = deqnt_affine_to_f32(hw_ptr[3], zp, scale) * 2.0;
-                        box_w = box_w * box_w;
-                        box_h = box_h * box_h;
-
-
-                        box_x = (box_x + w) * (float)stride;
-                        box_y = (box_y + h) * (float)stride;
-                        box_w *= (float)anchor[a * 2];
-                        box_h *= (float)anchor[a * 2 + 1];
-
-                        box_x -= (box_w / 2.0);
-                        box_y -= (box_h / 2.0);
-
-                        boxes.push_back(box_x);
-                        boxes.push_back(box_y);
-                        boxes.push_back(box_w);
-                        boxes.push_back(box_h);
-                        boxScores.push_back(limit_score);
-                        classId.push_back(maxClassId);
-                        validCount++;
-                    }
-                }
-            }
-        }
+        std::nth_element(order.begin(), order.begin() + topk, order.end(), by_score);
+        order.resize(topk);
     }
-    return validCount;
+    std::sort(order.begin(), order.end(), by_score);
+    return order.size();
 }
 
-static int process_fp32(float *input, int *anchor, int grid_h, int grid_w, int height, int width, int stride,
-                        std::vector<float> &boxes, std::vector<float> &objProbs, std::vector<int> &classId, float threshold)
-{
-    int validCount = 0;
-    int grid_len = grid_h * grid_w;
+static float sigmoid(float x) { return 1.0 / (1.0 + expf(-x)); }
 
-    for (int a = 0; a < 3; a++)
-    {
-        for (int i = 0; i < grid_h; i++)
-        {
-            for (int j = 0; j < grid_w; j++)
-            {
-                float box_confidence = input[(PROP_BOX_SIZE * a + 4) * grid_len + i * grid_w + j];
-                if (box_confidence >= threshold)
-                {
-                    int offset = (PROP_BOX_SIZE * a) * grid_len + i * grid_w + j;
-                    float *in_ptr = input + offset;
-                    float box_x = *in_ptr * 2.0 - 0.5;
-                    float box_y = in_ptr[grid_len] * 2.0 - 0.5;
-                    float box_w = in_ptr[2 * grid_len] * 2.0;
-                    float box_h = in_ptr[3 * grid_len] * 2.0;
-                    box_x = (box_x + j) * (float)stride;
-                    box_y = (box_y + i) * (float)stride;
-                    box_w = box_w * box_w * (float)anchor[a * 2];
-                    box_h = box_h * box_h * (float)anchor[a * 2 + 1];
-                    box_x -= (box_w / 2.0);
-                    box_y -= (box_h / 2.0);
-
-                    float maxClassProbs = in_ptr[5 * grid_len];
-                    int maxClassId = 0;
-                    for (int k = 1; k < OBJ_CLASS_NUM; ++k)
-                    {
-                        float prob = in_ptr[(5 + k) * grid_len];
-                        if (prob > maxClassProbs)
-                        {
-                            maxClassId = k;
-                            maxClassProbs = prob;
-                        }
-                    }
-                    if (maxClassProbs > threshold)
-                    {
-                        objProbs.push_back(maxClassProbs * box_confidence);
-                        classId.push_back(maxClassId);
-                        validCount++;
-                        boxes.push_back(box_x);
-                        boxes.push_back(box_y);
-                        boxes.push_back(box_w);
-                        boxes.push_back(box_h);
-                    }
-                }
-            }
-        }
-    }
-    return validCount;
-}
+static float unsigmoid(float y) { return -1.0 * logf((1.0 / y) - 1.0); }
 
 int post_process(rknn_app_context_t *app_ctx, void *outputs, letterbox_t *letter_box, float conf_threshold, float nms_threshold, object_detect_result_list *od_results)
 {
@@ -462,48 +157,34 @@ int post_process(rknn_app_context_t *app_ctx, void *outputs, letterbox_t *letter
 
     memset(od_results, 0, sizeof(object_detect_result_list));
 
-    for (int i = 0; i < 3; i++)
+    const yolov5_decoder_t *dec = &app_ctx->decoder;
+    for (int i = 0; i < YOLOV5_HEAD_NUM; i++)
     {
-
 #if defined(RV1106_1103) 
-        grid_h = app_ctx->output_attrs[i].dims[1];
-        grid_w = app_ctx->output_attrs[i].dims[2];
-        stride = model_in_h / grid_h;
-        //RV1106 only support i8
-        if (app_ctx->is_quant) {
-            validCount += process_i8_rv1106((int8_t *)(_outputs[i]->virt_addr), (int *)anchor[i], grid_h, grid_w, model_in_h, model_in_w, stride, filterBoxes, objProbs,
-                                     classId, conf_threshold, app_ctx->output_attrs[i].zp, app_ctx->output_attrs[i].scale);
-        }
-#elif defined(RKNPU1)
+        void *head = _outputs[i]->virt_addr;
+#else
+        void *head = _outputs[i].buf;
+#endif
+#if defined(RKNPU1)
         // NCHW reversed: WHCN
         grid_h = app_ctx->output_attrs[i].dims[1];
         grid_w = app_ctx->output_attrs[i].dims[0];
-        stride = model_in_h / grid_h;
-        if (app_ctx->is_quant)
-        {
-            validCount += process_u8((uint8_t *)_outputs[i].buf, (int *)anchor[i], grid_h, grid_w, model_in_h, model_in_w, stride, filterBoxes, objProbs,
-                                     classId, conf_threshold, app_ctx->output_attrs[i].zp, app_ctx->output_attrs[i].scale);
-        }
-        else
-        {
-            validCount += process_fp32((float *)_outputs[i].buf, (int *)anchor[i], grid_h, grid_w, model_in_h, model_in_w, stride, filterBoxes, objProbs,
-                                       classId, conf_threshold);
-        }
 #else
-        grid_h = app_ctx->output_attrs[i].dims[2];
-        grid_w = app_ctx->output_attrs[i].dims[3];
-        stride = model_in_h / grid_h;
-        if (app_ctx->is_quant)
+        if (dec->layout == YOLOV5_LAYOUT_NHWC)
         {
-            validCount += process_i8((int8_t *)_outputs[i].buf, (int *)anchor[i], grid_h, grid_w, model_in_h, model_in_w, stride, filterBoxes, objProbs,
-                                     classId, conf_threshold, app_ctx->output_attrs[i].zp, app_ctx->output_attrs[i].scale);
+            grid_h = app_ctx->output_attrs[i].dims[1];
+            grid_w = app_ctx->output_attrs[i].dims[2];
         }
         else
         {
-            validCount += process_fp32((float *)_outputs[i].buf, (int *)anchor[i], grid_h, grid_w, model_in_h, model_in_w, stride, filterBoxes, objProbs,
-                                       classId, conf_threshold);
+            grid_h = app_ctx->output_attrs[i].dims[2];
+            grid_w = app_ctx->output_attrs[i].dims[3];
         }
 #endif
+        stride = model_in_h / grid_h;
+        validCount += dec->decode(head, dec->anchors[i], grid_h, grid_w, stride, dec->num_class, dec->anchors_per_head,
+                                  filterBoxes, objProbs, classId, conf_threshold,
+                                  app_ctx->output_attrs[i].zp, app_ctx->output_attrs[i].scale);
     }
 
     // no object detect
@@ -511,55 +192,119 @@ int post_process(rknn_app_context_t *app_ctx, void *outputs, letterbox_t *letter
     {
         return 0;
     }
+    od_results->candidates = validCount;
+
     std::vector<int> indexArray;
-    for (int i = 0; i < validCount; ++i)
+    int topk = select_topk(objProbs, validCount, pp_config.pre_nms_topk, indexArray);
+    if (topk < validCount)
     {
-        indexArray.push_back(i);
+        od_results->clipped |= POST_PROCESS_CLIP_TOPK;
     }
-    quick_sort_indice_inverse(objProbs, 0, validCount - 1, indexArray);
-
-    std::set<int> class_set(std::begin(classId), std::end(classId));
 
-    for (auto c : class_set)
+    int max_det = pp_config.max_det;
+    if (max_det <= 0 || max_det > OBJ_NUMB_MAX_SIZE)
     {
-        nms(validCount, filterBoxes, classId, indexArray, c, nms_threshold);
+        max_det = OBJ_NUMB_MAX_SIZE;
+    }
+    nms_boxes_resize(&nms_boxes, topk);
+    for (int i = 0; i < topk; ++i)
+    {
+        int n = indexArray[i];
+        nms_boxes_set(&nms_boxes, i, filterBoxes[n * 4 + 0], filterBoxes[n * 4 + 1], filterBoxes[n * 4 + 2],
+                      filterBoxes[n * 4 + 3], objProbs[n], classId[n]);
     }
 
-    int last_count = 0;
-    od_results->count = 0;
+    nms_config_t nms_cfg;
+    nms_cfg.method = pp_config.nms_method;
+    nms_cfg.iou_threshold = nms_threshold;
+    nms_cfg.score_threshold = conf_threshold;
+    nms_cfg.sigma = pp_config.nms_sigma;
+    nms_cfg.max_det = max_det;
+    std::vector<int> keep;
+    int nms_clipped = 0;
+    int last_count = run_nms(&nms_boxes, &nms_cfg, keep, &nms_clipped);
+    if (nms_clipped)
+    {
+        od_results->clipped |= POST_PROCESS_CLIP_MAX_DET;
+    }
 
     /* box valid detect target */
-    for (int i = 0; i < validCount; ++i)
+    for (int i = 0; i < last_count; ++i)
     {
-        if (indexArray[i] == -1 || last_count >= OBJ_NUMB_MAX_SIZE)
+        int n = keep[i];
+
+        float x1 = nms_boxes.x1[n] - letter_box->x_pad;
+        float y1 = nms_boxes.y1[n] - letter_box->y_pad;
+        float x2 = nms_boxes.x2[n] - letter_box->x_pad;
+        float y2 = nms_boxes.y2[n] - letter_box->y_pad;
+        int id = nms_boxes.cls[n];
+        float obj_conf = nms_boxes.score[n];
+
+        od_results->results[i].box.left = (int)(clamp(x1, 0, model_in_w) / letter_box->scale);
+        od_results->results[i].box.top = (int)(clamp(y1, 0, model_in_h) / letter_box->scale);
+        od_results->results[i].box.right = (int)(clamp(x2, 0, model_in_w) / letter_box->scale);
+        od_results->results[i].box.bottom = (int)(clamp(y2, 0, model_in_h) / letter_box->scale);
+        od_results->results[i].prop = obj_conf;
+        od_results->results[i].cls_id = id;
+        od_results->results[i].sub_cls_id = -1;
+        od_results->results[i].sub_prop = 0;
+    }
+    od_results->count = last_count;
+    return 0;
+}
+
+int rotate_detect_results(object_detect_result_list *od_results, int src_width, int src_height, int rotation)
+{
+    for (int i = 0; i < od_results->count; ++i)
+    {
+        image_rect_t *box = &od_results->results[i].box;
+        image_rect_t r = *box;
+        switch (rotation)
         {
-            continue;
+        case 0:
+            break;
+        case 90:
+            // (x, y) -> (y, W - 1 - x)
+            box->left = r.top;
+            box->right = r.bottom;
+            box->top = src_width - 1 - r.right;
+            box->bottom = src_width - 1 - r.left;
+            break;
+        case 180:
+            box->left = src_width - 1 - r.right;
+            box->right = src_width - 1 - r.left;
+            box->top = src_height - 1 - r.bottom;
+            box->bottom = src_height - 1 - r.top;
+            break;
+        case 270:
+            // (x, y) -> (H - 1 - y, x)
+            box->left = src_height - 1 - r.bottom;
+            box->right = src_height - 1 - r.top;
+            box->top = r.left;
+            box->bottom = r.right;
+            break;
+        default:
+            printf("unsupported rotation %d\n", rotation);
+            return -1;
         }
-        int n = indexArray[i];
-
-        float x1 = filterBoxes[n * 4 + 0] - letter_box->x_pad;
-        float y1 = filterBoxes[n * 4 + 1] - letter_box->y_pad;
-        float x2 = x1 + filterBoxes[n * 4 + 2];
-        float y2 = y1 + filterBoxes[n * 4 + 3];
-        int id = classId[n];
-        float obj_conf = objProbs[i];
-
-        od_results->results[last_count].box.left = (int)(clamp(x1, 0, model_in_w) / letter_box->scale);
-        od_results->results[last_count].box.top = (int)(clamp(y1, 0, model_in_h) / letter_box->scale);
-        od_results->results[last_count].box.right = (int)(clamp(x2, 0, model_in_w) / letter_box->scale);
-        od_results->results[last_count].box.bottom = (int)(clamp(y2, 0, model_in_h) / letter_box->scale);
-        od_results->results[last_count].prop = obj_conf;
-        od_results->results[last_count].cls_id = id;
-        last_count++;
     }
-    od_results->count = last_count;
     return 0;
 }
 
+void set_post_process_config(const post_process_config_t *config)
+{
+    pp_config = *config;
+}
+
+void get_post_process_config(post_process_config_t *config)
+{
+    *config = pp_config;
+}
+
 int init_post_process()
 {
     int ret = 0;
-    ret = loadLabelName(LABEL_NALE_TXT_PATH, labels);
+    ret = load_label_names(LABEL_NALE_TXT_PATH, labels, OBJ_CLASS_NUM);
     if (ret < 0)
     {
         printf("Load %s failed!\n", LABEL_NALE_TXT_PATH);
@@ -586,12 +331,5 @@ char *coco_cls_to_name(int cls_id)
 
 void deinit_post_process()
 {
-    for (int i = 0; i < OBJ_CLASS_NUM; i++)
-    {
-        if (labels[i] != nullptr)
-        {
-            free(labels[i]);
-            labels[i] = nullptr;
-        }
-    }
+    free_label_names(labels, OBJ_CLASS_NUM);
 }
@@ -6,13 +6,19 @@
 #include "rknn_api.h"
 #include "common.h"
 #include "image_utils.h"
+#include "nms.h"
 
 #define OBJ_NAME_MAX_SIZE 64
 #define OBJ_NUMB_MAX_SIZE 128
-#define OBJ_CLASS_NUM 80
+#define OBJ_CLASS_NUM 80 // max label count, the decoder reads the real class count from the model
 #define NMS_THRESH 0.45
 #define BOX_THRESH 0.25
-#define PROP_BOX_SIZE (5 + OBJ_CLASS_NUM)
+#define PRE_NMS_TOPK 1024
+#define NMS_SIGMA 0.5f // Soft / Matrix NMS gaussian sigma
+
+// od_results.clipped flags
+#define POST_PROCESS_CLIP_TOPK      0x1 // more candidates than pre_nms_topk, lowest scores dropped
+#define POST_PROCESS_CLIP_MAX_DET   0x2 // NMS stopped at max_det
 
 // class rknn_app_context_t;
 
@@ -20,17 +26,46 @@ typedef struct {
     image_rect_t box;
     float prop;
     int cls_id;
+    int sub_cls_id;     // second stage class (cascade_run), -1: not classified
+    float sub_prop;
 } object_detect_result;
 
 typedef struct {
     int id;
     int count;
+    int candidates;     // boxes above conf threshold before top-K selection
+    int clipped;        // POST_PROCESS_CLIP_* flags
     object_detect_result results[OBJ_NUMB_MAX_SIZE];
 } object_detect_result_list;
 
+typedef struct {
+    int pre_nms_topk;   // max candidates sorted and fed to NMS, <= 0: no limit
+    int max_det;        // max detections kept after NMS, clamped to OBJ_NUMB_MAX_SIZE
+    nms_method_t nms_method;
+    float nms_sigma;    // only used by NMS_SOFT / NMS_MATRIX
+} post_process_config_t;
+
 int init_post_process();
 void deinit_post_process();
 char *coco_cls_to_name(int cls_id);
+/**
+ * @brief Read one label per line
+ *
+ * @return int labels read; -1: file not found
+ */
+int load_label_names(const char *path, char *labels[], int max_num);
+void free_label_names(char *labels[], int num);
+void set_post_process_config(const post_process_config_t *config);
+void get_post_process_config(post_process_config_t *config);
+/**
+ * @brief Map boxes found on the unrotated frame to the frame rotated counterclockwise by rotation degrees
+ *
+ * @param src_width [in] Width of the frame the boxes were detected on
+ * @param src_height [in] Height of the frame the boxes were detected on
+ * @param rotation [in] 0 / 90 / 180 / 270, counterclockwise like cv::ROTATE_90_COUNTERCLOCKWISE
+ * @return int 0: success, -1: unsupported rotation
+ */
+int rotate_detect_results(object_detect_result_list *od_results, int src_width, int src_height, int rotation);
 int post_process(rknn_app_context_t *app_ctx, void *outputs, letterbox_t *letter_box, float conf_threshold, float nms_threshold, object_detect_result_list *od_results);
 
 void deinitPostProcess();
@@ -0,0 +1,391 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "cascade.h"
+#include "file_utils.h"
+#include "image_utils.h"
+#include "rga_job.h"
+
+static int64_t get_time_us(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+void cascade_default_config(cascade_config_t *config)
+{
+    memset(config, 0, sizeof(cascade_config_t));
+    config->min_size = 16;
+    config->max_crops = 8;
+    config->expand = 0.1f;
+    config->core_mask = RKNN_NPU_CORE_2;
+    config->priority = NPU_PRIO_LOW;
+}
+
+int cascade_parse_classes(cascade_config_t *config, const char *str)
+{
+    config->class_num = 0;
+    const char *p = str;
+    while (*p != '\0') {
+        char *end;
+        long cls = strtol(p, &end, 10);
+        if (end == p || cls < 0 || config->class_num >= CASCADE_MAX_CLASSES || (*end != '\0' && *end != '+')) {
+            printf("cascade: invalid class list %s\n", str);
+            return -1;
+        }
+        config->classes[config->class_num++] = (int)cls;
+        p = *end == '+' ? end + 1 : end;
+    }
+    return 0;
+}
+
+int cascade_init(cascade_t *cascade, const char *model_path, const char *labels_path, const cascade_config_t *config)
+{
+    memset(cascade, 0, sizeof(cascade_t));
+    cascade->config = *config;
+    if (cascade->config.max_crops > CASCADE_MAX_CROPS) {
+        cascade->config.max_crops = CASCADE_MAX_CROPS;
+    }
+    if (cascade->config.min_size < 2) {
+        cascade->config.min_size = 2;
+    }
+
+    char *model = NULL;
+    int model_len = read_data_from_file(model_path, &model);
+    if (model == NULL) {
+        printf("cascade: load %s fail\n", model_path);
+        return -1;
+    }
+    // on single core NPUs the classifier shares the core, the detector jobs go first
+    int ret = rknn_init(&cascade->rknn_ctx, model, model_len, npu_sched_init_flag(cascade->config.priority), NULL);
+    free(model);
+    if (ret < 0) {
+        printf("cascade: rknn_init fail! ret=%d\n", ret);
+        cascade->rknn_ctx = 0;
+        return -1;
+    }
+
+    ret = rknn_query(cascade->rknn_ctx, RKNN_QUERY_IN_OUT_NUM, &cascade->io_num, sizeof(cascade->io_num));
+    cascade->input_attr.index = 0;
+    cascade->output_attr.index = 0;
+    if (ret != RKNN_SUCC || cascade->io_num.n_input != 1 || cascade->io_num.n_output < 1 ||
+        rknn_query(cascade->rknn_ctx, RKNN_QUERY_INPUT_ATTR, &cascade->input_attr, sizeof(rknn_tensor_attr)) != RKNN_SUCC ||
+        rknn_query(cascade->rknn_ctx, RKNN_QUERY_OUTPUT_ATTR, &cascade->output_attr, sizeof(rknn_tensor_attr)) != RKNN_SUCC) {
+        printf("cascade: %s is not a single input classifier\n", model_path);
+        cascade_release(cascade);
+        return -1;
+    }
+
+    rknn_tensor_attr *in = &cascade->input_attr;
+    int channel;
+    if (in->fmt == RKNN_TENSOR_NCHW) {
+        channel = in->dims[1];
+        cascade->height = in->dims[2];
+        cascade->width = in->dims[3];
+    } else {
+        cascade->height = in->dims[1];
+        cascade->width = in->dims[2];
+        channel = in->dims[3];
+    }
+    cascade->batch = in->n_dims == 4 && in->dims[0] > 1 ? in->dims[0] : 1;
+    cascade->class_num = cascade->output_attr.n_elems / cascade->batch;
+    if (channel != 3 || cascade->class_num < 1) {
+        printf("cascade: unsupported classifier input channel %d, %d outputs\n", channel, cascade->output_attr.n_elems);
+        cascade_release(cascade);
+        return -1;
+    }
+
+    if (cascade->config.core_mask != RKNN_NPU_CORE_AUTO) {
+        // single core NPUs reject the mask, the classifier then shares the core with the detector
+        ret = rknn_set_core_mask(cascade->rknn_ctx, (rknn_core_mask)cascade->config.core_mask);
+        if (ret != RKNN_SUCC) {
+            printf("cascade: rknn_set_core_mask %d fail! ret=%d\n", cascade->config.core_mask, ret);
+        }
+    }
+
+    // the NPU reads uint8 NHWC and converts to its own layout, no CPU pass over the crops
+    uint32_t size = (uint32_t)cascade->batch * cascade->height * cascade->width * 3;
+    in->type = RKNN_TENSOR_UINT8;
+    in->fmt = RKNN_TENSOR_NHWC;
+    in->pass_through = 0;
+    in->size = size;
+    in->size_with_stride = size;
+    cascade->input_mem = rknn_create_mem(cascade->rknn_ctx, size);
+    if (cascade->input_mem == NULL) {
+        printf("cascade: rknn_create_mem %u fail\n", size);
+        cascade_release(cascade);
+        return -1;
+    }
+    ret = rknn_set_io_mem(cascade->rknn_ctx, cascade->input_mem, in);
+    if (ret != RKNN_SUCC) {
+        printf("cascade: rknn_set_io_mem fail! ret=%d\n", ret);
+        cascade_release(cascade);
+        return -1;
+    }
+    cascade->input.width = cascade->width;
+    cascade->input.height = cascade->height * cascade->batch;
+    cascade->input.format = IMAGE_FORMAT_RGB888;
+    cascade->input.virt_addr = (unsigned char *)cascade->input_mem->virt_addr;
+    cascade->input.size = size;
+    cascade->input.fd = cascade->input_mem->fd;
+
+    if (labels_path != NULL) {
+        cascade->labels = (char **)calloc(CASCADE_MAX_LABELS, sizeof(char *));
+        if (cascade->labels != NULL) {
+            cascade->label_num = load_label_names(labels_path, cascade->labels, CASCADE_MAX_LABELS);
+        }
+        if (cascade->label_num < 0) {
+            cascade->label_num = 0;
+        }
+    }
+
+    printf("cascade: %s %dx%d batch %d, %d classes, %d labels, core mask %d, max %d crops per frame\n", model_path,
+           cascade->width, cascade->height, cascade->batch, cascade->class_num, cascade->label_num,
+           cascade->config.core_mask, cascade->config.max_crops);
+    return 0;
+}
+
+void cascade_release(cascade_t *cascade)
+{
+    if (cascade->labels != NULL) {
+        free_label_names(cascade->labels, CASCADE_MAX_LABELS);
+        free(cascade->labels);
+        cascade->labels = NULL;
+    }
+    if (cascade->input_mem != NULL) {
+        rknn_destroy_mem(cascade->rknn_ctx, cascade->input_mem);
+        cascade->input_mem = NULL;
+    }
+    if (cascade->rknn_ctx != 0) {
+        rknn_destroy(cascade->rknn_ctx);
+        cascade->rknn_ctx = 0;
+    }
+}
+
+static int class_selected(const cascade_config_t *config, int cls_id)
+{
+    if (config->class_num == 0) {
+        return 1;
+    }
+    for (int i = 0; i < config->class_num; i++) {
+        if (config->classes[i] == cls_id) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* detection box grown for context and clipped to the image, -1: too small */
+static int crop_box(const cascade_config_t *config, const image_buffer_t *src, const image_rect_t *box,
+                    image_rect_t *crop)
+{
+    int w = box->right - box->left + 1;
+    int h = box->bottom - box->top + 1;
+    if (w < config->min_size || h < config->min_size) {
+        return -1;
+    }
+    int ex = (int)(w * config->expand);
+    int ey = (int)(h * config->expand);
+    crop->left = box->left - ex > 0 ? box->left - ex : 0;
+    crop->top = box->top - ey > 0 ? box->top - ey : 0;
+    crop->right = box->right + ex < src->width - 1 ? box->right + ex : src->width - 1;
+    crop->bottom = box->bottom + ey < src->height - 1 ? box->bottom + ey : src->height - 1;
+    if (crop->right - crop->left < 1 || crop->bottom - crop->top < 1) {
+        return -1;
+    }
+    return 0;
+}
+
+static void slot_box(cascade_t *cascade, int slot, image_rect_t *box)
+{
+    box->left = 0;
+    box->top = slot * cascade->height;
+    box->right = cascade->width - 1;
+    box->bottom = box->top + cascade->height - 1;
+}
+
+/* scale crops[0..n) into slots 0..n, one RGA job per RGA_JOB_MAX_TASKS crops */
+static int fill_slots(cascade_t *cascade, image_buffer_t *src, image_rect_t *crops, int n)
+{
+    rga_job_t job;
+    image_rect_t slot;
+    int ret = 0;
+    for (int i = 0; i < n && ret == 0; i += RGA_JOB_MAX_TASKS) {
+        int end = i + RGA_JOB_MAX_TASKS < n ? i + RGA_JOB_MAX_TASKS : n;
+        ret = rga_job_begin(&job);
+        for (int b = i; b < end && ret == 0; b++) {
+            slot_box(cascade, b, &slot);
+            ret = rga_job_add_convert(&job, src, &cascade->input, &crops[b], &slot, 0, 0);
+        }
+        if (ret == 0) {
+            ret = rga_job_submit(&job, 0);
+        } else {
+            rga_job_cancel(&job);
+        }
+    }
+    if (ret == 0) {
+        return 0;
+    }
+
+    // RGA refuses very small crops and large scale ratios, convert_image falls back to the CPU
+    for (int b = 0; b < n; b++) {
+        slot_box(cascade, b, &slot);
+        if (convert_image(src, &cascade->input, &crops[b], &slot, 0) != 0) {
+            return -1;
+        }
+    }
+    return rknn_mem_sync(cascade->rknn_ctx, cascade->input_mem, RKNN_MEMORY_SYNC_TO_DEVICE) == RKNN_SUCC ? 0 : -1;
+}
+
+/* probability of the best class: the output as is when it already sums to 1, else its softmax */
+static float class_prob(const float *scores, int num, int best)
+{
+    float sum = 0;
+    int probs = 1;
+    for (int i = 0; i < num; i++) {
+        if (scores[i] < 0 || scores[i] > 1) {
+            probs = 0;
+        }
+        sum += scores[i];
+    }
+    if (probs && fabsf(sum - 1) < 0.01f) {
+        return scores[best];
+    }
+    sum = 0;
+    for (int i = 0; i < num; i++) {
+        sum += expf(scores[i] - scores[best]);
+    }
+    return 1 / sum;
+}
+
+/* 0: classified; 1: dropped by the scheduler, the deadline passed; -1: error */
+static int classify_slots(cascade_t *cascade, object_detect_result **results, int n, int64_t deadline_us)
+{
+    int64_t start = get_time_us();
+    int ret;
+    if (cascade->sched != NULL) {
+        // below the detector's priority, a due detection takes the NPU first
+        npu_job_t job;
+        memset(&job, 0, sizeof(job));
+        job.model = cascade->sched_model;
+        job.priority = cascade->config.priority;
+        job.deadline_us = deadline_us;
+        ret = npu_sched_submit(cascade->sched, &job);
+        if (job.dropped) {
+            cascade->dropped += n;
+            return 1;
+        }
+    } else {
+        ret = rknn_run(cascade->rknn_ctx, NULL);
+    }
+    if (ret < 0) {
+        printf("cascade: rknn_run fail! ret=%d\n", ret);
+        return -1;
+    }
+    rknn_output outputs[cascade->io_num.n_output];
+    memset(outputs, 0, sizeof(outputs));
+    for (uint32_t i = 0; i < cascade->io_num.n_output; i++) {
+        outputs[i].index = i;
+        outputs[i].want_float = 1;
+    }
+    ret = rknn_outputs_get(cascade->rknn_ctx, cascade->io_num.n_output, outputs, NULL);
+    if (ret < 0) {
+        printf("cascade: rknn_outputs_get fail! ret=%d\n", ret);
+        return -1;
+    }
+
+    // slots past n hold stale crops, their scores are ignored
+    for (int b = 0; b < n; b++) {
+        const float *scores = (const float *)outputs[0].buf + (size_t)b * cascade->class_num;
+        int best = 0;
+        for (int i = 1; i < cascade->class_num; i++) {
+            if (scores[i] > scores[best]) {
+                best = i;
+            }
+        }
+        results[b]->sub_cls_id = best;
+        results[b]->sub_prop = class_prob(scores, cascade->class_num, best);
+    }
+    rknn_outputs_release(cascade->rknn_ctx, cascade->io_num.n_output, outputs);
+    cascade->runs++;
+    cascade->npu_us += get_time_us() - start;
+    return 0;
+}
+
+int cascade_run(cascade_t *cascade, image_buffer_t *src, object_detect_result_list *od_results, int64_t deadline_us)
+{
+    object_detect_result *selected[OBJ_NUMB_MAX_SIZE];
+    image_rect_t crops[OBJ_NUMB_MAX_SIZE];
+    int n = 0;
+    cascade->frames++;
+
+    for (int i = 0; i < od_results->count; i++) {
+        object_detect_result *r = &od_results->results[i];
+        r->sub_cls_id = -1;
+        r->sub_prop = 0;
+        if (!class_selected(&cascade->config, r->cls_id) || crop_box(&cascade->config, src, &r->box, &crops[n]) != 0) {
+            cascade->skipped++;
+            continue;
+        }
+        // highest detector scores first, the budget drops the least certain boxes
+        int j = n++;
+        image_rect_t crop = crops[j];
+        for (; j > 0 && selected[j - 1]->prop < r->prop; j--) {
+            selected[j] = selected[j - 1];
+            crops[j] = crops[j - 1];
+        }
+        selected[j] = r;
+        crops[j] = crop;
+    }
+    if (n > cascade->config.max_crops) {
+        cascade->over_budget += n - cascade->config.max_crops;
+        n = cascade->config.max_crops;
+    }
+
+    for (int i = 0; i < n; i += cascade->batch) {
+        int num = n - i < cascade->batch ? n - i : cascade->batch;
+        int64_t start = get_time_us();
+        if (fill_slots(cascade, src, &crops[i], num) != 0) {
+            printf("cascade: crop fail\n");
+            return -1;
+        }
+        cascade->crop_us += get_time_us() - start;
+        int ret = classify_slots(cascade, &selected[i], num, deadline_us);
+        if (ret < 0) {
+            return -1;
+        }
+        if (ret > 0) {
+            // the later batches are past the deadline as well
+            cascade->dropped += n - i - num;
+            n = i;
+            break;
+        }
+    }
+    cascade->crops += n;
+    return n;
+}
+
+const char *cascade_cls_to_name(cascade_t *cascade, int cls_id)
+{
+    if (cls_id < 0 || cls_id >= cascade->label_num || cascade->labels[cls_id] == NULL) {
+        return NULL;
+    }
+    return cascade->labels[cls_id];
+}
+
+void cascade_print_stats(cascade_t *cascade)
+{
+    if (cascade->frames == 0) {
+        return;
+    }
+    double frames = (double)cascade->frames;
+    printf("cascade: %.2f crops / frame, skipped %llu, over budget %llu, dropped %llu, %.2f runs / frame, crop %.2f ms, "
+           "npu %.2f ms per frame\n",
+           cascade->crops / frames, (unsigned long long)cascade->skipped, (unsigned long long)cascade->over_budget,
+           (unsigned long long)cascade->dropped, cascade->runs / frames, cascade->crop_us / frames / 1000,
+           cascade->npu_us / frames / 1000);
+}
@@ -0,0 +1,322 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "npu_mem.h"
+#include "dma_alloc.h"
+
+int npu_mem_flags_from_string(const char *str)
+{
+    static const struct {
+        const char *name;
+        int flag;
+    } names[] = {
+        {"weights", NPU_MEM_SHARE_WEIGHTS},
+        {"internal", NPU_MEM_SHARE_INTERNAL},
+        {"sram", NPU_MEM_SRAM},
+        {"share-sram", NPU_MEM_SRAM | NPU_MEM_SHARE_SRAM},
+    };
+    int flags = 0;
+    const char *p = str;
+    while (*p != '\0') {
+        const char *end = strchr(p, ',');
+        size_t len = end != NULL ? (size_t)(end - p) : strlen(p);
+        int found = 0;
+        for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+            if (strlen(names[i].name) == len && strncmp(names[i].name, p, len) == 0) {
+                flags |= names[i].flag;
+                found = 1;
+                break;
+            }
+        }
+        if (!found) {
+            printf("unknown npu memory option %.*s\n", (int)len, p);
+            return -1;
+        }
+        p += len;
+        if (*p == ',') {
+            p++;
+        }
+    }
+    return flags;
+}
+
+void npu_mem_init(npu_mem_t *mem, int flags)
+{
+    memset(mem, 0, sizeof(npu_mem_t));
+    pthread_mutex_init(&mem->lock, NULL);
+    mem->flags = flags;
+    mem->internal_fd = -1;
+}
+
+void npu_mem_deinit(npu_mem_t *mem)
+{
+    if (mem->num > 0) {
+        printf("npu mem: %d contexts still registered\n", mem->num);
+    }
+    if (mem->internal_fd >= 0) {
+        dma_buf_free(mem->internal_size, &mem->internal_fd, mem->internal_va);
+        mem->internal_fd = -1;
+    }
+    for (int i = 0; i < mem->retired_num; i++) {
+        dma_buf_free(mem->retired[i].size, &mem->retired[i].fd, mem->retired[i].va);
+    }
+    mem->retired_num = 0;
+    pthread_mutex_destroy(&mem->lock);
+}
+
+int npu_mem_shares_internal(npu_mem_t *mem)
+{
+    return (mem->flags & NPU_MEM_SHARE_INTERNAL) != 0;
+}
+
+uint64_t npu_mem_model_hash(const void *model, uint32_t size)
+{
+    const uint8_t *p = (const uint8_t *)model;
+    uint64_t h = 1469598103934665603ULL;
+    for (uint32_t i = 0; i < size; i++) {
+        h = (h ^ p[i]) * 1099511628211ULL;
+    }
+    return h;
+}
+
+static npu_mem_ctx_t *find_ctx(npu_mem_t *mem, rknn_context ctx)
+{
+    for (int i = 0; i < mem->num; i++) {
+        if (mem->ctxs[i].ctx == ctx) {
+            return &mem->ctxs[i];
+        }
+    }
+    return NULL;
+}
+
+/* hand the buffer to one context, replacing its previous view */
+static int set_internal(npu_mem_t *mem, npu_mem_ctx_t *c)
+{
+    rknn_tensor_mem *view = rknn_create_mem_from_fd(c->ctx, mem->internal_fd, mem->internal_va, mem->internal_size, 0);
+    if (view == NULL) {
+        printf("npu mem: rknn_create_mem_from_fd size %u fail\n", mem->internal_size);
+        return -1;
+    }
+    int ret = rknn_set_internal_mem(c->ctx, view);
+    if (ret != RKNN_SUCC) {
+        printf("npu mem: rknn_set_internal_mem fail! ret=%d\n", ret);
+        rknn_destroy_mem(c->ctx, view);
+        return -1;
+    }
+    if (c->internal != NULL) {
+        rknn_destroy_mem(c->ctx, c->internal);
+    }
+    c->internal = view;
+    c->internal_fd = mem->internal_fd;
+    return 0;
+}
+
+static int internal_in_use(npu_mem_t *mem, int fd)
+{
+    for (int i = 0; i < mem->num; i++) {
+        if (mem->ctxs[i].internal != NULL && mem->ctxs[i].internal_fd == fd) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * The shared buffer is as large as the largest internal size. A larger one is only set on the
+ * new context here, the others may be running; npu_mem_apply_internal() moves them between frames.
+ */
+static int reserve_internal(npu_mem_t *mem, uint32_t size)
+{
+    if (mem->internal_fd >= 0 && size <= mem->internal_size) {
+        return 0;
+    }
+    int in_use = mem->internal_fd >= 0 && internal_in_use(mem, mem->internal_fd);
+    if (in_use && mem->retired_num >= NPU_MEM_MAX_CONTEXTS) {
+        printf("npu mem: too many internal buffers pending, call npu_mem_apply_internal\n");
+        return -1;
+    }
+    int fd = -1;
+    void *va = NULL;
+    if (dma_buf_alloc(DMA_HEAP_UNCACHE_PATH, size, &fd, &va) != 0 && dma_buf_alloc(DMA_HEAP_PATH, size, &fd, &va) != 0) {
+        printf("npu mem: alloc internal buffer %u fail\n", size);
+        return -1;
+    }
+    if (in_use) {
+        npu_mem_buf_t *old = &mem->retired[mem->retired_num++];
+        old->fd = mem->internal_fd;
+        old->va = mem->internal_va;
+        old->size = mem->internal_size;
+    } else if (mem->internal_fd >= 0) {
+        dma_buf_free(mem->internal_size, &mem->internal_fd, mem->internal_va);
+    }
+    mem->internal_fd = fd;
+    mem->internal_va = va;
+    mem->internal_size = size;
+    return 0;
+}
+
+int npu_mem_apply_internal(npu_mem_t *mem)
+{
+    pthread_mutex_lock(&mem->lock);
+    if (mem->retired_num == 0) {
+        pthread_mutex_unlock(&mem->lock);
+        return 0;
+    }
+    int ret = 0;
+    for (int i = 0; i < mem->num; i++) {
+        npu_mem_ctx_t *c = &mem->ctxs[i];
+        if (c->internal != NULL && c->internal_fd != mem->internal_fd && set_internal(mem, c) != 0) {
+            ret = -1;
+        }
+    }
+    int kept = 0;
+    for (int i = 0; i < mem->retired_num; i++) {
+        if (internal_in_use(mem, mem->retired[i].fd)) {
+            mem->retired[kept++] = mem->retired[i];
+        } else {
+            dma_buf_free(mem->retired[i].size, &mem->retired[i].fd, mem->retired[i].va);
+        }
+    }
+    mem->retired_num = kept;
+    pthread_mutex_unlock(&mem->lock);
+    return ret;
+}
+
+int npu_mem_init_context(npu_mem_t *mem, const char *model_path, void *model, uint32_t size, uint32_t extra_flags,
+                         rknn_context *ctx)
+{
+    pthread_mutex_lock(&mem->lock);
+    if (mem->num >= NPU_MEM_MAX_CONTEXTS) {
+        pthread_mutex_unlock(&mem->lock);
+        printf("npu mem: too many contexts\n");
+        return -1;
+    }
+
+    uint32_t flags = extra_flags;
+    rknn_init_extend extend;
+    memset(&extend, 0, sizeof(extend));
+    rknn_context weight_owner = 0;
+    uint64_t hash = 0;
+    if (mem->flags & NPU_MEM_SHARE_WEIGHTS) {
+        hash = npu_mem_model_hash(model, size);
+        for (int i = 0; i < mem->num; i++) {
+            if (mem->ctxs[i].model_size == size && mem->ctxs[i].model_hash == hash &&
+                mem->ctxs[i].weight_owner == mem->ctxs[i].ctx) {
+                weight_owner = mem->ctxs[i].ctx;
+                flags |= RKNN_FLAG_SHARE_WEIGHT_MEM;
+                extend.ctx = weight_owner;
+                break;
+            }
+        }
+    }
+    if (mem->flags & NPU_MEM_SHARE_INTERNAL) {
+        flags |= RKNN_FLAG_INTERNAL_ALLOC_OUTSIDE;
+    }
+    if (mem->flags & NPU_MEM_SRAM) {
+        flags |= RKNN_FLAG_ENABLE_SRAM;
+    }
+    if (mem->flags & NPU_MEM_SHARE_SRAM) {
+        flags |= RKNN_FLAG_SHARE_SRAM;
+    }
+
+    int ret = rknn_init(ctx, model, size, flags, weight_owner != 0 ? &extend : NULL);
+    if (ret < 0) {
+        pthread_mutex_unlock(&mem->lock);
+        printf("npu mem: rknn_init flags 0x%x fail! ret=%d\n", flags, ret);
+        return ret;
+    }
+
+    npu_mem_ctx_t *c = &mem->ctxs[mem->num];
+    memset(c, 0, sizeof(npu_mem_ctx_t));
+    c->ctx = *ctx;
+    snprintf(c->model_path, sizeof(c->model_path), "%s", model_path);
+    c->model_size = size;
+    c->model_hash = hash;
+    c->weight_owner = weight_owner != 0 ? weight_owner : *ctx;
+    rknn_query(*ctx, RKNN_QUERY_MEM_SIZE, &c->mem, sizeof(c->mem));
+
+    if (flags & RKNN_FLAG_INTERNAL_ALLOC_OUTSIDE) {
+        if (reserve_internal(mem, c->mem.total_internal_size) != 0 || set_internal(mem, c) != 0) {
+            pthread_mutex_unlock(&mem->lock);
+            rknn_destroy(*ctx);
+            *ctx = 0;
+            return -1;
+        }
+    }
+    mem->num++;
+    printf("npu mem: %s flags 0x%x, weight %u%s, internal %u%s\n", model_path, flags, c->mem.total_weight_size,
+           weight_owner != 0 ? " shared" : "", c->mem.total_internal_size,
+           (flags & RKNN_FLAG_INTERNAL_ALLOC_OUTSIDE) ? " shared" : "");
+    pthread_mutex_unlock(&mem->lock);
+    return 0;
+}
+
+static int has_borrowers(npu_mem_t *mem, rknn_context ctx)
+{
+    for (int i = 0; i < mem->num; i++) {
+        if (mem->ctxs[i].ctx != ctx && mem->ctxs[i].weight_owner == ctx) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int npu_mem_release_context(npu_mem_t *mem, rknn_context ctx)
+{
+    pthread_mutex_lock(&mem->lock);
+    npu_mem_ctx_t *c = find_ctx(mem, ctx);
+    if (c == NULL || c->released) {
+        pthread_mutex_unlock(&mem->lock);
+        return 0;
+    }
+    if (c->internal != NULL) {
+        rknn_destroy_mem(ctx, c->internal);
+        c->internal = NULL;
+    }
+    if (has_borrowers(mem, ctx)) {
+        // other contexts still use its weights, destroyed with the last of them
+        c->released = 1;
+        pthread_mutex_unlock(&mem->lock);
+        return 1;
+    }
+    *c = mem->ctxs[mem->num - 1];
+    mem->num--;
+
+    // weight owners kept alive only for their borrowers
+    for (int i = 0; i < mem->num; i++) {
+        if (mem->ctxs[i].released && !has_borrowers(mem, mem->ctxs[i].ctx)) {
+            rknn_destroy(mem->ctxs[i].ctx);
+            mem->ctxs[i] = mem->ctxs[mem->num - 1];
+            mem->num--;
+            i = -1;
+        }
+    }
+    pthread_mutex_unlock(&mem->lock);
+    return 0;
+}
+
+void npu_mem_print_stats(npu_mem_t *mem)
+{
+    pthread_mutex_lock(&mem->lock);
+    uint64_t alone = 0, shared = 0, internal = 0;
+    for (int i = 0; i < mem->num; i++) {
+        npu_mem_ctx_t *c = &mem->ctxs[i];
+        printf("  npu mem ctx %d %s: weight %u internal %u dma %llu%s\n", i, c->model_path, c->mem.total_weight_size,
+               c->mem.total_internal_size, (unsigned long long)c->mem.total_dma_allocated_size,
+               c->weight_owner != c->ctx ? ", weights shared" : "");
+        alone += (uint64_t)c->mem.total_weight_size + c->mem.total_internal_size;
+        if (c->weight_owner == c->ctx) {
+            shared += c->mem.total_weight_size;
+        }
+        internal += c->mem.total_internal_size;
+    }
+    shared += mem->internal_fd >= 0 ? mem->internal_size : internal;
+    if (mem->num > 0) {
+        rknn_mem_size sram;
+        memset(&sram, 0, sizeof(sram));
+        rknn_query(mem->ctxs[0].ctx, RKNN_QUERY_MEM_SIZE, &sram, sizeof(sram));
+        printf("npu mem: %d contexts, weight + internal %.1f MB unshared, %.1f MB shared, sram %u / %u free\n",
+               mem->num, alone / 1048576.0, shared / 1048576.0, sram.free_sram_size, sram.total_sram_size);
+    }
+    pthread_mutex_unlock(&mem->lock);
+}
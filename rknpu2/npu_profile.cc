@@ -0,0 +1,300 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "npu_profile.h"
+
+int npu_profile_open(npu_profile_t *prof, const char *prefix, int detail_interval)
+{
+    memset(prof, 0, sizeof(npu_profile_t));
+    snprintf(prof->prefix, sizeof(prof->prefix), "%s", prefix);
+    prof->detail_interval = detail_interval > 0 ? detail_interval : NPU_PROFILE_DETAIL_INTERVAL;
+
+    char path[300];
+    snprintf(path, sizeof(path), "%s_frames.csv", prefix);
+    prof->frames_csv = fopen(path, "w");
+    prof->layers = (npu_layer_stat_t *)calloc(NPU_PROFILE_MAX_LAYERS, sizeof(npu_layer_stat_t));
+    if (prof->frames_csv == NULL || prof->layers == NULL) {
+        printf("npu profile: create %s fail\n", path);
+        npu_profile_close(prof);
+        return -1;
+    }
+    prof->enabled = 1;
+    return 0;
+}
+
+/* one whitespace separated token of a line: start column and text */
+typedef struct {
+    int pos;
+    const char *s;
+    int len;
+} token_t;
+
+static int split_line(const char *line, int line_len, token_t *tokens, int max_tokens)
+{
+    int n = 0;
+    int i = 0;
+    while (i < line_len && n < max_tokens) {
+        while (i < line_len && isspace((unsigned char)line[i])) {
+            i++;
+        }
+        if (i >= line_len) {
+            break;
+        }
+        tokens[n].pos = i;
+        tokens[n].s = line + i;
+        while (i < line_len && !isspace((unsigned char)line[i])) {
+            i++;
+        }
+        tokens[n].len = (int)(line + i - tokens[n].s);
+        n++;
+    }
+    return n;
+}
+
+static int is_number(const token_t *t)
+{
+    for (int i = 0; i < t->len; i++) {
+        if (!isdigit((unsigned char)t->s[i]) && t->s[i] != '.') {
+            return 0;
+        }
+    }
+    return t->len > 0;
+}
+
+static void copy_token(char *dst, int size, const token_t *t)
+{
+    int len = t->len < size - 1 ? t->len : size - 1;
+    memcpy(dst, t->s, len);
+    dst[len] = '\0';
+}
+
+int npu_profile_parse_detail(const char *text, npu_layer_stat_t *layers, int max_layers)
+{
+    token_t tokens[64];
+    int time_col = -1;
+    int n_layers = 0;
+
+    const char *line = text;
+    while (line != NULL && *line != '\0') {
+        const char *end = strchr(line, '\n');
+        int len = end != NULL ? (int)(end - line) : (int)strlen(line);
+        int n = split_line(line, len, tokens, 64);
+
+        if (time_col < 0) {
+            // header: columns are left aligned under their titles
+            int has_op = 0;
+            for (int i = 0; i < n; i++) {
+                if (tokens[i].len == 6 && strncmp(tokens[i].s, "OpType", 6) == 0) {
+                    has_op = 1;
+                }
+                if (tokens[i].len == 8 && strncmp(tokens[i].s, "Time(us)", 8) == 0) {
+                    time_col = tokens[i].pos;
+                }
+            }
+            if (!has_op) {
+                time_col = -1;
+            }
+        } else if (n > 0 && strncmp(tokens[0].s, "Total", 5) == 0) {
+            break;
+        } else if (n >= 5 && isdigit((unsigned char)tokens[0].s[0]) && n_layers < max_layers) {
+            // the time is the first plain number starting at or after its title: a wider column before it
+            // shifts it right, the cycle and usage columns are '/' separated
+            const token_t *time = NULL;
+            for (int i = 4; i < n; i++) {
+                if (tokens[i].pos >= time_col - 1 && is_number(&tokens[i])) {
+                    time = &tokens[i];
+                    break;
+                }
+            }
+            if (time != NULL) {
+                npu_layer_stat_t *l = &layers[n_layers++];
+                memset(l, 0, sizeof(npu_layer_stat_t));
+                l->id = atoi(tokens[0].s);
+                copy_token(l->op_type, sizeof(l->op_type), &tokens[1]);
+                copy_token(l->target, sizeof(l->target), &tokens[3]);
+                copy_token(l->name, sizeof(l->name), &tokens[n - 1]);
+                l->time_us = atof(time->s);
+                l->samples = 1;
+            }
+        }
+        line = end != NULL ? end + 1 : NULL;
+    }
+    return n_layers;
+}
+
+void npu_profile_stage(npu_profile_t *prof, const char *name, int64_t us)
+{
+    if (!prof->enabled) {
+        return;
+    }
+    for (int i = 0; i < prof->stage_num; i++) {
+        if (strcmp(prof->stage_names[i], name) == 0) {
+            prof->stage_us[i] += us;
+            return;
+        }
+    }
+    // new stages only until the CSV header is written
+    if (prof->stages_fixed || prof->stage_num >= NPU_PROFILE_MAX_STAGES) {
+        return;
+    }
+    snprintf(prof->stage_names[prof->stage_num], sizeof(prof->stage_names[0]), "%s", name);
+    prof->stage_us[prof->stage_num++] = us;
+}
+
+static void json_string(FILE *fp, const char *s)
+{
+    fputc('"', fp);
+    for (; *s != '\0'; s++) {
+        if (*s == '"' || *s == '\\') {
+            fputc('\\', fp);
+        }
+        fputc(*s, fp);
+    }
+    fputc('"', fp);
+}
+
+static void write_reports(npu_profile_t *prof)
+{
+    char path[300];
+    double total = 0;
+    for (int i = 0; i < prof->layer_num; i++) {
+        total += prof->layers[i].time_us / prof->layers[i].samples;
+    }
+
+    snprintf(path, sizeof(path), "%s_layers.csv", prof->prefix);
+    FILE *fp = fopen(path, "w");
+    if (fp != NULL) {
+        fprintf(fp, "id,op_type,target,avg_us,percent,name\n");
+        for (int i = 0; i < prof->layer_num; i++) {
+            npu_layer_stat_t *l = &prof->layers[i];
+            double avg = l->time_us / l->samples;
+            fprintf(fp, "%d,%s,%s,%.1f,%.2f,%s\n", l->id, l->op_type, l->target, avg,
+                    total > 0 ? avg * 100 / total : 0, l->name);
+        }
+        fclose(fp);
+    }
+
+    snprintf(path, sizeof(path), "%s.json", prof->prefix);
+    fp = fopen(path, "w");
+    if (fp == NULL) {
+        printf("npu profile: write %s fail\n", path);
+        return;
+    }
+    fprintf(fp, "{\n  \"frames\": %llu,\n  \"detail_samples\": %d,\n", (unsigned long long)prof->frames,
+            prof->detail_samples);
+    fprintf(fp, "  \"npu_run_avg_us\": %.1f,\n  \"stages_avg_us\": {", prof->frames ? prof->npu_run_sum_us / prof->frames : 0);
+    for (int i = 0; i < prof->stage_num; i++) {
+        fprintf(fp, "%s\n    ", i ? "," : "");
+        json_string(fp, prof->stage_names[i]);
+        fprintf(fp, ": %.1f", prof->frames ? prof->stage_sum_us[i] / prof->frames : 0);
+    }
+    fprintf(fp, "\n  },\n  \"layers_total_us\": %.1f,\n  \"layers\": [", total);
+    for (int i = 0; i < prof->layer_num; i++) {
+        npu_layer_stat_t *l = &prof->layers[i];
+        double avg = l->time_us / l->samples;
+        fprintf(fp, "%s\n    {\"id\": %d, \"op_type\": ", i ? "," : "", l->id);
+        json_string(fp, l->op_type);
+        fprintf(fp, ", \"target\": ");
+        json_string(fp, l->target);
+        fprintf(fp, ", \"avg_us\": %.1f, \"percent\": %.2f, \"name\": ", avg, total > 0 ? avg * 100 / total : 0);
+        json_string(fp, l->name);
+        fputc('}', fp);
+    }
+    fprintf(fp, "\n  ]\n}\n");
+    fclose(fp);
+}
+
+static void sample_layers(npu_profile_t *prof, rknn_context ctx)
+{
+    rknn_perf_detail detail;
+    memset(&detail, 0, sizeof(detail));
+    if (rknn_query(ctx, RKNN_QUERY_PERF_DETAIL, &detail, sizeof(detail)) != RKNN_SUCC || detail.perf_data == NULL) {
+        return;
+    }
+    npu_layer_stat_t *sample = (npu_layer_stat_t *)malloc(NPU_PROFILE_MAX_LAYERS * sizeof(npu_layer_stat_t));
+    if (sample == NULL) {
+        return;
+    }
+    int n = npu_profile_parse_detail(detail.perf_data, sample, NPU_PROFILE_MAX_LAYERS);
+    if (n == 0) {
+        free(sample);
+        return;
+    }
+
+    // layers are matched by id, a model switch (dynamic shape, reload) keeps the same ids
+    for (int i = 0; i < n; i++) {
+        npu_layer_stat_t *l = NULL;
+        for (int j = 0; j < prof->layer_num; j++) {
+            if (prof->layers[j].id == sample[i].id) {
+                l = &prof->layers[j];
+                break;
+            }
+        }
+        if (l == NULL) {
+            if (prof->layer_num >= NPU_PROFILE_MAX_LAYERS) {
+                continue;
+            }
+            l = &prof->layers[prof->layer_num++];
+            *l = sample[i];
+            continue;
+        }
+        l->time_us += sample[i].time_us;
+        l->samples++;
+    }
+    free(sample);
+    prof->detail_samples++;
+    write_reports(prof);
+}
+
+void npu_profile_end_frame(npu_profile_t *prof, rknn_context ctx)
+{
+    if (!prof->enabled) {
+        return;
+    }
+    if (!prof->stages_fixed) {
+        fprintf(prof->frames_csv, "frame");
+        for (int i = 0; i < prof->stage_num; i++) {
+            fprintf(prof->frames_csv, ",%s_us", prof->stage_names[i]);
+        }
+        fprintf(prof->frames_csv, ",npu_run_us\n");
+        prof->stages_fixed = 1;
+    }
+
+    rknn_perf_run run;
+    memset(&run, 0, sizeof(run));
+    rknn_query(ctx, RKNN_QUERY_PERF_RUN, &run, sizeof(run));
+
+    fprintf(prof->frames_csv, "%llu", (unsigned long long)prof->frames);
+    for (int i = 0; i < prof->stage_num; i++) {
+        fprintf(prof->frames_csv, ",%lld", (long long)prof->stage_us[i]);
+        prof->stage_sum_us[i] += prof->stage_us[i];
+        prof->stage_us[i] = 0;
+    }
+    fprintf(prof->frames_csv, ",%lld\n", (long long)run.run_duration);
+    prof->npu_run_sum_us += run.run_duration;
+    prof->frames++;
+
+    if (prof->frames % prof->detail_interval == 0) {
+        // the demo usually ends with Ctrl-C, keep the files current
+        fflush(prof->frames_csv);
+        sample_layers(prof, ctx);
+    }
+}
+
+void npu_profile_close(npu_profile_t *prof)
+{
+    if (prof->enabled && prof->frames > 0) {
+        write_reports(prof);
+    }
+    if (prof->frames_csv != NULL) {
+        fclose(prof->frames_csv);
+        prof->frames_csv = NULL;
+    }
+    if (prof->layers != NULL) {
+        free(prof->layers);
+        prof->layers = NULL;
+    }
+    prof->enabled = 0;
+}
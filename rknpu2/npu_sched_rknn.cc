@@ -0,0 +1,18 @@
+#include <stdio.h>
+
+#include "npu_sched.h"
+
+int npu_sched_run_rknn(void *arg, npu_job_t *job)
+{
+    npu_sched_rknn_t *slot = (npu_sched_rknn_t *)arg;
+    rknn_context *ctx = slot->ctx[job->model];
+    if (ctx == NULL || *ctx == 0) {
+        printf("npu sched: no rknn context for model %d\n", job->model);
+        return -1;
+    }
+    int ret = rknn_run(*ctx, (rknn_run_extend *)job->data);
+    if (ret < 0) {
+        printf("npu sched: rknn_run model %d fail! ret=%d\n", job->model, ret);
+    }
+    return ret;
+}
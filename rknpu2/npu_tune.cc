@@ -0,0 +1,343 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "npu_tune.h"
+#include "npu_mem.h"
+#include "file_utils.h"
+
+typedef struct {
+    int pool_size;
+    int core_masks[NPU_TUNE_MAX_POOL];  // unused entries 0
+} tune_candidate_t;
+
+// one context on 1..3 cores, or a pool of rknn_dup_context contexts on separate cores
+static const tune_candidate_t candidates[] = {
+    {1, {RKNN_NPU_CORE_AUTO, 0, 0}},
+    {1, {RKNN_NPU_CORE_0, 0, 0}},
+    {1, {RKNN_NPU_CORE_0_1, 0, 0}},
+    {1, {RKNN_NPU_CORE_0_1_2, 0, 0}},
+    {2, {RKNN_NPU_CORE_0, RKNN_NPU_CORE_1, 0}},
+    {2, {RKNN_NPU_CORE_0_1, RKNN_NPU_CORE_2, 0}},
+    {3, {RKNN_NPU_CORE_0, RKNN_NPU_CORE_1, RKNN_NPU_CORE_2}},
+};
+
+static int64_t get_time_us(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+int npu_tune_model_key(const char *model_path, uint32_t *size, uint64_t *hash)
+{
+    char *model = NULL;
+    int len = read_data_from_file(model_path, &model);
+    if (model == NULL || len <= 0) {
+        free(model);
+        return -1;
+    }
+    *size = (uint32_t)len;
+    *hash = npu_mem_model_hash(model, *size);
+    free(model);
+    return 0;
+}
+
+const char *npu_tune_describe(const npu_tune_result_t *result, char *buf, int size)
+{
+    int len = 0;
+    buf[0] = '\0';
+    for (int i = 0; i < result->pool_size && len < size - 1; i++) {
+        if (i > 0) {
+            len += snprintf(buf + len, size - len, "|");
+        }
+        if (result->core_masks[i] == RKNN_NPU_CORE_AUTO) {
+            len += snprintf(buf + len, size - len, "auto");
+        }
+        for (int core = 0; core < 3 && len < size - 1; core++) {
+            if (result->core_masks[i] != RKNN_NPU_CORE_AUTO && (result->core_masks[i] & (1 << core))) {
+                len += snprintf(buf + len, size - len, "%d", core);
+            }
+        }
+        // truncated: snprintf returns the length it wanted
+        if (len >= size) {
+            len = size - 1;
+        }
+    }
+    return buf;
+}
+
+typedef struct {
+    rknn_context ctx;
+    rknn_input_output_num io_num;
+    const uint8_t *input;               // zeros, large enough for every input
+    std::vector<uint32_t> input_elems;
+    int64_t end_us;
+    std::vector<float> latency_ms;
+    int ret;
+} tune_worker_t;
+
+/* the frame loop of one pool context: set input, run, fetch outputs */
+static int run_once(tune_worker_t *w)
+{
+    rknn_input inputs[w->io_num.n_input];
+    memset(inputs, 0, sizeof(inputs));
+    for (uint32_t i = 0; i < w->io_num.n_input; i++) {
+        inputs[i].index = i;
+        inputs[i].buf = (void *)w->input;
+        inputs[i].size = w->input_elems[i];
+        inputs[i].type = RKNN_TENSOR_UINT8;
+        inputs[i].fmt = RKNN_TENSOR_NHWC;
+    }
+    if (rknn_inputs_set(w->ctx, w->io_num.n_input, inputs) < 0 || rknn_run(w->ctx, NULL) < 0) {
+        return -1;
+    }
+    rknn_output outputs[w->io_num.n_output];
+    memset(outputs, 0, sizeof(outputs));
+    for (uint32_t i = 0; i < w->io_num.n_output; i++) {
+        outputs[i].index = i;
+    }
+    if (rknn_outputs_get(w->ctx, w->io_num.n_output, outputs, NULL) < 0) {
+        return -1;
+    }
+    rknn_outputs_release(w->ctx, w->io_num.n_output, outputs);
+    return 0;
+}
+
+static void *tune_thread(void *arg)
+{
+    tune_worker_t *w = (tune_worker_t *)arg;
+    while (get_time_us() < w->end_us) {
+        int64_t start = get_time_us();
+        if (run_once(w) != 0) {
+            w->ret = -1;
+            break;
+        }
+        w->latency_ms.push_back((get_time_us() - start) / 1000.f);
+    }
+    return NULL;
+}
+
+/* measure one candidate, -1: the NPU has fewer cores than it needs */
+static int measure(void *model, uint32_t size, int run_ms, npu_tune_result_t *result)
+{
+    rknn_context ctxs[NPU_TUNE_MAX_POOL];
+    memset(ctxs, 0, sizeof(ctxs));
+    tune_worker_t workers[NPU_TUNE_MAX_POOL];
+    pthread_t threads[NPU_TUNE_MAX_POOL];
+    std::vector<uint8_t> input;
+    int ret = rknn_init(&ctxs[0], model, size, 0, NULL);
+
+    // pool contexts share the weights of the first
+    for (int i = 1; i < result->pool_size && ret == RKNN_SUCC; i++) {
+        ret = rknn_dup_context(&ctxs[0], &ctxs[i]);
+    }
+    for (int i = 0; i < result->pool_size && ret == RKNN_SUCC; i++) {
+        ret = rknn_set_core_mask(ctxs[i], (rknn_core_mask)result->core_masks[i]);
+    }
+
+    int started = 0;
+    int64_t start_us = 0;
+    if (ret == RKNN_SUCC) {
+        rknn_input_output_num io_num;
+        rknn_query(ctxs[0], RKNN_QUERY_IN_OUT_NUM, &io_num, sizeof(io_num));
+        std::vector<uint32_t> input_elems(io_num.n_input);
+        for (uint32_t i = 0; i < io_num.n_input; i++) {
+            rknn_tensor_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.index = i;
+            rknn_query(ctxs[0], RKNN_QUERY_INPUT_ATTR, &attr, sizeof(attr));
+            input_elems[i] = attr.n_elems;
+        }
+        input.resize(*std::max_element(input_elems.begin(), input_elems.end()));
+
+        for (int i = 0; i < result->pool_size; i++) {
+            workers[i].ctx = ctxs[i];
+            workers[i].io_num = io_num;
+            workers[i].input = input.data();
+            workers[i].input_elems = input_elems;
+            workers[i].ret = 0;
+            // first runs allocate and compile, keep them out of the numbers
+            for (int r = 0; r < 3 && ret == 0; r++) {
+                ret = run_once(&workers[i]);
+            }
+        }
+        start_us = get_time_us();
+        int64_t end_us = start_us + (int64_t)run_ms * 1000;
+        for (int i = 0; i < result->pool_size && ret == 0; i++) {
+            workers[i].end_us = end_us;
+            if (pthread_create(&threads[i], NULL, tune_thread, &workers[i]) != 0) {
+                ret = -1;
+                break;
+            }
+            started++;
+        }
+    }
+    std::vector<float> latency;
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+        ret |= workers[i].ret;
+        latency.insert(latency.end(), workers[i].latency_ms.begin(), workers[i].latency_ms.end());
+    }
+    int64_t elapsed_us = get_time_us() - start_us;
+
+    for (int i = result->pool_size - 1; i >= 0; i--) {
+        if (ctxs[i] != 0) {
+            rknn_destroy(ctxs[i]);
+        }
+    }
+    if (ret != 0 || latency.empty()) {
+        return -1;
+    }
+    std::sort(latency.begin(), latency.end());
+    result->fps = latency.size() * 1000000.f / elapsed_us;
+    result->p50_ms = latency[latency.size() / 2];
+    result->p99_ms = latency[std::min(latency.size() - 1, latency.size() * 99 / 100)];
+    return 0;
+}
+
+int npu_tune_run(const char *model_path, int run_ms, npu_tune_result_t best[2])
+{
+    char *model = NULL;
+    int model_len = read_data_from_file(model_path, &model);
+    if (model == NULL || model_len <= 0) {
+        printf("npu tune: load %s fail\n", model_path);
+        free(model);
+        return -1;
+    }
+    if (run_ms <= 0) {
+        run_ms = NPU_TUNE_RUN_MS;
+    }
+
+    const int n_candidate = sizeof(candidates) / sizeof(candidates[0]);
+    npu_tune_result_t results[n_candidate];
+    int measured = 0;
+    char desc[32], desc2[32];
+    printf("npu tune: %s, %d ms per candidate\n", model_path, run_ms);
+    printf("  cores        pool      fps  p50(ms)  p99(ms)\n");
+    for (int i = 0; i < n_candidate; i++) {
+        npu_tune_result_t r;
+        memset(&r, 0, sizeof(r));
+        r.pool_size = candidates[i].pool_size;
+        memcpy(r.core_masks, candidates[i].core_masks, sizeof(r.core_masks));
+        if (measure(model, model_len, run_ms, &r) != 0) {
+            printf("  %-12s %4d  not supported\n", npu_tune_describe(&r, desc, sizeof(desc)), r.pool_size);
+            continue;
+        }
+        printf("  %-12s %4d  %7.1f  %7.2f  %7.2f\n", npu_tune_describe(&r, desc, sizeof(desc)), r.pool_size, r.fps,
+               r.p50_ms, r.p99_ms);
+        results[measured++] = r;
+    }
+    free(model);
+    if (measured == 0) {
+        return 0;
+    }
+
+    // throughput: close to the fastest counts as a tie, the steadier one wins
+    const npu_tune_result_t *fastest = &results[0];
+    for (int i = 1; i < measured; i++) {
+        if (results[i].fps > fastest->fps) {
+            fastest = &results[i];
+        }
+    }
+    // latency: a single stream feeds one context, so only single context candidates compete
+    const npu_tune_result_t *quickest = NULL;
+    for (int i = 0; i < measured; i++) {
+        if (results[i].pool_size == 1 && (quickest == NULL || results[i].p50_ms < quickest->p50_ms)) {
+            quickest = &results[i];
+        }
+    }
+    if (quickest == NULL) {
+        quickest = fastest;
+    }
+    best[NPU_TUNE_THROUGHPUT] = *fastest;
+    for (int i = 0; i < measured; i++) {
+        if (results[i].fps >= fastest->fps * 0.97f && results[i].p99_ms < best[NPU_TUNE_THROUGHPUT].p99_ms) {
+            best[NPU_TUNE_THROUGHPUT] = results[i];
+        }
+    }
+    best[NPU_TUNE_LATENCY] = *quickest;
+    printf("npu tune: throughput %s x%d %.1f fps, latency %s %.2f ms\n",
+           npu_tune_describe(&best[NPU_TUNE_THROUGHPUT], desc, sizeof(desc)), best[NPU_TUNE_THROUGHPUT].pool_size,
+           best[NPU_TUNE_THROUGHPUT].fps, npu_tune_describe(&best[NPU_TUNE_LATENCY], desc2, sizeof(desc2)),
+           best[NPU_TUNE_LATENCY].p50_ms);
+    return measured;
+}
+
+/* one line of the tune file, 0: parsed; lines of other formats are not */
+static int parse_line(const char *line, uint32_t *size, uint64_t *hash, int *objective, npu_tune_result_t *r)
+{
+    unsigned long long h;
+    int end = 0;
+    memset(r, 0, sizeof(npu_tune_result_t));
+    if (line[0] == '#' || sscanf(line, "%u %llx %d %d %d %d %d %f %f %f %n", size, &h, objective, &r->pool_size,
+                                 &r->core_masks[0], &r->core_masks[1], &r->core_masks[2], &r->fps, &r->p50_ms,
+                                 &r->p99_ms, &end) != 10 || line[end] != '\0') {
+        return -1;
+    }
+    *hash = h;
+    return r->pool_size >= 1 && r->pool_size <= NPU_TUNE_MAX_POOL ? 0 : -1;
+}
+
+int npu_tune_load(const char *path, uint32_t size, uint64_t hash, int objective, npu_tune_result_t *result)
+{
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        return -1;
+    }
+    char line[256];
+    int found = -1;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        uint32_t s;
+        uint64_t h;
+        int o;
+        npu_tune_result_t r;
+        if (parse_line(line, &s, &h, &o, &r) == 0 && s == size && h == hash && o == objective) {
+            *result = r;
+            found = 0;
+        }
+    }
+    fclose(fp);
+    return found;
+}
+
+int npu_tune_save(const char *path, uint32_t size, uint64_t hash, int objective, const npu_tune_result_t *result)
+{
+    // keep the other models and objectives
+    std::vector<std::string> keep;
+    FILE *fp = fopen(path, "r");
+    if (fp != NULL) {
+        char line[256];
+        while (fgets(line, sizeof(line), fp) != NULL) {
+            uint32_t s;
+            uint64_t h;
+            int o;
+            npu_tune_result_t r;
+            if (parse_line(line, &s, &h, &o, &r) == 0 && !(s == size && h == hash && o == objective)) {
+                keep.push_back(line);
+            }
+        }
+        fclose(fp);
+    }
+
+    fp = fopen(path, "w");
+    if (fp == NULL) {
+        printf("open %s fail\n", path);
+        return -1;
+    }
+    fprintf(fp, "# model_size fnv1a objective(0: throughput, 1: latency) pool core_mask x3 fps p50_ms p99_ms\n");
+    for (size_t i = 0; i < keep.size(); i++) {
+        fputs(keep[i].c_str(), fp);
+    }
+    fprintf(fp, "%u %016llx %d %d %d %d %d %.1f %.2f %.2f\n", size, (unsigned long long)hash, objective,
+            result->pool_size, result->core_masks[0], result->core_masks[1], result->core_masks[2], result->fps,
+            result->p50_ms, result->p99_ms);
+    fclose(fp);
+    return 0;
+}
@@ -16,12 +16,53 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <pthread.h>
+#include <sys/time.h>
 
 #include "yolov5.h"
 #include "common.h"
 #include "file_utils.h"
 #include "image_utils.h"
 
+static int64_t get_time_us(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+// shared weight / internal memory for every context created here, NULL: plain rknn_init
+static npu_mem_t *yolov5_npu_mem = NULL;
+
+void set_yolov5_npu_mem(npu_mem_t *mem)
+{
+    yolov5_npu_mem = mem;
+}
+
+// RKNN_FLAG_COLLECT_PERF_MASK for every context created here, slows rknn_run down
+static uint32_t yolov5_init_flags = 0;
+
+void set_yolov5_profiling(int enable)
+{
+    yolov5_init_flags = enable ? RKNN_FLAG_COLLECT_PERF_MASK : 0;
+}
+
+// rknn_set_core_mask for every context created here, e.g. the npu_tune_run() winner
+static int yolov5_core_mask = RKNN_NPU_CORE_AUTO;
+
+void set_yolov5_core_mask(int core_mask)
+{
+    yolov5_core_mask = core_mask;
+}
+
+// rknn_init priority of every context created here, detections are safety critical by default
+static int yolov5_priority = NPU_PRIO_HIGH;
+
+void set_yolov5_priority(int priority)
+{
+    yolov5_priority = priority;
+}
+
 static void dump_tensor_attr(rknn_tensor_attr *attr)
 {
     printf("  index=%d, name=%s, n_dims=%d, dims=[%d, %d, %d, %d], n_elems=%d, size=%d, fmt=%s, type=%s, qnt_type=%s, "
@@ -31,7 +72,598 @@ static void dump_tensor_attr(rknn_tensor_attr *attr)
            get_qnt_type_string(attr->qnt_type), attr->zp, attr->scale);
 }
 
+/*
+ * 按原生输入属性选择输入布局：原生类型是 uint8（或零点 -128、scale 1/255 的 int8）时
+ * 直接按原生布局打包并直通，运行时不再转换；否则按模型输入格式（NCHW/NHWC）交给运行时
+ */
+static int init_yolov5_input(rknn_app_context_t *app_ctx)
+{
+    rknn_tensor_attr *native = &app_ctx->native_input_attr;
+    image_layout_desc_t *desc = &app_ctx->input_layout;
+    memset(native, 0, sizeof(rknn_tensor_attr));
+    memset(desc, 0, sizeof(image_layout_desc_t));
+    desc->width = app_ctx->model_width;
+    desc->height = app_ctx->model_height;
+    desc->channel = app_ctx->model_channel;
+    desc->w_stride = app_ctx->model_width;
+    app_ctx->input_pass_through = false;
+
+    native->index = 0;
+    /* 动态shape模型的原生属性随当前shape变化；batch模型按模型输入格式，每张图占一个槽 */
+    int ret = -1;
+    if (app_ctx->batch == 1)
+    {
+        ret = rknn_query(app_ctx->rknn_ctx,
+                         app_ctx->shape_num > 0 ? RKNN_QUERY_CURRENT_NATIVE_INPUT_ATTR : RKNN_QUERY_NATIVE_INPUT_ATTR,
+                         native, sizeof(rknn_tensor_attr));
+    }
+    if (ret == RKNN_SUCC)
+    {
+        printf("原生输入张量信息:\n");
+        dump_tensor_attr(native);
+
+        int h = 0, w = 0, c = 0, c2 = 0;
+        image_layout_t layout = IMAGE_LAYOUT_HWC;
+        if (native->fmt == RKNN_TENSOR_NHWC && native->n_dims == 4)
+        {
+            h = native->dims[1];
+            w = native->dims[2];
+            c = native->dims[3];
+        }
+        else if (native->fmt == RKNN_TENSOR_NCHW && native->n_dims == 4)
+        {
+            layout = IMAGE_LAYOUT_CHW;
+            c = native->dims[1];
+            h = native->dims[2];
+            w = native->dims[3];
+        }
+        else if (native->fmt == RKNN_TENSOR_NC1HWC2 && native->n_dims == 5)
+        {
+            layout = IMAGE_LAYOUT_C1HWC2;
+            h = native->dims[2];
+            w = native->dims[3];
+            c2 = native->dims[4];
+            c = app_ctx->model_channel;
+        }
+        bool int8_image = native->type == RKNN_TENSOR_INT8 && native->qnt_type == RKNN_TENSOR_QNT_AFFINE_ASYMMETRIC &&
+                          native->zp == -128 && fabsf(native->scale * 255.f - 1.f) < 1e-3f;
+        if (h == app_ctx->model_height && w == app_ctx->model_width && c == app_ctx->model_channel &&
+            (native->type == RKNN_TENSOR_UINT8 || int8_image))
+        {
+            desc->layout = layout;
+            desc->c2 = c2;
+            desc->w_stride = native->w_stride > (uint32_t)w ? native->w_stride : w;
+            desc->xor_mask = int8_image ? 0x80 : 0;
+            app_ctx->input_pass_through = true;
+        }
+    }
+    if (!app_ctx->input_pass_through)
+    {
+        desc->layout = app_ctx->input_attrs[0].fmt == RKNN_TENSOR_NCHW ? IMAGE_LAYOUT_CHW : IMAGE_LAYOUT_HWC;
+    }
+
+    app_ctx->input_pack_buf = NULL;
+    app_ctx->input_pack_size = 0;
+    app_ctx->input_packed = false;
+    if (!image_layout_is_identity(desc) || app_ctx->batch > 1)
+    {
+        app_ctx->input_pack_size = image_layout_size(desc);
+        if (app_ctx->input_pass_through && (int)native->size_with_stride > app_ctx->input_pack_size)
+        {
+            app_ctx->input_pack_size = native->size_with_stride;
+        }
+        /* batch模型：batch个槽连续存放，单帧路径只写第0个槽 */
+        app_ctx->input_slot_size = app_ctx->input_pack_size;
+        app_ctx->input_pack_size *= app_ctx->batch;
+        /* 填充通道和行尾对齐部分保持为0 */
+        app_ctx->input_pack_buf = (unsigned char *)calloc(1, app_ctx->input_pack_size);
+        if (app_ctx->input_pack_buf == NULL)
+        {
+            printf("malloc input pack buffer size:%d fail!\n", app_ctx->input_pack_size);
+            return -1;
+        }
+    }
+    static const char *layout_names[] = {"NHWC", "NCHW", "NC1HWC2"};
+    printf("输入布局: %s%s, w_stride=%d%s, batch=%d\n", layout_names[desc->layout],
+           app_ctx->input_pass_through ? " 直通" : "", desc->w_stride, desc->xor_mask ? ", uint8->int8" : "",
+           app_ctx->batch);
+    return 0;
+}
+
+/* 动态shape模型：记下所有可用的输入尺寸 */
+static void init_yolov5_shapes(rknn_app_context_t *app_ctx)
+{
+    app_ctx->shape_num = 0;
+    app_ctx->max_width = app_ctx->model_width;
+    app_ctx->max_height = app_ctx->model_height;
+
+    rknn_input_range *range = (rknn_input_range *)calloc(1, sizeof(rknn_input_range));
+    if (range == NULL)
+    {
+        return;
+    }
+    range->index = 0;
+    int ret = rknn_query(app_ctx->rknn_ctx, RKNN_QUERY_INPUT_DYNAMIC_RANGE, range, sizeof(rknn_input_range));
+    if (ret == RKNN_SUCC && range->shape_number > 1)
+    {
+        printf("动态shape模型，输入尺寸:");
+        for (uint32_t i = 0; i < range->shape_number && app_ctx->shape_num < YOLOV5_MAX_SHAPES; i++)
+        {
+            const uint32_t *dims = range->dyn_range[i];
+            int h = range->fmt == RKNN_TENSOR_NCHW ? dims[2] : dims[1];
+            int w = range->fmt == RKNN_TENSOR_NCHW ? dims[3] : dims[2];
+            app_ctx->shape_w[app_ctx->shape_num] = w;
+            app_ctx->shape_h[app_ctx->shape_num] = h;
+            app_ctx->shape_num++;
+            /* 缓冲按宽、高各自的最大值申请，任何shape都放得下 */
+            if (w > app_ctx->max_width)
+                app_ctx->max_width = w;
+            if (h > app_ctx->max_height)
+                app_ctx->max_height = h;
+            printf(" %dx%d", w, h);
+        }
+        printf("\n");
+    }
+    free(range);
+}
+
+int set_yolov5_input_shape(rknn_app_context_t *app_ctx, int width, int height)
+{
+    if (app_ctx->shape_num == 0)
+    {
+        return -1;
+    }
+    if (width == app_ctx->model_width && height == app_ctx->model_height)
+    {
+        return 0;
+    }
+
+    rknn_tensor_attr attr = app_ctx->input_attrs[0];
+    if (attr.fmt == RKNN_TENSOR_NCHW)
+    {
+        attr.dims[2] = height;
+        attr.dims[3] = width;
+    }
+    else
+    {
+        attr.dims[1] = height;
+        attr.dims[2] = width;
+    }
+    int ret = rknn_set_input_shapes(app_ctx->rknn_ctx, 1, &attr);
+    if (ret != RKNN_SUCC)
+    {
+        printf("rknn_set_input_shapes %dx%d fail! ret=%d\n", width, height, ret);
+        return -1;
+    }
+
+    /* 输出网格大小跟着输入shape变，post_process 从 output_attrs 读取 */
+    ret = rknn_query(app_ctx->rknn_ctx, RKNN_QUERY_CURRENT_INPUT_ATTR, &app_ctx->input_attrs[0], sizeof(rknn_tensor_attr));
+    for (uint32_t i = 0; ret == RKNN_SUCC && i < app_ctx->io_num.n_output; i++)
+    {
+        app_ctx->output_attrs[i].index = i;
+        ret = rknn_query(app_ctx->rknn_ctx, RKNN_QUERY_CURRENT_OUTPUT_ATTR, &app_ctx->output_attrs[i],
+                         sizeof(rknn_tensor_attr));
+    }
+    if (ret != RKNN_SUCC)
+    {
+        printf("rknn_query current attr fail! ret=%d\n", ret);
+        return -1;
+    }
+    app_ctx->model_width = width;
+    app_ctx->model_height = height;
+
+    if (app_ctx->input_pack_buf != NULL)
+    {
+        free(app_ctx->input_pack_buf);
+        app_ctx->input_pack_buf = NULL;
+    }
+    return init_yolov5_input(app_ctx);
+}
+
+/* 按长边从小到大排好的不同尺寸，返回个数 */
+static int sorted_shape_levels(rknn_app_context_t *app_ctx, int *levels)
+{
+    int n = 0;
+    for (int i = 0; i < app_ctx->shape_num; i++)
+    {
+        int side = app_ctx->shape_w[i] > app_ctx->shape_h[i] ? app_ctx->shape_w[i] : app_ctx->shape_h[i];
+        int j = 0;
+        while (j < n && levels[j] < side)
+            j++;
+        if (j < n && levels[j] == side)
+            continue;
+        memmove(&levels[j + 1], &levels[j], (n - j) * sizeof(int));
+        levels[j] = side;
+        n++;
+    }
+    return n;
+}
+
+int get_yolov5_shape_levels(rknn_app_context_t *app_ctx)
+{
+    int levels[YOLOV5_MAX_SHAPES];
+    int n = sorted_shape_levels(app_ctx, levels);
+    return n > 0 ? n : 1;
+}
+
+int select_yolov5_shape(rknn_app_context_t *app_ctx, int frame_w, int frame_h, int level)
+{
+    int levels[YOLOV5_MAX_SHAPES];
+    int n = sorted_shape_levels(app_ctx, levels);
+    if (n == 0)
+    {
+        return -1;
+    }
+    if (level < 0)
+        level = 0;
+    if (level >= n)
+        level = n - 1;
+
+    int best = -1;
+    float best_fill = -1.f;
+    for (int i = 0; i < app_ctx->shape_num; i++)
+    {
+        int w = app_ctx->shape_w[i];
+        int h = app_ctx->shape_h[i];
+        if ((w > h ? w : h) != levels[level])
+            continue;
+        /* letterbox 后图像占输入的比例，越大填充越少 */
+        float scale = (float)w / frame_w < (float)h / frame_h ? (float)w / frame_w : (float)h / frame_h;
+        float fill = scale * frame_w * scale * frame_h / (w * h);
+        if (fill > best_fill)
+        {
+            best_fill = fill;
+            best = i;
+        }
+    }
+    return best;
+}
+
+int set_yolov5_input(rknn_app_context_t *app_ctx, image_buffer_t *img, int row_begin, int row_end)
+{
+    rknn_input inputs[app_ctx->io_num.n_input];
+    memset(inputs, 0, sizeof(inputs));
+
+    inputs[0].index = 0;
+    if (app_ctx->input_pack_buf != NULL)
+    {
+        /* 首帧打包全部行，之后letterbox的填充行不变，只打包有效区域 */
+        if (!app_ctx->input_packed)
+        {
+            row_begin = 0;
+            row_end = app_ctx->model_height;
+        }
+        if (image_pack_rows(img, &app_ctx->input_layout, app_ctx->input_pack_buf, row_begin, row_end) != 0)
+        {
+            return -1;
+        }
+        app_ctx->input_packed = true;
+        inputs[0].buf = app_ctx->input_pack_buf;
+        inputs[0].size = app_ctx->input_pack_size;
+    }
+    else
+    {
+        inputs[0].buf = img->virt_addr;
+        inputs[0].size = app_ctx->model_width * app_ctx->model_height * app_ctx->model_channel;
+    }
+    inputs[0].pass_through = app_ctx->input_pass_through ? 1 : 0;
+    inputs[0].type = RKNN_TENSOR_UINT8;
+    inputs[0].fmt = app_ctx->input_layout.layout == IMAGE_LAYOUT_CHW ? RKNN_TENSOR_NCHW : RKNN_TENSOR_NHWC;
+
+    int ret = rknn_inputs_set(app_ctx->rknn_ctx, app_ctx->io_num.n_input, inputs);
+    if (ret < 0)
+    {
+        printf("rknn_input_set fail! ret=%d\n", ret);
+    }
+    return ret;
+}
+
+int warmup_yolov5_model(rknn_app_context_t *app_ctx, int runs)
+{
+    int size = app_ctx->model_width * app_ctx->model_height * app_ctx->model_channel * app_ctx->batch;
+    unsigned char *zero = (unsigned char *)calloc(1, size);
+    if (zero == NULL)
+    {
+        printf("malloc warmup input size:%d fail!\n", size);
+        return -1;
+    }
+
+    rknn_input inputs[app_ctx->io_num.n_input];
+    memset(inputs, 0, sizeof(inputs));
+    inputs[0].index = 0;
+    inputs[0].buf = zero;
+    inputs[0].size = size;
+    inputs[0].type = RKNN_TENSOR_UINT8;
+    inputs[0].fmt = RKNN_TENSOR_NHWC;
+
+    int64_t total = 0;
+    int ret = rknn_inputs_set(app_ctx->rknn_ctx, app_ctx->io_num.n_input, inputs);
+    for (int i = 0; ret >= 0 && i < runs; i++)
+    {
+        int64_t start = get_time_us();
+        ret = rknn_run(app_ctx->rknn_ctx, nullptr);
+        total += get_time_us() - start;
+    }
+    free(zero);
+    if (ret < 0)
+    {
+        printf("warmup rknn_run fail! ret=%d\n", ret);
+        return -1;
+    }
+    return runs > 0 ? (int)(total / runs) : 0;
+}
+
+static void *reload_thread(void *arg)
+{
+    yolov5_reload_t *reload = (yolov5_reload_t *)arg;
+    memset(&reload->next, 0, sizeof(rknn_app_context_t));
+
+    int64_t start = get_time_us();
+    int ret = init_yolov5_model_with_anchors(reload->model_path, reload->anchors_path, &reload->next);
+    if (ret == 0 && reload->labels_path[0] != '\0' && load_yolov5_labels(&reload->next, reload->labels_path) < 0)
+    {
+        ret = -1;
+    }
+    reload->load_us = get_time_us() - start;
+    /* 共享internal内存时预热会和正在推理的旧上下文同时跑，跳过 */
+    if (ret == 0 && (yolov5_npu_mem == NULL || !npu_mem_shares_internal(yolov5_npu_mem)))
+    {
+        start = get_time_us();
+        ret = warmup_yolov5_model(&reload->next, reload->warmup_runs) < 0 ? -1 : 0;
+        reload->warmup_us = get_time_us() - start;
+    }
+    if (ret != 0)
+    {
+        release_yolov5_model(&reload->next);
+    }
+    __atomic_store_n(&reload->state, ret == 0 ? YOLOV5_RELOAD_READY : YOLOV5_RELOAD_FAILED, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+int start_yolov5_reload(yolov5_reload_t *reload, const char *model_path, const char *anchors_path,
+                        const char *labels_path, int warmup_runs)
+{
+    if (__atomic_load_n(&reload->state, __ATOMIC_ACQUIRE) != YOLOV5_RELOAD_IDLE)
+    {
+        printf("model reload already in progress\n");
+        return -1;
+    }
+    snprintf(reload->model_path, sizeof(reload->model_path), "%s", model_path);
+    snprintf(reload->anchors_path, sizeof(reload->anchors_path), "%s",
+             anchors_path != NULL ? anchors_path : ANCHORS_TXT_PATH);
+    snprintf(reload->labels_path, sizeof(reload->labels_path), "%s", labels_path != NULL ? labels_path : "");
+    reload->warmup_runs = warmup_runs;
+    reload->request_us = get_time_us();
+    reload->load_us = 0;
+    reload->warmup_us = 0;
+    reload->state = YOLOV5_RELOAD_LOADING;
+    if (pthread_create(&reload->thread, NULL, reload_thread, reload) != 0)
+    {
+        printf("create model reload thread fail!\n");
+        reload->state = YOLOV5_RELOAD_IDLE;
+        return -1;
+    }
+    return 0;
+}
+
+static void *release_thread(void *arg)
+{
+    rknn_app_context_t *old = (rknn_app_context_t *)arg;
+    release_yolov5_model(old);
+    free(old);
+    return NULL;
+}
+
+int poll_yolov5_reload(yolov5_reload_t *reload, rknn_app_context_t *app_ctx)
+{
+    int state = __atomic_load_n(&reload->state, __ATOMIC_ACQUIRE);
+    if (state == YOLOV5_RELOAD_IDLE || state == YOLOV5_RELOAD_LOADING)
+    {
+        return 0;
+    }
+    pthread_join(reload->thread, NULL);
+    reload->state = YOLOV5_RELOAD_IDLE;
+    if (state == YOLOV5_RELOAD_FAILED)
+    {
+        printf("model reload %s fail, keep the running model\n", reload->model_path);
+        return -1;
+    }
+
+    rknn_app_context_t *next = &reload->next;
+    if (next->max_width != app_ctx->max_width || next->max_height != app_ctx->max_height ||
+        next->model_channel != app_ctx->model_channel || next->batch != app_ctx->batch ||
+        next->shape_num != app_ctx->shape_num ||
+        memcmp(next->shape_w, app_ctx->shape_w, sizeof(next->shape_w)) != 0 ||
+        memcmp(next->shape_h, app_ctx->shape_h, sizeof(next->shape_h)) != 0)
+    {
+        printf("model reload %s: input %dx%dx%d batch %d (or its shapes) does not match the running "
+               "%dx%dx%d batch %d, restart needed\n",
+               reload->model_path, next->max_width, next->max_height, next->model_channel, next->batch,
+               app_ctx->max_width, app_ctx->max_height, app_ctx->model_channel, app_ctx->batch);
+        release_yolov5_model(next);
+        return -1;
+    }
+
+    /* 在帧间交换，旧上下文没有在途的推理，放到后台销毁 */
+    int64_t swap_start = get_time_us();
+    rknn_app_context_t *old = (rknn_app_context_t *)malloc(sizeof(rknn_app_context_t));
+    if (old == NULL)
+    {
+        release_yolov5_model(next);
+        return -1;
+    }
+    *old = *app_ctx;
+    *app_ctx = *next;
+    /* 新模型没带标签时沿用旧模型的 */
+    if (app_ctx->labels == NULL)
+    {
+        app_ctx->labels = old->labels;
+        app_ctx->label_num = old->label_num;
+        old->labels = NULL;
+    }
+    memset(next, 0, sizeof(rknn_app_context_t));
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, release_thread, old) == 0)
+    {
+        pthread_detach(tid);
+    }
+    else
+    {
+        release_thread(old);
+    }
+    int64_t now = get_time_us();
+    reload->swaps++;
+    printf("model swap #%d %s: load %.1f ms, warmup %.1f ms, swap %.3f ms, request to service %.1f ms\n",
+           reload->swaps, reload->model_path, reload->load_us / 1000.0, reload->warmup_us / 1000.0,
+           (now - swap_start) / 1000.0, (now - reload->request_us) / 1000.0);
+    return 1;
+}
+
+int init_yolov5_batch(rknn_app_context_t *app_ctx, int core_num)
+{
+    if (app_ctx->batch <= 1)
+    {
+        printf("init_yolov5_batch: model batch is 1\n");
+        return -1;
+    }
+    if (core_num > 1)
+    {
+        /* 只有多核NPU的运行时支持，失败时仍在单核上跑整个batch */
+        int ret = rknn_set_batch_core_num(app_ctx->rknn_ctx, core_num);
+        if (ret != RKNN_SUCC)
+        {
+            printf("rknn_set_batch_core_num %d fail! ret=%d, batch runs on one core\n", core_num, ret);
+        }
+    }
+    return 0;
+}
+
+int inference_yolov5_batch(rknn_app_context_t *app_ctx, yolov5_batch_job_t **jobs, int n)
+{
+    if (n < 1 || n > app_ctx->batch || app_ctx->input_pack_buf == NULL)
+    {
+        printf("inference_yolov5_batch: %d images for batch %d\n", n, app_ctx->batch);
+        return -1;
+    }
+
+    /* 每张图打包进自己的槽；没用到的槽保留旧数据，它们的输出直接丢弃 */
+    for (int b = 0; b < n; b++)
+    {
+        if (image_pack_rows(jobs[b]->img, &app_ctx->input_layout,
+                            app_ctx->input_pack_buf + (size_t)b * app_ctx->input_slot_size, 0,
+                            app_ctx->model_height) != 0)
+        {
+            return -1;
+        }
+    }
+    app_ctx->input_packed = true;
+
+    rknn_input inputs[app_ctx->io_num.n_input];
+    memset(inputs, 0, sizeof(inputs));
+    inputs[0].index = 0;
+    inputs[0].buf = app_ctx->input_pack_buf;
+    inputs[0].size = app_ctx->input_pack_size;
+    inputs[0].pass_through = 0;
+    inputs[0].type = RKNN_TENSOR_UINT8;
+    inputs[0].fmt = app_ctx->input_layout.layout == IMAGE_LAYOUT_CHW ? RKNN_TENSOR_NCHW : RKNN_TENSOR_NHWC;
+    int ret = rknn_inputs_set(app_ctx->rknn_ctx, app_ctx->io_num.n_input, inputs);
+    if (ret < 0)
+    {
+        printf("rknn_input_set fail! ret=%d\n", ret);
+        return ret;
+    }
+
+    ret = rknn_run(app_ctx->rknn_ctx, nullptr);
+    if (ret < 0)
+    {
+        printf("rknn_run fail! ret=%d\n", ret);
+        return ret;
+    }
+
+    rknn_output outputs[app_ctx->io_num.n_output];
+    memset(outputs, 0, sizeof(outputs));
+    for (uint32_t i = 0; i < app_ctx->io_num.n_output; i++)
+    {
+        outputs[i].index = i;
+        outputs[i].want_float = (!app_ctx->is_quant && !app_ctx->is_fp16);
+    }
+    ret = rknn_outputs_get(app_ctx->rknn_ctx, app_ctx->io_num.n_output, outputs, NULL);
+    if (ret < 0)
+    {
+        printf("rknn_outputs_get fail! ret=%d\n", ret);
+        return ret;
+    }
+
+    /* 输出的第0维是batch，每张图的输出是连续的 1/batch，切片后逐张后处理 */
+    rknn_output slices[app_ctx->io_num.n_output];
+    for (int b = 0; b < n; b++)
+    {
+        for (uint32_t i = 0; i < app_ctx->io_num.n_output; i++)
+        {
+            uint32_t slice_size = outputs[i].size / app_ctx->batch;
+            slices[i] = outputs[i];
+            slices[i].buf = (char *)outputs[i].buf + (size_t)b * slice_size;
+            slices[i].size = slice_size;
+        }
+        memset(jobs[b]->od_results, 0, sizeof(object_detect_result_list));
+        post_process(app_ctx, slices, &jobs[b]->letter_box, BOX_THRESH, NMS_THRESH, jobs[b]->od_results);
+    }
+
+    rknn_outputs_release(app_ctx->rknn_ctx, app_ctx->io_num.n_output, outputs);
+    return 0;
+}
+
+int run_yolov5_batch(void *arg, batch_item_t **items, int n)
+{
+    rknn_app_context_t *app_ctx = (rknn_app_context_t *)arg;
+    yolov5_batch_job_t *jobs[BATCH_SCHED_MAX];
+    for (int i = 0; i < n; i++)
+    {
+        jobs[i] = (yolov5_batch_job_t *)items[i]->data;
+        items[i]->ret = 0;
+    }
+    return inference_yolov5_batch(app_ctx, jobs, n);
+}
+
 int init_yolov5_model(const char *model_path, rknn_app_context_t *app_ctx)
+{
+    return init_yolov5_model_with_anchors(model_path, ANCHORS_TXT_PATH, app_ctx);
+}
+
+int load_yolov5_labels(rknn_app_context_t *app_ctx, const char *labels_path)
+{
+    if (app_ctx->labels == NULL)
+    {
+        app_ctx->labels = (char **)calloc(OBJ_CLASS_NUM, sizeof(char *));
+        if (app_ctx->labels == NULL)
+        {
+            return -1;
+        }
+    }
+    free_label_names(app_ctx->labels, OBJ_CLASS_NUM);
+    app_ctx->label_num = load_label_names(labels_path, app_ctx->labels, OBJ_CLASS_NUM);
+    if (app_ctx->label_num < 0)
+    {
+        app_ctx->label_num = 0;
+        return -1;
+    }
+    return app_ctx->label_num;
+}
+
+const char *yolov5_cls_to_name(rknn_app_context_t *app_ctx, int cls_id)
+{
+    if (app_ctx->labels == NULL)
+    {
+        return coco_cls_to_name(cls_id);
+    }
+    if (cls_id < 0 || cls_id >= app_ctx->label_num || app_ctx->labels[cls_id] == NULL)
+    {
+        return "null";
+    }
+    return app_ctx->labels[cls_id];
+}
+
+int init_yolov5_model_with_anchors(const char *model_path, const char *anchors_path, rknn_app_context_t *app_ctx)
 {
     int ret;
     int model_len = 0;
@@ -46,13 +678,29 @@ int init_yolov5_model(const char *model_path, rknn_app_context_t *app_ctx)
         return -1;
     }
 
-    ret = rknn_init(&ctx, model, model_len, 0, NULL);
+    uint32_t init_flags = yolov5_init_flags | npu_sched_init_flag(yolov5_priority);
+    if (yolov5_npu_mem != NULL)
+    {
+        ret = npu_mem_init_context(yolov5_npu_mem, model_path, model, model_len, init_flags, &ctx);
+    }
+    else
+    {
+        ret = rknn_init(&ctx, model, model_len, init_flags, NULL);
+    }
     free(model);
     if (ret < 0)
     {
         printf("rknn_init 失败！ret=%d\n", ret);
         return -1;
     }
+    if (yolov5_core_mask != RKNN_NPU_CORE_AUTO)
+    {
+        ret = rknn_set_core_mask(ctx, (rknn_core_mask)yolov5_core_mask);
+        if (ret != RKNN_SUCC)
+        {
+            printf("rknn_set_core_mask %d 失败，由运行时选核 ret=%d\n", yolov5_core_mask, ret);
+        }
+    }
 
     // 获取模型的输入输出数量
     rknn_input_output_num io_num;
@@ -68,7 +716,7 @@ int init_yolov5_model(const char *model_path, rknn_app_context_t *app_ctx)
     printf("输入张量信息:\n");
     rknn_tensor_attr input_attrs[io_num.n_input];
     memset(input_attrs, 0, sizeof(input_attrs));
-    for (int i = 0; i < io_num.n_input; i++)
+    for (uint32_t i = 0; i < io_num.n_input; i++)
     {
         input_attrs[i].index = i;
         ret = rknn_query(ctx, RKNN_QUERY_INPUT_ATTR, &(input_attrs[i]), sizeof(rknn_tensor_attr));
@@ -84,7 +732,7 @@ int init_yolov5_model(const char *model_path, rknn_app_context_t *app_ctx)
     printf("输出张量信息:\n");
     rknn_tensor_attr output_attrs[io_num.n_output];
     memset(output_attrs, 0, sizeof(output_attrs));
-    for (int i = 0; i < io_num.n_output; i++)
+    for (uint32_t i = 0; i < io_num.n_output; i++)
     {
         output_attrs[i].index = i;
         ret = rknn_query(ctx, RKNN_QUERY_OUTPUT_ATTR, &(output_attrs[i]), sizeof(rknn_tensor_attr));
@@ -108,6 +756,12 @@ int init_yolov5_model(const char *model_path, rknn_app_context_t *app_ctx)
     {
         app_ctx->is_quant = false;
     }
+#if defined(YOLOV5_DECODE_FP16)
+    // FP16 输出直接交给FP16解码器，运行时不再转成FP32（输出内存流量减半）
+    app_ctx->is_fp16 = !app_ctx->is_quant && output_attrs[0].type == RKNN_TENSOR_FLOAT16;
+#else
+    app_ctx->is_fp16 = false;
+#endif
 
     app_ctx->io_num = io_num;
     app_ctx->input_attrs = (rknn_tensor_attr *)malloc(io_num.n_input * sizeof(rknn_tensor_attr));
@@ -132,6 +786,26 @@ int init_yolov5_model(const char *model_path, rknn_app_context_t *app_ctx)
     }
     printf("模型输入高度=%d, 宽度=%d, 通道数=%d\n",
            app_ctx->model_height, app_ctx->model_width, app_ctx->model_channel);
+    app_ctx->batch = input_attrs[0].n_dims == 4 && input_attrs[0].dims[0] > 1 ? input_attrs[0].dims[0] : 1;
+    if (app_ctx->batch > 1)
+    {
+        printf("batch模型，batch=%d\n", app_ctx->batch);
+    }
+
+    init_yolov5_shapes(app_ctx);
+    ret = init_yolov5_input(app_ctx);
+    if (ret != 0)
+    {
+        return -1;
+    }
+
+    // 根据输出张量和 anchors 文件选择解码器
+    ret = init_yolov5_decoder(app_ctx, anchors_path);
+    if (ret != 0)
+    {
+        printf("init_yolov5_decoder 失败！ret=%d\n", ret);
+        return -1;
+    }
 
     return 0;
 }
@@ -139,6 +813,18 @@ int init_yolov5_model(const char *model_path, rknn_app_context_t *app_ctx)
 
 int release_yolov5_model(rknn_app_context_t *app_ctx)
 {
+    if (app_ctx->labels != NULL)
+    {
+        free_label_names(app_ctx->labels, OBJ_CLASS_NUM);
+        free(app_ctx->labels);
+        app_ctx->labels = NULL;
+        app_ctx->label_num = 0;
+    }
+    if (app_ctx->input_pack_buf != NULL)
+    {
+        free(app_ctx->input_pack_buf);
+        app_ctx->input_pack_buf = NULL;
+    }
     if (app_ctx->input_attrs != NULL)
     {
         free(app_ctx->input_attrs);
@@ -151,7 +837,10 @@ int release_yolov5_model(rknn_app_context_t *app_ctx)
     }
     if (app_ctx->rknn_ctx != 0)
     {
-        rknn_destroy(app_ctx->rknn_ctx);
+        if (yolov5_npu_mem == NULL || npu_mem_release_context(yolov5_npu_mem, app_ctx->rknn_ctx) == 0)
+        {
+            rknn_destroy(app_ctx->rknn_ctx);
+        }
         app_ctx->rknn_ctx = 0;
     }
     return 0;
@@ -162,7 +851,6 @@ int inference_yolov5_model(rknn_app_context_t *app_ctx, image_buffer_t *img, obj
     int ret;
     image_buffer_t dst_img;
     letterbox_t letter_box;
-    rknn_input inputs[app_ctx->io_num.n_input];
     rknn_output outputs[app_ctx->io_num.n_output];
     const float nms_threshold = NMS_THRESH;      // Default NMS threshold
     const float box_conf_threshold = BOX_THRESH; // Default box threshold
@@ -176,7 +864,6 @@ int inference_yolov5_model(rknn_app_context_t *app_ctx, image_buffer_t *img, obj
     memset(od_results, 0x00, sizeof(*od_results));
     memset(&letter_box, 0, sizeof(letterbox_t));
     memset(&dst_img, 0, sizeof(image_buffer_t));
-    memset(inputs, 0, sizeof(inputs));
     memset(outputs, 0, sizeof(outputs));
 
     // Pre Process
@@ -199,17 +886,10 @@ int inference_yolov5_model(rknn_app_context_t *app_ctx, image_buffer_t *img, obj
         return -1;
     }
 
-    // Set Input Data
-    inputs[0].index = 0;
-    inputs[0].type = RKNN_TENSOR_UINT8;
-    inputs[0].fmt = RKNN_TENSOR_NHWC;
-    inputs[0].size = app_ctx->model_width * app_ctx->model_height * app_ctx->model_channel;
-    inputs[0].buf = dst_img.virt_addr;
-
-    ret = rknn_inputs_set(app_ctx->rknn_ctx, app_ctx->io_num.n_input, inputs);
+    // Set Input Data, in the layout the runtime wants
+    ret = set_yolov5_input(app_ctx, &dst_img, 0, app_ctx->model_height);
     if (ret < 0)
     {
-        printf("rknn_input_set fail! ret=%d\n", ret);
         return -1;
     }
 
@@ -227,7 +907,7 @@ int inference_yolov5_model(rknn_app_context_t *app_ctx, image_buffer_t *img, obj
     for (int i = 0; i < app_ctx->io_num.n_output; i++)
     {
         outputs[i].index = i;
-        outputs[i].want_float = (!app_ctx->is_quant);
+        outputs[i].want_float = (!app_ctx->is_quant && !app_ctx->is_fp16);
     }
     ret = rknn_outputs_get(app_ctx->rknn_ctx, app_ctx->io_num.n_output, outputs, NULL);
     if (ret < 0)
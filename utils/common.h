@@ -20,8 +20,8 @@ typedef enum {
 typedef struct {
     int width;
     int height;
-    int width_stride;
-    int height_stride;
+    int width_stride;   // row pitch in pixels, 0: same as width
+    int height_stride;  // rows between planes (NV12/NV21), 0: same as height
     image_format_t format;
     unsigned char* virt_addr;
     int size;
@@ -39,4 +39,14 @@ typedef struct {
     int bottom;
 } image_rect_t;
 
+/**
+ * @brief Rectangle of a parent image, no pixels of its own
+ *
+ * Crops, tiles and mosaic cells share the parent buffer and its strides.
+ */
+typedef struct {
+    image_buffer_t* parent;
+    image_rect_t rect;
+} image_view_t;
+
 #endif //_RKNN_MODEL_ZOO_COMMON_H_
@@ -0,0 +1,517 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "image_utils.h"
+#include "image_threads.h"
+#include "image_dispatch.h"
+
+#define LIVE_WEIGHT 0.125f          // moving average weight of a new call
+#define SATURATED_RATIO 1.5f        // RGA this much slower than calibrated: split with the CPU
+#define SATURATED_MIN_CALLS 8
+#define PROBE_INTERVAL 64           // every Nth call goes to the other engine to keep its cost current
+#define RETRY_MAX_CALLS 256         // longest back off after transient failures
+
+static int dispatch_enabled = 0;
+static image_dispatch_entry_t entries[IMAGE_DISPATCH_FMT_NUM][IMAGE_DISPATCH_FMT_NUM][IMAGE_DISPATCH_SIZE_CLASS_NUM];
+
+static const char* engine_names[IMAGE_ENGINE_NUM] = {"rga", "cpu"};
+
+// calibrated pairs and the target size of each size class
+static const image_format_t calib_pairs[][2] = {
+    {IMAGE_FORMAT_RGB888, IMAGE_FORMAT_RGB888},
+    {IMAGE_FORMAT_RGBA8888, IMAGE_FORMAT_RGBA8888},
+    {IMAGE_FORMAT_YUV420SP_NV12, IMAGE_FORMAT_YUV420SP_NV12},
+    {IMAGE_FORMAT_YUV420SP_NV12, IMAGE_FORMAT_RGB888},
+    {IMAGE_FORMAT_RGB888, IMAGE_FORMAT_RGBA8888},
+};
+static const int calib_sizes[IMAGE_DISPATCH_SIZE_CLASS_NUM][2] = {
+    {128, 96}, {320, 240}, {640, 480}, {1280, 720}, {1920, 1080},
+};
+
+static int64_t get_time_us()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static int get_size_class(int pixels)
+{
+    if (pixels < 32 * 1024) {
+        return 0;
+    }
+    if (pixels < 128 * 1024) {
+        return 1;
+    }
+    if (pixels < 512 * 1024) {
+        return 2;
+    }
+    if (pixels < 2 * 1024 * 1024) {
+        return 3;
+    }
+    return 4;
+}
+
+static void reset_entries()
+{
+    image_dispatch_entry_t* e = &entries[0][0][0];
+    int n = sizeof(entries) / sizeof(image_dispatch_entry_t);
+    for (int i = 0; i < n; i++) {
+        memset(&e[i], 0, sizeof(image_dispatch_entry_t));
+        for (int k = 0; k < IMAGE_ENGINE_NUM; k++) {
+            e[i].calib_us[k] = IMAGE_DISPATCH_UNKNOWN;
+            e[i].live_us[k] = IMAGE_DISPATCH_UNKNOWN;
+        }
+    }
+}
+
+static image_dispatch_entry_t* get_entry(image_buffer_t* src, image_buffer_t* dst, int dst_pixels)
+{
+    if (src->format < 0 || src->format >= IMAGE_DISPATCH_FMT_NUM || dst->format < 0 ||
+        dst->format >= IMAGE_DISPATCH_FMT_NUM) {
+        return NULL;
+    }
+    return &entries[src->format][dst->format][get_size_class(dst_pixels)];
+}
+
+static int run_engine(int engine, image_buffer_t* src, image_buffer_t* dst, image_rect_t* src_box,
+                      image_rect_t* dst_box, char color, int fill_pad)
+{
+    if (engine == IMAGE_ENGINE_RGA) {
+        return convert_image_rga(src, dst, src_box, dst_box, color, fill_pad);
+    }
+    return convert_image_cpu(src, dst, src_box, dst_box, color, fill_pad);
+}
+
+static int supported(const image_dispatch_entry_t* e, int engine)
+{
+    return e->calib_us[engine] != IMAGE_DISPATCH_UNSUPPORTED && e->live_us[engine] != IMAGE_DISPATCH_UNSUPPORTED;
+}
+
+// supported and not backing off after a failure
+static int available(const image_dispatch_entry_t* e, int engine)
+{
+    return supported(e, engine) && (int32_t)(e->tick - e->retry_tick[engine]) >= 0;
+}
+
+static void note_failure(image_dispatch_entry_t* e, int engine, int ret)
+{
+    if (ret == IMAGE_CONVERT_UNSUPPORTED) {
+        e->live_us[engine] = IMAGE_DISPATCH_UNSUPPORTED;
+        return;
+    }
+    // a busy core or a fence timeout, skip the engine for a while and retry
+    uint32_t wait = e->failures[engine] < 8 ? 2u << e->failures[engine] : RETRY_MAX_CALLS;
+    e->failures[engine]++;
+    e->retry_tick[engine] = e->tick + wait;
+}
+
+static float current_cost(const image_dispatch_entry_t* e, int engine)
+{
+    return e->live_us[engine] >= 0 ? e->live_us[engine] : e->calib_us[engine];
+}
+
+static void update_live(image_dispatch_entry_t* e, int engine, int64_t us, int dst_pixels)
+{
+    float cost = (float)us * 1000000.f / dst_pixels;
+    if (e->live_us[engine] < 0) {
+        e->live_us[engine] = cost;
+    } else {
+        e->live_us[engine] += (cost - e->live_us[engine]) * LIVE_WEIGHT;
+    }
+    e->calls[engine]++;
+    e->failures[engine] = 0;
+}
+
+// RGA first when nothing is known yet, as before
+static int choose_engine(const image_dispatch_entry_t* e)
+{
+    if (!available(e, IMAGE_ENGINE_RGA)) {
+        return IMAGE_ENGINE_CPU;
+    }
+    if (!available(e, IMAGE_ENGINE_CPU)) {
+        return IMAGE_ENGINE_RGA;
+    }
+    float rga = current_cost(e, IMAGE_ENGINE_RGA);
+    float cpu = current_cost(e, IMAGE_ENGINE_CPU);
+    if (rga < 0 || cpu < 0) {
+        return IMAGE_ENGINE_RGA;
+    }
+    int best = cpu < rga ? IMAGE_ENGINE_CPU : IMAGE_ENGINE_RGA;
+    if ((e->calls[IMAGE_ENGINE_RGA] + e->calls[IMAGE_ENGINE_CPU]) % PROBE_INTERVAL == PROBE_INTERVAL - 1) {
+        return best == IMAGE_ENGINE_RGA ? IMAGE_ENGINE_CPU : IMAGE_ENGINE_RGA;
+    }
+    return best;
+}
+
+static int gcd(int a, int b)
+{
+    while (b != 0) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+typedef struct {
+    image_dispatch_entry_t* e;
+    image_buffer_t* src;
+    image_buffer_t* dst;
+    image_rect_t sbox;
+    image_rect_t dbox;
+    int step_s;
+    int step_d;
+    int rga_steps;
+    int cpu_steps;
+    int cpu_units;
+    char color;
+    int dst_pixels;
+    int rga_ret;
+    int cpu_ret;
+} split_job_t;
+
+// unit 0: the RGA band; units 1..cpu_units: slices of the CPU band, the last one takes the remainder rows
+static void split_units(void* arg, int begin, int end)
+{
+    split_job_t* job = (split_job_t*)arg;
+    for (int u = begin; u < end; u++) {
+        image_rect_t sbox = job->sbox;
+        image_rect_t dbox = job->dbox;
+        if (u == 0) {
+            sbox.bottom = job->sbox.top + job->rga_steps * job->step_s - 1;
+            dbox.bottom = job->dbox.top + job->rga_steps * job->step_d - 1;
+            int64_t start = get_time_us();
+            job->rga_ret = convert_image_rga(job->src, job->dst, &sbox, &dbox, job->color, 0);
+            if (job->rga_ret != 0) {
+                // redo the band on the CPU
+                if (convert_image_cpu(job->src, job->dst, &sbox, &dbox, job->color, 0) != 0) {
+                    __atomic_store_n(&job->cpu_ret, -1, __ATOMIC_RELAXED);
+                }
+            } else {
+                // scaled to the whole call so the average can recover once RGA is idle again
+                int rga_rows = dbox.bottom - dbox.top + 1;
+                int dh = job->dbox.bottom - job->dbox.top + 1;
+                update_live(job->e, IMAGE_ENGINE_RGA, (get_time_us() - start) * dh / rga_rows, job->dst_pixels);
+            }
+            continue;
+        }
+        int first = job->rga_steps + job->cpu_steps * (u - 1) / job->cpu_units;
+        int last = job->rga_steps + job->cpu_steps * u / job->cpu_units;
+        sbox.top = job->sbox.top + first * job->step_s;
+        dbox.top = job->dbox.top + first * job->step_d;
+        if (u < job->cpu_units) {
+            if (first == last) {
+                continue;
+            }
+            sbox.bottom = job->sbox.top + last * job->step_s - 1;
+            dbox.bottom = job->dbox.top + last * job->step_d - 1;
+        }
+        if (convert_image_cpu(job->src, job->dst, &sbox, &dbox, 0, 0) != 0) {
+            __atomic_store_n(&job->cpu_ret, -1, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+/*
+ * Top rows on RGA, bottom rows in slices on the other image_threads workers; each unit is
+ * one band of the pool. Split rows are placed where both bands have an integer scale, so
+ * each band is an exact crop. Returns 1 if the call was not split.
+ */
+static int split_convert(image_dispatch_entry_t* e, image_buffer_t* src, image_buffer_t* dst, image_rect_t* src_box,
+                         image_rect_t* dst_box, char color, int fill_pad, int dst_pixels)
+{
+    int threads = image_threads_count();
+    if (threads < 2) {
+        // RGA and the CPU would run one after the other
+        return 1;
+    }
+    image_rect_t sbox = {0, 0, src->width - 1, src->height - 1};
+    image_rect_t dbox = {0, 0, dst->width - 1, dst->height - 1};
+    if (src_box != NULL) {
+        sbox = *src_box;
+    }
+    if (dst_box != NULL) {
+        dbox = *dst_box;
+    }
+    int sh = sbox.bottom - sbox.top + 1;
+    int dh = dbox.bottom - dbox.top + 1;
+    int g = gcd(sh, dh);
+    int step_s = sh / g;
+    int step_d = dh / g;
+    if (src->format == IMAGE_FORMAT_YUV420SP_NV12 || src->format == IMAGE_FORMAT_YUV420SP_NV21 ||
+        dst->format == IMAGE_FORMAT_YUV420SP_NV12 || dst->format == IMAGE_FORMAT_YUV420SP_NV21) {
+        // chroma rows come in pairs
+        while ((step_s | step_d) & 1) {
+            step_s *= 2;
+            step_d *= 2;
+        }
+    }
+    if (step_d * 4 > dh) {
+        return 1;
+    }
+
+    // equal finish time: rga_rows * rga_cost == cpu_rows * cpu_cost, the CPU cost was
+    // calibrated on all threads and the CPU band gets one less
+    float rga = current_cost(e, IMAGE_ENGINE_RGA);
+    float cpu = current_cost(e, IMAGE_ENGINE_CPU) * threads / (threads - 1);
+    int steps = (int)((float)dh / step_d * cpu / (rga + cpu) + 0.5f);
+    int rga_rows = steps * step_d;
+    if (rga_rows <= 0 || rga_rows >= dh) {
+        return 1;
+    }
+
+    // the RGA band must not fill over the CPU band while it runs
+    if (fill_pad && (dbox.right - dbox.left + 1 != dst->width || dh != dst->height)) {
+        fill_image_color(dst, color);
+    }
+
+    split_job_t job;
+    job.e = e;
+    job.src = src;
+    job.dst = dst;
+    job.sbox = sbox;
+    job.dbox = dbox;
+    job.step_s = step_s;
+    job.step_d = step_d;
+    job.rga_steps = steps;
+    job.cpu_steps = dh / step_d - steps;
+    job.cpu_units = threads - 1;
+    job.color = color;
+    job.dst_pixels = dst_pixels;
+    job.rga_ret = 0;
+    job.cpu_ret = 0;
+    // pool busy with another caller: the units run in this thread, still correct
+    image_threads_run_rows(threads, 0, 1, split_units, &job);
+
+    if (job.rga_ret != 0) {
+        note_failure(e, IMAGE_ENGINE_RGA, job.rga_ret);
+    }
+    e->splits++;
+    return job.cpu_ret != 0 ? -1 : 0;
+}
+
+int image_dispatch_convert(image_buffer_t* src_img, image_buffer_t* dst_img, image_rect_t* src_box,
+                           image_rect_t* dst_box, char color, int fill_pad)
+{
+    int ret;
+    if (!dispatch_enabled) {
+        ret = convert_image_rga(src_img, dst_img, src_box, dst_box, color, fill_pad);
+        if (ret != 0) {
+            printf("try convert image use cpu\n");
+            ret = convert_image_cpu(src_img, dst_img, src_box, dst_box, color, fill_pad);
+        }
+        return ret;
+    }
+
+    int dst_pixels = dst_img->width * dst_img->height;
+    if (dst_box != NULL) {
+        dst_pixels = (dst_box->right - dst_box->left + 1) * (dst_box->bottom - dst_box->top + 1);
+    }
+    image_dispatch_entry_t* e = get_entry(src_img, dst_img, dst_pixels);
+    if (e == NULL || dst_pixels <= 0) {
+        return -1;
+    }
+
+    e->tick++;
+    int engine = choose_engine(e);
+    if (engine == IMAGE_ENGINE_RGA && available(e, IMAGE_ENGINE_CPU) && e->calls[IMAGE_ENGINE_RGA] >= SATURATED_MIN_CALLS &&
+        e->calib_us[IMAGE_ENGINE_RGA] > 0 && e->calib_us[IMAGE_ENGINE_CPU] > 0 &&
+        e->live_us[IMAGE_ENGINE_RGA] > e->calib_us[IMAGE_ENGINE_RGA] * SATURATED_RATIO) {
+        ret = split_convert(e, src_img, dst_img, src_box, dst_box, color, fill_pad, dst_pixels);
+        if (ret <= 0) {
+            return ret;
+        }
+    }
+
+    for (int attempt = 0; attempt < IMAGE_ENGINE_NUM; attempt++) {
+        int64_t start = get_time_us();
+        ret = run_engine(engine, src_img, dst_img, src_box, dst_box, color, fill_pad);
+        if (ret == 0) {
+            update_live(e, engine, get_time_us() - start, dst_pixels);
+            return 0;
+        }
+        note_failure(e, engine, ret);
+        // the other engine even if it is backing off, better than failing the call
+        engine = engine == IMAGE_ENGINE_RGA ? IMAGE_ENGINE_CPU : IMAGE_ENGINE_RGA;
+        if (attempt + 1 == IMAGE_ENGINE_NUM || !supported(e, engine)) {
+            break;
+        }
+        printf("try convert image use %s\n", engine_names[engine]);
+    }
+    return -1;
+}
+
+static int malloc_image(void* arg, image_buffer_t* image)
+{
+    (void)arg;
+    image->size = get_image_size(image);
+    image->virt_addr = (unsigned char*)malloc(image->size);
+    image->fd = -1;
+    return image->virt_addr != NULL ? 0 : -1;
+}
+
+static void free_image(void* arg, image_buffer_t* image)
+{
+    (void)arg;
+    free(image->virt_addr);
+    image->virt_addr = NULL;
+}
+
+static const image_dispatch_allocator_t malloc_allocator = {malloc_image, free_image, NULL};
+
+static int alloc_calib_image(const image_dispatch_allocator_t* allocator, image_buffer_t* image,
+                             image_format_t format, int width, int height)
+{
+    memset(image, 0, sizeof(image_buffer_t));
+    image->width = width;
+    image->height = height;
+    image->format = format;
+    image->fd = -1;
+    if (allocator->alloc(allocator->arg, image) != 0 || image->virt_addr == NULL) {
+        image->virt_addr = NULL;
+        return -1;
+    }
+    memset(image->virt_addr, 0x80, get_image_size(image));
+    return 0;
+}
+
+void image_dispatch_calibrate(int iterations, const image_dispatch_allocator_t* allocator)
+{
+    if (iterations <= 0) {
+        iterations = 1;
+    }
+    if (allocator == NULL) {
+        allocator = &malloc_allocator;
+    }
+    int n_pairs = sizeof(calib_pairs) / sizeof(calib_pairs[0]);
+    for (int p = 0; p < n_pairs; p++) {
+        for (int c = 0; c < IMAGE_DISPATCH_SIZE_CLASS_NUM; c++) {
+            int dst_w = calib_sizes[c][0];
+            int dst_h = calib_sizes[c][1];
+            image_buffer_t src, dst;
+            // camera like source, 3/2 of the target each way
+            if (alloc_calib_image(allocator, &src, calib_pairs[p][0], dst_w * 3 / 2, dst_h * 3 / 2) != 0) {
+                printf("calibrate: alloc fail\n");
+                return;
+            }
+            if (alloc_calib_image(allocator, &dst, calib_pairs[p][1], dst_w, dst_h) != 0) {
+                printf("calibrate: alloc fail\n");
+                allocator->release(allocator->arg, &src);
+                return;
+            }
+            image_dispatch_entry_t* e = &entries[calib_pairs[p][0]][calib_pairs[p][1]][c];
+            for (int k = 0; k < IMAGE_ENGINE_NUM; k++) {
+                // warm up, also checks support; a transient failure leaves the cost unknown
+                int ret = run_engine(k, &src, &dst, NULL, NULL, 0, 0);
+                if (ret != 0) {
+                    e->calib_us[k] = ret == IMAGE_CONVERT_UNSUPPORTED ? IMAGE_DISPATCH_UNSUPPORTED : IMAGE_DISPATCH_UNKNOWN;
+                    continue;
+                }
+                int64_t start = get_time_us();
+                for (int i = 0; i < iterations; i++) {
+                    run_engine(k, &src, &dst, NULL, NULL, 0, 0);
+                }
+                int64_t us = (get_time_us() - start) / iterations;
+                e->calib_us[k] = (float)us * 1000000.f / (dst_w * dst_h);
+                e->live_us[k] = IMAGE_DISPATCH_UNKNOWN;
+            }
+            allocator->release(allocator->arg, &src);
+            allocator->release(allocator->arg, &dst);
+        }
+    }
+}
+
+int image_dispatch_load(const char* path)
+{
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL) {
+        return -1;
+    }
+    char line[256];
+    int count = 0;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        int sf, df, c;
+        float rga, cpu;
+        if (line[0] == '#' || sscanf(line, "%d %d %d %f %f", &sf, &df, &c, &rga, &cpu) != 5) {
+            continue;
+        }
+        if (sf < 0 || sf >= IMAGE_DISPATCH_FMT_NUM || df < 0 || df >= IMAGE_DISPATCH_FMT_NUM || c < 0 ||
+            c >= IMAGE_DISPATCH_SIZE_CLASS_NUM) {
+            continue;
+        }
+        entries[sf][df][c].calib_us[IMAGE_ENGINE_RGA] = rga;
+        entries[sf][df][c].calib_us[IMAGE_ENGINE_CPU] = cpu;
+        count++;
+    }
+    fclose(fp);
+    return count > 0 ? 0 : -1;
+}
+
+int image_dispatch_save(const char* path)
+{
+    FILE* fp = fopen(path, "w");
+    if (fp == NULL) {
+        printf("open %s fail\n", path);
+        return -1;
+    }
+    fprintf(fp, "# src_fmt dst_fmt size_class rga_us_per_mpix cpu_us_per_mpix (%.0f: unsupported)\n",
+            IMAGE_DISPATCH_UNSUPPORTED);
+    for (int sf = 0; sf < IMAGE_DISPATCH_FMT_NUM; sf++) {
+        for (int df = 0; df < IMAGE_DISPATCH_FMT_NUM; df++) {
+            for (int c = 0; c < IMAGE_DISPATCH_SIZE_CLASS_NUM; c++) {
+                const image_dispatch_entry_t* e = &entries[sf][df][c];
+                if (e->calib_us[IMAGE_ENGINE_RGA] == IMAGE_DISPATCH_UNKNOWN &&
+                    e->calib_us[IMAGE_ENGINE_CPU] == IMAGE_DISPATCH_UNKNOWN) {
+                    continue;
+                }
+                fprintf(fp, "%d %d %d %.1f %.1f\n", sf, df, c, e->calib_us[IMAGE_ENGINE_RGA],
+                        e->calib_us[IMAGE_ENGINE_CPU]);
+            }
+        }
+    }
+    fclose(fp);
+    return 0;
+}
+
+int image_dispatch_init(const char* profile_path, const image_dispatch_allocator_t* allocator)
+{
+    reset_entries();
+    if (profile_path == NULL || image_dispatch_load(profile_path) != 0) {
+        printf("calibrate rga / cpu image conversion\n");
+        image_dispatch_calibrate(5, allocator);
+        if (profile_path != NULL) {
+            image_dispatch_save(profile_path);
+        }
+    }
+    dispatch_enabled = 1;
+    return 0;
+}
+
+void image_dispatch_deinit()
+{
+    dispatch_enabled = 0;
+}
+
+void image_dispatch_print_stats()
+{
+    for (int sf = 0; sf < IMAGE_DISPATCH_FMT_NUM; sf++) {
+        for (int df = 0; df < IMAGE_DISPATCH_FMT_NUM; df++) {
+            for (int c = 0; c < IMAGE_DISPATCH_SIZE_CLASS_NUM; c++) {
+                const image_dispatch_entry_t* e = &entries[sf][df][c];
+                if (e->calib_us[IMAGE_ENGINE_RGA] == IMAGE_DISPATCH_UNKNOWN &&
+                    e->calib_us[IMAGE_ENGINE_CPU] == IMAGE_DISPATCH_UNKNOWN && e->calls[IMAGE_ENGINE_RGA] == 0 &&
+                    e->calls[IMAGE_ENGINE_CPU] == 0) {
+                    continue;
+                }
+                printf("fmt %d->%d class %d: rga %.0f/%.0f us/Mpix x%u, cpu %.0f/%.0f us/Mpix x%u, split x%u, "
+                       "failing rga %u cpu %u\n", sf, df, c, e->calib_us[IMAGE_ENGINE_RGA], e->live_us[IMAGE_ENGINE_RGA],
+                       e->calls[IMAGE_ENGINE_RGA], e->calib_us[IMAGE_ENGINE_CPU], e->live_us[IMAGE_ENGINE_CPU],
+                       e->calls[IMAGE_ENGINE_CPU], e->splits, e->failures[IMAGE_ENGINE_RGA],
+                       e->failures[IMAGE_ENGINE_CPU]);
+            }
+        }
+    }
+}
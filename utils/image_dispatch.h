@@ -0,0 +1,132 @@
+#ifndef _RKNN_MODEL_ZOO_IMAGE_DISPATCH_H_
+#define _RKNN_MODEL_ZOO_IMAGE_DISPATCH_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "common.h"
+
+/**
+ * @brief Engines convert_image can run on
+ */
+typedef enum {
+    IMAGE_ENGINE_RGA = 0,
+    IMAGE_ENGINE_CPU,
+    IMAGE_ENGINE_NUM,
+} image_engine_t;
+
+#define IMAGE_DISPATCH_FMT_NUM 5        // image_format_t values
+#define IMAGE_DISPATCH_SIZE_CLASS_NUM 5 // target pixels: <32K, <128K, <512K, <2M, larger
+
+#define IMAGE_DISPATCH_UNKNOWN -1.f
+#define IMAGE_DISPATCH_UNSUPPORTED -2.f
+
+// convert_image_rga / convert_image_cpu: the engine cannot do this format pair, retrying will
+// not help; any other error (busy core, fence timeout, rectangle out of range) may pass
+#define IMAGE_CONVERT_UNSUPPORTED -2
+
+/**
+ * @brief Cost of one (source format, target format, size class) on each engine
+ *
+ * Costs are microseconds per million target pixels.
+ */
+typedef struct {
+    float calib_us[IMAGE_ENGINE_NUM];   // from calibration or the profile file
+    float live_us[IMAGE_ENGINE_NUM];    // moving average of real calls
+    uint32_t calls[IMAGE_ENGINE_NUM];
+    uint32_t failures[IMAGE_ENGINE_NUM];    // transient failures in a row, 0 after a success
+    uint32_t retry_tick[IMAGE_ENGINE_NUM];  // engine skipped until tick reaches this, doubles per failure
+    uint32_t tick;                      // dispatched calls
+    uint32_t splits;                    // calls split between RGA and CPU
+} image_dispatch_entry_t;
+
+/**
+ * @brief Buffers for calibration, so each engine is timed on the memory it converts at runtime
+ *
+ * alloc gets width, height and format set and fills virt_addr, fd and size.
+ */
+typedef struct {
+    int (*alloc)(void* arg, image_buffer_t* image);
+    void (*release)(void* arg, image_buffer_t* image);
+    void* arg;
+} image_dispatch_allocator_t;
+
+/**
+ * @brief Enable cost based routing of convert_image
+ *
+ * Loads the profile file if it exists, otherwise calibrates both engines and writes it.
+ * Without this call convert_image tries RGA first and falls back to the CPU.
+ *
+ * @param profile_path [in] Profile file, NULL: calibrate and do not save
+ * @param allocator [in] Calibration buffers, e.g. image_pool_dispatch_allocator(); NULL: malloc
+ * @return int 0: success; -1: error
+ */
+int image_dispatch_init(const char* profile_path, const image_dispatch_allocator_t* allocator);
+
+/**
+ * @brief Disable routing, back to RGA first with CPU fallback
+ */
+void image_dispatch_deinit();
+
+/**
+ * @brief Time every calibrated format pair and size class on both engines
+ *
+ * RGA reads DMA buffers without the page locking a malloc buffer needs, so calibrate with the
+ * allocator the conversions use at runtime.
+ *
+ * @param iterations [in] Timed runs per engine and entry
+ * @param allocator [in] Calibration buffers, NULL: malloc
+ */
+void image_dispatch_calibrate(int iterations, const image_dispatch_allocator_t* allocator);
+
+/**
+ * @brief Read calibrated costs, one "src_fmt dst_fmt size_class rga_us cpu_us" line per entry
+ *
+ * @param path [in] Profile file
+ * @return int 0: success; -1: error
+ */
+int image_dispatch_load(const char* path);
+
+/**
+ * @brief Write calibrated costs
+ *
+ * @param path [in] Profile file
+ * @return int 0: success; -1: error
+ */
+int image_dispatch_save(const char* path);
+
+/**
+ * @brief convert_image entry: pick the engine, fall back to the other on failure
+ *
+ * When RGA runs clearly slower than calibrated (other jobs on its cores) and the CPU
+ * supports the conversion, the target rows are split between RGA and the image_threads
+ * pool in proportion to their costs. Rows at the seam sample only their own band.
+ *
+ * An engine returning IMAGE_CONVERT_UNSUPPORTED is not used for the entry again; after any
+ * other failure it is skipped for 2, 4, 8... up to 256 calls, then retried.
+ */
+int image_dispatch_convert(image_buffer_t* src_img, image_buffer_t* dst_img, image_rect_t* src_box,
+                           image_rect_t* dst_box, char color, int fill_pad);
+
+/**
+ * @brief Print costs and call counts of the entries that were calibrated or used
+ */
+void image_dispatch_print_stats();
+
+/*
+ * Engine entry points, implemented in image_utils.c.
+ * fill_pad: 1: fill the target with color first if dst_box does not cover it
+ * Return 0: success; IMAGE_CONVERT_UNSUPPORTED: not possible on this engine; -1: other error
+ */
+int convert_image_rga(image_buffer_t* src_img, image_buffer_t* dst_img, image_rect_t* src_box, image_rect_t* dst_box,
+                      char color, int fill_pad);
+int convert_image_cpu(image_buffer_t* src_img, image_buffer_t* dst_img, image_rect_t* src_box, image_rect_t* dst_box,
+                      char color, int fill_pad);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif // _RKNN_MODEL_ZOO_IMAGE_DISPATCH_H_
@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "image_layout.h"
+#include "image_threads.h"
+
+int image_layout_size(const image_layout_desc_t* desc)
+{
+    int plane = desc->height * desc->w_stride;
+    switch (desc->layout) {
+    case IMAGE_LAYOUT_HWC:
+    case IMAGE_LAYOUT_CHW:
+        return plane * desc->channel;
+    case IMAGE_LAYOUT_C1HWC2: {
+        int c1 = (desc->channel + desc->c2 - 1) / desc->c2;
+        return c1 * plane * desc->c2;
+    }
+    default:
+        return 0;
+    }
+}
+
+int image_layout_is_identity(const image_layout_desc_t* desc)
+{
+    return desc->layout == IMAGE_LAYOUT_HWC && desc->w_stride == desc->width && desc->xor_mask == 0;
+}
+
+static void pack_hwc_row(const uint8_t* src, uint8_t* dst, int n, uint8_t xor_mask)
+{
+    if (xor_mask == 0) {
+        memcpy(dst, src, n);
+        return;
+    }
+    for (int i = 0; i < n; i++) {
+        dst[i] = src[i] ^ xor_mask;
+    }
+}
+
+static void pack_chw_row(const uint8_t* src, uint8_t* const* planes, int width, int channel, uint8_t xor_mask)
+{
+    int x = 0;
+#if defined(__ARM_NEON)
+    if (channel == 3) {
+        uint8x16_t m = vdupq_n_u8(xor_mask);
+        for (; x + 16 <= width; x += 16) {
+            uint8x16x3_t v = vld3q_u8(src + x * 3);
+            vst1q_u8(planes[0] + x, veorq_u8(v.val[0], m));
+            vst1q_u8(planes[1] + x, veorq_u8(v.val[1], m));
+            vst1q_u8(planes[2] + x, veorq_u8(v.val[2], m));
+        }
+    }
+#endif
+    for (; x < width; x++) {
+        for (int c = 0; c < channel; c++) {
+            planes[c][x] = src[x * channel + c] ^ xor_mask;
+        }
+    }
+}
+
+static void pack_c1hwc2_row(const uint8_t* src, uint8_t* const* groups, int width, int channel, int c2,
+                            uint8_t xor_mask)
+{
+    for (int g = 0; g * c2 < channel; g++) {
+        int n = channel - g * c2 < c2 ? channel - g * c2 : c2;
+        const uint8_t* s = src + g * c2;
+        uint8_t* d = groups[g];
+        for (int x = 0; x < width; x++) {
+            for (int c = 0; c < n; c++) {
+                d[c] = s[c] ^ xor_mask;
+            }
+            s += channel;
+            d += c2;
+        }
+    }
+}
+
+typedef struct {
+    const uint8_t* src;
+    int src_stride;
+    const image_layout_desc_t* desc;
+    uint8_t* dst;
+    int row_begin;
+} pack_job_t;
+
+static void pack_band(void* arg, int begin, int end)
+{
+    pack_job_t* job = (pack_job_t*)arg;
+    const image_layout_desc_t* desc = job->desc;
+    int plane = desc->height * desc->w_stride;
+    uint8_t* ptrs[16];
+    for (int y = job->row_begin + begin; y < job->row_begin + end; y++) {
+        const uint8_t* src = job->src + (size_t)y * job->src_stride;
+        switch (desc->layout) {
+        case IMAGE_LAYOUT_HWC:
+            pack_hwc_row(src, job->dst + (size_t)y * desc->w_stride * desc->channel, desc->width * desc->channel,
+                         desc->xor_mask);
+            break;
+        case IMAGE_LAYOUT_CHW:
+            for (int c = 0; c < desc->channel; c++) {
+                ptrs[c] = job->dst + (size_t)c * plane + (size_t)y * desc->w_stride;
+            }
+            pack_chw_row(src, ptrs, desc->width, desc->channel, desc->xor_mask);
+            break;
+        case IMAGE_LAYOUT_C1HWC2:
+            for (int g = 0; g * desc->c2 < desc->channel; g++) {
+                ptrs[g] = job->dst + ((size_t)g * plane + (size_t)y * desc->w_stride) * desc->c2;
+            }
+            pack_c1hwc2_row(src, ptrs, desc->width, desc->channel, desc->c2, desc->xor_mask);
+            break;
+        }
+    }
+}
+
+int image_pack_rows(const image_buffer_t* src, const image_layout_desc_t* desc, uint8_t* dst, int row_begin,
+                    int row_end)
+{
+    int channel = src->format == IMAGE_FORMAT_RGB888 ? 3 : (src->format == IMAGE_FORMAT_RGBA8888 ? 4 : 1);
+    if (src->format == IMAGE_FORMAT_YUV420SP_NV12 || src->format == IMAGE_FORMAT_YUV420SP_NV21 ||
+        src->width != desc->width || src->height != desc->height || channel != desc->channel ||
+        desc->w_stride < desc->width || channel > 16 ||
+        (desc->layout == IMAGE_LAYOUT_C1HWC2 && desc->c2 <= 0)) {
+        printf("pack %dx%d format %d into layout %d %dx%dx%d fail\n", src->width, src->height, src->format,
+               desc->layout, desc->width, desc->height, desc->channel);
+        return -1;
+    }
+    if (row_begin < 0) {
+        row_begin = 0;
+    }
+    if (row_end > desc->height) {
+        row_end = desc->height;
+    }
+    if (row_begin >= row_end) {
+        return 0;
+    }
+
+    int ws = src->width_stride > 0 ? src->width_stride : src->width;
+    pack_job_t job;
+    job.src = src->virt_addr;
+    job.src_stride = ws * channel;
+    job.desc = desc;
+    job.dst = dst;
+    job.row_begin = row_begin;
+    image_threads_run_rows(row_end - row_begin, desc->width * channel, 1, pack_band, &job);
+    return 0;
+}
@@ -0,0 +1,67 @@
+#ifndef _RKNN_MODEL_ZOO_IMAGE_LAYOUT_H_
+#define _RKNN_MODEL_ZOO_IMAGE_LAYOUT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "common.h"
+
+/**
+ * @brief Memory layout of a packed model input (batch 1)
+ */
+typedef enum {
+    IMAGE_LAYOUT_HWC = 0,       // interleaved, the layout of image_buffer_t
+    IMAGE_LAYOUT_CHW,           // planar
+    IMAGE_LAYOUT_C1HWC2,        // channels in groups of c2, unused channels are zero
+} image_layout_t;
+
+typedef struct {
+    image_layout_t layout;
+    int width;
+    int height;
+    int channel;
+    int w_stride;               // pixels per packed row, >= width
+    int c2;                     // IMAGE_LAYOUT_C1HWC2 only
+    uint8_t xor_mask;           // 0x80: uint8 to int8 with zero point -128, 0: copy
+} image_layout_desc_t;
+
+/**
+ * @brief Bytes of a packed tensor
+ *
+ * @param desc [in] Layout
+ * @return int size in bytes
+ */
+int image_layout_size(const image_layout_desc_t* desc);
+
+/**
+ * @brief 1: the image can be handed over as is, no packing needed
+ *
+ * @param desc [in] Layout
+ * @return int 1: HWC without row padding or value mapping; 0: needs image_pack_rows()
+ */
+int image_layout_is_identity(const image_layout_desc_t* desc);
+
+/**
+ * @brief Pack rows [row_begin, row_end) of an interleaved image into the layout
+ *
+ * Rows are split across image_threads. The caller zeroes dst once, padding channels
+ * and row padding are never written. After a letterbox only the rows of the image
+ * box need packing again, the pad rows stay valid.
+ *
+ * @param src [in] Interleaved image, width / height / channels must match desc
+ * @param desc [in] Layout
+ * @param dst [out] Packed tensor of image_layout_size() bytes
+ * @param row_begin [in] First row
+ * @param row_end [in] End row (exclusive)
+ * @return int 0: success; -1: error
+ */
+int image_pack_rows(const image_buffer_t* src, const image_layout_desc_t* desc, uint8_t* dst, int row_begin,
+                    int row_end);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif // _RKNN_MODEL_ZOO_IMAGE_LAYOUT_H_
@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dma_alloc.h"
+
+#include "image_utils.h"
+#include "image_pool.h"
+
+// dma32 heaps: RGA2 can only address the low 4G
+static const char* heap_paths[2][2] = {
+    {DMA_HEAP_DMA32_UNCACHE_PATCH, DMA_HEAP_UNCACHE_PATH},
+    {DMA_HEAP_DMA32_PATCH, DMA_HEAP_PATH},
+};
+
+static const int role_cached[IMAGE_ROLE_NUM] = {
+    0,  // IMAGE_ROLE_DEVICE
+    1,  // IMAGE_ROLE_CAPTURE
+    1,  // IMAGE_ROLE_MODEL_INPUT
+    1,  // IMAGE_ROLE_DRAW
+    1,  // IMAGE_ROLE_DISPLAY
+};
+
+static const char* device_names[] = {"none", "cpu", "rga", "npu", "display"};
+
+static int heap_alloc(int cached, int size, int* fd, void** va)
+{
+    for (int i = 0; i < 2; i++) {
+        if (dma_buf_alloc(heap_paths[cached][i], size, fd, va) == 0) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static image_pool_entry_t* find_entry(image_pool_t* pool, image_buffer_t* image)
+{
+    if (image->virt_addr == NULL) {
+        return NULL;
+    }
+    for (int i = 0; i < IMAGE_POOL_MAX_BUFFERS; i++) {
+        if (pool->entries[i].virt_addr == image->virt_addr) {
+            return &pool->entries[i];
+        }
+    }
+    return NULL;
+}
+
+static void free_entry(image_pool_entry_t* e)
+{
+    if (e->fd > 0) {
+        dma_buf_free(e->size, &e->fd, e->virt_addr);
+    } else {
+        free(e->virt_addr);
+    }
+    memset(e, 0, sizeof(image_pool_entry_t));
+}
+
+void image_pool_init(image_pool_t* pool)
+{
+    memset(pool, 0, sizeof(image_pool_t));
+    pool->dma_available = 1;
+}
+
+int image_pool_deinit(image_pool_t* pool)
+{
+    int leaked = 0;
+    for (int i = 0; i < IMAGE_POOL_MAX_BUFFERS; i++) {
+        image_pool_entry_t* e = &pool->entries[i];
+        if (e->virt_addr == NULL) {
+            continue;
+        }
+        if (e->in_use) {
+            printf("image pool: leaked buffer %p size=%d role=%d last_writer=%s\n", e->virt_addr, e->size, e->role,
+                   device_names[e->last_writer]);
+            leaked++;
+        }
+        free_entry(e);
+    }
+    pool->in_use = 0;
+    pool->in_use_bytes = 0;
+    return leaked;
+}
+
+int image_pool_alloc(image_pool_t* pool, image_role_t role, image_buffer_t* image)
+{
+    int size = get_image_size(image);
+    if (size <= 0 || role < 0 || role >= IMAGE_ROLE_NUM) {
+        printf("image pool: invalid image %dx%d format=%d role=%d\n", image->width, image->height, image->format, role);
+        return -1;
+    }
+    int cached = role_cached[role];
+
+    image_pool_entry_t* e = NULL;
+    image_pool_entry_t* empty = NULL;
+    for (int i = 0; i < IMAGE_POOL_MAX_BUFFERS; i++) {
+        image_pool_entry_t* c = &pool->entries[i];
+        if (c->virt_addr == NULL) {
+            if (empty == NULL) {
+                empty = c;
+            }
+        } else if (!c->in_use && c->size == size && c->cached == cached) {
+            e = c;
+            break;
+        }
+    }
+
+    if (e != NULL) {
+        pool->reuses++;
+    } else {
+        if (empty == NULL) {
+            printf("image pool: too many buffers\n");
+            return -1;
+        }
+        e = empty;
+        int fd = 0;
+        void* va = NULL;
+        if (pool->dma_available && heap_alloc(cached, size, &fd, &va) != 0) {
+            printf("image pool: no dma heap, use malloc\n");
+            pool->dma_available = 0;
+        }
+        if (!pool->dma_available) {
+            fd = 0;
+            va = malloc(size);
+            if (va == NULL) {
+                printf("image pool: malloc size %d fail\n", size);
+                return -1;
+            }
+            pool->fallbacks++;
+        }
+        e->virt_addr = (unsigned char*)va;
+        e->fd = fd;
+        e->size = size;
+        e->cached = cached;
+        pool->allocs++;
+    }
+
+    e->in_use = 1;
+    e->role = role;
+    e->last_writer = IMAGE_DEVICE_NONE;
+    e->last_access = IMAGE_DEVICE_NONE;
+    pool->in_use++;
+    pool->in_use_bytes += size;
+    if (pool->in_use > pool->peak_in_use) {
+        pool->peak_in_use = pool->in_use;
+    }
+    if (pool->in_use_bytes > pool->peak_in_use_bytes) {
+        pool->peak_in_use_bytes = pool->in_use_bytes;
+    }
+
+    image->virt_addr = e->virt_addr;
+    image->fd = e->fd;
+    image->size = size;
+    return 0;
+}
+
+void image_pool_release(image_pool_t* pool, image_buffer_t* image)
+{
+    image_pool_entry_t* e = find_entry(pool, image);
+    if (e == NULL || !e->in_use) {
+        printf("image pool: release unknown buffer %p\n", image->virt_addr);
+        return;
+    }
+    e->in_use = 0;
+    pool->in_use--;
+    pool->in_use_bytes -= e->size;
+    image->virt_addr = NULL;
+    image->fd = 0;
+}
+
+static int dispatch_alloc(void* arg, image_buffer_t* image)
+{
+    // cached like the model input: RGA writes the target and the CPU path reads the source
+    return image_pool_alloc((image_pool_t*)arg, IMAGE_ROLE_MODEL_INPUT, image);
+}
+
+static void dispatch_release(void* arg, image_buffer_t* image)
+{
+    image_pool_t* pool = (image_pool_t*)arg;
+    image_pool_entry_t* e = find_entry(pool, image);
+    image_pool_release(pool, image);
+    if (e != NULL && !e->in_use) {
+        free_entry(e);
+    }
+}
+
+void image_pool_dispatch_allocator(image_pool_t* pool, image_dispatch_allocator_t* allocator)
+{
+    allocator->alloc = dispatch_alloc;
+    allocator->release = dispatch_release;
+    allocator->arg = pool;
+}
+
+int image_pool_sync(image_pool_t* pool, image_buffer_t* image, image_device_t device, int write)
+{
+    image_pool_entry_t* e = find_entry(pool, image);
+    if (e == NULL) {
+        return 0;
+    }
+
+    int ret = 0;
+    if (e->cached && e->fd > 0) {
+        if (device == IMAGE_DEVICE_CPU) {
+            // a device wrote since the CPU last looked: drop stale cache lines
+            if (e->last_writer != IMAGE_DEVICE_NONE && e->last_writer != IMAGE_DEVICE_CPU &&
+                e->last_access != IMAGE_DEVICE_CPU) {
+                ret = dma_sync_device_to_cpu(e->fd);
+                pool->invalidates++;
+            }
+        } else if (e->last_writer == IMAGE_DEVICE_CPU && e->last_access == IMAGE_DEVICE_CPU) {
+            // CPU writes are still in the cache
+            ret = dma_sync_cpu_to_device(e->fd);
+            pool->flushes++;
+        }
+    }
+    e->last_access = device;
+    if (write) {
+        e->last_writer = device;
+    }
+    if (ret != 0) {
+        printf("image pool: dma sync fail for %s\n", device_names[device]);
+        return -1;
+    }
+    return 0;
+}
+
+void image_pool_print_stats(const image_pool_t* pool)
+{
+    printf("image pool: in_use=%d (%lld bytes) peak=%d (%lld bytes) allocs=%llu reuses=%llu malloc=%llu "
+           "flushes=%llu invalidates=%llu\n",
+           pool->in_use, (long long)pool->in_use_bytes, pool->peak_in_use, (long long)pool->peak_in_use_bytes,
+           (unsigned long long)pool->allocs, (unsigned long long)pool->reuses, (unsigned long long)pool->fallbacks,
+           (unsigned long long)pool->flushes, (unsigned long long)pool->invalidates);
+}
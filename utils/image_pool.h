@@ -0,0 +1,143 @@
+#ifndef _RKNN_MODEL_ZOO_IMAGE_POOL_H_
+#define _RKNN_MODEL_ZOO_IMAGE_POOL_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "common.h"
+#include "image_dispatch.h"
+
+#define IMAGE_POOL_MAX_BUFFERS 32
+
+/**
+ * @brief Who touches an image buffer
+ */
+typedef enum {
+    IMAGE_DEVICE_NONE = 0,
+    IMAGE_DEVICE_CPU,
+    IMAGE_DEVICE_RGA,
+    IMAGE_DEVICE_NPU,
+    IMAGE_DEVICE_DISPLAY,
+} image_device_t;
+
+/**
+ * @brief How a buffer is used, decides the heap
+ *
+ * Buffers the CPU never touches come from the uncached heap and never need a sync.
+ * Buffers the CPU reads or writes come from the cached heap and are synced when
+ * ownership moves between the CPU and a device.
+ */
+typedef enum {
+    IMAGE_ROLE_DEVICE = 0,      // RGA / NPU only, e.g. intermediate frames: uncached
+    IMAGE_ROLE_CAPTURE,         // CPU copies the camera frame in, RGA reads: cached
+    IMAGE_ROLE_MODEL_INPUT,     // RGA writes, NPU (or rknn_inputs_set on the CPU) reads: cached
+    IMAGE_ROLE_DRAW,            // RGA writes, CPU draws, RGA reads: cached
+    IMAGE_ROLE_DISPLAY,         // RGA writes, CPU copies to the framebuffer: cached
+    IMAGE_ROLE_NUM,
+} image_role_t;
+
+typedef struct {
+    unsigned char* virt_addr;   // NULL: free slot
+    int fd;                     // dma-buf fd, 0: malloc fallback
+    int size;
+    int cached;
+    int in_use;
+    image_role_t role;
+    image_device_t last_writer;
+    image_device_t last_access;
+} image_pool_entry_t;
+
+/**
+ * @brief Image buffers backed by the DMA heap, with a malloc fallback
+ *
+ * Not thread safe, allocate and sync from one thread.
+ */
+typedef struct {
+    int dma_available;          // 0 after the first failed heap allocation, then malloc only
+    image_pool_entry_t entries[IMAGE_POOL_MAX_BUFFERS];
+    int in_use;
+    int peak_in_use;
+    int64_t in_use_bytes;
+    int64_t peak_in_use_bytes;
+    uint64_t allocs;            // new buffers
+    uint64_t reuses;            // served from a released buffer
+    uint64_t flushes;           // dma_sync_cpu_to_device
+    uint64_t invalidates;       // dma_sync_device_to_cpu
+    uint64_t fallbacks;         // malloc instead of DMA heap
+} image_pool_t;
+
+/**
+ * @brief Init pool
+ *
+ * @param pool [out] Pool
+ */
+void image_pool_init(image_pool_t* pool);
+
+/**
+ * @brief Free all buffers, report the ones still in use
+ *
+ * @param pool [in] Pool
+ * @return int number of leaked buffers
+ */
+int image_pool_deinit(image_pool_t* pool);
+
+/**
+ * @brief Allocate the pixels of an image
+ *
+ * width, height, format (and strides) must be set; size, virt_addr and fd are filled.
+ * A released buffer of the same size and heap is reused.
+ *
+ * @param pool [in] Pool
+ * @param role [in] Buffer role
+ * @param image [in/out] Image
+ * @return int 0: success; -1: error
+ */
+int image_pool_alloc(image_pool_t* pool, image_role_t role, image_buffer_t* image);
+
+/**
+ * @brief Give the pixels back to the pool, the mapping is kept for reuse
+ *
+ * @param pool [in] Pool
+ * @param image [in/out] Image, virt_addr and fd are cleared
+ */
+void image_pool_release(image_pool_t* pool, image_buffer_t* image);
+
+/**
+ * @brief Call before a device accesses a pool image
+ *
+ * Flushes CPU writes before a device reads, invalidates before the CPU reads what a
+ * device wrote. Does nothing for uncached, malloc and non-pool buffers.
+ *
+ * @param pool [in] Pool
+ * @param image [in] Image
+ * @param device [in] Device about to access
+ * @param write [in] 1: the device writes the image
+ * @return int 0: success; -1: error
+ */
+int image_pool_sync(image_pool_t* pool, image_buffer_t* image, image_device_t device, int write);
+
+/**
+ * @brief Calibration buffers of image_dispatch_init() / image_dispatch_calibrate() from the pool
+ *
+ * The engines are timed on the same DMA buffers they convert at runtime. Every calibration
+ * size is used once, so its buffer is freed on release instead of kept for reuse.
+ *
+ * @param pool [in] Pool, must outlive the calibration
+ * @param allocator [out] Allocator
+ */
+void image_pool_dispatch_allocator(image_pool_t* pool, image_dispatch_allocator_t* allocator);
+
+/**
+ * @brief Print occupancy and sync counters
+ *
+ * @param pool [in] Pool
+ */
+void image_pool_print_stats(const image_pool_t* pool);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif // _RKNN_MODEL_ZOO_IMAGE_POOL_H_
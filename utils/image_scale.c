@@ -0,0 +1,491 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "image_scale.h"
+#include "image_threads.h"
+
+#define SCALE_BITS 8
+#define SCALE_ONE (1 << SCALE_BITS)
+
+// tap offsets and weights for one axis, ofs is multiplied by step
+static void compute_taps(int src_len, int dst_len, int step, int* ofs, uint16_t* weight)
+{
+    float scale = (float)src_len / dst_len;
+    for (int d = 0; d < dst_len; d++) {
+        float f = (d + 0.5f) * scale - 0.5f;
+        int s0 = (int)floorf(f);
+        float frac = f - s0;
+        if (s0 < 0) {
+            s0 = 0;
+            frac = 0.f;
+        }
+        int s1 = s0 + 1;
+        if (s1 >= src_len) {
+            s0 = src_len - 1;
+            s1 = src_len - 1;
+            frac = 0.f;
+        }
+        ofs[d * 2] = s0 * step;
+        ofs[d * 2 + 1] = s1 * step;
+        weight[d] = (uint16_t)(frac * SCALE_ONE + 0.5f);
+    }
+}
+
+int image_scale_plan_init(image_scale_plan_t* plan, int channel, int src_w, int src_h, int dst_w, int dst_h)
+{
+    memset(plan, 0, sizeof(image_scale_plan_t));
+    if (channel < 1 || channel > 4 || src_w <= 0 || src_h <= 0 || dst_w <= 0 || dst_h <= 0) {
+        printf("invalid scale plan channel=%d %dx%d -> %dx%d\n", channel, src_w, src_h, dst_w, dst_h);
+        return -1;
+    }
+    plan->channel = channel;
+    plan->src_w = src_w;
+    plan->src_h = src_h;
+    plan->dst_w = dst_w;
+    plan->dst_h = dst_h;
+    plan->xofs = (int*)malloc(dst_w * 2 * sizeof(int));
+    plan->alpha = (uint16_t*)malloc(dst_w * sizeof(uint16_t));
+    plan->yofs = (int*)malloc(dst_h * 2 * sizeof(int));
+    plan->beta = (uint16_t*)malloc(dst_h * sizeof(uint16_t));
+    if (plan->xofs == NULL || plan->alpha == NULL || plan->yofs == NULL || plan->beta == NULL) {
+        printf("malloc scale plan fail\n");
+        image_scale_plan_release(plan);
+        return -1;
+    }
+    compute_taps(src_w, dst_w, channel, plan->xofs, plan->alpha);
+    compute_taps(src_h, dst_h, 1, plan->yofs, plan->beta);
+    return 0;
+}
+
+void image_scale_plan_release(image_scale_plan_t* plan)
+{
+    free(plan->xofs);
+    free(plan->alpha);
+    free(plan->yofs);
+    free(plan->beta);
+    memset(plan, 0, sizeof(image_scale_plan_t));
+}
+
+// horizontal pass: one source row to dst_w * channel values with 8 fractional bits, outputs [x, dst_w)
+static inline void hresize_row_c(const uint8_t* src, uint16_t* dst, const int* xofs, const uint16_t* alpha,
+                                 int x, int dst_w, const int channel)
+{
+    dst += x * channel;
+    for (; x < dst_w; x++) {
+        const uint8_t* p0 = src + xofs[x * 2];
+        const uint8_t* p1 = src + xofs[x * 2 + 1];
+        uint16_t a1 = alpha[x];
+        uint16_t a0 = SCALE_ONE - a1;
+        for (int c = 0; c < channel; c++) {
+            dst[c] = p0[c] * a0 + p1[c] * a1;
+        }
+        dst += channel;
+    }
+}
+
+#if defined(__ARM_NEON)
+static inline uint32_t load_u32(const uint8_t* p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline uint16_t load_u16(const uint8_t* p)
+{
+    uint16_t v;
+    memcpy(&v, p, 2);
+    return v;
+}
+
+// p0 * (256 - a) + p1 * a, at most 255 * 256 so it fits 16 bits
+static inline uint16x8_t hblend(uint16x8_t p0, uint16x8_t p1, uint16x8_t a)
+{
+    return vmlaq_u16(vmulq_u16(p0, vsubq_u16(vdupq_n_u16(SCALE_ONE), a)), p1, a);
+}
+
+/*
+ * Gathers the two taps of several outputs into one vector (bytes per channel count: 8 outputs
+ * for 1 and 2 channels, 4 outputs as 32 bit lanes for 3 and 4) and blends them with the weights
+ * spread over the channels. Returns the first output left for the C loop.
+ */
+static int hresize_row_neon(const uint8_t* src, uint16_t* dst, const int* xofs, const uint16_t* alpha, int dst_w,
+                            int channel, int src_bytes)
+{
+    int x = 0;
+    if (channel == 1) {
+        for (; x + 8 <= dst_w; x += 8) {
+            const int* o = xofs + x * 2;
+            uint8x8_t v0 = vdup_n_u8(0);
+            uint8x8_t v1 = vdup_n_u8(0);
+            v0 = vld1_lane_u8(src + o[0], v0, 0);
+            v1 = vld1_lane_u8(src + o[1], v1, 0);
+            v0 = vld1_lane_u8(src + o[2], v0, 1);
+            v1 = vld1_lane_u8(src + o[3], v1, 1);
+            v0 = vld1_lane_u8(src + o[4], v0, 2);
+            v1 = vld1_lane_u8(src + o[5], v1, 2);
+            v0 = vld1_lane_u8(src + o[6], v0, 3);
+            v1 = vld1_lane_u8(src + o[7], v1, 3);
+            v0 = vld1_lane_u8(src + o[8], v0, 4);
+            v1 = vld1_lane_u8(src + o[9], v1, 4);
+            v0 = vld1_lane_u8(src + o[10], v0, 5);
+            v1 = vld1_lane_u8(src + o[11], v1, 5);
+            v0 = vld1_lane_u8(src + o[12], v0, 6);
+            v1 = vld1_lane_u8(src + o[13], v1, 6);
+            v0 = vld1_lane_u8(src + o[14], v0, 7);
+            v1 = vld1_lane_u8(src + o[15], v1, 7);
+            vst1q_u16(dst + x, hblend(vmovl_u8(v0), vmovl_u8(v1), vld1q_u16(alpha + x)));
+        }
+    } else if (channel == 2) {
+        for (; x + 8 <= dst_w; x += 8) {
+            const int* o = xofs + x * 2;
+            uint16x8_t v0 = vdupq_n_u16(0);
+            uint16x8_t v1 = vdupq_n_u16(0);
+            v0 = vsetq_lane_u16(load_u16(src + o[0]), v0, 0);
+            v1 = vsetq_lane_u16(load_u16(src + o[1]), v1, 0);
+            v0 = vsetq_lane_u16(load_u16(src + o[2]), v0, 1);
+            v1 = vsetq_lane_u16(load_u16(src + o[3]), v1, 1);
+            v0 = vsetq_lane_u16(load_u16(src + o[4]), v0, 2);
+            v1 = vsetq_lane_u16(load_u16(src + o[5]), v1, 2);
+            v0 = vsetq_lane_u16(load_u16(src + o[6]), v0, 3);
+            v1 = vsetq_lane_u16(load_u16(src + o[7]), v1, 3);
+            v0 = vsetq_lane_u16(load_u16(src + o[8]), v0, 4);
+            v1 = vsetq_lane_u16(load_u16(src + o[9]), v1, 4);
+            v0 = vsetq_lane_u16(load_u16(src + o[10]), v0, 5);
+            v1 = vsetq_lane_u16(load_u16(src + o[11]), v1, 5);
+            v0 = vsetq_lane_u16(load_u16(src + o[12]), v0, 6);
+            v1 = vsetq_lane_u16(load_u16(src + o[13]), v1, 6);
+            v0 = vsetq_lane_u16(load_u16(src + o[14]), v0, 7);
+            v1 = vsetq_lane_u16(load_u16(src + o[15]), v1, 7);
+            uint8x16_t b0 = vreinterpretq_u8_u16(v0);
+            uint8x16_t b1 = vreinterpretq_u8_u16(v1);
+            uint16x8x2_t a = vzipq_u16(vld1q_u16(alpha + x), vld1q_u16(alpha + x));
+            vst1q_u16(dst + x * 2, hblend(vmovl_u8(vget_low_u8(b0)), vmovl_u8(vget_low_u8(b1)), a.val[0]));
+            vst1q_u16(dst + x * 2 + 8, hblend(vmovl_u8(vget_high_u8(b0)), vmovl_u8(vget_high_u8(b1)), a.val[1]));
+        }
+    } else {
+        // 3 channels read and write one value past each pixel: the taps must leave 4 bytes in the
+        // row, and the junk value of the last output lands inside the row buffer (x + 5 <= dst_w)
+        // to be overwritten by the next output
+        int tail = channel == 4 ? 4 : 5;
+        for (; x + tail <= dst_w && xofs[(x + 3) * 2 + 1] + 4 <= src_bytes; x += 4) {
+            const int* o = xofs + x * 2;
+            uint32x4_t v0 = vdupq_n_u32(0);
+            uint32x4_t v1 = vdupq_n_u32(0);
+            v0 = vsetq_lane_u32(load_u32(src + o[0]), v0, 0);
+            v1 = vsetq_lane_u32(load_u32(src + o[1]), v1, 0);
+            v0 = vsetq_lane_u32(load_u32(src + o[2]), v0, 1);
+            v1 = vsetq_lane_u32(load_u32(src + o[3]), v1, 1);
+            v0 = vsetq_lane_u32(load_u32(src + o[4]), v0, 2);
+            v1 = vsetq_lane_u32(load_u32(src + o[5]), v1, 2);
+            v0 = vsetq_lane_u32(load_u32(src + o[6]), v0, 3);
+            v1 = vsetq_lane_u32(load_u32(src + o[7]), v1, 3);
+            uint8x16_t b0 = vreinterpretq_u8_u32(v0);
+            uint8x16_t b1 = vreinterpretq_u8_u32(v1);
+            uint16x4_t a4 = vld1_u16(alpha + x);
+            uint16x4x2_t a2 = vzip_u16(a4, a4);
+            uint16x4x2_t a01 = vzip_u16(a2.val[0], a2.val[0]);
+            uint16x4x2_t a23 = vzip_u16(a2.val[1], a2.val[1]);
+            uint16x8_t lo = hblend(vmovl_u8(vget_low_u8(b0)), vmovl_u8(vget_low_u8(b1)),
+                                   vcombine_u16(a01.val[0], a01.val[1]));
+            uint16x8_t hi = hblend(vmovl_u8(vget_high_u8(b0)), vmovl_u8(vget_high_u8(b1)),
+                                   vcombine_u16(a23.val[0], a23.val[1]));
+            if (channel == 4) {
+                vst1q_u16(dst + x * 4, lo);
+                vst1q_u16(dst + x * 4 + 8, hi);
+            } else {
+                vst1_u16(dst + x * 3, vget_low_u16(lo));
+                vst1_u16(dst + x * 3 + 3, vget_high_u16(lo));
+                vst1_u16(dst + x * 3 + 6, vget_low_u16(hi));
+                vst1_u16(dst + x * 3 + 9, vget_high_u16(hi));
+            }
+        }
+    }
+    return x;
+}
+#endif
+
+static void hresize_row(const uint8_t* src, uint16_t* dst, const int* xofs, const uint16_t* alpha, int dst_w,
+                        int channel, int src_bytes)
+{
+    int x = 0;
+#if defined(__ARM_NEON)
+    x = hresize_row_neon(src, dst, xofs, alpha, dst_w, channel, src_bytes);
+#else
+    (void)src_bytes;
+#endif
+    // constant channel count lets the compiler unroll the inner loop
+    switch (channel) {
+    case 1:
+        hresize_row_c(src, dst, xofs, alpha, x, dst_w, 1);
+        break;
+    case 2:
+        hresize_row_c(src, dst, xofs, alpha, x, dst_w, 2);
+        break;
+    case 3:
+        hresize_row_c(src, dst, xofs, alpha, x, dst_w, 3);
+        break;
+    default:
+        hresize_row_c(src, dst, xofs, alpha, x, dst_w, 4);
+        break;
+    }
+}
+
+// vertical pass: blend two horizontal rows, (r0 * (256 - b) + r1 * b) >> 16 with rounding
+static void vresize_row(const uint16_t* r0, const uint16_t* r1, uint16_t b, uint8_t* dst, int n)
+{
+    int i = 0;
+#if defined(__ARM_NEON)
+    uint16x4_t vb0 = vdup_n_u16(SCALE_ONE - b);
+    uint16x4_t vb1 = vdup_n_u16(b);
+    for (; i + 16 <= n; i += 16) {
+        uint16x8_t a0 = vld1q_u16(r0 + i);
+        uint16x8_t a1 = vld1q_u16(r0 + i + 8);
+        uint16x8_t c0 = vld1q_u16(r1 + i);
+        uint16x8_t c1 = vld1q_u16(r1 + i + 8);
+        uint32x4_t s0 = vmlal_u16(vmull_u16(vget_low_u16(a0), vb0), vget_low_u16(c0), vb1);
+        uint32x4_t s1 = vmlal_u16(vmull_u16(vget_high_u16(a0), vb0), vget_high_u16(c0), vb1);
+        uint32x4_t s2 = vmlal_u16(vmull_u16(vget_low_u16(a1), vb0), vget_low_u16(c1), vb1);
+        uint32x4_t s3 = vmlal_u16(vmull_u16(vget_high_u16(a1), vb0), vget_high_u16(c1), vb1);
+        uint16x8_t d0 = vcombine_u16(vrshrn_n_u32(s0, SCALE_BITS * 2), vrshrn_n_u32(s1, SCALE_BITS * 2));
+        uint16x8_t d1 = vcombine_u16(vrshrn_n_u32(s2, SCALE_BITS * 2), vrshrn_n_u32(s3, SCALE_BITS * 2));
+        vst1q_u8(dst + i, vcombine_u8(vmovn_u16(d0), vmovn_u16(d1)));
+    }
+#endif
+    uint32_t b0 = SCALE_ONE - b;
+    uint32_t b1 = b;
+    for (; i < n; i++) {
+        dst[i] = (uint8_t)((r0[i] * b0 + r1[i] * b1 + (1 << (SCALE_BITS * 2 - 1))) >> (SCALE_BITS * 2));
+    }
+}
+
+int image_scale_rows_cb(const image_scale_plan_t* plan, image_scale_row_fn get_row, void* arg,
+                        uint8_t* dst, int dst_stride, int dst_y_begin, int dst_y_end)
+{
+    int row_len = plan->dst_w * plan->channel;
+    int src_bytes = plan->src_w * plan->channel;
+    // per thread, kept for the next call: this runs for every band of every frame
+    uint16_t* buf = (uint16_t*)image_threads_scratch(IMAGE_THREADS_SCRATCH_SCALE, row_len * 2 * sizeof(uint16_t));
+    if (buf == NULL) {
+        printf("malloc scale row buffer fail\n");
+        return -1;
+    }
+    // two horizontally scaled source rows, reused while consecutive target rows share them
+    uint16_t* rows[2] = {buf, buf + row_len};
+    int row_y[2] = {-1, -1};
+
+    for (int y = dst_y_begin; y < dst_y_end; y++) {
+        int sy0 = plan->yofs[y * 2];
+        int sy1 = plan->yofs[y * 2 + 1];
+        if (row_y[0] != sy0) {
+            if (row_y[1] == sy0) {
+                uint16_t* tmp = rows[0];
+                rows[0] = rows[1];
+                rows[1] = tmp;
+                row_y[1] = row_y[0];
+            } else {
+                hresize_row(get_row(arg, sy0), rows[0], plan->xofs, plan->alpha, plan->dst_w, plan->channel, src_bytes);
+            }
+            row_y[0] = sy0;
+        }
+        if (row_y[1] != sy1) {
+            hresize_row(get_row(arg, sy1), rows[1], plan->xofs, plan->alpha, plan->dst_w, plan->channel, src_bytes);
+            row_y[1] = sy1;
+        }
+        vresize_row(rows[0], rows[1], plan->beta[y], dst + (size_t)y * dst_stride, row_len);
+    }
+    return 0;
+}
+
+typedef struct {
+    const uint8_t* src;
+    int src_stride;
+} plane_rows_t;
+
+static const uint8_t* plane_row(void* arg, int y)
+{
+    plane_rows_t* plane = (plane_rows_t*)arg;
+    return plane->src + (size_t)y * plane->src_stride;
+}
+
+int image_scale_rows(const image_scale_plan_t* plan, const uint8_t* src, int src_stride,
+                     uint8_t* dst, int dst_stride, int dst_y_begin, int dst_y_end)
+{
+    plane_rows_t plane = {src, src_stride};
+    return image_scale_rows_cb(plan, plane_row, &plane, dst, dst_stride, dst_y_begin, dst_y_end);
+}
+
+/*
+ * The CPU fallback sees the same few sizes every frame, keep their plans.
+ * The dispatcher runs CPU slices of different heights on several threads at once, so the
+ * cache is locked and a slot is only rebuilt when no thread is scaling with it.
+ */
+#define SCALE_PLAN_CACHE_SIZE 8
+
+typedef struct {
+    image_scale_plan_t plan;    // first member, image_scale_put_plan() finds the slot from it
+    int refs;
+} plan_slot_t;
+
+static plan_slot_t plan_cache[SCALE_PLAN_CACHE_SIZE];
+static int plan_cache_next = 0;
+static pthread_mutex_t plan_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+const image_scale_plan_t* image_scale_get_plan(int channel, int src_w, int src_h, int dst_w, int dst_h)
+{
+    pthread_mutex_lock(&plan_cache_lock);
+    for (int i = 0; i < SCALE_PLAN_CACHE_SIZE; i++) {
+        image_scale_plan_t* plan = &plan_cache[i].plan;
+        if (plan->xofs != NULL && plan->channel == channel && plan->src_w == src_w && plan->src_h == src_h &&
+            plan->dst_w == dst_w && plan->dst_h == dst_h) {
+            plan_cache[i].refs++;
+            pthread_mutex_unlock(&plan_cache_lock);
+            return plan;
+        }
+    }
+    plan_slot_t* slot = NULL;
+    for (int i = 0; i < SCALE_PLAN_CACHE_SIZE && slot == NULL; i++) {
+        int index = (plan_cache_next + i) % SCALE_PLAN_CACHE_SIZE;
+        if (plan_cache[index].refs == 0) {
+            slot = &plan_cache[index];
+            plan_cache_next = (index + 1) % SCALE_PLAN_CACHE_SIZE;
+        }
+    }
+    if (slot == NULL) {
+        // every slot is in use, this plan lives until image_scale_put_plan()
+        pthread_mutex_unlock(&plan_cache_lock);
+        image_scale_plan_t* plan = (image_scale_plan_t*)malloc(sizeof(image_scale_plan_t));
+        if (plan == NULL || image_scale_plan_init(plan, channel, src_w, src_h, dst_w, dst_h) != 0) {
+            free(plan);
+            return NULL;
+        }
+        return plan;
+    }
+    image_scale_plan_release(&slot->plan);
+    if (image_scale_plan_init(&slot->plan, channel, src_w, src_h, dst_w, dst_h) != 0) {
+        pthread_mutex_unlock(&plan_cache_lock);
+        return NULL;
+    }
+    slot->refs = 1;
+    pthread_mutex_unlock(&plan_cache_lock);
+    return &slot->plan;
+}
+
+void image_scale_put_plan(const image_scale_plan_t* plan)
+{
+    if (plan == NULL) {
+        return;
+    }
+    plan_slot_t* slot = (plan_slot_t*)plan;
+    if (slot >= plan_cache && slot < plan_cache + SCALE_PLAN_CACHE_SIZE) {
+        pthread_mutex_lock(&plan_cache_lock);
+        slot->refs--;
+        pthread_mutex_unlock(&plan_cache_lock);
+        return;
+    }
+    image_scale_plan_release((image_scale_plan_t*)plan);
+    free((image_scale_plan_t*)plan);
+}
+
+typedef struct {
+    const image_scale_plan_t* plan;
+    const uint8_t* src;
+    int src_stride;
+    uint8_t* dst;
+    int dst_stride;
+    int ret;
+} scale_job_t;
+
+static void scale_band(void* arg, int begin, int end)
+{
+    scale_job_t* job = (scale_job_t*)arg;
+    if (image_scale_rows(job->plan, job->src, job->src_stride, job->dst, job->dst_stride, begin, end) != 0) {
+        job->ret = -1;
+    }
+}
+
+static int scale_plane(int channel, const uint8_t* src, int src_stride, int crop_x, int crop_y, int crop_w, int crop_h,
+                       uint8_t* dst, int dst_stride, int box_x, int box_y, int box_w, int box_h)
+{
+    const image_scale_plan_t* plan = image_scale_get_plan(channel, crop_w, crop_h, box_w, box_h);
+    if (plan == NULL) {
+        return -1;
+    }
+    scale_job_t job;
+    job.plan = plan;
+    job.src = src + (size_t)crop_y * src_stride + crop_x * channel;
+    job.src_stride = src_stride;
+    job.dst = dst + (size_t)box_y * dst_stride + box_x * channel;
+    job.dst_stride = dst_stride;
+    job.ret = 0;
+    // every target row depends only on the plan, so bands give the same pixels as one pass
+    image_threads_run_rows(box_h, box_w * channel, 1, scale_band, &job);
+    image_scale_put_plan(plan);
+    return job.ret;
+}
+
+int image_scale_bilinear(image_buffer_t* src, image_rect_t* src_box, image_buffer_t* dst, image_rect_t* dst_box)
+{
+    if (src->virt_addr == NULL || dst->virt_addr == NULL || src->format != dst->format) {
+        return -1;
+    }
+
+    int crop_x = 0, crop_y = 0, crop_w = src->width, crop_h = src->height;
+    if (src_box != NULL) {
+        crop_x = src_box->left;
+        crop_y = src_box->top;
+        crop_w = src_box->right - src_box->left + 1;
+        crop_h = src_box->bottom - src_box->top + 1;
+    }
+    int box_x = 0, box_y = 0, box_w = dst->width, box_h = dst->height;
+    if (dst_box != NULL) {
+        box_x = dst_box->left;
+        box_y = dst_box->top;
+        box_w = dst_box->right - dst_box->left + 1;
+        box_h = dst_box->bottom - dst_box->top + 1;
+    }
+
+    // strides are in pixels, 0 means packed
+    int src_ws = src->width_stride > 0 ? src->width_stride : src->width;
+    int dst_ws = dst->width_stride > 0 ? dst->width_stride : dst->width;
+
+    int channel;
+    switch (src->format) {
+    case IMAGE_FORMAT_GRAY8:
+        channel = 1;
+        break;
+    case IMAGE_FORMAT_RGB888:
+        channel = 3;
+        break;
+    case IMAGE_FORMAT_RGBA8888:
+        channel = 4;
+        break;
+    case IMAGE_FORMAT_YUV420SP_NV12:
+    case IMAGE_FORMAT_YUV420SP_NV21: {
+        int src_hs = src->height_stride > 0 ? src->height_stride : src->height;
+        int dst_hs = dst->height_stride > 0 ? dst->height_stride : dst->height;
+        int ret = scale_plane(1, src->virt_addr, src_ws, crop_x, crop_y, crop_w, crop_h,
+                              dst->virt_addr, dst_ws, box_x, box_y, box_w, box_h);
+        if (ret != 0) {
+            return ret;
+        }
+        // interleaved UV plane at half resolution, same byte pitch as Y
+        return scale_plane(2, src->virt_addr + (size_t)src_ws * src_hs, src_ws,
+                           crop_x / 2, crop_y / 2, crop_w / 2, crop_h / 2,
+                           dst->virt_addr + (size_t)dst_ws * dst_hs, dst_ws,
+                           box_x / 2, box_y / 2, box_w / 2, box_h / 2);
+    }
+    default:
+        printf("no support format %d\n", src->format);
+        return -1;
+    }
+    return scale_plane(channel, src->virt_addr, src_ws * channel, crop_x, crop_y, crop_w, crop_h,
+                       dst->virt_addr, dst_ws * channel, box_x, box_y, box_w, box_h);
+}
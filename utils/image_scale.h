@@ -0,0 +1,125 @@
+#ifndef _RKNN_MODEL_ZOO_IMAGE_SCALE_H_
+#define _RKNN_MODEL_ZOO_IMAGE_SCALE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "common.h"
+
+/**
+ * @brief Precomputed bilinear scaling plan for one (channel, src size, dst size)
+ *
+ * Center-aligned sampling, weights are fixed point with 8 fractional bits (0..256).
+ * Edge clamping is folded into the tap offsets, so the row loops have no branches.
+ */
+typedef struct {
+    int channel;
+    int src_w;
+    int src_h;
+    int dst_w;
+    int dst_h;
+    int* xofs;          // [dst_w * 2] byte offsets of the left / right tap inside a row
+    uint16_t* alpha;    // [dst_w] weight of the right tap
+    int* yofs;          // [dst_h * 2] source rows of the top / bottom tap
+    uint16_t* beta;     // [dst_h] weight of the bottom tap
+} image_scale_plan_t;
+
+/**
+ * @brief Build a scaling plan
+ *
+ * @param plan [out] Plan, release with image_scale_plan_release()
+ * @param channel [in] Interleaved channels per pixel (1-4)
+ * @param src_w [in] Source (crop) width
+ * @param src_h [in] Source (crop) height
+ * @param dst_w [in] Target width
+ * @param dst_h [in] Target height
+ * @return int 0: success; -1: error
+ */
+int image_scale_plan_init(image_scale_plan_t* plan, int channel, int src_w, int src_h, int dst_w, int dst_h);
+
+/**
+ * @brief Release a scaling plan
+ *
+ * @param plan [in] Plan
+ */
+void image_scale_plan_release(image_scale_plan_t* plan);
+
+/**
+ * @brief Scale target rows [dst_y_begin, dst_y_end), rows can be split across threads
+ *
+ * @param plan [in] Plan
+ * @param src [in] First pixel of the source crop
+ * @param src_stride [in] Source row pitch in bytes
+ * @param dst [out] First pixel of the target box
+ * @param dst_stride [in] Target row pitch in bytes
+ * @param dst_y_begin [in] First target row
+ * @param dst_y_end [in] End target row (exclusive)
+ * @return int 0: success; -1: error
+ */
+int image_scale_rows(const image_scale_plan_t* plan, const uint8_t* src, int src_stride,
+                     uint8_t* dst, int dst_stride, int dst_y_begin, int dst_y_end);
+
+/**
+ * @brief Source row provider for image_scale_rows_cb
+ *
+ * Returns the first pixel of source (crop) row y. The row is read before the next call,
+ * so one reused row buffer is enough.
+ */
+typedef const uint8_t* (*image_scale_row_fn)(void* arg, int y);
+
+/**
+ * @brief Scale target rows [dst_y_begin, dst_y_end) from rows produced on demand
+ *
+ * Only the source rows the bilinear taps need are requested, each once per call while
+ * consecutive target rows share it. Lets a caller convert a large frame row by row
+ * without materializing it.
+ *
+ * @param plan [in] Plan
+ * @param get_row [in] Source row provider
+ * @param arg [in] Passed to get_row
+ * @param dst [out] First pixel of the target box
+ * @param dst_stride [in] Target row pitch in bytes
+ * @param dst_y_begin [in] First target row
+ * @param dst_y_end [in] End target row (exclusive)
+ * @return int 0: success; -1: error
+ */
+int image_scale_rows_cb(const image_scale_plan_t* plan, image_scale_row_fn get_row, void* arg,
+                        uint8_t* dst, int dst_stride, int dst_y_begin, int dst_y_end);
+
+/**
+ * @brief Cached plan for a size, shared with image_scale_bilinear
+ *
+ * Thread safe. The plan stays valid until image_scale_put_plan(), a cached plan in use is
+ * never rebuilt for another size; when all are in use the plan is built for this caller only.
+ *
+ * @return const image_scale_plan_t* plan, NULL: error
+ */
+const image_scale_plan_t* image_scale_get_plan(int channel, int src_w, int src_h, int dst_w, int dst_h);
+
+/**
+ * @brief Return a plan from image_scale_get_plan
+ *
+ * @param plan [in] Plan, NULL is ignored
+ */
+void image_scale_put_plan(const image_scale_plan_t* plan);
+
+/**
+ * @brief Bilinear crop and scale on CPU (GRAY8/RGB888/RGBA8888/NV12/NV21), honours width_stride
+ *
+ * Plans are cached per size. Rows are split across image_threads when started.
+ *
+ * @param src [in] Source image
+ * @param src_box [in] Crop rectangle on source image, NULL: whole image
+ * @param dst [out] Target image, same format as src
+ * @param dst_box [in] Rectangle on target image, NULL: whole image
+ * @return int 0: success; -1: error
+ */
+int image_scale_bilinear(image_buffer_t* src, image_rect_t* src_box, image_buffer_t* dst, image_rect_t* dst_box);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif // _RKNN_MODEL_ZOO_IMAGE_SCALE_H_
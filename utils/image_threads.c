@@ -0,0 +1,219 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "image_threads.h"
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t start_cond;
+    pthread_cond_t done_cond;
+    pthread_mutex_t run_lock;       // one job at a time
+    pthread_t threads[IMAGE_THREADS_MAX];
+    int num_threads;                // including the caller
+    int quit;
+    unsigned int generation;        // bumped for every job
+    int active;                     // workers still on the current job
+
+    // current job
+    image_threads_fn fn;
+    void* arg;
+    int rows;
+    int band_rows;
+    int num_bands;
+    int next_band;
+} image_threads_t;
+
+static image_threads_t pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .start_cond = PTHREAD_COND_INITIALIZER,
+    .done_cond = PTHREAD_COND_INITIALIZER,
+    .run_lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static void run_bands()
+{
+    int band;
+    while ((band = __atomic_fetch_add(&pool.next_band, 1, __ATOMIC_RELAXED)) < pool.num_bands) {
+        int begin = band * pool.band_rows;
+        int end = begin + pool.band_rows;
+        if (end > pool.rows) {
+            end = pool.rows;
+        }
+        pool.fn(pool.arg, begin, end);
+    }
+}
+
+static void* worker_thread(void* arg)
+{
+    (void)arg;
+    unsigned int seen = 0;
+    pthread_mutex_lock(&pool.lock);
+    for (;;) {
+        while (!pool.quit && pool.generation == seen) {
+            pthread_cond_wait(&pool.start_cond, &pool.lock);
+        }
+        if (pool.quit) {
+            break;
+        }
+        seen = pool.generation;
+        pthread_mutex_unlock(&pool.lock);
+
+        run_bands();
+
+        pthread_mutex_lock(&pool.lock);
+        if (--pool.active == 0) {
+            pthread_cond_signal(&pool.done_cond);
+        }
+    }
+    pthread_mutex_unlock(&pool.lock);
+    return NULL;
+}
+
+int image_threads_init(int num_threads)
+{
+    image_threads_deinit();
+    if (num_threads <= 0) {
+        num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (num_threads > IMAGE_THREADS_MAX) {
+        num_threads = IMAGE_THREADS_MAX;
+    }
+    if (num_threads <= 1) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&pool.run_lock);
+    pool.quit = 0;
+    pool.generation = 0;
+    for (int i = 0; i < num_threads - 1; i++) {
+        if (pthread_create(&pool.threads[i], NULL, worker_thread, NULL) != 0) {
+            printf("image threads: create thread %d fail\n", i);
+            pool.num_threads = i + 1;
+            pthread_mutex_unlock(&pool.run_lock);
+            image_threads_deinit();
+            return -1;
+        }
+    }
+    pool.num_threads = num_threads;
+    pthread_mutex_unlock(&pool.run_lock);
+    return 0;
+}
+
+void image_threads_deinit()
+{
+    pthread_mutex_lock(&pool.run_lock);
+    if (pool.num_threads > 1) {
+        pthread_mutex_lock(&pool.lock);
+        pool.quit = 1;
+        pthread_cond_broadcast(&pool.start_cond);
+        pthread_mutex_unlock(&pool.lock);
+        for (int i = 0; i < pool.num_threads - 1; i++) {
+            pthread_join(pool.threads[i], NULL);
+        }
+    }
+    pool.num_threads = 0;
+    pthread_mutex_unlock(&pool.run_lock);
+}
+
+int image_threads_count()
+{
+    return pool.num_threads > 1 ? pool.num_threads : 1;
+}
+
+void image_threads_run_rows(int rows, int row_bytes, int align, image_threads_fn fn, void* arg)
+{
+    if (rows <= 0) {
+        return;
+    }
+    if (align < 1) {
+        align = 1;
+    }
+
+    int band_rows = row_bytes > 0 ? IMAGE_THREADS_BAND_BYTES / row_bytes : rows;
+    int threads = image_threads_count();
+    if (band_rows * threads > rows) {
+        // small job: one band per thread
+        band_rows = (rows + threads - 1) / threads;
+    }
+    band_rows = (band_rows + align - 1) / align * align;
+    int num_bands = (rows + band_rows - 1) / band_rows;
+
+    if (threads <= 1 || num_bands <= 1 || pthread_mutex_trylock(&pool.run_lock) != 0) {
+        fn(arg, 0, rows);
+        return;
+    }
+    if (pool.num_threads <= 1) {
+        // stopped between the count and the lock
+        pthread_mutex_unlock(&pool.run_lock);
+        fn(arg, 0, rows);
+        return;
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    pool.fn = fn;
+    pool.arg = arg;
+    pool.rows = rows;
+    pool.band_rows = band_rows;
+    pool.num_bands = num_bands;
+    pool.next_band = 0;
+    pool.active = pool.num_threads - 1;
+    pool.generation++;
+    pthread_cond_broadcast(&pool.start_cond);
+    pthread_mutex_unlock(&pool.lock);
+
+    run_bands();
+
+    pthread_mutex_lock(&pool.lock);
+    while (pool.active > 0) {
+        pthread_cond_wait(&pool.done_cond, &pool.lock);
+    }
+    pthread_mutex_unlock(&pool.lock);
+    pthread_mutex_unlock(&pool.run_lock);
+}
+
+typedef struct {
+    void* buf[IMAGE_THREADS_SCRATCH_NUM];
+    size_t size[IMAGE_THREADS_SCRATCH_NUM];
+} scratch_t;
+
+static pthread_key_t scratch_key;
+static pthread_once_t scratch_once = PTHREAD_ONCE_INIT;
+
+static void scratch_free(void* arg)
+{
+    scratch_t* scratch = (scratch_t*)arg;
+    for (int i = 0; i < IMAGE_THREADS_SCRATCH_NUM; i++) {
+        free(scratch->buf[i]);
+    }
+    free(scratch);
+}
+
+static void scratch_key_init()
+{
+    pthread_key_create(&scratch_key, scratch_free);
+}
+
+void* image_threads_scratch(int slot, size_t size)
+{
+    if (slot < 0 || slot >= IMAGE_THREADS_SCRATCH_NUM) {
+        return NULL;
+    }
+    pthread_once(&scratch_once, scratch_key_init);
+    scratch_t* scratch = (scratch_t*)pthread_getspecific(scratch_key);
+    if (scratch == NULL) {
+        scratch = (scratch_t*)calloc(1, sizeof(scratch_t));
+        if (scratch == NULL || pthread_setspecific(scratch_key, scratch) != 0) {
+            free(scratch);
+            return NULL;
+        }
+    }
+    if (scratch->size[slot] < size) {
+        free(scratch->buf[slot]);
+        scratch->buf[slot] = malloc(size);
+        scratch->size[slot] = scratch->buf[slot] != NULL ? size : 0;
+    }
+    return scratch->buf[slot];
+}
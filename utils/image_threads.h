@@ -0,0 +1,78 @@
+#ifndef _RKNN_MODEL_ZOO_IMAGE_THREADS_H_
+#define _RKNN_MODEL_ZOO_IMAGE_THREADS_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+#define IMAGE_THREADS_MAX 8
+
+// image_threads_scratch() slots, independent buffers of one thread
+#define IMAGE_THREADS_SCRATCH_SCALE 0   // horizontally scaled rows of image_scale_rows_cb
+#define IMAGE_THREADS_SCRATCH_ROW   1   // converted source row fed to the scaler
+#define IMAGE_THREADS_SCRATCH_NUM   4
+
+// target bytes written per band, a slice of a Cortex-A55 L2 so a band's rows stay hot
+#define IMAGE_THREADS_BAND_BYTES (64 * 1024)
+
+/**
+ * @brief Process rows [begin, end) of a job
+ */
+typedef void (*image_threads_fn)(void* arg, int begin, int end);
+
+/**
+ * @brief Start the worker threads used by the CPU image conversion
+ *
+ * Without this call (or with 1 thread) the CPU path runs in the calling thread.
+ * Calling it again restarts the pool with the new size.
+ *
+ * @param num_threads [in] Threads including the caller, 0: online CPUs, capped to IMAGE_THREADS_MAX
+ * @return int 0: success; -1: error
+ */
+int image_threads_init(int num_threads);
+
+/**
+ * @brief Stop the worker threads, back to single threaded
+ */
+void image_threads_deinit();
+
+/**
+ * @brief Threads including the caller, 1 when the pool is not running
+ */
+int image_threads_count();
+
+/**
+ * @brief Run fn over rows in bands of about IMAGE_THREADS_BAND_BYTES, return when all are done
+ *
+ * The caller works on bands too. Bands never overlap and each row is handled by exactly
+ * one call, so the output does not depend on the thread count. If another caller is
+ * using the pool, the rows run in the calling thread.
+ *
+ * @param rows [in] Rows to process
+ * @param row_bytes [in] Bytes written per row, sizes the bands
+ * @param align [in] Band height multiple, e.g. 2 for YUV420 rows
+ * @param fn [in] Row range function, called concurrently
+ * @param arg [in] Passed to fn
+ */
+void image_threads_run_rows(int rows, int row_bytes, int align, image_threads_fn fn, void* arg);
+
+/**
+ * @brief Scratch buffer of the calling thread, grown on demand and freed when the thread exits
+ *
+ * Row buffers of band functions: bands of one job run on different threads, and the next
+ * frame reuses the buffer instead of allocating one per band. The contents are not kept
+ * across a call that grows it.
+ *
+ * @param slot [in] IMAGE_THREADS_SCRATCH_*
+ * @param size [in] Bytes needed
+ * @return void* buffer, NULL: out of memory
+ */
+void* image_threads_scratch(int slot, size_t size);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif // _RKNN_MODEL_ZOO_IMAGE_THREADS_H_
@@ -19,6 +19,9 @@
 #include "turbojpeg.h"
 
 #include "image_utils.h"
+#include "image_scale.h"
+#include "image_threads.h"
+#include "image_dispatch.h"
 #include "file_utils.h"
 
 static const char* filter_image_names[] = {
@@ -188,12 +191,13 @@ static int write_image_jpeg(const char* path, int quality, const image_buffer_t*
     const unsigned char* data = image->virt_addr;
     int width = image->width;
     int height = image->height;
+    int pitch = (image->width_stride > 0 ? image->width_stride : width) * 3;
     int pixelFormat = TJPF_RGB;
 
 	tjhandle handle = tjInitCompress();
 
     if (image->format == IMAGE_FORMAT_RGB888) {
-        ret = tjCompress2(handle, data, width, 0, height, pixelFormat, &jpegBuf, &jpegSize, jpegSubsamp, quality, flags);
+        ret = tjCompress2(handle, data, width, pitch, height, pixelFormat, &jpegBuf, &jpegSize, jpegSubsamp, quality, flags);
     } else {
         printf("write_image_jpeg: pixel format %d not support\n", image->format);
         return -1;
@@ -263,6 +267,7 @@ int write_image(const char* path, const image_buffer_t* img)
     int width = img->width;
     int height = img->height;
     int channel = 3;
+    int pitch = (img->width_stride > 0 ? img->width_stride : width) * channel;
     void* data = img->virt_addr;
     printf("write_image path: %s width=%d height=%d channel=%d data=%p\n",
         path, width, height, channel, data);
@@ -277,7 +282,7 @@ int write_image(const char* path, const image_buffer_t* img)
         int quality = 95;
         ret = write_image_jpeg(path, quality, img);
     } else if (strcmp(_ext, ".png") == 0 | strcmp(_ext, ".PNG") == 0) {
-        ret = stbi_write_png(path, width, height, channel, data, 0);
+        ret = stbi_write_png(path, width, height, channel, data, pitch);
     } else if (strcmp(_ext, ".data") == 0 | strcmp(_ext, ".DATA") == 0) {
         int size = get_image_size(img);
         ret = write_data_to_file(path, data, size);
@@ -288,165 +293,215 @@ int write_image(const char* path, const image_buffer_t* img)
     return ret;
 }
 
-static int crop_and_scale_image_c(int channel, unsigned char *src, int src_width, int src_height,
-                                    int crop_x, int crop_y, int crop_width, int crop_height,
-                                    unsigned char *dst, int dst_width, int dst_height,
-                                    int dst_box_x, int dst_box_y, int dst_box_width, int dst_box_height) {
-    if (dst == NULL) {
-        printf("dst buffer is null\n");
-        return -1;
+static int get_bytes_per_pixel(image_format_t format)
+{
+    switch (format) {
+    case IMAGE_FORMAT_RGB888:
+        return 3;
+    case IMAGE_FORMAT_RGBA8888:
+        return 4;
+    default:
+        return 1;   // GRAY8 and the luma plane of YUV420SP
     }
+}
 
-    float x_ratio = (float)crop_width / (float)dst_box_width;
-    float y_ratio = (float)crop_height / (float)dst_box_height;
-
-    // printf("src_width=%d src_height=%d crop_x=%d crop_y=%d crop_width=%d crop_height=%d\n",
-    //     src_width, src_height, crop_x, crop_y, crop_width, crop_height);
-    // printf("dst_width=%d dst_height=%d dst_box_x=%d dst_box_y=%d dst_box_width=%d dst_box_height=%d\n",
-    //     dst_width, dst_height, dst_box_x, dst_box_y, dst_box_width, dst_box_height);
-    // printf("channel=%d x_ratio=%f y_ratio=%f\n", channel, x_ratio, y_ratio);
-
-    // 从原图指定区域取数据，双线性缩放到目标指定区域
-    for (int dst_y = dst_box_y; dst_y < dst_box_y + dst_box_height; dst_y++) {
-        for (int dst_x = dst_box_x; dst_x < dst_box_x + dst_box_width; dst_x++) {
-            int dst_x_offset = dst_x - dst_box_x;
-            int dst_y_offset = dst_y - dst_box_y;
+typedef struct {
+    unsigned char* data;
+    int size;
+    char color;
+} fill_job_t;
 
-            int src_x = (int)(dst_x_offset * x_ratio) + crop_x;
-            int src_y = (int)(dst_y_offset * y_ratio) + crop_y;
+static void fill_band(void* arg, int begin, int end)
+{
+    fill_job_t* job = (fill_job_t*)arg;
+    int offset = begin * IMAGE_THREADS_BAND_BYTES;
+    int len = (end - begin) * IMAGE_THREADS_BAND_BYTES;
+    if (offset + len > job->size) {
+        len = job->size - offset;
+    }
+    memset(job->data + offset, job->color, len);
+}
 
-            float x_diff = (dst_x_offset * x_ratio) - (src_x - crop_x);
-            float y_diff = (dst_y_offset * y_ratio) - (src_y - crop_y);
+static void fill_image_cpu(image_buffer_t* image, char color)
+{
+    fill_job_t job;
+    job.data = image->virt_addr;
+    job.size = get_image_size(image);
+    job.color = color;
+    int chunks = (job.size + IMAGE_THREADS_BAND_BYTES - 1) / IMAGE_THREADS_BAND_BYTES;
+    image_threads_run_rows(chunks, IMAGE_THREADS_BAND_BYTES, 1, fill_band, &job);
+}
 
-            int index1 = src_y * src_width * channel + src_x * channel;
-            int index2 = index1 + src_width * channel;    // down
-            if (src_y == src_height - 1) {
-                // 如果到图像最下边缘，变成选择上面的像素
-                index2 = index1 - src_width * channel;
-            }
-            int index3 = index1 + 1 * channel;            // right
-            int index4 = index2 + 1 * channel;            // down right
-            if (src_x == src_width - 1) {
-                // 如果到图像最右边缘，变成选择左边的像素
-                index3 = index1 - 1 * channel;
-                index4 = index2 - 1 * channel;
-            }
+typedef struct {
+    const unsigned char* y_plane;
+    const unsigned char* uv_plane;
+    int src_pitch;          // bytes, same for Y and UV
+    int x;                  // crop origin on source
+    int y;
+    int width;
+    int u_index;            // 0: NV12, 1: NV21
+    unsigned char* dst;     // first pixel of the target box
+    int dst_pitch;
+    int channel;            // 3: RGB888, 4: RGBA8888
+} yuv_job_t;
+
+static inline unsigned char clamp_u8(int v)
+{
+    return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
 
-            // printf("dst_x=%d dst_y=%d dst_x_offset=%d dst_y_offset=%d src_x=%d src_y=%d x_diff=%f y_diff=%f src index=%d %d %d %d\n",
-            //     dst_x, dst_y, dst_x_offset, dst_y_offset,
-            //     src_x, src_y, x_diff, y_diff,
-            //     index1, index2, index3, index4);
-
-            for (int c = 0; c < channel; c++) {
-                unsigned char A = src[index1+c];
-                unsigned char B = src[index3+c];
-                unsigned char C = src[index2+c];
-                unsigned char D = src[index4+c];
-
-                unsigned char pixel = (unsigned char)(
-                    A * (1 - x_diff) * (1 - y_diff) +
-                    B * x_diff * (1 - y_diff) +
-                    C * y_diff * (1 - x_diff) +
-                    D * x_diff * y_diff
-                );
-
-                dst[(dst_y * dst_width  + dst_x) * channel + c] = pixel;
-            }
+// crop row r, BT.601 limited range like RGA's default, 10 fractional bits
+static void yuv420sp_to_rgb_row(const yuv_job_t* job, int r, unsigned char* out)
+{
+    const unsigned char* y_row = job->y_plane + (size_t)(job->y + r) * job->src_pitch + job->x;
+    const unsigned char* uv_row = job->uv_plane + (size_t)((job->y + r) / 2) * job->src_pitch;
+    for (int i = 0; i < job->width; i++) {
+        const unsigned char* uv = uv_row + ((job->x + i) & ~1);
+        int u = uv[job->u_index] - 128;
+        int v = uv[1 - job->u_index] - 128;
+        int y = (y_row[i] - 16) * 1192 + 512;
+        out[0] = clamp_u8((y + 1634 * v) >> 10);
+        out[1] = clamp_u8((y - 400 * u - 833 * v) >> 10);
+        out[2] = clamp_u8((y + 2066 * u) >> 10);
+        if (job->channel == 4) {
+            out[3] = 255;
         }
+        out += job->channel;
     }
+}
 
-    return 0;
+static void yuv420sp_to_rgb_band(void* arg, int begin, int end)
+{
+    yuv_job_t* job = (yuv_job_t*)arg;
+    for (int r = begin; r < end; r++) {
+        yuv420sp_to_rgb_row(job, r, job->dst + (size_t)r * job->dst_pitch);
+    }
 }
 
-static int crop_and_scale_image_yuv420sp(unsigned char *src, int src_width, int src_height,
-                                    int crop_x, int crop_y, int crop_width, int crop_height,
-                                    unsigned char *dst, int dst_width, int dst_height,
-                                    int dst_box_x, int dst_box_y, int dst_box_width, int dst_box_height) {
+typedef struct {
+    const yuv_job_t* yuv;
+    unsigned char* row;
+} yuv_row_source_t;
 
-    unsigned char* src_y = src;
-    unsigned char* src_uv = src + src_width * src_height;
+static const uint8_t* yuv_source_row(void* arg, int y)
+{
+    yuv_row_source_t* source = (yuv_row_source_t*)arg;
+    yuv420sp_to_rgb_row(source->yuv, y, source->row);
+    return source->row;
+}
 
-    unsigned char* dst_y = dst;
-    unsigned char* dst_uv = dst + dst_width * dst_height;
+typedef struct {
+    yuv_job_t yuv;
+    const image_scale_plan_t* plan;
+    int ret;
+} yuv_scale_job_t;
 
-    crop_and_scale_image_c(1, src_y, src_width, src_height, crop_x, crop_y, crop_width, crop_height,
-        dst_y, dst_width, dst_height, dst_box_x, dst_box_y, dst_box_width, dst_box_height);
-    
-    crop_and_scale_image_c(2, src_uv, src_width / 2, src_height / 2, crop_x / 2, crop_y / 2, crop_width / 2, crop_height / 2,
-        dst_uv, dst_width / 2, dst_height / 2, dst_box_x, dst_box_y, dst_box_width, dst_box_height);
+// a band converts only the source rows its target rows sample, one RGB row at a time
+static void yuv420sp_scale_band(void* arg, int begin, int end)
+{
+    yuv_scale_job_t* job = (yuv_scale_job_t*)arg;
+    yuv_row_source_t source;
+    source.yuv = &job->yuv;
+    source.row = (unsigned char*)image_threads_scratch(IMAGE_THREADS_SCRATCH_ROW, job->yuv.width * job->yuv.channel);
+    if (source.row == NULL) {
+        job->ret = -1;
+        return;
+    }
+    if (image_scale_rows_cb(job->plan, yuv_source_row, &source, job->yuv.dst, job->yuv.dst_pitch, begin, end) != 0) {
+        job->ret = -1;
+    }
+}
 
-    return 0;
+/*
+ * YUV420SP crop to RGB888/RGBA8888. When the sizes differ, colour conversion is fused
+ * into the scaler row by row, so no RGB copy of the crop is ever made.
+ */
+static int convert_yuv420sp_to_rgb_cpu(image_buffer_t* src, image_buffer_t* dst, image_rect_t* src_box,
+                                       image_rect_t* dst_box)
+{
+    int crop_x = 0, crop_y = 0, crop_w = src->width, crop_h = src->height;
+    if (src_box != NULL) {
+        crop_x = src_box->left;
+        crop_y = src_box->top;
+        crop_w = src_box->right - src_box->left + 1;
+        crop_h = src_box->bottom - src_box->top + 1;
+    }
+    int box_x = 0, box_y = 0, box_w = dst->width, box_h = dst->height;
+    if (dst_box != NULL) {
+        box_x = dst_box->left;
+        box_y = dst_box->top;
+        box_w = dst_box->right - dst_box->left + 1;
+        box_h = dst_box->bottom - dst_box->top + 1;
+    }
+    int src_ws = src->width_stride > 0 ? src->width_stride : src->width;
+    int src_hs = src->height_stride > 0 ? src->height_stride : src->height;
+    int channel = get_bytes_per_pixel(dst->format);
+
+    yuv_job_t job;
+    job.y_plane = src->virt_addr;
+    job.uv_plane = src->virt_addr + (size_t)src_ws * src_hs;
+    job.src_pitch = src_ws;
+    job.x = crop_x;
+    job.y = crop_y;
+    job.width = crop_w;
+    job.u_index = src->format == IMAGE_FORMAT_YUV420SP_NV21 ? 1 : 0;
+    job.channel = channel;
+
+    int dst_ws = dst->width_stride > 0 ? dst->width_stride : dst->width;
+    job.dst_pitch = dst_ws * channel;
+    job.dst = dst->virt_addr + (size_t)box_y * job.dst_pitch + box_x * channel;
+    if (crop_w == box_w && crop_h == box_h) {
+        image_threads_run_rows(crop_h, crop_w * channel, 1, yuv420sp_to_rgb_band, &job);
+        return 0;
+    }
+
+    yuv_scale_job_t scale_job;
+    scale_job.yuv = job;
+    scale_job.plan = image_scale_get_plan(channel, crop_w, crop_h, box_w, box_h);
+    scale_job.ret = 0;
+    if (scale_job.plan == NULL) {
+        return -1;
+    }
+    image_threads_run_rows(box_h, box_w * channel, 1, yuv420sp_scale_band, &scale_job);
+    image_scale_put_plan(scale_job.plan);
+    return scale_job.ret;
 }
 
-static int convert_image_cpu(image_buffer_t *src, image_buffer_t *dst, image_rect_t *src_box, image_rect_t *dst_box, char color) {
-    int ret;
+int convert_image_cpu(image_buffer_t *src, image_buffer_t *dst, image_rect_t *src_box, image_rect_t *dst_box, char color, int fill_pad) {
     if (dst->virt_addr == NULL) {
         return -1;
     }
     if (src->virt_addr == NULL) {
         return -1;
     }
-    if (src->format != dst->format) {
-        return -1;
+    int yuv_to_rgb = (src->format == IMAGE_FORMAT_YUV420SP_NV12 || src->format == IMAGE_FORMAT_YUV420SP_NV21) &&
+                     (dst->format == IMAGE_FORMAT_RGB888 || dst->format == IMAGE_FORMAT_RGBA8888);
+    if (src->format != dst->format && !yuv_to_rgb) {
+        return IMAGE_CONVERT_UNSUPPORTED;
     }
 
-    int src_box_x = 0;
-    int src_box_y = 0;
-    int src_box_w = src->width;
-    int src_box_h = src->height;
-    if (src_box != NULL) {
-        src_box_x = src_box->left;
-        src_box_y = src_box->top;
-        src_box_w = src_box->right - src_box->left + 1;
-        src_box_h = src_box->bottom - src_box->top + 1;
-    }
-    int dst_box_x = 0;
-    int dst_box_y = 0;
     int dst_box_w = dst->width;
     int dst_box_h = dst->height;
     if (dst_box != NULL) {
-        dst_box_x = dst_box->left;
-        dst_box_y = dst_box->top;
         dst_box_w = dst_box->right - dst_box->left + 1;
         dst_box_h = dst_box->bottom - dst_box->top + 1;
     }
 
     // fill pad color
-    if (dst_box_w != dst->width || dst_box_h != dst->height) {
-        int dst_size = get_image_size(dst);
-        memset(dst->virt_addr, color, dst_size);
-    }
-
-    int need_release_dst_buffer = 0;
-    int reti = 0;
-    if (src->format == IMAGE_FORMAT_RGB888) {
-        reti = crop_and_scale_image_c(3, src->virt_addr, src->width, src->height,
-            src_box_x, src_box_y, src_box_w, src_box_h,
-            dst->virt_addr, dst->width, dst->height,
-            dst_box_x, dst_box_y, dst_box_w, dst_box_h);
-    } else if (src->format == IMAGE_FORMAT_RGBA8888) {
-        reti = crop_and_scale_image_c(4, src->virt_addr, src->width, src->height,
-            src_box_x, src_box_y, src_box_w, src_box_h,
-            dst->virt_addr, dst->width, dst->height,
-            dst_box_x, dst_box_y, dst_box_w, dst_box_h);
-    } else if (src->format == IMAGE_FORMAT_GRAY8) {
-        reti = crop_and_scale_image_c(1, src->virt_addr, src->width, src->height,
-            src_box_x, src_box_y, src_box_w, src_box_h,
-            dst->virt_addr, dst->width, dst->height,
-            dst_box_x, dst_box_y, dst_box_w, dst_box_h);
-    } else if (src->format == IMAGE_FORMAT_YUV420SP_NV12 || src->format == IMAGE_FORMAT_YUV420SP_NV21) {
-        reti = crop_and_scale_image_yuv420sp(src->virt_addr, src->width, src->height,
-            src_box_x, src_box_y, src_box_w, src_box_h,
-            dst->virt_addr, dst->width, dst->height,
-            dst_box_x, dst_box_y, dst_box_w, dst_box_h);
+    if (fill_pad && (dst_box_w != dst->width || dst_box_h != dst->height)) {
+        fill_image_cpu(dst, color);
+    }
+
+    int reti;
+    if (yuv_to_rgb) {
+        reti = convert_yuv420sp_to_rgb_cpu(src, dst, src_box, dst_box);
     } else {
-        printf("no support format %d\n", src->format);
+        reti = image_scale_bilinear(src, src_box, dst, dst_box);
     }
     if (reti != 0) {
         printf("convert_image_cpu fail %d\n", reti);
         return -1;
     }
-    printf("finish\n");
     return 0;
 }
 
@@ -471,28 +526,34 @@ int get_image_size(image_buffer_t* image)
     if (image == NULL) {
         return 0;
     }
+    // strides are in pixels, 0 means packed
+    int ws = image->width_stride > 0 ? image->width_stride : image->width;
+    int hs = image->height_stride > 0 ? image->height_stride : image->height;
     switch (image->format)
     {
     case IMAGE_FORMAT_GRAY8:
-        return image->width * image->height;
+        return ws * hs;
     case IMAGE_FORMAT_RGB888:
-        return image->width * image->height * 3;    
+        return ws * hs * 3;
     case IMAGE_FORMAT_RGBA8888:
-        return image->width * image->height * 4;
+        return ws * hs * 4;
     case IMAGE_FORMAT_YUV420SP_NV12:
     case IMAGE_FORMAT_YUV420SP_NV21:
-        return image->width * image->height * 3 / 2;
+        return ws * hs * 3 / 2;
     default:
         break;
     }
+    return 0;
 }
 
-static int convert_image_rga(image_buffer_t* src_img, image_buffer_t* dst_img, image_rect_t* src_box, image_rect_t* dst_box, char color)
+int convert_image_rga(image_buffer_t* src_img, image_buffer_t* dst_img, image_rect_t* src_box, image_rect_t* dst_box, char color, int fill_pad)
 {
     int ret = 0;
 
     int srcWidth = src_img->width;
     int srcHeight = src_img->height;
+    int srcWStride = src_img->width_stride > 0 ? src_img->width_stride : srcWidth;
+    int srcHStride = src_img->height_stride > 0 ? src_img->height_stride : srcHeight;
     void *src = src_img->virt_addr;
     int src_fd = src_img->fd;
     void *src_phy = NULL;
@@ -500,6 +561,8 @@ static int convert_image_rga(image_buffer_t* src_img, image_buffer_t* dst_img, i
 
     int dstWidth = dst_img->width;
     int dstHeight = dst_img->height;
+    int dstWStride = dst_img->width_stride > 0 ? dst_img->width_stride : dstWidth;
+    int dstHStride = dst_img->height_stride > 0 ? dst_img->height_stride : dstHeight;
     void *dst = dst_img->virt_addr;
     int dst_fd = dst_img->fd;
     void *dst_phy = NULL;
@@ -518,6 +581,10 @@ static int convert_image_rga(image_buffer_t* src_img, image_buffer_t* dst_img, i
     //     dstWidth, dstHeight, dstFmt, dst, dst_fd);
     // printf("rotate=%d\n", rotate);
 
+    if (srcFmt == -1 || dstFmt == -1) {
+        return IMAGE_CONVERT_UNSUPPORTED;
+    }
+
     int usage = 0;
     IM_STATUS ret_rga = IM_STATUS_NOERROR;
 
@@ -563,13 +630,13 @@ static int convert_image_rga(image_buffer_t* src_img, image_buffer_t* dst_img, i
     memset(&pat, 0, sizeof(rga_buffer_t));
 
     im_handle_param_t in_param;
-    in_param.width = srcWidth;
-    in_param.height = srcHeight;
+    in_param.width = srcWStride;
+    in_param.height = srcHStride;
     in_param.format = srcFmt;
 
     im_handle_param_t dst_param;
-    dst_param.width = dstWidth;
-    dst_param.height = dstHeight;
+    dst_param.width = dstWStride;
+    dst_param.height = dstHStride;
     dst_param.format = dstFmt;
 
     if (use_handle) {
@@ -585,14 +652,14 @@ static int convert_image_rga(image_buffer_t* src_img, image_buffer_t* dst_img, i
             ret = -1;
             goto err;
         }
-        rga_buf_src = wrapbuffer_handle(rga_handle_src, srcWidth, srcHeight, srcFmt, srcWidth, srcHeight);
+        rga_buf_src = wrapbuffer_handle(rga_handle_src, srcWidth, srcHeight, srcFmt, srcWStride, srcHStride);
     } else {
         if (src_phy != NULL) {
-            rga_buf_src = wrapbuffer_physicaladdr(src_phy, srcWidth, srcHeight, srcFmt, srcWidth, srcHeight);
+            rga_buf_src = wrapbuffer_physicaladdr(src_phy, srcWidth, srcHeight, srcFmt, srcWStride, srcHStride);
         } else if (src_fd > 0) {
-            rga_buf_src = wrapbuffer_fd(src_fd, srcWidth, srcHeight, srcFmt, srcWidth, srcHeight);
+            rga_buf_src = wrapbuffer_fd(src_fd, srcWidth, srcHeight, srcFmt, srcWStride, srcHStride);
         } else {
-            rga_buf_src = wrapbuffer_virtualaddr(src, srcWidth, srcHeight, srcFmt, srcWidth, srcHeight);
+            rga_buf_src = wrapbuffer_virtualaddr(src, srcWidth, srcHeight, srcFmt, srcWStride, srcHStride);
         }
     }
 
@@ -609,18 +676,18 @@ static int convert_image_rga(image_buffer_t* src_img, image_buffer_t* dst_img, i
             ret = -1;
             goto err;
         }
-        rga_buf_dst = wrapbuffer_handle(rga_handle_dst, dstWidth, dstHeight, dstFmt, dstWidth, dstHeight);
+        rga_buf_dst = wrapbuffer_handle(rga_handle_dst, dstWidth, dstHeight, dstFmt, dstWStride, dstHStride);
     } else {
         if (dst_phy != NULL) {
-            rga_buf_dst = wrapbuffer_physicaladdr(dst_phy, dstWidth, dstHeight, dstFmt, dstWidth, dstHeight);
+            rga_buf_dst = wrapbuffer_physicaladdr(dst_phy, dstWidth, dstHeight, dstFmt, dstWStride, dstHStride);
         } else if (dst_fd > 0) {
-            rga_buf_dst = wrapbuffer_fd(dst_fd, dstWidth, dstHeight, dstFmt, dstWidth, dstHeight);
+            rga_buf_dst = wrapbuffer_fd(dst_fd, dstWidth, dstHeight, dstFmt, dstWStride, dstHStride);
         } else {
-            rga_buf_dst = wrapbuffer_virtualaddr(dst, dstWidth, dstHeight, dstFmt, dstWidth, dstHeight);
+            rga_buf_dst = wrapbuffer_virtualaddr(dst, dstWidth, dstHeight, dstFmt, dstWStride, dstHStride);
         }
     }
 
-    if (drect.width != dstWidth || drect.height != dstHeight) {
+    if (fill_pad && (drect.width != dstWidth || drect.height != dstHeight)) {
         im_rect dst_whole_rect = {0, 0, dstWidth, dstHeight};
         int imcolor;
         char* p_imcolor = &imcolor;
@@ -628,8 +695,6 @@ static int convert_image_rga(image_buffer_t* src_img, image_buffer_t* dst_img, i
         p_imcolor[1] = color;
         p_imcolor[2] = color;
         p_imcolor[3] = color;
-        printf("fill dst image (x y w h)=(%d %d %d %d) with color=0x%x\n",
-            dst_whole_rect.x, dst_whole_rect.y, dst_whole_rect.width, dst_whole_rect.height, imcolor);
         ret_rga = imfill(rga_buf_dst, dst_whole_rect, imcolor);
         if (ret_rga <= 0) {
             if (dst != NULL) {
@@ -646,7 +711,8 @@ static int convert_image_rga(image_buffer_t* src_img, image_buffer_t* dst_img, i
     if (ret_rga <= 0) {
         printf("Error on improcess STATUS=%d\n", ret_rga);
         printf("RGA error message: %s\n", imStrError((IM_STATUS)ret_rga));
-        ret = -1;
+        // parameter errors depend on this call's rectangles, not on the format pair
+        ret = ret_rga == IM_STATUS_NOT_SUPPORTED ? IMAGE_CONVERT_UNSUPPORTED : -1;
     }
 
 err:
@@ -662,38 +728,135 @@ err:
     return ret;
 }
 
+static int convert_image_internal(image_buffer_t* src_img, image_buffer_t* dst_img, image_rect_t* src_box, image_rect_t* dst_box, char color, int fill_pad)
+{
+    return image_dispatch_convert(src_img, dst_img, src_box, dst_box, color, fill_pad);
+}
+
 int convert_image(image_buffer_t* src_img, image_buffer_t* dst_img, image_rect_t* src_box, image_rect_t* dst_box, char color)
 {
-    int ret;
- 
-    printf("src width=%d height=%d fmt=0x%x virAddr=0x%p fd=%d\n",
-        src_img->width, src_img->height, src_img->format, src_img->virt_addr, src_img->fd);
-    printf("dst width=%d height=%d fmt=0x%x virAddr=0x%p fd=%d\n",
-        dst_img->width, dst_img->height, dst_img->format, dst_img->virt_addr, dst_img->fd);
-    if (src_box != NULL) {
-        printf("src_box=(%d %d %d %d)\n", src_box->left, src_box->top, src_box->right, src_box->bottom);
+    return convert_image_internal(src_img, dst_img, src_box, dst_box, color, 1);
+}
+
+int image_view_init(image_view_t* view, image_buffer_t* parent, int x, int y, int w, int h)
+{
+    if (x < 0 || y < 0 || w <= 0 || h <= 0 || x + w > parent->width || y + h > parent->height) {
+        printf("view (%d %d %d %d) outside image %dx%d\n", x, y, w, h, parent->width, parent->height);
+        return -1;
     }
-    if (dst_box != NULL) {
-        printf("dst_box=(%d %d %d %d)\n", dst_box->left, dst_box->top, dst_box->right, dst_box->bottom);
+    if ((parent->format == IMAGE_FORMAT_YUV420SP_NV12 || parent->format == IMAGE_FORMAT_YUV420SP_NV21) &&
+        ((x | y | w | h) & 1)) {
+        printf("view (%d %d %d %d) must be even on YUV420SP\n", x, y, w, h);
+        return -1;
     }
-    printf("color=0x%x\n", color);
+    view->parent = parent;
+    view->rect.left = x;
+    view->rect.top = y;
+    view->rect.right = x + w - 1;
+    view->rect.bottom = y + h - 1;
+    return 0;
+}
 
-    ret = convert_image_rga(src_img, dst_img, src_box, dst_box, color);
-    if (ret != 0) {
-        printf("try convert image use cpu\n");
-        ret = convert_image_cpu(src_img, dst_img, src_box, dst_box, color);
+int image_view_buffer(const image_view_t* view, image_buffer_t* image)
+{
+    const image_buffer_t* parent = view->parent;
+    if (parent == NULL || parent->virt_addr == NULL) {
+        return -1;
     }
-    return ret;
+    int ws = parent->width_stride > 0 ? parent->width_stride : parent->width;
+    int hs = parent->height_stride > 0 ? parent->height_stride : parent->height;
+    int x = view->rect.left;
+    int y = view->rect.top;
+
+    memset(image, 0, sizeof(image_buffer_t));
+    image->width = view->rect.right - view->rect.left + 1;
+    image->height = view->rect.bottom - view->rect.top + 1;
+    image->format = parent->format;
+    image->width_stride = ws;
+    image->height_stride = hs;
+    int offset = (y * ws + x) * get_bytes_per_pixel(parent->format);
+    image->virt_addr = parent->virt_addr + offset;
+    if (parent->format == IMAGE_FORMAT_YUV420SP_NV12 || parent->format == IMAGE_FORMAT_YUV420SP_NV21) {
+        // UV is found at virt_addr + ws * height_stride, moving the luma origin down y rows
+        // moves the UV origin only y / 2 rows
+        image->height_stride = hs - y / 2;
+    }
+    // bytes left in the parent from the view origin
+    image->size = get_image_size((image_buffer_t*)parent) - offset;
+    return 0;
 }
 
-int convert_image_with_letterbox(image_buffer_t* src_image, image_buffer_t* dst_image, letterbox_t* letterbox, char color)
+int convert_image_view(image_view_t* src_view, image_view_t* dst_view, char color)
+{
+    return convert_image(src_view->parent, dst_view->parent, &src_view->rect, &dst_view->rect, color);
+}
+
+int fill_image_color(image_buffer_t* image, char color)
+{
+    if (image->virt_addr == NULL && image->fd <= 0) {
+        return -1;
+    }
+
+    int width = image->width;
+    int height = image->height;
+    int ws = image->width_stride > 0 ? image->width_stride : width;
+    int hs = image->height_stride > 0 ? image->height_stride : height;
+    int fmt = get_rga_fmt(image->format);
+    IM_STATUS ret_rga = IM_STATUS_FAILED;
+    if (fmt >= 0) {
+        rga_buffer_t rga_buf;
+        if (image->fd > 0) {
+            rga_buf = wrapbuffer_fd(image->fd, width, height, fmt, ws, hs);
+        } else {
+            rga_buf = wrapbuffer_virtualaddr(image->virt_addr, width, height, fmt, ws, hs);
+        }
+        im_rect whole_rect = {0, 0, width, height};
+        int imcolor;
+        char* p_imcolor = (char*)&imcolor;
+        p_imcolor[0] = color;
+        p_imcolor[1] = color;
+        p_imcolor[2] = color;
+        p_imcolor[3] = color;
+        ret_rga = imfill(rga_buf, whole_rect, imcolor);
+    }
+    if (ret_rga <= 0) {
+        if (image->virt_addr == NULL) {
+            printf("Warning: Can not fill color on target image\n");
+            return -1;
+        }
+        memset(image->virt_addr, color, get_image_size(image));
+    }
+    return 0;
+}
+
+/*
+ * Letterbox geometry only depends on (src size, dst size), which never change for a camera
+ * stream, so compute it once per pair. Small round-robin table, not thread safe.
+ */
+#define LETTERBOX_CACHE_SIZE 8
+
+typedef struct {
+    int src_w;
+    int src_h;
+    int dst_w;
+    int dst_h;
+    float scale;
+    int x_pad;
+    int y_pad;
+    image_rect_t dst_box;
+} letterbox_geometry_t;
+
+static letterbox_geometry_t letterbox_cache[LETTERBOX_CACHE_SIZE];
+static int letterbox_cache_count = 0;
+static int letterbox_cache_next = 0;
+
+static void compute_letterbox_geometry(letterbox_geometry_t* geo)
 {
-    int ret = 0;
     int allow_slight_change = 1;
-    int src_w = src_image->width;
-    int src_h = src_image->height;
-    int dst_w = dst_image->width;
-    int dst_h = dst_image->height;
+    int src_w = geo->src_w;
+    int src_h = geo->src_h;
+    int dst_w = geo->dst_w;
+    int dst_h = geo->dst_h;
     int resize_w = dst_w;
     int resize_h = dst_h;
 
@@ -704,17 +867,11 @@ int convert_image_with_letterbox(image_buffer_t* src_image, image_buffer_t* dst_
     int _top_offset = 0;
     float scale = 1.0;
 
-    image_rect_t src_box;
-    src_box.left = 0;
-    src_box.top = 0;
-    src_box.right = src_image->width - 1;
-    src_box.bottom = src_image->height - 1;
-
     image_rect_t dst_box;
     dst_box.left = 0;
     dst_box.top = 0;
-    dst_box.right = dst_image->width - 1;
-    dst_box.bottom = dst_image->height - 1;
+    dst_box.right = dst_w - 1;
+    dst_box.bottom = dst_h - 1;
 
     float _scale_w = (float)dst_w / src_w;
     float _scale_h = (float)dst_h / src_h;
@@ -757,15 +914,73 @@ int convert_image_with_letterbox(image_buffer_t* src_image, image_buffer_t* dst_
         dst_box.right = dst_box.left + resize_w - 1;
         _left_offset = dst_box.left;
     }
-    printf("scale=%f dst_box=(%d %d %d %d) allow_slight_change=%d _left_offset=%d _top_offset=%d padding_w=%d padding_h=%d\n",
-        scale, dst_box.left, dst_box.top, dst_box.right, dst_box.bottom, allow_slight_change,
-        _left_offset, _top_offset, padding_w, padding_h);
+    printf("letterbox %dx%d -> %dx%d: scale=%f dst_box=(%d %d %d %d) padding_w=%d padding_h=%d\n",
+        src_w, src_h, dst_w, dst_h, scale, dst_box.left, dst_box.top, dst_box.right, dst_box.bottom,
+        padding_w, padding_h);
+
+    geo->scale = scale;
+    geo->x_pad = _left_offset;
+    geo->y_pad = _top_offset;
+    geo->dst_box = dst_box;
+}
+
+static const letterbox_geometry_t* get_letterbox_geometry(int src_w, int src_h, int dst_w, int dst_h)
+{
+    for (int i = 0; i < letterbox_cache_count; i++) {
+        letterbox_geometry_t* geo = &letterbox_cache[i];
+        if (geo->src_w == src_w && geo->src_h == src_h && geo->dst_w == dst_w && geo->dst_h == dst_h) {
+            return geo;
+        }
+    }
+
+    letterbox_geometry_t* geo = &letterbox_cache[letterbox_cache_next];
+    letterbox_cache_next = (letterbox_cache_next + 1) % LETTERBOX_CACHE_SIZE;
+    if (letterbox_cache_count < LETTERBOX_CACHE_SIZE) {
+        letterbox_cache_count++;
+    }
+    geo->src_w = src_w;
+    geo->src_h = src_h;
+    geo->dst_w = dst_w;
+    geo->dst_h = dst_h;
+    compute_letterbox_geometry(geo);
+    return geo;
+}
+
+int get_letterbox(int src_w, int src_h, int dst_w, int dst_h, letterbox_t* letterbox, image_rect_t* dst_box)
+{
+    if (src_w <= 0 || src_h <= 0 || dst_w <= 0 || dst_h <= 0) {
+        return -1;
+    }
+    const letterbox_geometry_t* geo = get_letterbox_geometry(src_w, src_h, dst_w, dst_h);
+    if (letterbox != NULL) {
+        letterbox->scale = geo->scale;
+        letterbox->x_pad = geo->x_pad;
+        letterbox->y_pad = geo->y_pad;
+    }
+    if (dst_box != NULL) {
+        *dst_box = geo->dst_box;
+    }
+    return 0;
+}
+
+static int letterbox_internal(image_buffer_t* src_image, image_buffer_t* dst_image, letterbox_t* letterbox, char color, int fill_pad)
+{
+    const letterbox_geometry_t* geo = get_letterbox_geometry(src_image->width, src_image->height,
+                                                             dst_image->width, dst_image->height);
+
+    image_rect_t src_box;
+    src_box.left = 0;
+    src_box.top = 0;
+    src_box.right = src_image->width - 1;
+    src_box.bottom = src_image->height - 1;
+
+    image_rect_t dst_box = geo->dst_box;
 
     //set offset and scale
     if(letterbox != NULL){
-        letterbox->scale = scale;
-        letterbox->x_pad = _left_offset;
-        letterbox->y_pad = _top_offset;
+        letterbox->scale = geo->scale;
+        letterbox->x_pad = geo->x_pad;
+        letterbox->y_pad = geo->y_pad;
     }
     // alloc memory buffer for dst image,
     // remember to free
@@ -776,7 +991,18 @@ int convert_image_with_letterbox(image_buffer_t* src_image, image_buffer_t* dst_
             printf("malloc size %d error\n", dst_size);
             return -1;
         }
+        // fresh buffer has no padding yet
+        fill_pad = 1;
     }
-    ret = convert_image(src_image, dst_image, &src_box, &dst_box, color);
-    return ret;
-}
\ No newline at end of file
+    return convert_image_internal(src_image, dst_image, &src_box, &dst_box, color, fill_pad);
+}
+
+int convert_image_with_letterbox(image_buffer_t* src_image, image_buffer_t* dst_image, letterbox_t* letterbox, char color)
+{
+    return letterbox_internal(src_image, dst_image, letterbox, color, 1);
+}
+
+int convert_image_with_letterbox_prefilled(image_buffer_t* src_image, image_buffer_t* dst_image, letterbox_t* letterbox)
+{
+    return letterbox_internal(src_image, dst_image, letterbox, 0, 0);
+}
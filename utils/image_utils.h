@@ -47,6 +47,43 @@ int write_image(const char* path, const image_buffer_t* image);
  */
 int convert_image(image_buffer_t* src_image, image_buffer_t* dst_image, image_rect_t* src_box, image_rect_t* dst_box, char color);
 
+/**
+ * @brief Init a view on a rectangle of an image
+ *
+ * @param view [out] View
+ * @param parent [in] Parent image, must outlive the view
+ * @param x [in] Left
+ * @param y [in] Top
+ * @param w [in] Width
+ * @param h [in] Height
+ * @return int 0: success; -1: rectangle outside the parent (or odd offset on YUV420SP)
+ */
+int image_view_init(image_view_t* view, image_buffer_t* parent, int x, int y, int w, int h);
+
+/**
+ * @brief Describe a view as an image buffer pointing into the parent pixels
+ *
+ * virt_addr is offset into the parent and the strides are the parent's, so the result can
+ * go to the drawing and CPU functions. fd is cleared since a dma-buf can not carry the
+ * offset; for RGA pass the parent with the view rectangle (convert_image_view(),
+ * rga_job_add_convert()).
+ *
+ * @param view [in] View
+ * @param image [out] Image buffer
+ * @return int 0: success; -1: error
+ */
+int image_view_buffer(const image_view_t* view, image_buffer_t* image);
+
+/**
+ * @brief convert_image between views, the parents are passed with the view rectangles
+ *
+ * @param src_view [in] Source view
+ * @param dst_view [in] Target view
+ * @param color [in] Pading color if the target view is smaller than its parent
+ * @return int 0: success; -1: error
+ */
+int convert_image_view(image_view_t* src_view, image_view_t* dst_view, char color);
+
 /**
  * @brief Convert image with letterbox
  * 
@@ -58,6 +95,42 @@ int convert_image(image_buffer_t* src_image, image_buffer_t* dst_image, image_re
  */
 int convert_image_with_letterbox(image_buffer_t* src_image, image_buffer_t* dst_image, letterbox_t* letterbox, char color);
 
+/**
+ * @brief Convert image with letterbox, without filling the padding
+ *
+ * For persistent target buffers: fill the whole buffer once with fill_image_color() after
+ * allocation, then only the resized region is rewritten per frame.
+ * The letterbox geometry is cached per (src size, dst size).
+ *
+ * @param src_image [in] Source Image
+ * @param dst_image [out] Target Image, padding already filled
+ * @param letterbox [out] Letterbox
+ * @return int
+ */
+int convert_image_with_letterbox_prefilled(image_buffer_t* src_image, image_buffer_t* dst_image, letterbox_t* letterbox);
+
+/**
+ * @brief Get the cached letterbox geometry without converting
+ *
+ * @param src_w [in] Source width
+ * @param src_h [in] Source height
+ * @param dst_w [in] Target width
+ * @param dst_h [in] Target height
+ * @param letterbox [out] Letterbox, may be NULL
+ * @param dst_box [out] Resized region on target image, may be NULL
+ * @return int 0: success; -1: error
+ */
+int get_letterbox(int src_w, int src_h, int dst_w, int dst_h, letterbox_t* letterbox, image_rect_t* dst_box);
+
+/**
+ * @brief Fill the whole image with one color (RGA, memset fallback)
+ *
+ * @param image [in] Image
+ * @param color [in] Fill color, written to every byte
+ * @return int 0: success; -1: error
+ */
+int fill_image_color(image_buffer_t* image, char color);
+
 /**
  * @brief Get the image size
  * 
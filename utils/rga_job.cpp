@@ -0,0 +1,354 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "im2d.hpp"
+
+#include "rga_job.h"
+
+static int get_rga_fmt(image_format_t fmt, int swap_rb)
+{
+    switch (fmt) {
+    case IMAGE_FORMAT_GRAY8:
+        return RK_FORMAT_YCbCr_400;
+    case IMAGE_FORMAT_RGB888:
+        return swap_rb ? RK_FORMAT_BGR_888 : RK_FORMAT_RGB_888;
+    case IMAGE_FORMAT_RGBA8888:
+        return swap_rb ? RK_FORMAT_BGRA_8888 : RK_FORMAT_RGBA_8888;
+    case IMAGE_FORMAT_YUV420SP_NV12:
+        return RK_FORMAT_YCbCr_420_SP;
+    case IMAGE_FORMAT_YUV420SP_NV21:
+        return RK_FORMAT_YCrCb_420_SP;
+    default:
+        return -1;
+    }
+}
+
+// counterclockwise degrees to RGA transform (RGA rotates clockwise)
+static int get_rga_rotation(int rotation)
+{
+    switch (rotation) {
+    case 0:
+        return 0;
+    case 90:
+        return IM_HAL_TRANSFORM_ROT_270;
+    case 180:
+        return IM_HAL_TRANSFORM_ROT_180;
+    case 270:
+        return IM_HAL_TRANSFORM_ROT_90;
+    default:
+        return -1;
+    }
+}
+
+static int get_buffer_size(image_buffer_t* image)
+{
+    int ws = image->width_stride > 0 ? image->width_stride : image->width;
+    int hs = image->height_stride > 0 ? image->height_stride : image->height;
+    switch (image->format) {
+    case IMAGE_FORMAT_GRAY8:
+        return ws * hs;
+    case IMAGE_FORMAT_RGB888:
+        return ws * hs * 3;
+    case IMAGE_FORMAT_RGBA8888:
+        return ws * hs * 4;
+    case IMAGE_FORMAT_YUV420SP_NV12:
+    case IMAGE_FORMAT_YUV420SP_NV21:
+        return ws * hs * 3 / 2;
+    default:
+        return 0;
+    }
+}
+
+static void release_buffers(rga_job_t* job)
+{
+    for (int i = 0; i < job->buffer_count; i++) {
+        releasebuffer_handle(job->buffer_handles[i]);
+    }
+    job->buffer_count = 0;
+}
+
+// import once per job, tasks of the same job often share a buffer
+static int wrap_image(rga_job_t* job, image_buffer_t* image, int swap_rb, rga_buffer_t* buf)
+{
+    int fmt = get_rga_fmt(image->format, swap_rb);
+    if (fmt < 0) {
+        printf("rga job: no support format %d\n", image->format);
+        return -1;
+    }
+
+    rga_buffer_handle_t handle = 0;
+    for (int i = 0; i < job->buffer_count; i++) {
+        if ((image->fd > 0 && job->buffer_fds[i] == image->fd) ||
+            (image->fd <= 0 && job->buffer_addrs[i] == image->virt_addr)) {
+            handle = job->buffer_handles[i];
+            break;
+        }
+    }
+    if (handle == 0) {
+        if (job->buffer_count >= RGA_JOB_MAX_BUFFERS) {
+            printf("rga job: too many buffers\n");
+            return -1;
+        }
+        int size = get_buffer_size(image);
+        if (image->fd > 0) {
+            handle = importbuffer_fd(image->fd, size);
+        } else {
+            handle = importbuffer_virtualaddr(image->virt_addr, size);
+        }
+        if (handle <= 0) {
+            printf("rga job: import buffer fail\n");
+            return -1;
+        }
+        job->buffer_handles[job->buffer_count] = handle;
+        job->buffer_addrs[job->buffer_count] = image->virt_addr;
+        job->buffer_fds[job->buffer_count] = image->fd;
+        job->buffer_count++;
+    }
+
+    int ws = image->width_stride > 0 ? image->width_stride : image->width;
+    int hs = image->height_stride > 0 ? image->height_stride : image->height;
+    *buf = wrapbuffer_handle(handle, image->width, image->height, fmt, ws, hs);
+    return 0;
+}
+
+static int64_t get_time_us()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static int check_task(rga_job_t* job, IM_STATUS status, const char* name)
+{
+    if (status != IM_STATUS_SUCCESS) {
+        printf("rga job: add %s task fail, %s\n", name, imStrError(status));
+        return -1;
+    }
+    job->task_count++;
+    return 0;
+}
+
+// describe the task for the scheduler, called before the task is added
+static int describe_task(rga_job_t* job, int op, image_buffer_t* src, image_buffer_t* dst)
+{
+    if (job->task_count >= RGA_JOB_MAX_TASKS) {
+        printf("rga job: too many tasks\n");
+        return -1;
+    }
+    rga_work_t* w = &job->work[job->task_count];
+    w->op = op;
+    w->src_w = src != NULL ? src->width : 0;
+    w->src_h = src != NULL ? src->height : 0;
+    w->src_fmt = src != NULL ? src->format : dst->format;
+    w->dst_w = dst->width;
+    w->dst_h = dst->height;
+    w->dst_fmt = dst->format;
+    return 0;
+}
+
+int rga_job_begin(rga_job_t* job)
+{
+    memset(job, 0, sizeof(rga_job_t));
+    job->release_fence = -1;
+    job->handle = imbeginJob();
+    if (job->handle == 0) {
+        printf("rga job: imbeginJob fail\n");
+        return -1;
+    }
+    return 0;
+}
+
+int rga_job_add_cvtcolor(rga_job_t* job, image_buffer_t* src, image_buffer_t* dst)
+{
+    rga_buffer_t s, d;
+    if (describe_task(job, RGA_OP_CVTCOLOR, src, dst) != 0 ||
+        wrap_image(job, src, 0, &s) != 0 || wrap_image(job, dst, 0, &d) != 0) {
+        return -1;
+    }
+    return check_task(job, imcvtcolorTask(job->handle, s, d, s.format, d.format), "cvtcolor");
+}
+
+int rga_job_add_rotate(rga_job_t* job, image_buffer_t* src, image_buffer_t* dst, int rotation)
+{
+    int rga_rotation = get_rga_rotation(rotation);
+    if (rga_rotation <= 0) {
+        printf("rga job: unsupported rotation %d\n", rotation);
+        return -1;
+    }
+    rga_buffer_t s, d;
+    if (describe_task(job, RGA_OP_ROTATE, src, dst) != 0 ||
+        wrap_image(job, src, 0, &s) != 0 || wrap_image(job, dst, 0, &d) != 0) {
+        return -1;
+    }
+    return check_task(job, imrotateTask(job->handle, s, d, rga_rotation), "rotate");
+}
+
+int rga_job_add_fill(rga_job_t* job, image_buffer_t* dst, image_rect_t* rect, char color)
+{
+    rga_buffer_t d;
+    if (describe_task(job, RGA_OP_FILL, NULL, dst) != 0 || wrap_image(job, dst, 0, &d) != 0) {
+        return -1;
+    }
+    im_rect r = {0, 0, dst->width, dst->height};
+    if (rect != NULL) {
+        r.x = rect->left;
+        r.y = rect->top;
+        r.width = rect->right - rect->left + 1;
+        r.height = rect->bottom - rect->top + 1;
+    }
+    uint32_t imcolor;
+    memset(&imcolor, color, sizeof(imcolor));
+    return check_task(job, imfillTask(job->handle, d, r, imcolor), "fill");
+}
+
+int rga_job_add_convert(rga_job_t* job, image_buffer_t* src, image_buffer_t* dst, image_rect_t* src_box,
+                        image_rect_t* dst_box, int fill_pad, char color)
+{
+    im_rect srect = {0, 0, src->width, src->height};
+    if (src_box != NULL) {
+        srect.x = src_box->left;
+        srect.y = src_box->top;
+        srect.width = src_box->right - src_box->left + 1;
+        srect.height = src_box->bottom - src_box->top + 1;
+    }
+    im_rect drect = {0, 0, dst->width, dst->height};
+    if (dst_box != NULL) {
+        drect.x = dst_box->left;
+        drect.y = dst_box->top;
+        drect.width = dst_box->right - dst_box->left + 1;
+        drect.height = dst_box->bottom - dst_box->top + 1;
+    }
+    if (fill_pad && (drect.width != dst->width || drect.height != dst->height) &&
+        rga_job_add_fill(job, dst, NULL, color) != 0) {
+        return -1;
+    }
+
+    rga_buffer_t s, d, pat;
+    if (describe_task(job, RGA_OP_RESIZE | (src->format != dst->format ? RGA_OP_CVTCOLOR : 0), src, dst) != 0 ||
+        wrap_image(job, src, 0, &s) != 0 || wrap_image(job, dst, 0, &d) != 0) {
+        return -1;
+    }
+    memset(&pat, 0, sizeof(pat));
+    im_rect prect;
+    memset(&prect, 0, sizeof(prect));
+    return check_task(job, improcessTask(job->handle, s, d, pat, srect, drect, prect, NULL, 0), "convert");
+}
+
+int rga_job_add_letterbox(rga_job_t* job, image_buffer_t* src, image_buffer_t* dst, letterbox_t* letterbox,
+                          int fill_pad, char color)
+{
+    image_rect_t box;
+    if (get_letterbox(src->width, src->height, dst->width, dst->height, letterbox, &box) != 0) {
+        return -1;
+    }
+    return rga_job_add_convert(job, src, dst, NULL, &box, fill_pad, color);
+}
+
+int rga_job_add_resize(rga_job_t* job, image_buffer_t* src, image_buffer_t* dst, int rotation, int flags)
+{
+    int rga_rotation = get_rga_rotation(rotation);
+    if (rga_rotation < 0) {
+        printf("rga job: unsupported rotation %d\n", rotation);
+        return -1;
+    }
+    int op = RGA_OP_RESIZE | (rotation != 0 ? RGA_OP_ROTATE : 0) | (src->format != dst->format ? RGA_OP_CVTCOLOR : 0);
+    rga_buffer_t s, d, pat;
+    if (describe_task(job, op, src, dst) != 0 ||
+        wrap_image(job, src, flags & RGA_JOB_SWAP_RB, &s) != 0 || wrap_image(job, dst, 0, &d) != 0) {
+        return -1;
+    }
+    memset(&pat, 0, sizeof(pat));
+    im_rect srect = {0, 0, src->width, src->height};
+    im_rect drect = {0, 0, dst->width, dst->height};
+    im_rect prect;
+    memset(&prect, 0, sizeof(prect));
+    return check_task(job, improcessTask(job->handle, s, d, pat, srect, drect, prect, NULL, rga_rotation), "resize");
+}
+
+void rga_job_set_core(rga_job_t* job, int core_id)
+{
+    job->core = core_id;
+}
+
+int rga_job_submit(rga_job_t* job, int async)
+{
+    if (job->handle == 0) {
+        return -1;
+    }
+    if (job->task_count == 0) {
+        rga_job_cancel(job);
+        return 0;
+    }
+
+    // scheduler core is a thread config, only keep it for this job
+    if (job->core != 0) {
+        imconfig(IM_CONFIG_SCHEDULER_CORE, job->core);
+    }
+    job->submit_us = get_time_us();
+    IM_STATUS ret;
+    if (async) {
+        ret = imendJob(job->handle, IM_ASYNC, 0, &job->release_fence);
+    } else {
+        ret = imendJob(job->handle, IM_SYNC);
+        job->latency_us = get_time_us() - job->submit_us;
+    }
+    if (job->core != 0) {
+        imconfig(IM_CONFIG_SCHEDULER_CORE, IM_SCHEDULER_DEFAULT);
+    }
+    job->handle = 0;
+    job->submitted = 1;
+    if (ret != IM_STATUS_SUCCESS) {
+        printf("rga job: imendJob fail, %s\n", imStrError(ret));
+        job->release_fence = -1;
+        release_buffers(job);
+        return -1;
+    }
+    if (!async) {
+        release_buffers(job);
+    }
+    return 0;
+}
+
+int rga_job_wait(rga_job_t* job)
+{
+    int ret = 0;
+    if (job->release_fence > 0) {
+        // imsync closes the fence
+        if (imsync(job->release_fence) != IM_STATUS_SUCCESS) {
+            printf("rga job: imsync fail\n");
+            ret = -1;
+        }
+        job->release_fence = -1;
+        job->latency_us = get_time_us() - job->submit_us;
+    }
+    release_buffers(job);
+    job->submitted = 0;
+    return ret;
+}
+
+void rga_job_cancel(rga_job_t* job)
+{
+    if (job->handle != 0) {
+        imcancelJob(job->handle);
+        job->handle = 0;
+    }
+    release_buffers(job);
+    job->task_count = 0;
+}
+
+int convert_image_async(image_buffer_t* src_image, image_buffer_t* dst_image, image_rect_t* src_box,
+                        image_rect_t* dst_box, char color, rga_job_t* job)
+{
+    if (rga_job_begin(job) == 0 &&
+        rga_job_add_convert(job, src_image, dst_image, src_box, dst_box, 1, color) == 0 &&
+        rga_job_submit(job, 1) == 0) {
+        return 0;
+    }
+    rga_job_cancel(job);
+
+    // RGA could not take it, convert now; rga_job_wait() is then a no-op
+    memset(job, 0, sizeof(rga_job_t));
+    job->release_fence = -1;
+    return convert_image(src_image, dst_image, src_box, dst_box, color);
+}
@@ -0,0 +1,175 @@
+#ifndef _RKNN_MODEL_ZOO_RGA_JOB_H_
+#define _RKNN_MODEL_ZOO_RGA_JOB_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "common.h"
+#include "image_utils.h"
+#include "rga_sched.h"
+
+#define RGA_JOB_MAX_BUFFERS 16
+#define RGA_JOB_MAX_TASKS 16
+
+// rga_job_add_* flags
+#define RGA_JOB_SWAP_RB 0x1     // treat the source as BGR / BGRA
+
+/**
+ * @brief Several RGA tasks submitted to the driver as one job
+ *
+ * Tasks run in the order they were added. Buffers are imported once per job and
+ * released after completion.
+ */
+typedef struct {
+    uint32_t handle;            // im_job_handle_t, 0: no open job
+    int task_count;
+    int buffer_count;
+    int buffer_handles[RGA_JOB_MAX_BUFFERS];
+    void* buffer_addrs[RGA_JOB_MAX_BUFFERS];
+    int buffer_fds[RGA_JOB_MAX_BUFFERS];
+    int release_fence;          // async job: fence signalled on completion, -1: none
+    int submitted;
+    int core;                   // IM_SCHEDULER_* core, 0: driver decides
+    rga_work_t work[RGA_JOB_MAX_TASKS]; // task descriptions for rga_sched_submit()
+    int64_t submit_us;
+    int64_t latency_us;         // submit to completion, set by rga_job_wait()
+} rga_job_t;
+
+/**
+ * @brief Start collecting tasks
+ *
+ * @param job [out] Job
+ * @return int 0: success; -1: error
+ */
+int rga_job_begin(rga_job_t* job);
+
+/**
+ * @brief Add color conversion, src and dst have the same size
+ *
+ * @param job [in] Job
+ * @param src [in] Source image
+ * @param dst [out] Target image
+ * @return int 0: success; -1: error
+ */
+int rga_job_add_cvtcolor(rga_job_t* job, image_buffer_t* src, image_buffer_t* dst);
+
+/**
+ * @brief Add rotation, dst has the rotated size
+ *
+ * @param job [in] Job
+ * @param src [in] Source image
+ * @param dst [out] Target image
+ * @param rotation [in] 90 / 180 / 270, counterclockwise like cv::ROTATE_90_COUNTERCLOCKWISE
+ * @return int 0: success; -1: error
+ */
+int rga_job_add_rotate(rga_job_t* job, image_buffer_t* src, image_buffer_t* dst, int rotation);
+
+/**
+ * @brief Add color fill of a rectangle
+ *
+ * @param job [in] Job
+ * @param dst [out] Target image
+ * @param rect [in] Rectangle, NULL: whole image
+ * @param color [in] Fill color, written to every byte
+ * @return int 0: success; -1: error
+ */
+int rga_job_add_fill(rga_job_t* job, image_buffer_t* dst, image_rect_t* rect, char color);
+
+/**
+ * @brief Add crop / scale / color conversion, like convert_image
+ *
+ * @param job [in] Job
+ * @param src [in] Source image
+ * @param dst [out] Target image
+ * @param src_box [in] Crop rectangle on source image, NULL: whole image
+ * @param dst_box [in] Rectangle on target image, NULL: whole image
+ * @param fill_pad [in] 1: fill the target with color first if dst_box does not cover it
+ * @param color [in] Padding color
+ * @return int 0: success; -1: error
+ */
+int rga_job_add_convert(rga_job_t* job, image_buffer_t* src, image_buffer_t* dst, image_rect_t* src_box,
+                        image_rect_t* dst_box, int fill_pad, char color);
+
+/**
+ * @brief Add letterbox resize, uses the cached geometry of convert_image_with_letterbox
+ *
+ * @param job [in] Job
+ * @param src [in] Source image
+ * @param dst [out] Target image
+ * @param letterbox [out] Letterbox
+ * @param fill_pad [in] 1: also fill the padding with color, 0: padding already filled
+ * @param color [in] Padding color
+ * @return int 0: success; -1: error
+ */
+int rga_job_add_letterbox(rga_job_t* job, image_buffer_t* src, image_buffer_t* dst, letterbox_t* letterbox,
+                          int fill_pad, char color);
+
+/**
+ * @brief Add scale to the whole target, with optional rotation (display path)
+ *
+ * @param job [in] Job
+ * @param src [in] Source image
+ * @param dst [out] Target image
+ * @param rotation [in] 0 / 90 / 180 / 270, counterclockwise
+ * @param flags [in] RGA_JOB_* flags
+ * @return int 0: success; -1: error
+ */
+int rga_job_add_resize(rga_job_t* job, image_buffer_t* src, image_buffer_t* dst, int rotation, int flags);
+
+/**
+ * @brief Run the job on a specific core
+ *
+ * @param job [in] Job
+ * @param core_id [in] IM_SCHEDULER_* value (see rga_sched_core_id()), 0: driver decides
+ */
+void rga_job_set_core(rga_job_t* job, int core_id);
+
+/**
+ * @brief Submit all tasks as one job
+ *
+ * @param job [in] Job
+ * @param async [in] 0: wait for completion; 1: return at once, call rga_job_wait() later
+ * @return int 0: success; -1: error
+ */
+int rga_job_submit(rga_job_t* job, int async);
+
+/**
+ * @brief Wait for an async job and release its buffers, no-op for a sync job
+ *
+ * @param job [in] Job
+ * @return int 0: success; -1: error
+ */
+int rga_job_wait(rga_job_t* job);
+
+/**
+ * @brief Drop a job that was not submitted and release its buffers
+ *
+ * @param job [in] Job
+ */
+void rga_job_cancel(rga_job_t* job);
+
+/**
+ * @brief Asynchronous convert_image
+ *
+ * Submits the conversion as an async RGA job and returns at once. Call rga_job_wait()
+ * before the target is read. If RGA can not run it, the image is converted on the CPU
+ * before returning and rga_job_wait() does nothing.
+ *
+ * @param src_image [in] Source Image
+ * @param dst_image [out] Target Image
+ * @param src_box [in] Crop rectangle on source image
+ * @param dst_box [in] Crop rectangle on target image
+ * @param color [in] Pading color if dst_box can not fill target image
+ * @param job [out] Job to wait on
+ * @return int 0: success; -1: error
+ */
+int convert_image_async(image_buffer_t* src_image, image_buffer_t* dst_image, image_rect_t* src_box,
+                        image_rect_t* dst_box, char color, rga_job_t* job);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif // _RKNN_MODEL_ZOO_RGA_JOB_H_
@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "im2d_type.h"
+
+#include "rga_sched.h"
+
+/*
+ * Rough RK3588 numbers, RGA3 cores are about twice as fast as RGA2.
+ * Only the ratio between cores matters for routing.
+ */
+static const rga_core_model_t default_model[RGA_CORE_NUM] = {
+    {120, 600},     // RGA3 core0
+    {120, 600},     // RGA3 core1
+    {150, 300},     // RGA2 core0
+};
+
+static const char* core_names[RGA_CORE_NUM] = {"rga3_core0", "rga3_core1", "rga2_core0"};
+
+static int64_t get_time_us()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+void rga_sched_init(rga_scheduler_t* sched, int stub)
+{
+    memset(sched, 0, sizeof(rga_scheduler_t));
+    sched->stub = stub;
+    memcpy(sched->model, default_model, sizeof(default_model));
+    sched->start_us = stub ? 0 : get_time_us();
+}
+
+static int in_range(int v, int min, int max)
+{
+    return v >= min && v <= max;
+}
+
+int rga_sched_core_supports(rga_core_t core, const rga_work_t* work, int n_work)
+{
+    for (int i = 0; i < n_work; i++) {
+        const rga_work_t* w = &work[i];
+        if (core == RGA_CORE_RGA2) {
+            if (w->src_w > 8192 || w->src_h > 8192 || w->dst_w > 4096 || w->dst_h > 4096) {
+                return 0;
+            }
+            continue;
+        }
+        // RGA3
+        if (w->op & RGA_OP_FILL) {
+            return 0;
+        }
+        if (w->src_fmt == IMAGE_FORMAT_GRAY8 || w->dst_fmt == IMAGE_FORMAT_GRAY8) {
+            return 0;
+        }
+        if (!in_range(w->src_w, 68, 8176) || !in_range(w->src_h, 2, 8176) ||
+            !in_range(w->dst_w, 68, 8176) || !in_range(w->dst_h, 2, 8176)) {
+            return 0;
+        }
+        if (w->op & RGA_OP_RESIZE) {
+            // compare against the rotated target
+            int dw = (w->op & RGA_OP_ROTATE) ? w->dst_h : w->dst_w;
+            int dh = (w->op & RGA_OP_ROTATE) ? w->dst_w : w->dst_h;
+            if (dw * 8 < w->src_w || dh * 8 < w->src_h || dw > w->src_w * 8 || dh > w->src_h * 8) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+int64_t rga_sched_estimate_us(const rga_scheduler_t* sched, rga_core_t core, const rga_work_t* work, int n_work)
+{
+    const rga_core_model_t* m = &sched->model[core];
+    int64_t pixels = 0;
+    for (int i = 0; i < n_work; i++) {
+        if (!(work[i].op & RGA_OP_FILL)) {
+            pixels += (int64_t)work[i].src_w * work[i].src_h;
+        }
+        pixels += (int64_t)work[i].dst_w * work[i].dst_h;
+    }
+    return m->overhead_us + pixels / m->mpix_per_s;
+}
+
+int rga_sched_submit(rga_scheduler_t* sched, const rga_work_t* work, int n_work, int64_t* estimate_us)
+{
+    int best = -1;
+    int64_t best_finish = 0;
+    int64_t best_est = 0;
+    for (int c = 0; c < RGA_CORE_NUM; c++) {
+        if (!rga_sched_core_supports((rga_core_t)c, work, n_work)) {
+            continue;
+        }
+        int64_t est = rga_sched_estimate_us(sched, (rga_core_t)c, work, n_work);
+        int64_t queued = sched->pending_us[c];
+        if (sched->stub && sched->stub_free_at_us[c] > sched->stub_now_us) {
+            queued = sched->stub_free_at_us[c] - sched->stub_now_us;
+        }
+        int64_t finish = queued + est;
+        if (best < 0 || finish < best_finish) {
+            best = c;
+            best_finish = finish;
+            best_est = est;
+        }
+    }
+    if (best < 0) {
+        sched->rejected++;
+        return -1;
+    }
+    sched->pending_us[best] += best_est;
+    sched->jobs[best]++;
+    if (estimate_us != NULL) {
+        *estimate_us = best_est;
+    }
+    return best;
+}
+
+void rga_sched_job_done(rga_scheduler_t* sched, int core, int64_t estimate_us, int64_t busy_us)
+{
+    if (core < 0 || core >= RGA_CORE_NUM) {
+        return;
+    }
+    sched->pending_us[core] -= estimate_us;
+    if (sched->pending_us[core] < 0) {
+        sched->pending_us[core] = 0;
+    }
+    sched->busy_us[core] += busy_us > 0 ? busy_us : estimate_us;
+}
+
+int64_t rga_sched_stub_run(rga_scheduler_t* sched, int core, int64_t estimate_us)
+{
+    int64_t start = sched->stub_free_at_us[core] > sched->stub_now_us ? sched->stub_free_at_us[core] : sched->stub_now_us;
+    sched->stub_free_at_us[core] = start + estimate_us;
+    return sched->stub_free_at_us[core];
+}
+
+int rga_sched_core_id(int core)
+{
+    switch (core) {
+    case RGA_CORE_RGA3_0:
+        return IM_SCHEDULER_RGA3_CORE0;
+    case RGA_CORE_RGA3_1:
+        return IM_SCHEDULER_RGA3_CORE1;
+    case RGA_CORE_RGA2:
+        return IM_SCHEDULER_RGA2_CORE0;
+    default:
+        return IM_SCHEDULER_DEFAULT;
+    }
+}
+
+const char* rga_sched_core_name(int core)
+{
+    if (core < 0 || core >= RGA_CORE_NUM) {
+        return "default";
+    }
+    return core_names[core];
+}
+
+void rga_sched_print_stats(const rga_scheduler_t* sched, int64_t elapsed_us)
+{
+    if (elapsed_us <= 0) {
+        elapsed_us = sched->stub ? sched->stub_now_us : get_time_us() - sched->start_us;
+    }
+    for (int c = 0; c < RGA_CORE_NUM; c++) {
+        printf("%s: jobs=%llu busy=%llu us util=%.1f%%\n", core_names[c], (unsigned long long)sched->jobs[c],
+               (unsigned long long)sched->busy_us[c], elapsed_us > 0 ? 100.0 * sched->busy_us[c] / elapsed_us : 0.0);
+    }
+    if (sched->rejected > 0) {
+        printf("rejected jobs=%llu\n", (unsigned long long)sched->rejected);
+    }
+}
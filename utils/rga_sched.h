@@ -0,0 +1,139 @@
+#ifndef _RKNN_MODEL_ZOO_RGA_SCHED_H_
+#define _RKNN_MODEL_ZOO_RGA_SCHED_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "common.h"
+
+/**
+ * @brief RK3588 RGA cores
+ */
+typedef enum {
+    RGA_CORE_RGA3_0 = 0,
+    RGA_CORE_RGA3_1,
+    RGA_CORE_RGA2,
+    RGA_CORE_NUM,
+} rga_core_t;
+
+// rga_work_t.op
+#define RGA_OP_CVTCOLOR 0x1
+#define RGA_OP_RESIZE   0x2
+#define RGA_OP_ROTATE   0x4
+#define RGA_OP_FILL     0x8
+
+/**
+ * @brief One RGA task, as far as routing is concerned
+ */
+typedef struct {
+    int op;                 // RGA_OP_* flags
+    int src_w;
+    int src_h;
+    image_format_t src_fmt;
+    int dst_w;
+    int dst_h;
+    image_format_t dst_fmt;
+} rga_work_t;
+
+/**
+ * @brief Latency model of one core: overhead + pixels / throughput
+ */
+typedef struct {
+    int overhead_us;        // per job, submit + interrupt
+    int mpix_per_s;         // read + write pixels per second, in millions
+} rga_core_model_t;
+
+/**
+ * @brief Core router and per-core counters
+ *
+ * The stub backend replaces the hardware with the latency model on a virtual clock,
+ * so routing can be exercised without a board.
+ */
+typedef struct {
+    int stub;
+    rga_core_model_t model[RGA_CORE_NUM];
+    int64_t pending_us[RGA_CORE_NUM];   // estimated work submitted but not completed
+    uint64_t jobs[RGA_CORE_NUM];
+    uint64_t busy_us[RGA_CORE_NUM];     // measured (hardware) or modelled (stub) busy time
+    uint64_t rejected;                  // jobs no core could run
+    int64_t start_us;
+    int64_t stub_now_us;                // stub: virtual clock
+    int64_t stub_free_at_us[RGA_CORE_NUM];
+} rga_scheduler_t;
+
+/**
+ * @brief Init scheduler with the default RK3588 latency model
+ *
+ * @param sched [out] Scheduler
+ * @param stub [in] 1: model latency instead of using the hardware
+ */
+void rga_sched_init(rga_scheduler_t* sched, int stub);
+
+/**
+ * @brief Check that a core can run all tasks of a job
+ *
+ * RGA3: no color fill, no GRAY8, 68..8176 pixels per side, scale 1/8..8.
+ * RGA2: everything RGA3 does plus fill and GRAY8, source up to 8192, output up to 4096.
+ *
+ * @return int 1: supported; 0: not supported
+ */
+int rga_sched_core_supports(rga_core_t core, const rga_work_t* work, int n_work);
+
+/**
+ * @brief Modelled execution time of a job on a core
+ */
+int64_t rga_sched_estimate_us(const rga_scheduler_t* sched, rga_core_t core, const rga_work_t* work, int n_work);
+
+/**
+ * @brief Pick the capable core that finishes the job first and account it as pending
+ *
+ * Large scale / convert jobs end up on the RGA3 cores because they are faster,
+ * fills and formats RGA3 can not handle go to RGA2.
+ *
+ * @param sched [in] Scheduler
+ * @param work [in] Tasks of the job
+ * @param n_work [in] Task count
+ * @param estimate_us [out] Modelled execution time, pass back to rga_sched_job_done()
+ * @return int rga_core_t, -1 if no core supports the job
+ */
+int rga_sched_submit(rga_scheduler_t* sched, const rga_work_t* work, int n_work, int64_t* estimate_us);
+
+/**
+ * @brief Account a finished job
+ *
+ * @param sched [in] Scheduler
+ * @param core [in] Core returned by rga_sched_submit()
+ * @param estimate_us [in] Estimate returned by rga_sched_submit()
+ * @param busy_us [in] Measured time, <= 0: use the estimate
+ */
+void rga_sched_job_done(rga_scheduler_t* sched, int core, int64_t estimate_us, int64_t busy_us);
+
+/**
+ * @brief Stub backend: run a job on the virtual clock
+ *
+ * @return int64_t virtual completion time in us
+ */
+int64_t rga_sched_stub_run(rga_scheduler_t* sched, int core, int64_t estimate_us);
+
+/**
+ * @brief IM_SCHEDULER_* value of a core, for imconfig(IM_CONFIG_SCHEDULER_CORE)
+ */
+int rga_sched_core_id(int core);
+
+const char* rga_sched_core_name(int core);
+
+/**
+ * @brief Print jobs and utilization per core
+ *
+ * @param sched [in] Scheduler
+ * @param elapsed_us [in] Wall (or virtual) time the utilization refers to, <= 0: since init
+ */
+void rga_sched_print_stats(const rga_scheduler_t* sched, int64_t elapsed_us);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif // _RKNN_MODEL_ZOO_RGA_SCHED_H_
@@ -18,6 +18,11 @@
 
 #include "rknn_api.h"
 #include "common.h"
+#include "image_layout.h"
+#include "batch_sched.h"
+#include "npu_mem.h"
+#include "npu_sched.h"
+#include "yolov5_decoder.h"
 #if defined(RV1106_1103) 
     typedef struct {
         char *dma_buf_virt_addr;
@@ -26,6 +31,7 @@
     }rknn_dma_buf;
 #endif
 
+#define YOLOV5_MAX_SHAPES 16
 
 typedef struct {
     rknn_context rknn_ctx;
@@ -41,15 +47,204 @@ typedef struct {
     int model_width;
     int model_height;
     bool is_quant;
+    bool is_fp16;                       // FP16 outputs fetched without want_float, decoded as half
+    yolov5_decoder_t decoder;
+    rknn_tensor_attr native_input_attr; // RKNN_QUERY_NATIVE_INPUT_ATTR, layout the NPU reads
+    bool input_pass_through;            // input handed over in the native layout, runtime converts nothing
+    image_layout_desc_t input_layout;   // layout rknn_inputs_set receives
+    unsigned char* input_pack_buf;      // packed input, NULL: the letterboxed image is handed over as is
+    int input_pack_size;                // all batch slots
+    int input_slot_size;                // one image
+    bool input_packed;                  // pad rows of input_pack_buf are valid
+    int shape_num;                      // input shapes of a dynamic shape model, 0: static model
+    int shape_w[YOLOV5_MAX_SHAPES];
+    int shape_h[YOLOV5_MAX_SHAPES];
+    int max_width;                      // largest input over all shapes, for buffer allocation
+    int max_height;
+    int batch;                          // images per rknn_run, dims[0] of the input
+    char** labels;                      // per model class names, NULL: the global coco labels
+    int label_num;
 } rknn_app_context_t;
 
 #include "postprocess.h"
 
+typedef enum {
+    YOLOV5_RELOAD_IDLE = 0,
+    YOLOV5_RELOAD_LOADING,              // rknn_init and warmup running in the background
+    YOLOV5_RELOAD_READY,                // new context waiting for poll_yolov5_reload()
+    YOLOV5_RELOAD_FAILED,
+} yolov5_reload_state_t;
+
+/**
+ * @brief Background model swap, see start_yolov5_reload()
+ */
+typedef struct {
+    pthread_t thread;
+    int state;                          // yolov5_reload_state_t, atomic
+    char model_path[256];
+    char anchors_path[256];
+    char labels_path[256];              // empty: keep the labels of the running model
+    int warmup_runs;
+    rknn_app_context_t next;
+    int64_t request_us;
+    int64_t load_us;                    // rknn_init .. decoder ready
+    int64_t warmup_us;
+    int swaps;
+} yolov5_reload_t;
+
+/**
+ * @brief One image of a batch
+ */
+typedef struct {
+    image_buffer_t* img;                // letterboxed RGB888 model input, model_width x model_height
+    letterbox_t letter_box;
+    object_detect_result_list* od_results;
+} yolov5_batch_job_t;
+
+
+/**
+ * @brief Create all following contexts through a memory manager (shared weights / internal memory, SRAM)
+ *
+ * @param mem [in] Manager, NULL: plain rknn_init
+ */
+void set_yolov5_npu_mem(npu_mem_t* mem);
+
+/**
+ * @brief Create all following contexts with RKNN_FLAG_COLLECT_PERF_MASK, for npu_profile_t
+ *
+ * Off by default, per layer timing slows every rknn_run down.
+ */
+void set_yolov5_profiling(int enable);
+
+/**
+ * @brief rknn_set_core_mask for all following contexts, RKNN_NPU_CORE_AUTO (default): runtime decides
+ */
+void set_yolov5_core_mask(int core_mask);
+
+/**
+ * @brief rknn_init priority (NPU_PRIO_*) of all following contexts, NPU_PRIO_HIGH (default)
+ *
+ * The driver serves the jobs of higher priority contexts first when they compete for a core.
+ */
+void set_yolov5_priority(int priority);
 
 int init_yolov5_model(const char* model_path, rknn_app_context_t* app_ctx);
 
+/**
+ * @brief init_yolov5_model() with the anchors of this model instead of ANCHORS_TXT_PATH
+ */
+int init_yolov5_model_with_anchors(const char* model_path, const char* anchors_path, rknn_app_context_t* app_ctx);
+
+/**
+ * @brief Load the class names of this model, released with the model
+ *
+ * @return int labels read; -1: error
+ */
+int load_yolov5_labels(rknn_app_context_t* app_ctx, const char* labels_path);
+
+/**
+ * @brief Class name from the model's own labels, else from the global coco labels
+ */
+const char* yolov5_cls_to_name(rknn_app_context_t* app_ctx, int cls_id);
+
+int init_yolov5_decoder(rknn_app_context_t* app_ctx, const char* anchors_path);
+
 int release_yolov5_model(rknn_app_context_t* app_ctx);
 
+/**
+ * @brief Switch a dynamic shape model to another input size
+ *
+ * Updates model_width / model_height, the input and output attrs (so post_process follows
+ * the new grid sizes) and the input layout. Only sizes listed in shape_w / shape_h work.
+ *
+ * @return int 0: success; -1: error or static model
+ */
+int set_yolov5_input_shape(rknn_app_context_t* app_ctx, int width, int height);
+
+/**
+ * @brief Pick the input shape for a frame at a size level
+ *
+ * Among the shapes whose longer side is the level-th smallest, the one that pads the
+ * frame least after letterboxing.
+ *
+ * @param level [in] Index into the sorted distinct longer sides, clamped
+ * @return int index into shape_w / shape_h, -1: static model
+ */
+int select_yolov5_shape(rknn_app_context_t* app_ctx, int frame_w, int frame_h, int level);
+
+/**
+ * @brief Number of distinct input sizes (longer side) of a dynamic shape model, 1 for static
+ */
+int get_yolov5_shape_levels(rknn_app_context_t* app_ctx);
+
+/**
+ * @brief Hand the letterboxed RGB888 model input to the runtime in its preferred layout
+ *
+ * Packs rows [row_begin, row_end) into the native layout when needed; the first call packs
+ * all rows. Pass the letterbox image box rows when the padding is unchanged between frames.
+ *
+ * @return int 0: success; <0: error
+ */
+int set_yolov5_input(rknn_app_context_t* app_ctx, image_buffer_t* img, int row_begin, int row_end);
+
 int inference_yolov5_model(rknn_app_context_t* app_ctx, image_buffer_t* img, object_detect_result_list* od_results);
 
+/**
+ * @brief Run the model a few times on a zero input so the first real frame is not slow
+ *
+ * @return int average rknn_run time in us; -1: error
+ */
+int warmup_yolov5_model(rknn_app_context_t* app_ctx, int runs);
+
+/**
+ * @brief Load and warm up a model in a background thread
+ *
+ * The running context is not touched; poll_yolov5_reload() swaps the new one in.
+ * No warmup when contexts share internal memory, it would run alongside the live model.
+ *
+ * @param reload [in] Zeroed before the first use
+ * @param anchors_path [in] NULL: ANCHORS_TXT_PATH, as init_yolov5_model()
+ * @param labels_path [in] NULL or empty: keep the labels of the running model
+ * @return int 0: started; -1: a reload is still running or the thread could not start
+ */
+int start_yolov5_reload(yolov5_reload_t* reload, const char* model_path, const char* anchors_path,
+                        const char* labels_path, int warmup_runs);
+
+/**
+ * @brief Swap in a loaded model, call between frames from the thread running inference
+ *
+ * Nothing may be in flight on app_ctx, i.e. its outputs are released. The old context is
+ * destroyed in the background, its labels move over to the new one. A model with a
+ * different input size or batch is refused,
+ * the buffers of the pipeline are sized for the running one.
+ *
+ * @return int 1: swapped; 0: nothing ready; -1: the reload failed, the running model stays
+ */
+int poll_yolov5_reload(yolov5_reload_t* reload, rknn_app_context_t* app_ctx);
+
+/**
+ * @brief Prepare a batch model (input dims[0] > 1) for inference_yolov5_batch()
+ *
+ * @param core_num [in] NPU cores sharing a batch via rknn_set_batch_core_num, <= 1: leave as is.
+ *                      Runtimes without multi-core batch support keep running on one core.
+ * @return int 0: success; -1: not a batch model
+ */
+int init_yolov5_batch(rknn_app_context_t* app_ctx, int core_num);
+
+/**
+ * @brief Run 1..batch images in one rknn_run and post process each
+ *
+ * Image b goes into input slot b; output b is the b-th 1/batch slice of every output
+ * tensor and is handed to post_process with that image's letterbox.
+ *
+ * @return int 0: success; <0: error
+ */
+int inference_yolov5_batch(rknn_app_context_t* app_ctx, yolov5_batch_job_t** jobs, int n);
+
+/**
+ * @brief batch_run_fn backend over inference_yolov5_batch(), arg is the rknn_app_context_t,
+ *        item data a yolov5_batch_job_t
+ */
+int run_yolov5_batch(void* arg, batch_item_t** items, int n);
+
 #endif //_RKNN_DEMO_YOLOV5_H_
\ No newline at end of file
@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "yolov5.h"
+#include "file_utils.h"
+
+typedef struct {
+    rknn_tensor_type elem_type;
+    yolov5_layout_t layout;
+    int num_class;          // 0: any class count
+    int anchors_per_head;   // 0: any anchor count
+    yolov5_decode_fn fn;
+    const char *name;
+} yolov5_decoder_entry_t;
+
+#define DECODER_ENTRY(T, TYPE, NC, NA, L) \
+    { TYPE, L, NC, NA, yolov5_decode_head<T, NC, NA, L>, #T "/" #NC "cls/" #NA "anchor/" #L }
+
+#define DECODER_ENTRIES(T, TYPE, L)              \
+    DECODER_ENTRY(T, TYPE, 80, 3, L),            \
+    DECODER_ENTRY(T, TYPE, 12, 3, L),            \
+    DECODER_ENTRY(T, TYPE, 3, 3, L),             \
+    DECODER_ENTRY(T, TYPE, 0, 3, L),             \
+    DECODER_ENTRY(T, TYPE, 0, 0, L)
+
+#if defined(__ARM_FEATURE_FP16_VECTOR_ARITHMETIC)
+#define YOLOV5_FP16_NAME "fp16_neon"
+#else
+#define YOLOV5_FP16_NAME "fp16"
+#endif
+
+#define FP16_ENTRY(NC, NA) \
+    { RKNN_TENSOR_FLOAT16, YOLOV5_LAYOUT_NCHW, NC, NA, yolov5_decode_head_fp16<NC, NA>, YOLOV5_FP16_NAME "/" #NC "cls/" #NA "anchor" }
+
+// Add a line here to get a specialized decoder for another model
+static const yolov5_decoder_entry_t decoder_registry[] = {
+    DECODER_ENTRIES(int8_t, RKNN_TENSOR_INT8, YOLOV5_LAYOUT_NCHW),
+    DECODER_ENTRIES(int8_t, RKNN_TENSOR_INT8, YOLOV5_LAYOUT_NHWC),
+    DECODER_ENTRIES(uint8_t, RKNN_TENSOR_UINT8, YOLOV5_LAYOUT_NCHW),
+    DECODER_ENTRIES(float, RKNN_TENSOR_FLOAT32, YOLOV5_LAYOUT_NCHW),
+    DECODER_ENTRIES(float, RKNN_TENSOR_FLOAT32, YOLOV5_LAYOUT_NHWC),
+#if defined(YOLOV5_DECODE_FP16)
+    FP16_ENTRY(80, 3),
+    FP16_ENTRY(0, 3),
+    FP16_ENTRY(0, 0),
+    DECODER_ENTRIES(yolov5_half_t, RKNN_TENSOR_FLOAT16, YOLOV5_LAYOUT_NHWC),
+#endif
+};
+
+static const float default_anchors[YOLOV5_HEAD_NUM][6] = {{10, 13, 16, 30, 33, 23},
+                                                          {30, 61, 62, 45, 59, 119},
+                                                          {116, 90, 156, 198, 373, 326}};
+
+yolov5_decode_fn find_yolov5_decoder(rknn_tensor_type elem_type, yolov5_layout_t layout, int num_class,
+                                     int anchors_per_head, const char **name)
+{
+    const int n_entry = sizeof(decoder_registry) / sizeof(decoder_registry[0]);
+    // exact match first, then generic class count, then fully generic
+    const int want_class[3] = {num_class, 0, 0};
+    const int want_anchor[3] = {anchors_per_head, anchors_per_head, 0};
+    for (int pass = 0; pass < 3; pass++) {
+        for (int i = 0; i < n_entry; i++) {
+            const yolov5_decoder_entry_t *e = &decoder_registry[i];
+            if (e->elem_type == elem_type && e->layout == layout &&
+                e->num_class == want_class[pass] && e->anchors_per_head == want_anchor[pass]) {
+                if (name != NULL) {
+                    *name = e->name;
+                }
+                return e->fn;
+            }
+        }
+    }
+    return NULL;
+}
+
+int load_yolov5_anchors(const char *path, float anchors[YOLOV5_HEAD_NUM][YOLOV5_MAX_ANCHORS_PER_HEAD * 2])
+{
+    int line_count = 0;
+    char **lines = read_lines_from_file(path, &line_count);
+    if (lines == NULL) {
+        return -1;
+    }
+
+    float values[YOLOV5_HEAD_NUM * YOLOV5_MAX_ANCHORS_PER_HEAD * 2];
+    int n = 0;
+    for (int i = 0; i < line_count; i++) {
+        if (lines[i] == NULL || lines[i][0] == '\0') {
+            continue;
+        }
+        if (n >= (int)(sizeof(values) / sizeof(values[0]))) {
+            n = -1;
+            break;
+        }
+        values[n++] = atof(lines[i]);
+    }
+    free_lines(lines, line_count);
+
+    if (n <= 0 || n % (YOLOV5_HEAD_NUM * 2) != 0) {
+        printf("invalid anchors file %s, value count=%d\n", path, n);
+        return -1;
+    }
+    int anchors_per_head = n / (YOLOV5_HEAD_NUM * 2);
+    for (int h = 0; h < YOLOV5_HEAD_NUM; h++) {
+        memcpy(anchors[h], values + h * anchors_per_head * 2, anchors_per_head * 2 * sizeof(float));
+    }
+    return anchors_per_head;
+}
+
+int init_yolov5_decoder(rknn_app_context_t *app_ctx, const char *anchors_path)
+{
+    yolov5_decoder_t *dec = &app_ctx->decoder;
+    memset(dec, 0, sizeof(yolov5_decoder_t));
+
+    dec->anchors_per_head = load_yolov5_anchors(anchors_path, dec->anchors);
+    if (dec->anchors_per_head <= 0) {
+        printf("use default anchors\n");
+        dec->anchors_per_head = 3;
+        for (int h = 0; h < YOLOV5_HEAD_NUM; h++) {
+            memcpy(dec->anchors[h], default_anchors[h], sizeof(default_anchors[h]));
+        }
+    }
+
+    if (app_ctx->io_num.n_output < YOLOV5_HEAD_NUM) {
+        printf("yolov5 decoder need %d outputs, model has %d\n", YOLOV5_HEAD_NUM, app_ctx->io_num.n_output);
+        return -1;
+    }
+
+    rknn_tensor_attr *attr = &app_ctx->output_attrs[0];
+    int channel;
+#if defined(RKNPU1)
+    // NCHW reversed: WHCN
+    dec->layout = YOLOV5_LAYOUT_NCHW;
+    channel = attr->dims[2];
+#else
+    if (attr->fmt == RKNN_TENSOR_NHWC) {
+        dec->layout = YOLOV5_LAYOUT_NHWC;
+        channel = attr->dims[3];
+    } else {
+        dec->layout = YOLOV5_LAYOUT_NCHW;
+        channel = attr->dims[1];
+    }
+#endif
+    if (channel % dec->anchors_per_head != 0 || channel / dec->anchors_per_head <= 5) {
+        printf("output channel %d does not match %d anchors per head\n", channel, dec->anchors_per_head);
+        return -1;
+    }
+    dec->num_class = channel / dec->anchors_per_head - 5;
+
+    // FP16 outputs are decoded as they are, other non-quant outputs are fetched with want_float
+    if (app_ctx->is_quant || app_ctx->is_fp16) {
+        dec->elem_type = attr->type;
+    } else {
+        dec->elem_type = RKNN_TENSOR_FLOAT32;
+    }
+    dec->decode = find_yolov5_decoder(dec->elem_type, dec->layout, dec->num_class, dec->anchors_per_head,
+                                      &dec->decode_name);
+    if (dec->decode == NULL) {
+        printf("no yolov5 decoder for type=%s layout=%d\n", get_type_string(dec->elem_type), dec->layout);
+        return -1;
+    }
+    printf("yolov5 decoder: %s (num_class=%d anchors_per_head=%d)\n", dec->decode_name, dec->num_class,
+           dec->anchors_per_head);
+    return 0;
+}
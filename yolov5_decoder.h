@@ -0,0 +1,289 @@
+#ifndef _RKNN_YOLOV5_DEMO_DECODER_H_
+#define _RKNN_YOLOV5_DEMO_DECODER_H_
+
+#include <stdint.h>
+#include <vector>
+#include "rknn_api.h"
+#if defined(__ARM_FEATURE_FP16_VECTOR_ARITHMETIC)
+#include <arm_neon.h>
+#endif
+
+#define YOLOV5_HEAD_NUM 3
+#define YOLOV5_MAX_ANCHORS_PER_HEAD 8
+#define ANCHORS_TXT_PATH "../model/anchors_yolov5.txt"
+
+/**
+ * @brief Memory layout of one detection head output
+ *
+ * NCHW: [anchor * (5 + class)][grid_h][grid_w], rknpu1/rknpu2 default
+ * NHWC: [grid_h][grid_w][anchor * (5 + class)], rv1106 native output
+ */
+typedef enum {
+    YOLOV5_LAYOUT_NCHW,
+    YOLOV5_LAYOUT_NHWC,
+} yolov5_layout_t;
+
+/**
+ * @brief Decode one head into candidate boxes (x, y, w, h in model input pixels)
+ *
+ * num_class / anchors_per_head are only read by the generic instantiation,
+ * specialized ones use their compile-time values.
+ */
+typedef int (*yolov5_decode_fn)(const void *input, const float *anchor, int grid_h, int grid_w, int stride,
+                                int num_class, int anchors_per_head,
+                                std::vector<float> &boxes, std::vector<float> &objProbs, std::vector<int> &classId,
+                                float threshold, int32_t zp, float scale);
+
+/**
+ * @brief Decoder config, filled by init_yolov5_decoder() from output attrs and anchors file
+ */
+typedef struct {
+    int num_class;
+    int anchors_per_head;
+    yolov5_layout_t layout;
+    rknn_tensor_type elem_type;
+    float anchors[YOLOV5_HEAD_NUM][YOLOV5_MAX_ANCHORS_PER_HEAD * 2];
+    yolov5_decode_fn decode;
+    const char *decode_name;
+} yolov5_decoder_t;
+
+/**
+ * @brief Look up the best decoder instantiation
+ *
+ * Tries (type, layout, num_class, anchors_per_head) first, then a generic class count,
+ * then a fully generic decoder. Returns NULL if the element type is not supported.
+ */
+yolov5_decode_fn find_yolov5_decoder(rknn_tensor_type elem_type, yolov5_layout_t layout, int num_class,
+                                     int anchors_per_head, const char **name);
+
+/**
+ * @brief Load anchors from text file (one value per line, YOLOV5_HEAD_NUM * anchors_per_head * 2 values)
+ *
+ * @return anchors per head, or -1 on error
+ */
+int load_yolov5_anchors(const char *path, float anchors[YOLOV5_HEAD_NUM][YOLOV5_MAX_ANCHORS_PER_HEAD * 2]);
+
+/*
+ * FP16 output element. aarch64 has the __fp16 storage type, a compare or dequantize is one fcvt;
+ * other hosts compare the raw half bits with rknpu2::float16, no float conversion of the scan.
+ */
+#if !defined(RKNPU1)
+#if defined(__ARM_FP16_FORMAT_IEEE)
+typedef __fp16 yolov5_half_t;
+#else
+#include "Float16.h"
+typedef rknpu2::float16 yolov5_half_t;
+#endif
+#define YOLOV5_DECODE_FP16 1
+#endif
+
+/* quantization helpers, shared by all decoder instantiations */
+template <typename T>
+struct yolov5_qnt;
+
+template <>
+struct yolov5_qnt<int8_t> {
+    static inline int8_t quantize(float f32, int32_t zp, float scale)
+    {
+        float dst_val = (f32 / scale) + zp;
+        return (int8_t)(dst_val <= -128 ? -128 : (dst_val >= 127 ? 127 : dst_val));
+    }
+    static inline float dequantize(int8_t qnt, int32_t zp, float scale) { return ((float)qnt - (float)zp) * scale; }
+};
+
+template <>
+struct yolov5_qnt<uint8_t> {
+    static inline uint8_t quantize(float f32, int32_t zp, float scale)
+    {
+        float dst_val = (f32 / scale) + zp;
+        return (uint8_t)(dst_val <= 0 ? 0 : (dst_val >= 255 ? 255 : dst_val));
+    }
+    static inline float dequantize(uint8_t qnt, int32_t zp, float scale) { return ((float)qnt - (float)zp) * scale; }
+};
+
+template <>
+struct yolov5_qnt<float> {
+    static inline float quantize(float f32, int32_t, float) { return f32; }
+    static inline float dequantize(float qnt, int32_t, float) { return qnt; }
+};
+
+#if defined(YOLOV5_DECODE_FP16)
+template <>
+struct yolov5_qnt<yolov5_half_t> {
+    static inline yolov5_half_t quantize(float f32, int32_t, float) { return yolov5_half_t(f32); }
+    static inline float dequantize(yolov5_half_t qnt, int32_t, float) { return (float)qnt; }
+};
+#endif
+
+/* argmax over class scores, step is the distance between two classes of one cell */
+template <typename T, int NumClass>
+static inline int yolov5_argmax(const T *cls_ptr, int step, int num_class, T *max_prob)
+{
+    const int n = NumClass > 0 ? NumClass : num_class;
+    T best = cls_ptr[0];
+    int best_id = 0;
+#pragma GCC unroll 16
+    for (int k = 1; k < n; ++k) {
+        T prob = cls_ptr[k * step];
+        if (prob > best) {
+            best_id = k;
+            best = prob;
+        }
+    }
+    *max_prob = best;
+    return best_id;
+}
+
+/**
+ * @brief Decode one cell of one anchor, in_ptr points at its x; 1: box added
+ */
+template <typename T, int NumClass, yolov5_layout_t Layout>
+static inline int yolov5_decode_cell(const T *in_ptr, int step, int num_class, const float *anchor, int i, int j,
+                                     int stride, T thres_q, float threshold, int32_t zp, float scale,
+                                     std::vector<float> &boxes, std::vector<float> &objProbs,
+                                     std::vector<int> &classId)
+{
+    typedef yolov5_qnt<T> qnt;
+    T box_confidence = in_ptr[4 * step];
+    if (box_confidence < thres_q) {
+        return 0;
+    }
+
+    T maxClassProbs;
+    int maxClassId = yolov5_argmax<T, NumClass>(in_ptr + 5 * step, step, num_class, &maxClassProbs);
+
+    float score;
+    if (Layout == YOLOV5_LAYOUT_NCHW) {
+        if (!(maxClassProbs > thres_q)) {
+            return 0;
+        }
+        score = qnt::dequantize(maxClassProbs, zp, scale) * qnt::dequantize(box_confidence, zp, scale);
+    } else {
+        // rv1106 layout keeps the original combined-score filter
+        score = qnt::dequantize(maxClassProbs, zp, scale) * qnt::dequantize(box_confidence, zp, scale);
+        if (!(score > threshold)) {
+            return 0;
+        }
+    }
+
+    float box_x = qnt::dequantize(in_ptr[0], zp, scale) * 2.0f - 0.5f;
+    float box_y = qnt::dequantize(in_ptr[step], zp, scale) * 2.0f - 0.5f;
+    float box_w = qnt::dequantize(in_ptr[2 * step], zp, scale) * 2.0f;
+    float box_h = qnt::dequantize(in_ptr[3 * step], zp, scale) * 2.0f;
+    box_x = (box_x + j) * (float)stride;
+    box_y = (box_y + i) * (float)stride;
+    box_w = box_w * box_w * anchor[0];
+    box_h = box_h * box_h * anchor[1];
+    box_x -= (box_w / 2.0f);
+    box_y -= (box_h / 2.0f);
+
+    boxes.push_back(box_x);
+    boxes.push_back(box_y);
+    boxes.push_back(box_w);
+    boxes.push_back(box_h);
+    objProbs.push_back(score);
+    classId.push_back(maxClassId);
+    return 1;
+}
+
+/**
+ * @brief Decoder template
+ *
+ * T: int8_t / uint8_t / float / yolov5_half_t output element
+ * NumClass, AnchorsPerHead: compile-time sizes, 0 means read from the runtime arguments
+ */
+template <typename T, int NumClass, int AnchorsPerHead, yolov5_layout_t Layout>
+int yolov5_decode_head(const void *input_, const float *anchor, int grid_h, int grid_w, int stride,
+                       int num_class_rt, int anchors_per_head_rt,
+                       std::vector<float> &boxes, std::vector<float> &objProbs, std::vector<int> &classId,
+                       float threshold, int32_t zp, float scale)
+{
+    typedef yolov5_qnt<T> qnt;
+    const T *input = (const T *)input_;
+    const int num_class = NumClass > 0 ? NumClass : num_class_rt;
+    const int num_anchor = AnchorsPerHead > 0 ? AnchorsPerHead : anchors_per_head_rt;
+    const int prop_box_size = 5 + num_class;
+    const int grid_len = grid_h * grid_w;
+    // distance between two properties of the same cell
+    const int step = (Layout == YOLOV5_LAYOUT_NCHW) ? grid_len : 1;
+    const T thres_q = qnt::quantize(threshold, zp, scale);
+    int validCount = 0;
+
+    for (int a = 0; a < num_anchor; a++) {
+        for (int i = 0; i < grid_h; i++) {
+            for (int j = 0; j < grid_w; j++) {
+                const T *in_ptr;
+                if (Layout == YOLOV5_LAYOUT_NCHW) {
+                    in_ptr = input + (prop_box_size * a) * grid_len + i * grid_w + j;
+                } else {
+                    in_ptr = input + (i * grid_w + j) * prop_box_size * num_anchor + a * prop_box_size;
+                }
+                validCount += yolov5_decode_cell<T, NumClass, Layout>(in_ptr, step, num_class, anchor + a * 2, i, j,
+                                                                      stride, thres_q, threshold, zp, scale, boxes,
+                                                                      objProbs, classId);
+            }
+        }
+    }
+    return validCount;
+}
+
+#if defined(YOLOV5_DECODE_FP16)
+/**
+ * @brief FP16 NCHW decoder
+ *
+ * With ARMv8.2 FP16 NEON the objectness plane of each anchor is compared 8 cells per
+ * instruction and only cells above the threshold are decoded; without it this is the
+ * yolov5_half_t template.
+ */
+template <int NumClass, int AnchorsPerHead>
+int yolov5_decode_head_fp16(const void *input_, const float *anchor, int grid_h, int grid_w, int stride,
+                            int num_class_rt, int anchors_per_head_rt,
+                            std::vector<float> &boxes, std::vector<float> &objProbs, std::vector<int> &classId,
+                            float threshold, int32_t zp, float scale)
+{
+#if defined(__ARM_FEATURE_FP16_VECTOR_ARITHMETIC)
+    const float16_t *input = (const float16_t *)input_;
+    const int num_class = NumClass > 0 ? NumClass : num_class_rt;
+    const int num_anchor = AnchorsPerHead > 0 ? AnchorsPerHead : anchors_per_head_rt;
+    const int prop_box_size = 5 + num_class;
+    const int grid_len = grid_h * grid_w;
+    const float16_t thres_h = (float16_t)threshold;
+    const float16x8_t thres_v = vdupq_n_f16(thres_h);
+    int validCount = 0;
+
+    for (int a = 0; a < num_anchor; a++) {
+        const float16_t *plane = input + (prop_box_size * a) * grid_len;
+        const float16_t *conf = plane + 4 * grid_len;
+        int c = 0;
+        for (; c + 8 <= grid_len; c += 8) {
+            uint16x8_t hit = vcgeq_f16(vld1q_f16(conf + c), thres_v);
+            if (vmaxvq_u16(hit) == 0) {
+                continue;
+            }
+            uint16_t lanes[8];
+            vst1q_u16(lanes, hit);
+            for (int k = 0; k < 8; k++) {
+                if (lanes[k]) {
+                    int cell = c + k;
+                    validCount += yolov5_decode_cell<float16_t, NumClass, YOLOV5_LAYOUT_NCHW>(
+                        plane + cell, grid_len, num_class, anchor + a * 2, cell / grid_w, cell % grid_w, stride,
+                        thres_h, threshold, zp, scale, boxes, objProbs, classId);
+                }
+            }
+        }
+        for (; c < grid_len; c++) {
+            validCount += yolov5_decode_cell<float16_t, NumClass, YOLOV5_LAYOUT_NCHW>(
+                plane + c, grid_len, num_class, anchor + a * 2, c / grid_w, c % grid_w, stride, thres_h, threshold,
+                zp, scale, boxes, objProbs, classId);
+        }
+    }
+    return validCount;
+#else
+    return yolov5_decode_head<yolov5_half_t, NumClass, AnchorsPerHead, YOLOV5_LAYOUT_NCHW>(
+        input_, anchor, grid_h, grid_w, stride, num_class_rt, anchors_per_head_rt, boxes, objProbs, classId,
+        threshold, zp, scale);
+#endif
+}
+#endif
+
+#endif //_RKNN_YOLOV5_DEMO_DECODER_H_